@@ -338,18 +338,28 @@ void stopBell() {
 // ==========================================
 // NVS Storage (Offline Support)
 // ==========================================
+// The schedule is stored as one packed blob ("slots": minutes since midnight
+// per active slot) so a save is a single NVS write instead of two per slot.
+// An empty schedule is stored as no "slots" key, which loads as zero slots.
 void loadScheduleFromNVS() {
   preferences.begin("sched", true); // Read-only
-  int count = preferences.getInt("count", 0);
+  uint16_t slots[NUM_SLOTS];
+  size_t count = preferences.getBytes("slots", slots, sizeof(slots)) / sizeof(uint16_t);
   
-  for (int i = 0; i < count; i++) {
-    if (i >= NUM_SLOTS) break;
-    char keyH[8], keyM[8];
-    sprintf(keyH, "h%d", i);
-    sprintf(keyM, "m%d", i);
-    
-    schedule[i].hour = preferences.getInt(keyH, 0);
-    schedule[i].minute = preferences.getInt(keyM, 0);
+  if (count == 0 && preferences.isKey("count")) {
+    // Older firmware: one key per hour and minute
+    count = (size_t)constrain(preferences.getInt("count", 0), 0, NUM_SLOTS);
+    for (size_t i = 0; i < count; i++) {
+      char keyH[8], keyM[8];
+      sprintf(keyH, "h%d", (int)i);
+      sprintf(keyM, "m%d", (int)i);
+      slots[i] = preferences.getInt(keyH, 0) * 60 + preferences.getInt(keyM, 0);
+    }
+  }
+  
+  for (size_t i = 0; i < count; i++) {
+    schedule[i].hour = slots[i] / 60;
+    schedule[i].minute = slots[i] % 60;
     schedule[i].active = true;
   }
   preferences.end();
@@ -357,21 +367,21 @@ void loadScheduleFromNVS() {
 }
 
 void saveScheduleToNVS() {
-  preferences.begin("sched", false); // Read-write
-  
-  int activeCount = 0;
+  uint16_t slots[NUM_SLOTS];
+  size_t activeCount = 0;
   for (int i = 0; i < NUM_SLOTS; i++) {
     if (schedule[i].active) {
-      char keyH[8], keyM[8];
-      sprintf(keyH, "h%d", activeCount);
-      sprintf(keyM, "m%d", activeCount);
-      
-      preferences.putInt(keyH, schedule[i].hour);
-      preferences.putInt(keyM, schedule[i].minute);
-      activeCount++;
+      slots[activeCount++] = schedule[i].hour * 60 + schedule[i].minute;
     }
   }
-  preferences.putInt("count", activeCount);
+  
+  preferences.begin("sched", false); // Read-write
+  if (preferences.isKey("count")) preferences.clear(); // Drop the old per-slot keys once
+  if (activeCount > 0) {
+    preferences.putBytes("slots", slots, activeCount * sizeof(uint16_t));
+  } else {
+    preferences.remove("slots"); // putBytes() ignores zero-length writes
+  }
   preferences.end();
   Serial.println("Schedule saved to NVS.");
 }
@@ -0,0 +1,253 @@
+#ifndef AUDIO_TEST_H
+#define AUDIO_TEST_H
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "hal/NativeHal.h"
+#include "BellScheduler.h"
+#include "AudioCache.h"
+#include "StallTest.h" // STALL_BUZZER_PIN
+
+// ==========================================
+// AUDIO CACHE TEST
+// ==========================================
+//
+// Two simulated weeks of a school timetable with per-bell sounds, served by
+// FakeHttpClient into an AudioCache on a host directory (/tmp/autobell-audio).
+// The network side steps the cache every AUDIO_TEST_STEP_S and republishes
+// the schedule when a file is added, as main.cpp does.
+//
+//   Mon-Fri  08:00 a.mp3, 10:00 b.mp3, 12:00 c.mp3, 14:00 d.mp3 (same bytes
+//            as a.mp3), 4 s each
+//   Sat      09:00 e.mp3, 10 s
+//
+// The budget holds three sounds, so the Saturday sound only fits once the
+// week's bells have rung, by evicting one that rings again after it.
+//
+//   online   network up from the start
+//   outage   every request fails for the first three days
+//
+// Checks:
+//   - every bell rang on its minute, for its own duration;
+//   - with the sound cached, a bell played it (matched by content);
+//   - online: every bell played its own sound; a.mp3 and d.mp3 share a
+//     track; the Saturday sound caused an eviction; never over budget;
+//   - outage: bells in the outage played the default sound, the rest their
+//     own; the failing downloads backed off;
+//   - no HTTP request was made inside BellScheduler::poll();
+//   - idleMs() never called a step idle that had work; past the first step
+//     of a minute (the recheck of what did not fit) it called due no more
+//     steps with nothing to do than there were bells (saves after a touch()).
+//
+// Returns 0 if all passed.
+
+static const char* AUDIO_TEST_DIR = "/tmp/autobell-audio";
+static const uint32_t AUDIO_TEST_SOUND = 40 * 1024;
+static const uint32_t AUDIO_TEST_BUDGET = 3 * AUDIO_TEST_SOUND;
+static const uint32_t AUDIO_TEST_STEP_S = 10;
+static const uint32_t AUDIO_TEST_DEFAULT_MS = 5000;
+static const uint32_t AUDIO_TEST_OUTAGE_MIN = 3 * MINUTES_PER_DAY;
+
+static std::string audioTestSound(uint32_t seed) {
+    std::string s(AUDIO_TEST_SOUND, '\0');
+    uint32_t x = seed;
+    for (char& c : s) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        c = (char)x;
+    }
+    return s;
+}
+
+static std::string audioTestSha(const std::string& data) {
+    uint8_t digest[SHA256_SIZE];
+    char hex[SHA256_HEX_LEN + 1];
+    Sha256 sha;
+    sha.update((const uint8_t*)data.data(), data.size());
+    sha.finish(digest);
+    sha256Hex(digest, hex);
+    return hex;
+}
+
+struct AudioRun {
+    uint32_t bells = 0;
+    uint32_t onTime = 0;
+    uint32_t rightDuration = 0;
+    uint32_t own = 0;        // Played the entry's sound
+    uint32_t defaults = 0;   // Played the default track
+    uint32_t wrong = 0;      // Played some other sound
+    uint32_t outageDefaults = 0;
+    uint32_t outageBells = 0;
+    uint32_t requests = 0;
+    uint32_t outageRequests = 0;
+    uint32_t pollRequests = 0; // Made while the scheduler polled: must stay 0
+    uint32_t busyWakes = 0;    // Steps idleMs() called due that had nothing to do, past a minute's first
+    uint32_t lateWakes = 0;    // Steps idleMs() called idle that made a request: must stay 0
+    uint32_t maxUsed = 0;
+    uint32_t evictions = 0;
+    uint32_t downloads = 0;
+    bool shared = false;     // a.mp3 and d.mp3 on one track
+};
+
+static AudioRun runAudio(bool outage) {
+    mkdir(AUDIO_TEST_DIR, 0755);
+    mkdir((std::string(AUDIO_TEST_DIR) + "/mp3").c_str(), 0755);
+    hal::HostFileSystem card(AUDIO_TEST_DIR);
+    card.remove(AUDIO_MANIFEST);
+    card.remove(AUDIO_MANIFEST_TMP);
+    for (uint16_t t = 1; t <= 16; t++) {
+        char name[16];
+        snprintf(name, sizeof(name), "/mp3/%04u.mp3", t);
+        card.remove(name);
+    }
+
+    const char* paths[] = {"school/a.mp3", "school/b.mp3", "school/c.mp3", "school/d.mp3", "school/e.mp3"};
+    std::string bodies[] = {audioTestSound(1), audioTestSound(2), audioTestSound(3), audioTestSound(1),
+                            audioTestSound(5)};
+    hal::FakeHttpClient http;
+    for (int i = 0; i < 5; i++) http.route(paths[i], outage ? 503 : 200, outage ? "" : bodies[i]);
+
+    ScheduleIndexBuilder builder;
+    for (int i = 0; i < 4; i++) builder.add(8 + 2 * i, 0, 0x3E, 4, paths[i]);
+    builder.add(9, 0, 0x40, 10, paths[4]);
+    ScheduleIndex* index = new ScheduleIndex();
+    builder.build(*index);
+
+    hal::SimClock clock;
+    hal::FakeGpio gpio;
+    hal::FakeDFPlayer player;
+    BellScheduler sched(clock, gpio, player, STALL_BUZZER_PIN, AUDIO_TEST_DEFAULT_MS);
+    AudioCache cache(http, card, "http://files", "/", AUDIO_TEST_BUDGET);
+    cache.begin();
+
+    ScheduleIndex* published = index;
+    cache.resolve(*index);
+    cache.plan(*index);
+    sched.publish(index);
+
+    AudioRun r;
+    std::vector<uint32_t> rang, expected; // Buzzer times measured, and the entries' durations
+    uint32_t ringStartMs = 0;
+    uint32_t fires = 0;
+    uint16_t playedFile = 0; // FakeDFPlayer::lastFile when the bell started
+    for (uint32_t minute = 0; minute < 2 * MINUTES_PER_WEEK; minute++) {
+        uint16_t mow = (uint16_t)(minute % MINUTES_PER_WEEK);
+        if (outage && minute == AUDIO_TEST_OUTAGE_MIN) {
+            for (int i = 0; i < 5; i++) http.route(paths[i], 200, bodies[i]);
+        }
+        for (uint32_t s = 0; s < 60; s += AUDIO_TEST_STEP_S) {
+            // Scheduler, polled every 100 ms
+            for (uint32_t p = 0; p < AUDIO_TEST_STEP_S * 10; p++) {
+                uint32_t before = http.stats().requests;
+                sched.poll(mow);
+                r.pollRequests += http.stats().requests - before;
+                uint32_t now = clock.millis();
+                if (sched.stats().fires.load() != fires) {
+                    fires = sched.stats().fires.load();
+                    playedFile = player.lastFile;
+                    if (now == minute * 60000) r.onTime++;
+                }
+                if (gpio.tones[STALL_BUZZER_PIN] && !ringStartMs) ringStartMs = now;
+                if (!gpio.tones[STALL_BUZZER_PIN] && ringStartMs) {
+                    rang.push_back(now - ringStartMs);
+                    ringStartMs = 0;
+                }
+                clock.delay(100);
+            }
+
+            // Network
+            BellEvent e;
+            while (sched.events().pop(e)) {
+                if (e.type != EVENT_SCHEDULED) continue;
+                r.bells++;
+                expected.push_back(published->entry(e.entry).duration * 1000);
+                bool inOutage = outage && minute < AUDIO_TEST_OUTAGE_MIN;
+                if (inOutage) r.outageBells++;
+                if (e.track == 0) {
+                    r.defaults++;
+                    if (inOutage) r.outageDefaults++;
+                } else {
+                    std::string want = audioTestSha(bodies[e.entry]);
+                    bool match = false;
+                    for (size_t i = 0; cache.asset(i); i++) {
+                        if (cache.asset(i)->track == e.track) match = want == cache.asset(i)->sha256;
+                    }
+                    if (match && playedFile == e.track) r.own++;
+                    else r.wrong++;
+                }
+                cache.touch(e.track);
+            }
+            ScheduleIndex* old;
+            while (sched.retired().pop(old)) delete old;
+
+            uint32_t before = http.stats().requests;
+            uint32_t idle = cache.idleMs(mow, clock.millis(), 60000 - clock.millis() % 60000);
+            AudioStep step = cache.pending() ? cache.step(mow, clock.millis()) : AUDIO_IDLE;
+            if (step == AUDIO_ADDED) {
+                ScheduleIndex* next = new ScheduleIndex(*published);
+                cache.resolve(*next);
+                cache.plan(*next);
+                if (sched.publish(next)) {
+                    published = next;
+                } else {
+                    delete next;
+                }
+            }
+            uint32_t made = http.stats().requests - before;
+            if (idle == 0 && made == 0 && step == AUDIO_IDLE && s > 0) r.busyWakes++; // s == 0: the minute's recheck
+            if (idle > 0 && made > 0) r.lateWakes++;
+            r.requests += made;
+            if (outage && minute < AUDIO_TEST_OUTAGE_MIN) r.outageRequests += made;
+            if (cache.usedBytes() > r.maxUsed) r.maxUsed = cache.usedBytes();
+        }
+    }
+    for (size_t i = 0; i < rang.size() && i < expected.size(); i++) {
+        if (rang[i] >= expected[i] && rang[i] <= expected[i] + 100) r.rightDuration++;
+    }
+    r.evictions = cache.evictions();
+    r.downloads = cache.downloads();
+    r.shared = cache.track(paths[0]) && cache.track(paths[0]) == cache.track(paths[3]);
+
+    sched.poll(BellScheduler::NO_MINUTE);
+    ScheduleIndex* old;
+    while (sched.retired().pop(old)) delete old;
+    return r;
+}
+
+static void printAudio(const char* name, const AudioRun& r) {
+    printf("audio/%-7s %u bells, %u on time, %u right duration; own sound %u, default %u, wrong %u; "
+           "%u requests, %u downloads, %u evictions, max %u KB cached; %u busy and %u late wakes\n",
+           name, r.bells, r.onTime, r.rightDuration, r.own, r.defaults, r.wrong, r.requests, r.downloads,
+           r.evictions, r.maxUsed / 1024, r.busyWakes, r.lateWakes);
+}
+
+static int runAudioTest() {
+    printf("Sounds %u KB, budget %u KB, cache stepped every %u s\n", AUDIO_TEST_SOUND / 1024,
+           AUDIO_TEST_BUDGET / 1024, AUDIO_TEST_STEP_S);
+    const uint32_t bells = 2 * (5 * 4 + 1);
+
+    AudioRun a = runAudio(false);
+    printAudio("online", a);
+    bool okOnline = a.bells == bells && a.onTime == bells && a.rightDuration == bells && a.own == bells &&
+                    a.shared && a.evictions > 0 && a.maxUsed <= AUDIO_TEST_BUDGET && a.pollRequests == 0 &&
+                    a.busyWakes <= a.bells && a.lateWakes == 0;
+
+    AudioRun b = runAudio(true);
+    printAudio("outage", b);
+    printf("             %u of %u bells in the outage played the default sound, %u requests during it\n",
+           b.outageDefaults, b.outageBells, b.outageRequests);
+    bool okOutage = b.bells == bells && b.onTime == bells && b.rightDuration == bells && b.wrong == 0 &&
+                    b.outageDefaults == b.outageBells && b.own == bells - b.outageBells &&
+                    b.outageRequests < 200 && b.maxUsed <= AUDIO_TEST_BUDGET && b.pollRequests == 0 &&
+                    b.busyWakes <= b.bells && b.lateWakes == 0;
+
+    bool ok = okOnline && okOutage;
+    printf("%s: online %s, outage %s\n", ok ? "PASS" : "FAIL", okOnline ? "ok" : "FAILED", okOutage ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+#endif
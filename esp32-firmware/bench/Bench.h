@@ -0,0 +1,62 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "hal/NativeHal.h"
+
+// ==========================================
+// MICRO-BENCHMARK HARNESS (env:native)
+// ==========================================
+
+// Heap allocations since start, counted by the allocator hooks in main.cpp
+struct AllocStats {
+    uint64_t count;
+    uint64_t bytes;
+};
+AllocStats allocStats();
+
+struct BenchResult {
+    std::string name;
+    double nsPerOp;
+    double bytesPerOp;
+    double allocsPerOp;
+};
+
+// Keeps the optimizer from discarding a computed value
+inline void doNotOptimize(uint64_t v) {
+    static volatile uint64_t sink;
+    sink = sink + v;
+}
+
+// Runs `fn` in growing batches until `minMillis` have elapsed and reports
+// the per-call cost. `fn` is called once untimed first to warm caches.
+template <typename F>
+BenchResult runBench(const std::string& name, F&& fn, uint32_t minMillis) {
+    static hal::StdClock clock;
+    fn();
+
+    uint64_t iterations = 0;
+    uint64_t batch = 1;
+    uint64_t elapsedUs = 0;
+    AllocStats before = allocStats();
+    while (elapsedUs < (uint64_t)minMillis * 1000) {
+        uint64_t start = clock.micros();
+        for (uint64_t i = 0; i < batch; i++) fn();
+        elapsedUs += clock.micros() - start;
+        iterations += batch;
+        if (batch < (1u << 20)) batch *= 2;
+    }
+    AllocStats after = allocStats();
+
+    BenchResult r;
+    r.name = name;
+    r.nsPerOp = elapsedUs * 1000.0 / iterations;
+    r.bytesPerOp = (double)(after.bytes - before.bytes) / iterations;
+    r.allocsPerOp = (double)(after.count - before.count) / iterations;
+    return r;
+}
+
+#endif
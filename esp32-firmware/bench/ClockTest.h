@@ -0,0 +1,135 @@
+#ifndef CLOCK_TEST_H
+#define CLOCK_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ClockService.h"
+
+// ==========================================
+// CLOCK DISCIPLINE TEST
+// ==========================================
+//
+// Replays days of skewed clock input into ClockService on a simulated
+// monotonic clock (no sleeping). Each scenario has an oscillator skew,
+// a sample source, and reference jumps (e.g. NTP rewriting the RTC).
+// Every CLOCK_POLL_US, as often as the scheduler polls, it checks:
+//
+//   - local time never goes backwards;
+//   - the minute only ever advances by one (none skipped, none repeated)
+//     after the initial set;
+//   - at the end, the error against the reference and the drift estimate
+//     are within the scenario's bounds.
+//
+// Returns 0 if all scenarios pass.
+
+static const uint64_t CLOCK_POLL_US = 10 * 1000;
+static const int64_t CLOCK_START_US = 1792240440LL * 1000000; // 2026-10-17 12:34 local
+
+struct ClockJump {
+    uint64_t atUs; // Monotonic time the reference moves
+    int64_t byUs;
+};
+
+struct ClockScenario {
+    const char* name;
+    int64_t skewPpb;          // Reference runs this much faster than the oscillator
+    uint64_t sampleEveryUs;
+    bool truncateSeconds;     // Source reports whole seconds (NTPClient, unaligned RTC read)
+    uint32_t uncertaintyUs;
+    int64_t jitterUs;         // Random error added to each sample
+    uint64_t durationUs;
+    ClockJump jumps[2];
+    int64_t maxErrorUs;       // Bound at the end
+    int64_t maxDriftErrorPpb;
+};
+
+struct ClockResult {
+    bool monotonic = true;
+    uint32_t minutes = 0;
+    uint32_t skipped = 0;
+    uint32_t repeated = 0;
+    int64_t finalErrorUs = 0;
+    int64_t maxErrorUs = 0; // After the first hour
+    int32_t driftPpb = 0;
+    uint32_t slews = 0;
+    uint32_t steps = 0;
+};
+
+static int64_t clockReference(const ClockScenario& sc, uint64_t mono) {
+    int64_t ref = CLOCK_START_US + (int64_t)mono + (int64_t)mono / 1000 * sc.skewPpb / 1000000;
+    for (const ClockJump& j : sc.jumps) {
+        if (j.atUs && mono >= j.atUs) ref += j.byUs;
+    }
+    return ref;
+}
+
+static ClockResult runClockScenario(const ClockScenario& sc) {
+    ClockService clock;
+    ClockResult r;
+    srand(12345);
+    int64_t prev = 0;
+    int64_t prevMinute = -1;
+    uint64_t nextSample = 0;
+    for (uint64_t mono = 0; mono <= sc.durationUs; mono += CLOCK_POLL_US) {
+        if (mono >= nextSample) {
+            nextSample += sc.sampleEveryUs;
+            int64_t reading = clockReference(sc, mono) + (rand() % (2 * sc.jitterUs + 1)) - sc.jitterUs;
+            if (sc.truncateSeconds) reading = reading / 1000000 * 1000000 + 500000; // Centre of the second
+            ClockSample s = {reading, mono, sc.uncertaintyUs};
+            clock.discipline(s, mono);
+        }
+
+        int64_t now = clock.nowUs(mono);
+        if (now < prev) r.monotonic = false;
+        prev = now;
+
+        int64_t minute = now / 60000000;
+        if (prevMinute >= 0 && minute != prevMinute) {
+            r.minutes++;
+            if (minute > prevMinute + 1) r.skipped += (uint32_t)(minute - prevMinute - 1);
+            if (minute < prevMinute) r.repeated++;
+        }
+        prevMinute = minute;
+
+        int64_t err = llabs(now - clockReference(sc, mono));
+        if (mono >= 3600ULL * 1000000 && err > r.maxErrorUs) r.maxErrorUs = err;
+        r.finalErrorUs = err;
+    }
+    r.driftPpb = clock.driftPpb();
+    r.slews = clock.slews();
+    r.steps = clock.steps();
+    return r;
+}
+
+static int runClockTest() {
+    const uint64_t H = 3600ULL * 1000000;
+    // Skew is of the reference against the oscillator, so the expected
+    // drift estimate equals it
+    static const ClockScenario scenarios[] = {
+        // DS3231 read right after each SQW edge, every 10 min; NTP rewrites
+        // the RTC 1.8 s forward after 6 h and 0.7 s back after 30 h
+        {"rtc-edge", 150000, H / 6, false, 1000, 300, 48 * H, {{6 * H, 1800000}, {30 * H, -700000}},
+         10 * 1000, 5000},
+        // No RTC: NTPClient whole seconds every hour, 30 ms network jitter;
+        // the first server was 40 s off, and 25 s back at 60 h
+        {"ntp-only", -90000, H, true, 500000, 30000, 7 * 24 * H, {{12 * H, 40000000}, {60 * H, -25000000}},
+         1000 * 1000, 10000},
+    };
+
+    bool ok = true;
+    for (const ClockScenario& sc : scenarios) {
+        ClockResult r = runClockScenario(sc);
+        int64_t driftErr = llabs((int64_t)r.driftPpb - sc.skewPpb);
+        bool pass = r.monotonic && r.skipped == 0 && r.repeated == 0 && r.finalErrorUs <= sc.maxErrorUs &&
+                    driftErr <= sc.maxDriftErrorPpb;
+        printf("clock/%-9s %s: %u minutes, %u skipped, %u repeated, %s, error final %.1f ms / max %.1f ms, "
+               "drift %.1f ppm (true %.1f), %u slews, %u steps\n",
+               sc.name, pass ? "PASS" : "FAIL", r.minutes, r.skipped, r.repeated,
+               r.monotonic ? "monotonic" : "WENT BACKWARDS", r.finalErrorUs / 1000.0, r.maxErrorUs / 1000.0,
+               r.driftPpb / 1000.0, sc.skewPpb / 1000.0, r.slews, r.steps);
+        ok = ok && pass;
+    }
+    return ok ? 0 : 1;
+}
+
+#endif
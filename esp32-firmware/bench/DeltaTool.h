@@ -0,0 +1,299 @@
+#ifndef DELTA_TOOL_H
+#define DELTA_TOOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "DeltaPatch.h"
+#include "Sha256.h"
+
+// ==========================================
+// DELTA PATCH TOOL
+// ==========================================
+//
+//   program --delta-make <old.bin> <new.bin> <out.patch>
+//
+// Writes a DeltaPatch.h patch that turns old.bin (the firmware running on
+// the devices) into new.bin. Matching is bsdiff's: a suffix array over the
+// old image finds the longest exact matches, which are then extended in both
+// directions while at least half the bytes agree. The result is applied again
+// with the firmware's own DeltaDecoder, fed in odd-sized pieces with its
+// state saved and restored along the way (as after a reboot), and must
+// reproduce new.bin exactly before the patch is written.
+//
+// Returns 0 on success, 1 if the round trip failed, 2 on file errors.
+
+typedef std::vector<uint8_t> Bytes;
+
+static bool readFileBytes(const char* path, Bytes& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t chunk[64 * 1024];
+    size_t n;
+    out.clear();
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) out.insert(out.end(), chunk, chunk + n);
+    fclose(f);
+    return true;
+}
+
+static bool writeFileBytes(const char* path, const Bytes& data) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+// --- Encoding ---
+
+static void putU32(Bytes& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static void putVarint(Bytes& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static void putSvarint(Bytes& out, int32_t v) {
+    putVarint(out, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+// Suffix array by prefix doubling
+static std::vector<int32_t> suffixArray(const Bytes& s) {
+    int32_t n = (int32_t)s.size();
+    std::vector<int32_t> sa(n), rank(n), tmp(n);
+    if (n == 0) return sa;
+    for (int32_t i = 0; i < n; i++) {
+        sa[i] = i;
+        rank[i] = s[i];
+    }
+    for (int32_t k = 1;; k *= 2) {
+        auto key = [&](int32_t i) { return std::make_pair(rank[i], i + k < n ? rank[i + k] : -1); };
+        std::sort(sa.begin(), sa.end(), [&](int32_t a, int32_t b) { return key(a) < key(b); });
+        tmp[sa[0]] = 0;
+        for (int32_t i = 1; i < n; i++) tmp[sa[i]] = tmp[sa[i - 1]] + (key(sa[i - 1]) < key(sa[i]) ? 1 : 0);
+        rank.swap(tmp);
+        if (rank[sa[n - 1]] == n - 1) break;
+    }
+    return sa;
+}
+
+static int64_t matchLength(const uint8_t* a, int64_t an, const uint8_t* b, int64_t bn) {
+    int64_t i = 0;
+    while (i < an && i < bn && a[i] == b[i]) i++;
+    return i;
+}
+
+// Longest match of b in old, by binary search over the suffix array
+static int64_t longestMatch(const std::vector<int32_t>& sa, const Bytes& old, const uint8_t* b, int64_t bn,
+                            int64_t& pos) {
+    int64_t lo = 0, hi = (int64_t)sa.size() - 1;
+    while (hi - lo >= 2) {
+        int64_t mid = lo + (hi - lo) / 2;
+        int64_t an = (int64_t)old.size() - sa[mid];
+        if (memcmp(old.data() + sa[mid], b, (size_t)std::min(an, bn)) < 0) lo = mid;
+        else hi = mid;
+    }
+    int64_t x = matchLength(old.data() + sa[lo], (int64_t)old.size() - sa[lo], b, bn);
+    int64_t y = matchLength(old.data() + sa[hi], (int64_t)old.size() - sa[hi], b, bn);
+    pos = x > y ? sa[lo] : sa[hi];
+    return std::max(x, y);
+}
+
+// Delta bytes as (zeros, n, n bytes) runs; a run of fewer than 3 zeros costs
+// more as its own pair than inline
+static void putDiff(Bytes& out, const uint8_t* delta, int64_t len) {
+    int64_t i = 0;
+    while (i < len) {
+        int64_t zeros = 0;
+        while (i + zeros < len && delta[i + zeros] == 0) zeros++;
+        i += zeros;
+        int64_t lit = 0;
+        while (i + lit < len) {
+            int64_t z = 0;
+            while (i + lit + z < len && delta[i + lit + z] == 0 && z < 3) z++;
+            if (z == 3 || i + lit + z == len) break;
+            lit += z + 1;
+        }
+        putVarint(out, (uint32_t)zeros);
+        putVarint(out, (uint32_t)lit);
+        out.insert(out.end(), delta + i, delta + i + lit);
+        i += lit;
+    }
+}
+
+static Bytes makeDelta(const Bytes& old, const Bytes& nw) {
+    Bytes out;
+    uint8_t digest[SHA256_SIZE];
+    Sha256 sha;
+    putU32(out, DELTA_MAGIC);
+    putU32(out, (uint32_t)old.size());
+    putU32(out, (uint32_t)nw.size());
+    sha.update(old.data(), old.size());
+    sha.finish(digest);
+    out.insert(out.end(), digest, digest + SHA256_SIZE);
+    sha.reset();
+    sha.update(nw.data(), nw.size());
+    sha.finish(digest);
+    out.insert(out.end(), digest, digest + SHA256_SIZE);
+
+    std::vector<int32_t> sa = suffixArray(old);
+    const int64_t oldSize = (int64_t)old.size(), newSize = (int64_t)nw.size();
+    int64_t scan = 0, len = 0, pos = 0, lastScan = 0, lastPos = 0, lastOffset = 0;
+    Bytes delta;
+
+    while (scan < newSize) {
+        int64_t oldScore = 0;
+        for (int64_t scsc = scan += len; scan < newSize; scan++) {
+            len = oldSize ? longestMatch(sa, old, nw.data() + scan, newSize - scan, pos) : 0;
+            for (; scsc < scan + len; scsc++) {
+                if (scsc + lastOffset < oldSize && old[scsc + lastOffset] == nw[scsc]) oldScore++;
+            }
+            if ((len == oldScore && len != 0) || len > oldScore + 8) break;
+            if (scan + lastOffset < oldSize && old[scan + lastOffset] == nw[scan]) oldScore--;
+        }
+        if (len == oldScore && scan != newSize) continue;
+
+        // Extend the previous match forward and this one backward while at
+        // least half the bytes agree
+        int64_t s = 0, best = 0, lenF = 0;
+        for (int64_t i = 0; lastScan + i < scan && lastPos + i < oldSize;) {
+            if (old[lastPos + i] == nw[lastScan + i]) s++;
+            i++;
+            if (s * 2 - i > best * 2 - lenF) {
+                best = s;
+                lenF = i;
+            }
+        }
+        int64_t lenB = 0;
+        if (scan < newSize) {
+            s = 0;
+            best = 0;
+            for (int64_t i = 1; scan >= lastScan + i && pos >= i; i++) {
+                if (old[pos - i] == nw[scan - i]) s++;
+                if (s * 2 - i > best * 2 - lenB) {
+                    best = s;
+                    lenB = i;
+                }
+            }
+        }
+        if (lastScan + lenF > scan - lenB) { // Overlap: split where it scores best
+            int64_t overlap = (lastScan + lenF) - (scan - lenB);
+            int64_t lenS = 0;
+            s = 0;
+            best = 0;
+            for (int64_t i = 0; i < overlap; i++) {
+                if (nw[lastScan + lenF - overlap + i] == old[lastPos + lenF - overlap + i]) s++;
+                if (nw[scan - lenB + i] == old[pos - lenB + i]) s--;
+                if (s > best) {
+                    best = s;
+                    lenS = i + 1;
+                }
+            }
+            lenF += lenS - overlap;
+            lenB -= lenS;
+        }
+
+        int64_t extra = (scan - lenB) - (lastScan + lenF);
+        int64_t seek = (pos - lenB) - (lastPos + lenF);
+        if (lenF || extra || seek) {
+            delta.resize((size_t)lenF);
+            for (int64_t i = 0; i < lenF; i++) delta[i] = (uint8_t)(nw[lastScan + i] - old[lastPos + i]);
+            putVarint(out, (uint32_t)lenF);
+            putVarint(out, (uint32_t)extra);
+            putSvarint(out, (int32_t)seek);
+            putDiff(out, delta.data(), lenF);
+            out.insert(out.end(), nw.begin() + lastScan + lenF, nw.begin() + lastScan + lenF + extra);
+        }
+        lastScan = scan - lenB;
+        lastPos = pos - lenB;
+        lastOffset = pos - scan;
+    }
+    return out;
+}
+
+// --- Round trip through the firmware's decoder ---
+
+class MemoryDeltaSink : public DeltaSink {
+public:
+    explicit MemoryDeltaSink(const Bytes& source) : source(source) {}
+
+    bool readSource(uint32_t offset, uint8_t* data, size_t length) override {
+        if (offset + length > source.size()) return false;
+        memcpy(data, source.data() + offset, length);
+        return true;
+    }
+    bool emit(const uint8_t* data, size_t length) override {
+        output.insert(output.end(), data, data + length);
+        return true;
+    }
+
+    const Bytes& source;
+    Bytes output;
+};
+
+// Feeds the patch in pieces of 1..4096 bytes, each to a fresh decoder
+// restored from the state the previous one left
+static bool applyDelta(const Bytes& old, const Bytes& patch, Bytes& out, const char*& error) {
+    MemoryDeltaSink sink(old);
+    DeltaDecoder first(sink);
+    DeltaState saved = first.state();
+    uint32_t rng = 0x9e3779b9;
+    size_t pos = 0;
+    while (pos < patch.size()) {
+        DeltaDecoder decoder(sink);
+        decoder.restore(saved);
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        size_t n = std::min<size_t>(1 + rng % 4096, patch.size() - pos);
+        if (!decoder.feed(patch.data() + pos, n)) {
+            error = decoder.error();
+            return false;
+        }
+        pos += n;
+        saved = decoder.state();
+    }
+    DeltaDecoder last(sink);
+    last.restore(saved);
+    if (!last.done()) {
+        error = "patch ended early";
+        return false;
+    }
+    out.swap(sink.output);
+    return true;
+}
+
+static int runDeltaMake(const char* oldPath, const char* newPath, const char* patchPath) {
+    Bytes old, nw;
+    if (!readFileBytes(oldPath, old) || !readFileBytes(newPath, nw)) {
+        fprintf(stderr, "Cannot read %s or %s\n", oldPath, newPath);
+        return 2;
+    }
+    auto started = std::chrono::steady_clock::now();
+    Bytes patch = makeDelta(old, nw);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    Bytes rebuilt;
+    const char* error = "";
+    bool ok = applyDelta(old, patch, rebuilt, error) && rebuilt == nw;
+    printf("old %zu bytes, new %zu bytes, patch %zu bytes (%.1f%% of new), made in %.1f s, round trip %s%s%s\n",
+           old.size(), nw.size(), patch.size(), 100.0 * patch.size() / (nw.size() ? nw.size() : 1), seconds,
+           ok ? "ok" : "FAILED", error[0] ? ": " : "", error);
+    if (!ok) return 1;
+    if (!writeFileBytes(patchPath, patch)) {
+        fprintf(stderr, "Cannot write %s\n", patchPath);
+        return 2;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,422 @@
+#ifndef FLEET_SIM_H
+#define FLEET_SIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ArduinoJson.h>
+#include "hal/PosixHttpClient.h"
+#include "DeviceApi.h"
+#include "Metrics.h"
+
+// ==========================================
+// FLEET SIMULATOR
+// ==========================================
+//
+// Thousands of virtual devices against a real backend at `url`, on the
+// firmware's own DeviceApi (same request bodies, same response parsing),
+// e.g. scripts/fleet-standin.js or PostgREST on a local database.
+//
+// The scenario is a power cut: every device boots within --boot-spread-ms
+// (WiFi association) and then does what networkLoop() does:
+//
+//   STATE_BOOT        register_device_from_esp (fetchDeviceDetails). A
+//                     failure here leaves the firmware in STATE_BOOT until
+//                     the next reboot; those devices are counted as "stuck"
+//   STATE_UNASSIGNED  register again every PROVISION_POLL_INTERVAL; an
+//                     invalid school code is dropped as the firmware drops it
+//   STATE_ACTIVE      get_device_config (syncSchedules), then device_tick
+//                     every COMMAND_POLL_INTERVAL, or HEARTBEAT_INTERVAL for
+//                     the --push-pct devices whose Realtime socket is up;
+//                     a full command batch ticks again at once, a stale
+//                     config syncs, acks go with the next tick, REBOOT
+//                     reboots, a metrics snapshot rides along once a minute
+//
+// --unassigned-pct devices boot without a school code and wait to be
+// assigned (POST /api/assign on the stand-in). Device timing runs on the
+// wall clock. Devices are spread over --threads workers, each with a timer
+// queue and one kept-alive connection, so one thread serves hundreds of
+// devices.
+//
+// Requests are blocking, so at most --threads are in flight, while a real
+// fleet after a power cut offers one per device at once. The report says
+// so; to offer the backend the whole burst, set --threads to the device
+// count.
+//
+// Prints requests/s and state counts every --report-s, then per RPC:
+// requests, requests/s, error rate (transport failures, HTTP errors and
+// unusable responses) and latency percentiles.
+
+// As in main.cpp
+static const uint32_t FLEET_COMMAND_POLL_MS = 5 * 1000;
+static const uint32_t FLEET_HEARTBEAT_MS = 60 * 1000;
+static const uint32_t FLEET_PROVISION_POLL_MS = 10 * 1000;
+static const size_t FLEET_COMMAND_BATCH = 10;
+
+enum FleetRpc { FLEET_REGISTER, FLEET_CONFIG, FLEET_TICK, FLEET_ACK, FLEET_RPCS };
+static const char* const FLEET_RPC_NAMES[FLEET_RPCS] = {"register_device_from_esp", "get_device_config",
+                                                        "device_tick", "ack_commands"};
+
+enum FleetState : uint8_t { FLEET_BOOT, FLEET_UNASSIGNED, FLEET_ACTIVE, FLEET_STUCK };
+
+struct FleetOptions {
+    const char* url = nullptr;
+    const char* key = "fleet-sim";
+    const char* schoolCode = "DEMO";
+    uint32_t devices = 1000;
+    uint32_t threads = 64;
+    uint32_t seconds = 120;
+    uint32_t bootSpreadMs = 8000;
+    uint32_t pushPct = 0;
+    uint32_t unassignedPct = 0;
+    uint32_t reportS = 10;
+};
+
+struct FleetDevice {
+    char mac[18];
+    char name[24];
+    std::string dbId;
+    const char* schoolCode = "";
+    char configHash[CONFIG_HASH_LEN + 1] = "";
+    FleetState state = FLEET_BOOT;
+    bool push = false;
+    uint64_t lastMetricsMs = 0;
+    CommandAck acks[FLEET_COMMAND_BATCH];
+    size_t ackCount = 0;
+};
+
+// Shared between the workers and the reporting thread
+struct FleetCounters {
+    std::atomic<uint32_t> requests[FLEET_RPCS] = {};
+    std::atomic<uint32_t> errors[FLEET_RPCS] = {};
+    std::atomic<uint32_t> commands{0};
+    std::atomic<uint32_t> reboots{0};
+    std::atomic<int32_t> states[4] = {};
+};
+
+class FleetWorker {
+public:
+    FleetWorker(const FleetOptions& options, FleetCounters& counters, uint64_t seed)
+        : options(options), counters(counters), api(http, options.url, options.key), rng(seed) {
+        api.setMetrics(&metrics);
+    }
+
+    void add(FleetDevice* d, uint64_t bootMs) {
+        devices.push_back(d);
+        counters.states[FLEET_BOOT]++;
+        queue.push({bootMs, devices.size() - 1});
+    }
+
+    // Serves this worker's devices until `endMs` (time since `start`)
+    void run(std::chrono::steady_clock::time_point start, uint64_t endMs) {
+        while (!queue.empty()) {
+            Due due = queue.top();
+            if (due.atMs >= endMs) break;
+            queue.pop();
+            uint64_t now = elapsedMs(start);
+            if (due.atMs > now) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(due.atMs - now));
+                now = due.atMs;
+            }
+            uint64_t next = step(*devices[due.index], now);
+            if (next != UINT64_MAX) queue.push({next, due.index});
+        }
+    }
+
+    std::vector<uint32_t> latencyUs[FLEET_RPCS];
+
+private:
+    struct Due {
+        uint64_t atMs;
+        size_t index;
+        bool operator<(const Due& o) const { return atMs > o.atMs; } // Earliest first
+    };
+
+    static uint64_t elapsedMs(std::chrono::steady_clock::time_point start) {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                               start).count();
+    }
+
+    // One pass of the device's network loop; returns when it is due again
+    uint64_t step(FleetDevice& d, uint64_t now) {
+        switch (d.state) {
+            case FLEET_BOOT:
+            case FLEET_UNASSIGNED:
+                if (!fetchDeviceDetails(d)) {
+                    if (d.state == FLEET_BOOT) setState(d, FLEET_STUCK);
+                    return d.state == FLEET_STUCK ? UINT64_MAX : now + FLEET_PROVISION_POLL_MS;
+                }
+                if (d.state != FLEET_ACTIVE) return now + FLEET_PROVISION_POLL_MS;
+                syncSchedules(d);
+                return now; // lastDeviceTick starts at 0: the first tick is immediate
+            case FLEET_ACTIVE: {
+                bool full = false;
+                bool rebooted = deviceTick(d, now, full);
+                if (rebooted) return now + bootDelay();
+                return full ? now : now + (d.push ? FLEET_HEARTBEAT_MS : FLEET_COMMAND_POLL_MS);
+            }
+            default:
+                return UINT64_MAX;
+        }
+    }
+
+    template <typename F>
+    int timed(FleetRpc rpc, F&& call) {
+        auto started = std::chrono::steady_clock::now();
+        int code = call(); // Request and response parsing, as the device spends it
+        latencyUs[rpc].push_back((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now() - started).count());
+        counters.requests[rpc]++;
+        if (code != 200 && code != 204) counters.errors[rpc]++;
+        return code;
+    }
+
+    void setState(FleetDevice& d, FleetState s) {
+        counters.states[d.state]--;
+        counters.states[s]++;
+        d.state = s;
+    }
+
+    // fetchDeviceDetails(): register, then ACTIVE if the server assigned a school
+    bool fetchDeviceDetails(FleetDevice& d) {
+        JsonDocument doc;
+        int code = timed(FLEET_REGISTER, [&] { return api.registerDevice(d.mac, d.schoolCode, d.name, doc); });
+        if (code != 200) return false;
+        if (api.parseError() || doc.size() == 0) {
+            counters.errors[FLEET_REGISTER]++;
+            setState(d, FLEET_UNASSIGNED);
+            return true;
+        }
+        d.dbId = doc[0]["id"] | "";
+        const char* message = doc[0]["message"] | "OK";
+        bool invalidCode = strstr(message, "Invalid School Code") || strstr(message, "Unassigned");
+        if (invalidCode) d.schoolCode = "";
+        const char* school = doc[0]["school_id"] | "";
+        setState(d, !invalidCode && school[0] ? FLEET_ACTIVE : FLEET_UNASSIGNED);
+        return true;
+    }
+
+    // syncSchedules(): fetch, filter and compile the config like the device
+    void syncSchedules(FleetDevice& d) {
+        JsonDocument doc;
+        int code = timed(FLEET_CONFIG, [&] { return api.getDeviceConfig(d.mac, d.configHash, doc); });
+        if (code != 200) return;
+        if (api.parseError()) {
+            counters.errors[FLEET_CONFIG]++;
+        } else if (configUnchanged(doc.as<JsonVariantConst>())) {
+            return;
+        } else if (doc["schedules"].is<JsonArray>()) {
+            ScheduleIndex index;
+            compileSchedules(doc["schedules"].as<JsonArrayConst>(), index);
+            snprintf(d.configHash, sizeof(d.configHash), "%s", doc["config_hash"] | "");
+        } else {
+            counters.errors[FLEET_CONFIG]++;
+        }
+    }
+
+    // deviceTick(); true if the device rebooted
+    bool deviceTick(FleetDevice& d, uint64_t now, bool& full) {
+        char telemetry[256];
+        snprintf(telemetry, sizeof(telemetry),
+                 "{\"rssi\":%d,\"free_heap\":%u,\"uptime_s\":%u,\"realtime\":%s,\"http_requests\":%u}",
+                 -50 - (int)(rng() % 30), 180000u + (unsigned)(rng() % 4096), (unsigned)(now / 1000),
+                 d.push ? "true" : "false", http.stats().requests);
+
+        static thread_local char metricsJson[1536];
+        bool withMetrics = now - d.lastMetricsMs >= FLEET_HEARTBEAT_MS &&
+                           report.take((uint32_t)now, metricsJson, sizeof(metricsJson));
+
+        JsonDocument doc;
+        int code = timed(FLEET_TICK, [&] {
+            return api.tick(d.dbId.c_str(), "online", d.configHash, telemetry, d.acks, d.ackCount, FLEET_COMMAND_BATCH,
+                            doc, withMetrics ? metricsJson : nullptr);
+        });
+        if (code != 200) return false;
+        d.ackCount = 0;
+        if (withMetrics) {
+            report.commit();
+            d.lastMetricsMs = now;
+        }
+        if (api.parseError() || doc["error"].is<const char*>()) {
+            counters.errors[FLEET_TICK]++;
+            return false;
+        }
+
+        bool reboot = false;
+        bool sync = false;
+        JsonArrayConst batch = doc["commands"].as<JsonArrayConst>();
+        for (JsonVariantConst item : batch) {
+            Command cmd;
+            CommandStatus status = parseCommand(item, cmd);
+            if (status == COMMAND_NONE || cmd.id[0] == '\0' || d.ackCount == FLEET_COMMAND_BATCH) continue;
+            counters.commands++;
+            CommandAck& ack = d.acks[d.ackCount++];
+            snprintf(ack.id, sizeof(ack.id), "%s", cmd.id);
+            ack.ok = status == COMMAND_OK && knownCommand(cmd.name);
+            ack.executedAt = (uint32_t)time(nullptr);
+            if (!strcmp(cmd.name, "REBOOT")) reboot = true;
+            if (!strcmp(cmd.name, "CONFIG")) sync = true;
+        }
+
+        if (reboot) {
+            // flushAcks(), restart: back to STATE_BOOT after WiFi comes up
+            if (timed(FLEET_ACK, [&] { return api.ackCommands(d.dbId.c_str(), d.acks, d.ackCount); }) == 200) {
+                d.ackCount = 0;
+            }
+            counters.reboots++;
+            setState(d, FLEET_BOOT);
+            return true;
+        }
+        if (sync || (doc["config_stale"] | false)) syncSchedules(d);
+        full = batch.size() >= FLEET_COMMAND_BATCH;
+        return false;
+    }
+
+    // What executeCommand() runs; anything else is acked as failed
+    static bool knownCommand(const char* name) {
+        static const char* const known[] = {"RING",     "EMERGENCY", "STOP",   "TEST_BUZZER",
+                                            "SYNC_TIME", "CONFIG",    "REBOOT", "UPDATE_FIRMWARE"};
+        for (const char* k : known) {
+            if (!strcmp(name, k)) return true;
+        }
+        return false;
+    }
+
+    uint64_t bootDelay() { return 1000 + rng() % (options.bootSpreadMs ? options.bootSpreadMs : 1); }
+
+    const FleetOptions& options;
+    FleetCounters& counters;
+    hal::PosixHttpClient http{10000};
+    DeviceApi api;
+    Metrics metrics;
+    MetricsReport report{metrics};
+    std::mt19937_64 rng;
+    std::vector<FleetDevice*> devices;
+    std::priority_queue<Due> queue;
+};
+
+static uint32_t fleetPercentile(std::vector<uint32_t>& sorted, uint32_t pct) {
+    if (sorted.empty()) return 0;
+    size_t rank = (sorted.size() * pct + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+static int runFleetSim(const FleetOptions& options) {
+    if (!options.url || strncmp(options.url, "http://", 7) != 0) {
+        printf("--fleet needs a plain http:// base URL, e.g. http://127.0.0.1:54321\n");
+        return 1;
+    }
+    uint32_t threads = std::max<uint32_t>(1, std::min(options.threads, options.devices));
+    printf("Fleet: %u devices on %u threads against %s, school code \"%s\", %u%% with Realtime, "
+           "%u%% unassigned, booting within %u ms, %u s\n",
+           options.devices, threads, options.url, options.schoolCode, options.pushPct, options.unassignedPct,
+           options.bootSpreadMs, options.seconds);
+    if (threads < options.devices) {
+        printf("At most %u requests in flight (--threads): the boot burst of %u devices is queued on this side, "
+               "not offered to the backend at once\n",
+               threads, options.devices);
+    }
+
+    FleetCounters counters;
+    std::vector<FleetDevice> devices(options.devices);
+    std::vector<std::unique_ptr<FleetWorker>> workers;
+    for (uint32_t t = 0; t < threads; t++) workers.emplace_back(new FleetWorker(options, counters, 0xF1EE7 + t));
+    std::mt19937 rng(0x5EED);
+    for (uint32_t i = 0; i < options.devices; i++) {
+        FleetDevice& d = devices[i];
+        snprintf(d.mac, sizeof(d.mac), "02:00:%02X:%02X:%02X:%02X", (i >> 24) & 0xFF, (i >> 16) & 0xFF,
+                 (i >> 8) & 0xFF, i & 0xFF);
+        snprintf(d.name, sizeof(d.name), "Fleet %u", i);
+        d.push = rng() % 100 < options.pushPct;
+        d.schoolCode = rng() % 100 < options.unassignedPct ? "" : options.schoolCode;
+        workers[i % threads]->add(&d, 1000 + rng() % (options.bootSpreadMs ? options.bootSpreadMs : 1));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t endMs = (uint64_t)options.seconds * 1000;
+    std::vector<std::thread> pool;
+    for (auto& w : workers) pool.emplace_back([&w, start, endMs] { w->run(start, endMs); });
+
+    uint32_t lastTotal = 0;
+    for (uint32_t s = options.reportS; s < options.seconds; s += options.reportS) {
+        std::this_thread::sleep_until(start + std::chrono::seconds(s));
+        uint32_t total = 0, errors = 0;
+        for (int r = 0; r < FLEET_RPCS; r++) {
+            total += counters.requests[r].load();
+            errors += counters.errors[r].load();
+        }
+        printf("t=%4us  %7.1f req/s  %u errors  boot %d, unassigned %d, active %d, stuck %d  %u commands\n", s,
+               (total - lastTotal) / (double)options.reportS, errors, counters.states[FLEET_BOOT].load(),
+               counters.states[FLEET_UNASSIGNED].load(), counters.states[FLEET_ACTIVE].load(),
+               counters.states[FLEET_STUCK].load(), counters.commands.load());
+        lastTotal = total;
+    }
+    for (auto& t : pool) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("\n%-26s %9s %9s %8s %9s %9s %9s %9s\n", "rpc", "requests", "req/s", "errors", "p50 ms", "p90 ms",
+           "p99 ms", "max ms");
+    uint32_t totalErrors = 0;
+    for (int r = 0; r < FLEET_RPCS; r++) {
+        std::vector<uint32_t> all;
+        for (auto& w : workers) all.insert(all.end(), w->latencyUs[r].begin(), w->latencyUs[r].end());
+        if (all.empty()) continue;
+        std::sort(all.begin(), all.end());
+        uint32_t n = counters.requests[r].load();
+        uint32_t errors = counters.errors[r].load();
+        totalErrors += errors;
+        printf("%-26s %9u %9.1f %7.2f%% %9.2f %9.2f %9.2f %9.2f\n", FLEET_RPC_NAMES[r], n, n / seconds,
+               n ? 100.0 * errors / n : 0.0, fleetPercentile(all, 50) / 1000.0, fleetPercentile(all, 90) / 1000.0,
+               fleetPercentile(all, 99) / 1000.0, all.back() / 1000.0);
+    }
+    printf("\nStates: boot %d, unassigned %d, active %d, stuck after a failed registration %d; "
+           "%u commands, %u reboots\n",
+           counters.states[FLEET_BOOT].load(), counters.states[FLEET_UNASSIGNED].load(),
+           counters.states[FLEET_ACTIVE].load(), counters.states[FLEET_STUCK].load(), counters.commands.load(),
+           counters.reboots.load());
+    if (threads < options.devices) {
+        printf("Concurrency was capped at %u requests (--threads), not %u devices: not a thundering-herd result\n",
+               threads, options.devices);
+    }
+    return totalErrors ? 1 : 0;
+}
+
+// --fleet <url> [--devices N] [--threads N] [--seconds N] [--school CODE]
+//               [--push-pct N] [--unassigned-pct N] [--boot-spread-ms N] [--report-s N] [--key KEY]
+static int runFleetSim(int argc, char** argv, int first) {
+    FleetOptions options;
+    options.url = argv[first];
+    for (int i = first + 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--devices") && hasValue) options.devices = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && hasValue) options.threads = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seconds") && hasValue) options.seconds = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--school") && hasValue) options.schoolCode = argv[++i];
+        else if (!strcmp(argv[i], "--push-pct") && hasValue) options.pushPct = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--unassigned-pct") && hasValue) options.unassignedPct = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--boot-spread-ms") && hasValue) options.bootSpreadMs = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--report-s") && hasValue) options.reportS = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--key") && hasValue) options.key = argv[++i];
+        else {
+            fprintf(stderr, "Unknown --fleet option: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (options.devices == 0 || options.reportS == 0) {
+        fprintf(stderr, "--devices and --report-s must be at least 1\n");
+        return 2;
+    }
+    return runFleetSim(options);
+}
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef JOURNAL_TEST_H
+#define JOURNAL_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <set>
+#include <string>
+#include "hal/NativeHal.h"
+#include "DeviceApi.h"
+#include "EventJournal.h"
+#include "JournalUploader.h"
+
+// ==========================================
+// EVENT JOURNAL TEST
+// ==========================================
+//
+// EventJournal on a host directory (/tmp/autobell-journal) and
+// JournalUploader against FakeHttpClient, on simulated time. The "server"
+// reads every upload_device_events body and keeps events by seq, like the
+// table's primary key:
+//
+//   offline   a day offline: bells and commands (some acked) journaled,
+//             then a reboot; numbering continues and the unacked commands
+//             come back
+//   replay    back online: every 3rd response is lost after the server
+//             stored the batch
+//   online    caught up: a few new bells wait for a full batch or
+//             JOURNAL_UPLOAD_MS instead of a request each
+//   overflow  three segments' worth offline: the journal stays bounded and
+//             the dropped records are counted
+//   torn      a half-written record at the end of a segment (power cut)
+//
+// Checks: every bell and command reached the server exactly once (resent
+// batches rejected as duplicates), acks were never uploaded, batches were
+// at most JOURNAL_BATCH events, and flash use stayed within two segments.
+//
+// Returns 0 if all passed.
+
+static const char* JOURNAL_TEST_DIR = "/tmp/autobell-journal";
+
+struct JournalServer {
+    std::set<uint32_t> seqs;
+    uint32_t requests = 0;
+    uint32_t duplicates = 0;
+    uint32_t acks = 0;         // ACKED records that were sent (must stay 0)
+    uint32_t largestBatch = 0;
+};
+
+// Stores the events of the last request, if there was one
+static void receiveJournal(hal::FakeHttpClient& http, uint32_t& seenRequests, JournalServer& server) {
+    if (http.stats().requests == seenRequests) return;
+    seenRequests = http.stats().requests;
+    server.requests++;
+    uint32_t n = 0;
+    const char* p = http.lastBody.c_str();
+    while ((p = strstr(p, "{\"seq\":")) != nullptr) {
+        uint32_t seq = (uint32_t)strtoul(p + 7, nullptr, 10);
+        if (!server.seqs.insert(seq).second) server.duplicates++;
+        n++;
+        p += 7;
+    }
+    if (strstr(http.lastBody.c_str(), "\"acked\"")) server.acks++;
+    if (n > server.largestBatch) server.largestBatch = n;
+}
+
+static void clearJournalDir() {
+    mkdir(JOURNAL_TEST_DIR, 0755);
+    hal::HostFileSystem fs(JOURNAL_TEST_DIR);
+    for (const char* path : JOURNAL_SEGMENT_PATHS) fs.remove(path);
+    fs.remove(JOURNAL_POS);
+}
+
+static size_t journalFlashBytes() {
+    size_t total = 0;
+    for (const char* path : JOURNAL_SEGMENT_PATHS) {
+        struct stat st;
+        if (stat((std::string(JOURNAL_TEST_DIR) + path).c_str(), &st) == 0) total += (size_t)st.st_size;
+    }
+    return total;
+}
+
+// Steps the uploader once per simulated second until it has nothing left
+// (or `maxMs` passed); every `loseEvery`th response is lost
+static void replayJournal(JournalUploader& uploader, EventJournal& journal, hal::FakeHttpClient& http,
+                          JournalServer& server, uint32_t& nowMs, uint32_t maxMs, uint32_t loseEvery) {
+    uint32_t seenRequests = http.stats().requests;
+    for (uint32_t end = nowMs + maxMs; nowMs < end && journal.pending(); nowMs += 1000) {
+        bool lose = loseEvery && (server.requests + 1) % loseEvery == 0;
+        http.route("/rpc/upload_device_events", lose ? 504 : 200, lose ? "" : "1");
+        uploader.step("dev-1", nowMs);
+        receiveJournal(http, seenRequests, server);
+    }
+}
+
+static int runJournalTest() {
+    clearJournalDir();
+    hal::HostFileSystem fs(JOURNAL_TEST_DIR);
+    hal::FakeHttpClient http;
+    DeviceApi api(http, "http://fake", "key");
+    JournalServer server;
+    uint32_t nowMs = 0;
+
+    // offline: 60 bells, 6 commands of which the first 3 were acked
+    const uint32_t bells = 60, commands = 6, acked = 3;
+    uint32_t expected = 0; // Events the server must end up with
+    {
+        EventJournal journal(fs);
+        journal.begin(0xC0FFEE);
+        for (uint32_t i = 0; i < bells; i++, nowMs += 60000) {
+            journal.appendBell(1769400000 + i * 60, (uint16_t)(480 + i), (uint16_t)i, 0, nowMs);
+            journal.tick(nowMs);
+            if (i % 10 == 0 && i / 10 < commands) {
+                journal.appendCommand(1769400000 + i * 60, 1000 + i / 10, "RING", true, nowMs);
+            }
+        }
+        for (uint32_t c = 0; c < acked; c++) journal.appendAcked(1000 + c, nowMs);
+        expected = bells + commands;
+    }
+    EventJournal journal(fs);
+    journal.begin(0xBAD);
+    std::set<int64_t> unacked;
+    journal.forEachUnacked([&](const JournalRecord& r) { unacked.insert(r.commandId); });
+    uint32_t afterReboot = journal.size();
+    journal.appendBell(1769500000, 500, 0, 0, nowMs);
+    expected++;
+    bool okOffline = journal.id() == 0xC0FFEE && afterReboot == bells + commands + acked &&
+                     journal.pending() == afterReboot + 1 && unacked == std::set<int64_t>({1003, 1004, 1005});
+    printf("journal/offline  %u records after reboot, %u pending, %u unacked commands\n", afterReboot,
+           journal.pending(), (unsigned)unacked.size());
+
+    // replay: the device just booted, so batches go out back to back
+    JournalUploader uploader(journal, api);
+    replayJournal(uploader, journal, http, server, nowMs, 600000, 3);
+    bool okReplay = journal.pending() == 0 && server.seqs.size() == expected && server.duplicates > 0 &&
+                    server.acks == 0 && server.largestBatch <= JOURNAL_BATCH;
+    printf("journal/replay   %u events in %u requests (%u resent after a lost response), largest batch %u\n",
+           (unsigned)server.seqs.size(), server.requests, server.duplicates, server.largestBatch);
+
+    // online: 5 bells wait for JOURNAL_UPLOAD_MS, then go in one request
+    uint32_t requestsBefore = server.requests;
+    uint32_t seenRequests = http.stats().requests;
+    http.route("/rpc/upload_device_events", 200, "5");
+    for (uint32_t i = 0; i < 5; i++, nowMs += 60000) {
+        journal.appendBell(1769600000 + i * 60, (uint16_t)(600 + i), 0, 0, nowMs);
+        expected++;
+        uploader.step("dev-1", nowMs);
+        receiveJournal(http, seenRequests, server);
+    }
+    bool heldBack = server.requests == requestsBefore;
+    nowMs += JOURNAL_UPLOAD_MS;
+    uploader.step("dev-1", nowMs);
+    receiveJournal(http, seenRequests, server);
+    bool okOnline = heldBack && server.requests == requestsBefore + 1 && server.seqs.size() == expected;
+    printf("journal/online   5 bells held back %s, then %u request\n", heldBack ? "yes" : "NO",
+           server.requests - requestsBefore);
+
+    // overflow: 3 segments of bells with no connection
+    size_t maxFlash = 0;
+    for (uint32_t i = 0; i < 3u * JOURNAL_SEGMENT_RECORDS; i++, nowMs += 1000) {
+        journal.appendBell(1769700000 + i, (uint16_t)(i % 10080), 0, 0, nowMs);
+        size_t bytes = journalFlashBytes();
+        if (bytes > maxFlash) maxFlash = bytes;
+    }
+    uint32_t lost = journal.lost();
+    uint32_t kept = journal.pending();
+    uploader.reconnected();
+    size_t before = server.seqs.size();
+    replayJournal(uploader, journal, http, server, nowMs, 600000, 0);
+    bool okOverflow = lost + kept == 3u * JOURNAL_SEGMENT_RECORDS && lost > 0 &&
+                      maxFlash <= 2 * (JOURNAL_SEGMENT_RECORDS + 1) * sizeof(JournalRecord) &&
+                      server.seqs.size() - before == kept && journal.pending() == 0;
+    printf("journal/overflow %u records offline: %u kept, %u lost, at most %u bytes of flash\n",
+           3u * JOURNAL_SEGMENT_RECORDS, kept, lost, (unsigned)maxFlash);
+
+    // torn: half a record at the end of the active segment
+    clearJournalDir();
+    {
+        EventJournal j(fs);
+        j.begin(7);
+        for (uint32_t i = 0; i < 10; i++) j.appendBell(1769800000 + i, 0, 0, 0, nowMs);
+    }
+    FILE* f = fopen((std::string(JOURNAL_TEST_DIR) + JOURNAL_SEGMENT_PATHS[0]).c_str(), "ab");
+    fwrite("\x0b\x00\x00\x00garbage-garbage", 1, 20, f);
+    fclose(f);
+    bool okTorn = false;
+    {
+        EventJournal j(fs);
+        j.begin(8);
+        bool cut = j.size() == 10 && j.id() == 7;
+        j.appendBell(1769900000, 0, 0, 0, nowMs);
+        j.sync();
+        JournalRecord last[16];
+        size_t n = j.read(1, last, 16);
+        okTorn = cut && n == 11 && last[10].seq == 11 && last[10].time == 1769900000;
+        printf("journal/torn     %u intact records kept, next record readable: %s\n", (unsigned)(n - 1),
+               okTorn ? "yes" : "NO");
+    }
+
+    bool ok = okOffline && okReplay && okOnline && okOverflow && okTorn;
+    printf("%s: offline %s, replay %s, online %s, overflow %s, torn %s\n", ok ? "PASS" : "FAIL",
+           okOffline ? "ok" : "FAILED", okReplay ? "ok" : "FAILED", okOnline ? "ok" : "FAILED",
+           okOverflow ? "ok" : "FAILED", okTorn ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef NTP_TEST_H
+#define NTP_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "hal/NativeHal.h"
+#include "hal/PosixUdp.h"
+#include "SntpClient.h"
+#include "RtcTrim.h"
+
+// ==========================================
+// SNTP AND RTC TRIM TEST
+// ==========================================
+//
+// SntpClient over real UDP against fake NTP servers on 127.0.0.1, each a
+// thread whose UTC is the shared clock plus NTP_TRUE_OFFSET_US:
+//
+//   good      replies after 0..NTP_JITTER_US, stamps T2 and T3, then waits
+//             0..NTP_JITTER_US again before sending (random, uneven legs)
+//   false     the same, 300 ms off
+//   silent    never replies
+//   kiss      replies with a RATE kiss-o'-death
+//   echo      a good server that sends every reply twice, 30 ms apart, so
+//             the next exchange sees a stray
+//   lossy     a good server that drops every other request
+//
+//   jitter    3 good, false, silent, kiss: NTP_ROUNDS rounds
+//   strays    echo, lossy, good: NTP_ROUNDS rounds
+//   split     one good and one false: no majority, the round must fail
+//
+// A round passes if its result is within its bound of the true offset and
+// the false, silent and kissing servers were left out.
+//
+// RtcTrim on simulated time: a DS3231 that runs NTP_RTC_PPM fast (and slow)
+// with a register step of 0.12 ppm rather than the nominal 0.1, checked
+// hourly with up to NTP_CHECK_ERROR_US of NTP error for NTP_TRIM_DAYS days.
+// Passes if the rate ends within NTP_TRIM_PASS_PPB and the error never
+// went past the rewrite tolerance plus an hour's drift. Reported with how
+// far each would drift over 30 days offline.
+//
+// Returns 0 if all passed.
+
+static const int64_t NTP_TRUE_OFFSET_US = 1792368000LL * 1000000 + 123457; // Server UTC minus our clock
+static const uint32_t NTP_JITTER_US = 20000;
+static const uint32_t NTP_ROUNDS = 3;
+static const uint32_t NTP_SPACING_MS = 30;
+static const int64_t NTP_FALSE_US = 300000;
+static const int32_t NTP_RTC_PPM_PPB = 2700;
+static const uint32_t NTP_CHECK_ERROR_US = 5000;
+static const uint32_t NTP_TRIM_DAYS = 21;
+static const int32_t NTP_TRIM_PASS_PPB = 150;
+
+enum FakeNtpKind { NTP_GOOD, NTP_FALSE, NTP_SILENT, NTP_KISS, NTP_ECHO, NTP_LOSSY };
+
+class FakeNtpServer {
+public:
+    FakeNtpServer(hal::Clock& clock, FakeNtpKind kind, uint32_t seed) : clock(clock), kind(kind), rng(seed) {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(fd, (sockaddr*)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(fd, (sockaddr*)&addr, &len);
+        port = ntohs(addr.sin_port);
+        timeval tv = {0, 20000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        worker = std::thread([this]() { serve(); });
+    }
+    ~FakeNtpServer() {
+        stop = true;
+        worker.join();
+        close(fd);
+    }
+
+    uint16_t port = 0;
+
+private:
+    void serve() {
+        uint32_t requests = 0;
+        while (!stop) {
+            uint8_t req[48];
+            sockaddr_in from = {};
+            socklen_t fromLen = sizeof(from);
+            if (recvfrom(fd, req, sizeof(req), 0, (sockaddr*)&from, &fromLen) != 48) continue;
+            requests++;
+            if (kind == NTP_SILENT || (kind == NTP_LOSSY && requests % 2 == 0)) continue;
+
+            uint8_t reply[48] = {};
+            reply[0] = (0 << 6) | (4 << 3) | 4; // LI 0, version 4, server
+            reply[1] = kind == NTP_KISS ? 0 : 2;
+            putU32(reply + 4, 0x00000041);      // Root delay 1 ms
+            putU32(reply + 8, 0x00000021);      // Root dispersion 0.5 ms
+            memcpy(reply + 12, kind == NTP_KISS ? "RATE" : "\x7f\0\0\x01", 4);
+            memcpy(reply + 24, req + 40, 8);    // Originate = the client's transmit stamp
+            pause();
+            putTime(reply + 32);
+            putTime(reply + 40);
+            pause();
+            sendto(fd, reply, sizeof(reply), 0, (sockaddr*)&from, fromLen);
+            if (kind == NTP_ECHO) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(30));
+                sendto(fd, reply, sizeof(reply), 0, (sockaddr*)&from, fromLen);
+            }
+        }
+    }
+
+    void pause() {
+        if (kind == NTP_KISS) return;
+        std::this_thread::sleep_for(std::chrono::microseconds(rng() % NTP_JITTER_US));
+    }
+
+    void putTime(uint8_t* p) {
+        int64_t us = (int64_t)clock.micros() + NTP_TRUE_OFFSET_US + (kind == NTP_FALSE ? NTP_FALSE_US : 0);
+        putU32(p, (uint32_t)(us / 1000000 + 2208988800LL));
+        putU32(p + 4, (uint32_t)(((uint64_t)(us % 1000000) << 32) / 1000000));
+    }
+
+    static void putU32(uint8_t* p, uint32_t v) {
+        p[0] = (uint8_t)(v >> 24);
+        p[1] = (uint8_t)(v >> 16);
+        p[2] = (uint8_t)(v >> 8);
+        p[3] = (uint8_t)v;
+    }
+
+    hal::Clock& clock;
+    FakeNtpKind kind;
+    std::mt19937 rng;
+    int fd = -1;
+    std::atomic<bool> stop{false};
+    std::thread worker;
+};
+
+// Runs `rounds` rounds against servers of the given kinds. Returns false if
+// a round failed its checks (or, with `expectFail`, did not fail).
+static bool runNtpRounds(const char* name, std::initializer_list<FakeNtpKind> kinds, uint32_t rounds,
+                         bool expectFail) {
+    hal::StdClock clock;
+    hal::PosixUdp udp(clock);
+    SntpClient sntp(udp, clock, 0, NTP_SPACING_MS);
+    std::vector<std::unique_ptr<FakeNtpServer>> servers;
+    uint8_t truechimers = 0, expectedOut = 0;
+    for (FakeNtpKind k : kinds) {
+        servers.emplace_back(new FakeNtpServer(clock, k, 1000 + (uint32_t)servers.size()));
+        sntp.addServer("127.0.0.1", servers.back()->port);
+        if (k == NTP_GOOD || k == NTP_ECHO || k == NTP_LOSSY) truechimers++;
+        if (k == NTP_FALSE) expectedOut++;
+    }
+
+    bool ok = true;
+    int64_t worstUs = 0;
+    uint32_t worstBoundUs = 0, done = 0;
+    for (uint32_t r = 0; r < rounds; r++) {
+        sntp.start();
+        SntpStep step;
+        do {
+            step = sntp.step();
+            if (step == SNTP_BUSY) std::this_thread::sleep_for(std::chrono::milliseconds(std::min(sntp.waitMs(), 5u)));
+        } while (step == SNTP_BUSY);
+        if (step != SNTP_DONE) continue;
+
+        done++;
+        const SntpResult& res = sntp.result();
+        int64_t err = res.offsetUs - NTP_TRUE_OFFSET_US;
+        if (llabs(err) > llabs(worstUs)) worstUs = err;
+        if (res.boundUs > worstBoundUs) worstBoundUs = res.boundUs;
+        bool pass = llabs(err) <= res.boundUs && res.used == truechimers && res.servers == truechimers + expectedOut;
+        if (!pass) {
+            printf("ntp/%-7s round %u FAIL: off by %+.3f ms, bound %.3f ms, %u of %u servers used\n", name, r,
+                   err / 1000.0, res.boundUs / 1000.0, res.used, res.servers);
+        }
+        ok = ok && pass;
+    }
+
+    const SntpStats& st = sntp.stats();
+    if (expectFail) {
+        ok = done == 0 && st.failures == rounds;
+    } else {
+        ok = ok && done == rounds;
+    }
+    printf("ntp/%-7s %s: %u/%u rounds, worst %+.3f ms (bound up to %.3f ms), %u sent, %u timeouts, "
+           "%u kisses, %u falsetickers, %u rejected\n",
+           name, ok ? "PASS" : "FAIL", done, rounds, worstUs / 1000.0, worstBoundUs / 1000.0, st.sent, st.timeouts,
+           st.kisses, st.falsetickers, st.rejected);
+    return ok;
+}
+
+struct TrimRun {
+    int32_t finalRatePpb = 0;
+    int64_t maxErrorUs = 0;
+    uint32_t sets = 0;
+    uint32_t trims = 0;
+    uint32_t firstTrimHours = 0;
+    int8_t aging = 0;
+};
+
+// Simulated DS3231 running `naturalPpb` fast at aging 0, checked hourly
+static TrimRun runTrim(int32_t naturalPpb, uint32_t seed) {
+    const double PPB_PER_LSB_REAL = 120; // The chip's real step, not RtcTrim's nominal 100
+    std::mt19937 rng(seed);
+    auto noise = [&]() { return (int64_t)(rng() % (2 * NTP_CHECK_ERROR_US + 1)) - (int64_t)NTP_CHECK_ERROR_US; };
+
+    RtcTrim trim;
+    trim.begin(RtcTrimState(), 0);
+    TrimRun r;
+    double errorUs = 400000; // Set by hand, 0.4 s off
+    uint32_t utc = 1792368000;
+    for (uint32_t h = 0; h < NTP_TRIM_DAYS * 24; h++) {
+        double rate = naturalPpb - trim.aging() * PPB_PER_LSB_REAL;
+        errorUs += rate * 3600 / 1000.0; // ppb * s = ns
+        utc += 3600;
+        if (h > 0 && llabs((int64_t)errorUs) > llabs(r.maxErrorUs)) r.maxErrorUs = (int64_t)errorUs;
+
+        uint8_t actions = trim.check(utc, (int64_t)errorUs + noise(), 2 * NTP_CHECK_ERROR_US);
+        if (actions & TRIM_AGING) {
+            r.trims++;
+            if (!r.firstTrimHours) r.firstTrimHours = h + 1;
+        }
+        if (actions & TRIM_SET_TIME) {
+            // Set to the measured error, plus the write's own timing error
+            int64_t step = -((int64_t)errorUs + noise()) + (int64_t)(rng() % 401) - 200;
+            errorUs += step;
+            trim.timeSet(step);
+            r.sets++;
+        }
+    }
+    r.finalRatePpb = (int32_t)(naturalPpb - trim.aging() * PPB_PER_LSB_REAL);
+    r.aging = trim.aging();
+    return r;
+}
+
+static bool printTrim(const char* name, int32_t naturalPpb, const TrimRun& r) {
+    int64_t limit = RtcTrim::SET_ERROR_US + NTP_CHECK_ERROR_US + llabs(naturalPpb) * 3600 / 1000;
+    bool ok = llabs(r.finalRatePpb) <= NTP_TRIM_PASS_PPB && llabs(r.maxErrorUs) <= limit;
+    printf("ntp/trim-%-4s %s: %+.2f ppm -> %+.3f ppm (aging %d, %u trims, first after %.1f days), "
+           "%u rewrites, worst error %+.1f ms; 30 days offline: %+.0f ms untrimmed, %+.0f ms trimmed\n",
+           name, ok ? "PASS" : "FAIL", naturalPpb / 1000.0, r.finalRatePpb / 1000.0, r.aging, r.trims,
+           r.firstTrimHours / 24.0, r.sets, r.maxErrorUs / 1000.0, naturalPpb * 30 * 86400.0 / 1e6,
+           r.finalRatePpb * 30 * 86400.0 / 1e6);
+    return ok;
+}
+
+static int runNtpTest() {
+    printf("Fake NTP servers on 127.0.0.1, up to %.0f ms of jitter on each leg\n", NTP_JITTER_US / 1000.0);
+    bool ok = runNtpRounds("jitter", {NTP_GOOD, NTP_GOOD, NTP_FALSE, NTP_SILENT, NTP_KISS, NTP_GOOD}, NTP_ROUNDS,
+                           false);
+    ok = runNtpRounds("strays", {NTP_ECHO, NTP_LOSSY, NTP_GOOD}, NTP_ROUNDS, false) && ok;
+    ok = runNtpRounds("split", {NTP_GOOD, NTP_FALSE}, 2, true) && ok;
+    ok = printTrim("fast", NTP_RTC_PPM_PPB, runTrim(NTP_RTC_PPM_PPB, 1)) && ok;
+    ok = printTrim("slow", -NTP_RTC_PPM_PPB * 2 / 3, runTrim(-NTP_RTC_PPM_PPB * 2 / 3, 2)) && ok;
+    return ok ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef OTA_TEST_H
+#define OTA_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include "hal/NativeHal.h"
+#include "hal/PosixHttpClient.h"
+#include "OtaEngine.h"
+
+// ==========================================
+// OTA DOWNLOAD TEST
+// ==========================================
+//
+// Runs OtaEngine against scripts/ota-fileserver.js (real sockets, the
+// server's image) into a MemoryOtaPartition, with progress kept in /tmp:
+//
+//   clean     one download; throughput and request count
+//   resume    every 3rd request drops halfway, and halfway through the
+//             image the device "reboots" (new engine, resume())
+//   corrupt   the served image has one byte flipped
+//   gone      the image URL answers 404 until the engine gives up
+//   delta     (server started with --base/--patch) the patch applied to
+//             /base.bin as the running image, with the same drops and
+//             reboot as resume
+//   base      the same patch offered to a device running something else
+//   fallback  a corrupted patch, with a reboot partway: the engine must
+//             drop it and download the full image instead
+//
+// Simulated time jumps past every retry backoff, so the test never waits.
+//
+// Checks:
+//   - clean and resume end READY with the partition activated;
+//   - resume continued from where it stopped and wrote every byte once;
+//   - corrupt and gone end FAILED, are never activated and leave no
+//     state for the next boot to resume;
+//   - delta rebuilds exactly the clean image from patch bytes only;
+//   - base refuses the patch before downloading anything;
+//   - fallback ends READY with exactly the clean image, one fallback.
+//
+// Returns 0 if all passed, 2 if the server could not be reached.
+
+static const char* OTA_TEST_STATE = "/ota-test.state";
+static const char* OTA_TEST_STATE_TMP = "/ota-test.state.tmp";
+static const size_t OTA_TEST_PARTITION = 1920 * 1024; // Default 4 MB layout app slot
+
+struct OtaManifest {
+    std::string url;
+    uint32_t size = 0;
+    char sha256[SHA256_HEX_LEN + 1] = "";
+    std::string patchUrl; // Empty without --patch
+    uint32_t patchSize = 0;
+    char baseSha256[SHA256_HEX_LEN + 1] = "";
+};
+
+static bool jsonString(const char* body, const char* key, std::string& out) {
+    const char* p = strstr(body, key);
+    if (!p) return false;
+    p += strlen(key);
+    const char* end = strchr(p, '"');
+    if (!end) return false;
+    out.assign(p, end);
+    return true;
+}
+
+static bool jsonNumber(const char* body, const char* key, uint32_t& out) {
+    const char* p = strstr(body, key);
+    if (!p) return false;
+    out = (uint32_t)strtoul(p + strlen(key), nullptr, 10);
+    return true;
+}
+
+// GET /manifest.json; just enough JSON for the server's own output
+static bool fetchOtaManifest(const std::string& base, OtaManifest& m) {
+    hal::PosixHttpClient http;
+    if (!http.begin((base + "/manifest.json").c_str()) || http.get() != 200) return false;
+    char body[1024] = "";
+    body[http.readBytes(body, sizeof(body) - 1)] = '\0';
+    http.end();
+
+    std::string sha, baseSha;
+    if (!jsonString(body, "\"url\":\"", m.url) || !jsonNumber(body, "\"size\":", m.size) ||
+        !jsonString(body, "\"sha256\":\"", sha) || sha.size() != SHA256_HEX_LEN) {
+        return false;
+    }
+    memcpy(m.sha256, sha.c_str(), SHA256_HEX_LEN + 1);
+    if (jsonString(body, "\"patch_url\":\"", m.patchUrl) && jsonNumber(body, "\"patch_size\":", m.patchSize) &&
+        jsonString(body, "\"base_sha256\":\"", baseSha) && baseSha.size() == SHA256_HEX_LEN) {
+        memcpy(m.baseSha256, baseSha.c_str(), SHA256_HEX_LEN + 1);
+    } else {
+        m.patchUrl.clear();
+    }
+    return true;
+}
+
+// Whole file into memory (the delta base)
+static bool fetchOtaFile(const std::string& url, std::vector<uint8_t>& out) {
+    hal::PosixHttpClient http;
+    if (!http.begin(url.c_str()) || http.get() != 200) return false;
+    char chunk[16 * 1024];
+    size_t n;
+    out.clear();
+    while ((n = http.readBytes(chunk, sizeof(chunk))) > 0) out.insert(out.end(), chunk, chunk + n);
+    http.end();
+    return true;
+}
+
+struct OtaRun {
+    OtaStatus status = OTA_IDLE;
+    const char* error = "";
+    double seconds = 0;
+    uint32_t requests = 0;
+    uint32_t retries = 0;
+    uint32_t resumedAt = 0;
+    bool stateLeft = false; // A new engine would resume() after this run
+    uint32_t fallbacks = 0; // Deltas replaced by the full image
+};
+
+// Steps until done; with rebootAt > 0 the engine is thrown away once it
+// has downloaded that much and a new one resumes from the saved state. A
+// download that finished in the same step (a patch within one chunk) is
+// not rebooted.
+static OtaRun runOtaDownload(const OtaManifest& m, const std::string& url, hal::MemoryOtaPartition& partition,
+                             uint32_t rebootAt, bool delta = false) {
+    hal::HostFileSystem fs("/tmp");
+    fs.remove(OTA_TEST_STATE);
+    hal::PosixHttpClient http;
+    OtaRun r;
+    uint32_t nowMs = 0;
+
+    auto startedAt = std::chrono::steady_clock::now();
+    std::unique_ptr<OtaEngine> engine(new OtaEngine(http, partition, fs, OTA_TEST_STATE, OTA_TEST_STATE_TMP));
+    bool started = delta ? engine->startDelta(url.c_str(), m.patchSize, m.baseSha256, m.size, m.sha256, m.url.c_str())
+                         : engine->start(url.c_str(), m.size, m.sha256);
+    if (!started) {
+        r.status = engine->status();
+        r.error = engine->error();
+        return r;
+    }
+    while (engine->active()) {
+        engine->step(nowMs);
+        nowMs += OTA_RETRY_MAX_MS;
+        if (rebootAt && engine->active() && engine->downloaded() >= rebootAt) {
+            rebootAt = 0;
+            r.retries += engine->retryCount();
+            r.fallbacks += engine->fallbackCount();
+            engine.reset(new OtaEngine(http, partition, fs, OTA_TEST_STATE, OTA_TEST_STATE_TMP));
+            if (!engine->resume()) break;
+            r.resumedAt = engine->resumedAt();
+        }
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startedAt).count();
+    r.status = engine->status();
+    r.error = engine->error();
+    r.retries += engine->retryCount();
+    r.fallbacks += engine->fallbackCount();
+    r.requests = http.stats().requests;
+    OtaEngine next(http, partition, fs, OTA_TEST_STATE, OTA_TEST_STATE_TMP);
+    r.stateLeft = next.resume();
+    return r;
+}
+
+static void printOtaRun(const char* name, const OtaRun& r, const hal::MemoryOtaPartition& partition) {
+    static const char* names[] = {"idle", "downloading", "ready", "failed"};
+    printf("ota/%-8s %-6s %s%s%s %u requests, %u retries, %zu bytes written, %.1f KB/s of image",
+           name, names[r.status], r.error[0] ? "(" : "", r.error, r.error[0] ? ")" : "", r.requests, r.retries,
+           partition.bytesWritten, r.seconds > 0 ? partition.bytesWritten / 1024.0 / r.seconds : 0.0);
+    if (r.resumedAt) printf(", resumed at %u", r.resumedAt);
+    if (r.fallbacks) printf(", full image after %u failed delta", r.fallbacks);
+    printf("\n");
+}
+
+static int runOtaTest(const char* base) {
+    OtaManifest m;
+    if (!fetchOtaManifest(base, m)) {
+        printf("Cannot fetch %s/manifest.json (start scripts/ota-fileserver.js)\n", base);
+        return 2;
+    }
+    printf("Image %u bytes, chunk %u bytes, sha256 %s\n", m.size, OTA_CHUNK_SIZE, m.sha256);
+
+    hal::MemoryOtaPartition clean(OTA_TEST_PARTITION);
+    OtaRun a = runOtaDownload(m, m.url, clean, 0);
+    printOtaRun("clean", a, clean);
+    bool okClean = a.status == OTA_READY && clean.activatedSize == m.size && clean.bytesWritten == m.size;
+
+    hal::MemoryOtaPartition resumed(OTA_TEST_PARTITION);
+    OtaRun b = runOtaDownload(m, m.url + "?drop=3", resumed, m.size / 2);
+    printOtaRun("resume", b, resumed);
+    bool okResume = b.status == OTA_READY && resumed.activatedSize == m.size && b.retries > 0 &&
+                    b.resumedAt >= m.size / 2 && resumed.bytesWritten == m.size &&
+                    resumed.flash == clean.flash;
+
+    hal::MemoryOtaPartition corrupt(OTA_TEST_PARTITION);
+    OtaRun c = runOtaDownload(m, m.url + "?corrupt=1", corrupt, 0);
+    printOtaRun("corrupt", c, corrupt);
+    bool okCorrupt = c.status == OTA_FAILED && corrupt.activatedSize == 0 && !c.stateLeft;
+
+    hal::MemoryOtaPartition gone(OTA_TEST_PARTITION);
+    OtaRun g = runOtaDownload(m, m.url + ".gone", gone, 0);
+    printOtaRun("gone", g, gone);
+    bool okGone = g.status == OTA_FAILED && g.requests == OTA_MAX_FAILURES && gone.activatedSize == 0 && !g.stateLeft;
+
+    bool ok = okClean && okResume && okCorrupt && okGone;
+    printf("%s: clean %s, resume %s, corrupt image %s, missing image %s\n", ok ? "PASS" : "FAIL",
+           okClean ? "ok" : "FAILED", okResume ? "ok" : "FAILED", okCorrupt ? "rejected" : "NOT REJECTED",
+           okGone ? "dropped" : "NOT DROPPED");
+    if (m.patchUrl.empty()) return ok ? 0 : 1;
+
+    hal::MemoryOtaPartition delta(OTA_TEST_PARTITION);
+    if (!fetchOtaFile(std::string(base) + "/base.bin", delta.running)) {
+        printf("Cannot fetch %s/base.bin\n", base);
+        return 2;
+    }
+    OtaRun d = runOtaDownload(m, m.patchUrl + "?drop=3", delta, m.patchSize / 2, true);
+    printOtaRun("delta", d, delta);
+    printf("             %u patch bytes instead of %u (%.1f%%)\n", m.patchSize, m.size, 100.0 * m.patchSize / m.size);
+    bool okDelta = d.status == OTA_READY && d.fallbacks == 0 && delta.activatedSize == m.size &&
+                   delta.flash == clean.flash;
+
+    hal::MemoryOtaPartition other(OTA_TEST_PARTITION);
+    other.running = delta.running;
+    other.running[other.running.size() / 2] ^= 0xFF;
+    OtaRun o = runOtaDownload(m, m.patchUrl, other, 0, true);
+    printOtaRun("base", o, other);
+    bool okBase = o.status == OTA_FAILED && o.requests == 0 && other.activatedSize == 0;
+
+    hal::MemoryOtaPartition fallback(OTA_TEST_PARTITION);
+    fallback.running = delta.running;
+    OtaRun f = runOtaDownload(m, m.patchUrl + "?corrupt=1", fallback, m.patchSize / 4, true);
+    printOtaRun("fallback", f, fallback);
+    bool okFallback = f.status == OTA_READY && f.fallbacks == 1 && fallback.activatedSize == m.size &&
+                      fallback.flash == clean.flash;
+
+    bool okAll = ok && okDelta && okBase && okFallback;
+    printf("%s: delta %s, patch for another base %s, corrupt patch %s\n", okAll ? "PASS" : "FAIL",
+           okDelta ? "ok" : "FAILED", okBase ? "refused" : "NOT REFUSED",
+           okFallback ? "replaced by the full image" : "NOT REPLACED");
+    return okAll ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef OUTAGE_TEST_H
+#define OUTAGE_TEST_H
+
+#include <stdio.h>
+#include "hal/NativeHal.h"
+#include "BellScheduler.h"
+#include "ConnectivityManager.h"
+#include "StallTest.h" // everyMinuteSchedule()
+
+// ==========================================
+// WIFI OUTAGE TEST
+// ==========================================
+//
+// Two simulated hours, polled every OUTAGE_POLL_MS, with a schedule that
+// rings every minute. The AP disappears for 30 minutes and later for 1
+// minute. A simulated WiFi driver answers connection attempts: link up
+// after 2 s if the AP is there, or a disconnect event after 3 s if not.
+//
+//   managed   ConnectivityManager + BellScheduler in one loop; nothing waits
+//   legacy    the old loop: WiFi.reconnect(); delay(5000); return; while
+//             offline, with the buzzer shut-off in the same loop
+//
+// Checks for the managed run:
+//   - every minute rang within one poll of its boundary;
+//   - the buzzer never ran past BELL_MS plus one poll;
+//   - retries backed off (bounded attempts during the long outage);
+//   - it was back online within BACKOFF_MAX_MS + connect time of the AP
+//     returning.
+//
+// Returns 0 if the managed run passed.
+
+static const uint32_t OUTAGE_POLL_MS = 10;
+static const uint32_t OUTAGE_RUN_MS = 120 * 60 * 1000;
+static const uint32_t OUTAGE_BELL_MS = 5000;
+static const uint32_t OUTAGE_CONNECT_MS = 2000;
+static const uint32_t OUTAGE_NO_AP_MS = 3000;
+static const uint32_t OUTAGE_WINDOWS[][2] = {{20 * 60 * 1000, 50 * 60 * 1000}, {70 * 60 * 1000, 71 * 60 * 1000}};
+
+struct OutageResult {
+    uint32_t minutes = 0;
+    uint32_t fires = 0;
+    uint32_t maxLateMs = 0;
+    uint32_t maxBuzzMs = 0;
+    uint32_t attemptsInLongOutage = 0;
+    uint32_t maxReconnectMs = 0; // AP back -> online
+};
+
+static bool outageApUp(uint32_t ms) {
+    for (const auto& w : OUTAGE_WINDOWS) {
+        if (ms >= w[0] && ms < w[1]) return false;
+    }
+    return true;
+}
+
+static OutageResult runOutage(bool managed) {
+    hal::SimClock clock;
+    hal::FakeGpio gpio;
+    hal::FakeDFPlayer player;
+    BellScheduler sched(clock, gpio, player, STALL_BUZZER_PIN, OUTAGE_BELL_MS);
+    sched.publish(everyMinuteSchedule());
+    ConnectivityManager conn(0x5eed);
+
+    OutageResult r;
+    bool link = true;
+    conn.linkUp();
+    uint32_t attemptEndsAt = 0; // Simulated driver: when the pending attempt resolves, 0 = none
+    uint32_t apBackAt = 0;
+    uint32_t buzzStart = 0;
+    uint32_t lastFires = 0;
+    uint16_t polledMinute = BellScheduler::NO_MINUTE;
+
+    while (clock.millis() < OUTAGE_RUN_MS) {
+        uint32_t now = clock.millis();
+        bool ap = outageApUp(now);
+
+        // WiFi driver
+        if (link && !ap) {
+            link = false;
+            conn.linkDown();
+        }
+        if (!ap) apBackAt = 0;
+        else if (!apBackAt && !link) apBackAt = now;
+        if (attemptEndsAt && now >= attemptEndsAt) {
+            attemptEndsAt = 0;
+            if (ap) {
+                link = true;
+                conn.linkUp();
+            } else {
+                conn.linkDown();
+            }
+        }
+
+        // Bells. The legacy loop returned before its minute check while
+        // offline, so it only saw the buzzer shut-off; polling the same
+        // minute again does exactly that.
+        uint32_t minute = now / 60000;
+        if (managed || link) polledMinute = (uint16_t)(minute % MINUTES_PER_WEEK);
+        sched.poll(polledMinute);
+        if (sched.stats().fires.load() != lastFires) {
+            lastFires = sched.stats().fires.load();
+            r.fires++;
+            uint32_t late = now - minute * 60000;
+            if (late > r.maxLateMs) r.maxLateMs = late;
+        }
+        r.minutes = minute + 1;
+        if (gpio.tones[STALL_BUZZER_PIN] && !buzzStart) buzzStart = now;
+        if (!gpio.tones[STALL_BUZZER_PIN]) buzzStart = 0;
+        if (buzzStart && now - buzzStart > r.maxBuzzMs) r.maxBuzzMs = now - buzzStart;
+
+        // Network
+        if (managed) {
+            if (conn.update(now) == CONN_ATTEMPT) {
+                attemptEndsAt = now + (ap ? OUTAGE_CONNECT_MS : OUTAGE_NO_AP_MS);
+                if (now >= OUTAGE_WINDOWS[0][0] && now < OUTAGE_WINDOWS[0][1]) r.attemptsInLongOutage++;
+            }
+            if (conn.changed() && conn.online() && apBackAt) {
+                if (now - apBackAt > r.maxReconnectMs) r.maxReconnectMs = now - apBackAt;
+                apBackAt = 0;
+            }
+            clock.delay(OUTAGE_POLL_MS);
+        } else if (!link) {
+            if (now >= OUTAGE_WINDOWS[0][0] && now < OUTAGE_WINDOWS[0][1]) r.attemptsInLongOutage++;
+            if (ap) { // WiFi.reconnect() lands during the delay
+                link = true;
+                conn.linkUp();
+                if (apBackAt && now + 5000 - apBackAt > r.maxReconnectMs) r.maxReconnectMs = now + 5000 - apBackAt;
+                apBackAt = 0;
+            }
+            clock.delay(5000);
+        } else {
+            clock.delay(OUTAGE_POLL_MS);
+        }
+    }
+
+    ScheduleIndex* old;
+    while (sched.retired().pop(old)) delete old;
+    return r;
+}
+
+static void printOutage(const char* name, const OutageResult& r) {
+    printf("outage/%-8s %u/%u minutes rang, late by max %u ms, buzzer on max %u ms, "
+           "%u attempts in the 30 min outage, back online max %u ms after the AP\n",
+           name, r.fires, r.minutes, r.maxLateMs, r.maxBuzzMs, r.attemptsInLongOutage, r.maxReconnectMs);
+}
+
+static int runOutageTest() {
+    printf("AP down 20-50 min and 70-71 min, bell %u ms, poll %u ms\n", OUTAGE_BELL_MS, OUTAGE_POLL_MS);
+    OutageResult legacy = runOutage(false);
+    printOutage("legacy", legacy);
+    OutageResult managed = runOutage(true);
+    printOutage("managed", managed);
+
+    bool ok = managed.fires == managed.minutes && managed.maxLateMs <= OUTAGE_POLL_MS &&
+              managed.maxBuzzMs <= OUTAGE_BELL_MS + OUTAGE_POLL_MS && managed.attemptsInLongOutage <= 20 &&
+              managed.maxReconnectMs <= ConnectivityManager::BACKOFF_MAX_MS + OUTAGE_CONNECT_MS + OUTAGE_POLL_MS;
+    printf("%s: bells %s during the outage\n", ok ? "PASS" : "FAIL", ok ? "kept time" : "were late or missed");
+    return ok ? 0 : 1;
+}
+
+#endif
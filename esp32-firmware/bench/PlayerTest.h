@@ -0,0 +1,199 @@
+#ifndef PLAYER_TEST_H
+#define PLAYER_TEST_H
+
+#include <stdio.h>
+#include <vector>
+#include "hal/NativeHal.h"
+#include "DFPlayerDriver.h"
+
+// ==========================================
+// DFPLAYER DRIVER TEST
+// ==========================================
+//
+// DFPlayerDriver against FakeDFPlayerModule on simulated time, polled every
+// PLAYER_TEST_POLL_MS like the scheduler task does:
+//
+//   clean    20 bells (play / playFile alternately), 5 s apart
+//   lossy    the same, with every 3rd frame to the module lost and every
+//            5th frame from it corrupted
+//   busy     the module is still reading its card for the first 1.5 s;
+//            begin(), volume() and a bell are queued at power-up
+//   nocard   no card: begin() reports it, a bell fails with the module's
+//            error; then the card is inserted and the next bell plays
+//   burst    10 RINGs in one pass, then a STOP, then a bell
+//
+// Checks:
+//   - no call into the driver moved the clock (nothing waits);
+//   - every bell that could play was confirmed playing, within
+//     PLAYER_TEST_MAX_LATENCY_MS of play() (with retries: within the
+//     retry budget), and its end was reported once;
+//   - lossy: lost and corrupted frames were retried, nothing failed;
+//   - busy / nocard: the failures and card changes were reported;
+//   - burst: only the last of the 10 RINGs reached the module.
+//
+// Returns 0 if all passed.
+
+static const uint32_t PLAYER_TEST_POLL_MS = 10; // SCHEDULER_PERIOD_MS
+static const uint32_t PLAYER_TEST_MAX_LATENCY_MS = 150;
+
+struct PlayerRun {
+    uint32_t playing = 0;
+    uint32_t finished = 0;
+    uint32_t failed = 0;
+    uint16_t lastError = 0;
+    int cardOnline = -1;   // Last DF_EVENT_CARD
+    uint32_t cardEvents = 0;
+    uint32_t minLatencyUs = UINT32_MAX;
+    uint32_t maxLatencyUs = 0;
+    uint64_t totalLatencyUs = 0;
+    bool waited = false;   // A driver call advanced the clock
+};
+
+// Polls for `ms` of simulated time and collects the events
+static void pumpPlayer(DFPlayerDriver& driver, hal::SimClock& clock, uint32_t ms, PlayerRun& r) {
+    for (uint32_t t = 0; t < ms; t += PLAYER_TEST_POLL_MS) {
+        uint64_t before = clock.micros();
+        driver.poll();
+        if (clock.micros() != before) r.waited = true;
+        DFEvent e;
+        while (driver.events().pop(e)) {
+            switch (e.type) {
+                case DF_EVENT_PLAYING:
+                    r.playing++;
+                    r.totalLatencyUs += e.latencyUs;
+                    if (e.latencyUs < r.minLatencyUs) r.minLatencyUs = e.latencyUs;
+                    if (e.latencyUs > r.maxLatencyUs) r.maxLatencyUs = e.latencyUs;
+                    break;
+                case DF_EVENT_FINISHED:
+                    r.finished++;
+                    break;
+                case DF_EVENT_FAILED:
+                    r.failed++;
+                    r.lastError = e.error;
+                    break;
+                case DF_EVENT_CARD:
+                    r.cardOnline = e.param;
+                    r.cardEvents++;
+                    break;
+            }
+        }
+        clock.delay(PLAYER_TEST_POLL_MS);
+    }
+}
+
+// Queues one call and notes whether it waited
+template <typename F>
+static void callPlayer(hal::SimClock& clock, PlayerRun& r, F&& call) {
+    uint64_t before = clock.micros();
+    call();
+    if (clock.micros() != before) r.waited = true;
+}
+
+static PlayerRun runPlayerBells(hal::FakeDFPlayerModule& module, hal::SimClock& clock, DFPlayerDriver& driver,
+                                uint32_t bells) {
+    PlayerRun r;
+    callPlayer(clock, r, [&] { driver.begin(); });
+    callPlayer(clock, r, [&] { driver.volume(20); });
+    pumpPlayer(driver, clock, 500, r);
+    for (uint32_t i = 0; i < bells; i++) {
+        uint16_t track = (uint16_t)(1 + i % module.tracks);
+        callPlayer(clock, r, [&] { i % 2 ? driver.playFile(track) : driver.play(track); });
+        pumpPlayer(driver, clock, 5000, r);
+    }
+    return r;
+}
+
+static void printPlayer(const char* name, const PlayerRun& r, const DFPlayerDriver& driver,
+                        const hal::FakeDFPlayerModule& module) {
+    const DFPlayerStats& s = driver.stats();
+    printf("player/%-6s %u playing, %u finished, %u failed; latency min %.1f avg %.1f max %.1f ms; "
+           "%u retries, %u bad frames, %u frames to the module%s\n",
+           name, r.playing, r.finished, r.failed, r.playing ? r.minLatencyUs / 1000.0 : 0.0,
+           r.playing ? r.totalLatencyUs / 1000.0 / r.playing : 0.0, r.maxLatencyUs / 1000.0, s.retries.load(),
+           s.badFrames.load(), module.frames, r.waited ? ", WAITED" : "");
+}
+
+static int runPlayerTest() {
+    printf("Polled every %u ms; module answers in 15 ms and starts a track 80 ms after the command\n",
+           PLAYER_TEST_POLL_MS);
+    const uint32_t bells = 20;
+
+    hal::SimClock c1;
+    hal::FakeDFPlayerModule m1(c1);
+    DFPlayerDriver d1(m1, c1);
+    PlayerRun a = runPlayerBells(m1, c1, d1, bells);
+    printPlayer("clean", a, d1, m1);
+    bool okClean = !a.waited && a.playing == bells && a.finished == bells && a.failed == 0 && a.cardOnline == 1 &&
+                   a.maxLatencyUs <= PLAYER_TEST_MAX_LATENCY_MS * 1000 && m1.volume == 20;
+
+    hal::SimClock c2;
+    hal::FakeDFPlayerModule m2(c2);
+    m2.dropEvery = 3;
+    m2.garbleEvery = 5;
+    DFPlayerDriver d2(m2, c2);
+    PlayerRun b = runPlayerBells(m2, c2, d2, bells);
+    printPlayer("lossy", b, d2, m2);
+    const uint32_t retryBudgetMs = DF_MAX_ATTEMPTS * (DF_ACK_TIMEOUT_MS + PLAYER_TEST_POLL_MS) + DF_ACK_TIMEOUT_MS +
+                                   PLAYER_TEST_MAX_LATENCY_MS;
+    bool okLossy = !b.waited && b.playing == bells && b.failed == 0 && d2.stats().retries.load() > 0 &&
+                   d2.stats().badFrames.load() > 0 && b.maxLatencyUs <= retryBudgetMs * 1000;
+
+    hal::SimClock c3;
+    hal::FakeDFPlayerModule m3(c3);
+    m3.busyUntilMs = 1500;
+    DFPlayerDriver d3(m3, c3);
+    PlayerRun c;
+    callPlayer(c3, c, [&] { d3.begin(); });
+    callPlayer(c3, c, [&] { d3.volume(20); });
+    callPlayer(c3, c, [&] { d3.play(1); });
+    pumpPlayer(d3, c3, 5000, c);
+    printPlayer("busy", c, d3, m3);
+    bool okBusy = !c.waited && c.playing == 1 && c.failed == 0 && c.cardOnline == 1 && m3.volume == 20 &&
+                  c.maxLatencyUs >= m3.busyUntilMs * 1000;
+
+    hal::SimClock c4;
+    hal::FakeDFPlayerModule m4(c4);
+    m4.card = false;
+    DFPlayerDriver d4(m4, c4);
+    PlayerRun d;
+    callPlayer(c4, d, [&] { d4.begin(); });
+    pumpPlayer(d4, c4, 500, d);
+    bool reportedMissing = d.cardOnline == 0;
+    callPlayer(c4, d, [&] { d4.play(1); });
+    pumpPlayer(d4, c4, 1000, d);
+    bool failedFast = d.failed == 1 && d.lastError != 0 && d4.idle();
+    m4.insertCard(true);
+    pumpPlayer(d4, c4, 500, d);
+    callPlayer(c4, d, [&] { d4.play(1); });
+    pumpPlayer(d4, c4, 5000, d);
+    printPlayer("nocard", d, d4, m4);
+    bool okNoCard = !d.waited && reportedMissing && failedFast && d.cardOnline == 1 && d.cardEvents == 2 &&
+                    d.playing == 1 && d.finished == 1;
+
+    hal::SimClock c5;
+    hal::FakeDFPlayerModule m5(c5);
+    DFPlayerDriver d5(m5, c5);
+    PlayerRun e;
+    callPlayer(c5, e, [&] { d5.begin(); });
+    pumpPlayer(d5, c5, 500, e);
+    callPlayer(c5, e, [&] {
+        for (uint16_t i = 1; i <= 10; i++) d5.play(i);
+    });
+    pumpPlayer(d5, c5, 1000, e);
+    bool onlyLast = m5.plays == 1 && m5.lastTrack == 10;
+    callPlayer(c5, e, [&] { d5.stop(); });
+    pumpPlayer(d5, c5, 500, e);
+    callPlayer(c5, e, [&] { d5.play(3); });
+    pumpPlayer(d5, c5, 5000, e);
+    printPlayer("burst", e, d5, m5);
+    bool okBurst = !e.waited && onlyLast && m5.stops == 1 && m5.lastTrack == 3 && e.playing == 2 &&
+                   e.finished == 1 && d5.stats().dropped.load() == 0 && d5.stats().superseded.load() == 9;
+
+    bool ok = okClean && okLossy && okBusy && okNoCard && okBurst;
+    printf("%s: clean %s, lossy %s, busy %s, nocard %s, burst %s\n", ok ? "PASS" : "FAIL", okClean ? "ok" : "FAILED",
+           okLossy ? "ok" : "FAILED", okBusy ? "ok" : "FAILED", okNoCard ? "ok" : "FAILED",
+           okBurst ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+#endif
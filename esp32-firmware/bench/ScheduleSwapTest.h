@@ -0,0 +1,162 @@
+#ifndef SCHEDULE_SWAP_TEST_H
+#define SCHEDULE_SWAP_TEST_H
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <ArduinoJson.h>
+#include "hal/NativeHal.h"
+#include "BellScheduler.h"
+#include "DeviceApi.h"
+#include "StallTest.h" // STALL_BUZZER_PIN
+
+// ==========================================
+// SCHEDULE SWAP TEST
+// ==========================================
+//
+// Two parts:
+//
+//   validate   compileSchedules() on get_device_config bodies with one bad
+//              entry each (time, days, duration) or no array at all. Each
+//              must be rejected with the right status and leave the index
+//              it was compiling into as it was.
+//   swap       the network side publishes a new index as fast as it can
+//              on its own thread while the scheduler side polls every
+//              minute, for SWAP_WEEKS weeks and at least SWAP_SCHEDULES
+//              published indexes. Every index rings every minute,
+//              so a poll that saw a missing or half-built timetable shows
+//              up as a missed bell. Replaced indexes are deleted as they
+//              come back through retired(), as in main.cpp.
+//
+// Returns 0 if every case was rejected correctly and no bell was missed.
+// Build with -fsanitize=thread or address to also catch a swap that reads
+// freed or unpublished memory.
+
+static const uint32_t SWAP_WEEKS = 20;
+static const uint32_t SWAP_SCHEDULES = 500;
+
+struct SwapCase {
+    const char* name;
+    const char* json;
+    ScheduleStatus expected;
+};
+
+static const SwapCase SWAP_CASES[] = {
+    {"valid", "{\"schedules\":[{\"bell_time\":\"08:30:00\",\"days_of_week\":[1,2,3,4,5],\"duration\":10,"
+              "\"audio_url\":\"a.mp3\"},{\"bell_time\":\"9:05\",\"days_of_week\":[],\"duration\":null}]}",
+     SCHEDULE_OK},
+    {"missing", "{\"config_hash\":\"x\"}", SCHEDULE_NOT_ARRAY},
+    {"object", "{\"schedules\":{\"bell_time\":\"08:30\"}}", SCHEDULE_NOT_ARRAY},
+    {"hour", "{\"schedules\":[{\"bell_time\":\"24:00:00\",\"days_of_week\":[1]}]}", SCHEDULE_BAD_TIME},
+    {"minute", "{\"schedules\":[{\"bell_time\":\"08:60\",\"days_of_week\":[1]}]}", SCHEDULE_BAD_TIME},
+    {"trailing", "{\"schedules\":[{\"bell_time\":\"08:30pm\",\"days_of_week\":[1]}]}", SCHEDULE_BAD_TIME},
+    {"notime", "{\"schedules\":[{\"days_of_week\":[1]}]}", SCHEDULE_BAD_TIME},
+    {"nodays", "{\"schedules\":[{\"bell_time\":\"08:30\"}]}", SCHEDULE_BAD_DAYS},
+    {"day7", "{\"schedules\":[{\"bell_time\":\"08:30\",\"days_of_week\":[1,7]}]}", SCHEDULE_BAD_DAYS},
+    {"daytext", "{\"schedules\":[{\"bell_time\":\"08:30\",\"days_of_week\":[\"1\"]}]}", SCHEDULE_BAD_DAYS},
+    {"negative", "{\"schedules\":[{\"bell_time\":\"08:30\",\"days_of_week\":[1],\"duration\":-5}]}",
+     SCHEDULE_BAD_DURATION},
+    {"long", "{\"schedules\":[{\"bell_time\":\"08:30\",\"days_of_week\":[1],\"duration\":70000}]}",
+     SCHEDULE_BAD_DURATION},
+    {"last", "{\"schedules\":[{\"bell_time\":\"07:00\",\"days_of_week\":[1]},"
+             "{\"bell_time\":\"08:00\",\"days_of_week\":[1]},{\"bell_time\":\"8\",\"days_of_week\":[1]}]}",
+     SCHEDULE_BAD_TIME},
+};
+
+static bool runSwapValidate() {
+    bool ok = true;
+    for (const SwapCase& c : SWAP_CASES) {
+        JsonDocument doc;
+        deserializeJson(doc, c.json, DeserializationOption::Filter(scheduleFilter()));
+
+        // Compile into an index that already holds a timetable
+        ScheduleIndex out;
+        ScheduleIndexBuilder b;
+        b.add(12, 0, 0x7F, 0, nullptr);
+        b.build(out);
+
+        size_t badEntry = 0;
+        ScheduleStatus status = compileSchedules(doc["schedules"].as<JsonArrayConst>(), out, &badEntry);
+        bool pass = status == c.expected;
+        if (status == SCHEDULE_OK) pass = pass && out.entryCount() == 2 && out.fireCount() == 5;
+        else pass = pass && out.entryCount() == 1 && out.fireCount() == 7 && out.fires(12 * 60);
+        if (!pass) {
+            printf("swap/validate/%-9s FAIL: %s (entry %u), expected %s, index has %u entries\n", c.name,
+                   scheduleStatusName(status), (unsigned)badEntry, scheduleStatusName(c.expected),
+                   (unsigned)out.entryCount());
+        }
+        ok = ok && pass;
+    }
+    printf("swap/validate %s: %u cases\n", ok ? "PASS" : "FAIL", (unsigned)(sizeof(SWAP_CASES) / sizeof(SWAP_CASES[0])));
+    return ok;
+}
+
+// A bell in every minute of the week, `duration` seconds long
+static ScheduleIndex* everyMinute(uint16_t duration) {
+    ScheduleIndexBuilder b;
+    b.reserve(MINUTES_PER_DAY);
+    for (int m = 0; m < MINUTES_PER_DAY; m++) b.add(m / 60, m % 60, 0x7F, duration, "bell.mp3");
+    ScheduleIndex* index = new ScheduleIndex();
+    b.build(*index);
+    return index;
+}
+
+static bool runSwapThreads() {
+    hal::SimClock mono;
+    hal::FakeGpio gpio;
+    hal::FakeDFPlayer player;
+    BellScheduler sched(mono, gpio, player, STALL_BUZZER_PIN, 5000);
+    sched.publish(everyMinute(1));
+
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> published(0);
+    uint32_t deleted = 0;
+    std::thread network([&]() {
+        uint16_t duration = 2;
+        while (!done.load(std::memory_order_relaxed)) {
+            ScheduleIndex* old;
+            while (sched.retired().pop(old)) {
+                delete old;
+                deleted++;
+            }
+            BellEvent e;
+            while (sched.events().pop(e)) {}
+
+            ScheduleIndex* next = everyMinute(duration);
+            if (sched.publish(next)) {
+                published.fetch_add(1, std::memory_order_relaxed);
+                duration = duration % 60 + 1;
+            } else {
+                delete next;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t minutes = 0;
+    while (minutes < SWAP_WEEKS * MINUTES_PER_WEEK || published.load(std::memory_order_relaxed) < SWAP_SCHEDULES) {
+        mono.advance(60ULL * 1000000);
+        sched.poll((uint16_t)(minutes++ % MINUTES_PER_WEEK));
+    }
+    done.store(true);
+    network.join();
+
+    ScheduleIndex* old;
+    while (sched.retired().pop(old)) {
+        delete old;
+        deleted++;
+    }
+    uint32_t fires = sched.stats().fires.load();
+    bool ok = fires == minutes;
+    printf("swap/threads  %s: %u/%u bells, %u schedules published and %u freed during the run\n", ok ? "PASS" : "FAIL",
+           fires, minutes, published.load(), deleted);
+    return ok;
+}
+
+static int runScheduleSwapTest() {
+    bool ok = runSwapValidate();
+    ok = runSwapThreads() && ok;
+    return ok ? 0 : 1;
+}
+
+#endif
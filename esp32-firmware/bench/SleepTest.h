@@ -0,0 +1,174 @@
+#ifndef SLEEP_TEST_H
+#define SLEEP_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal/NativeHal.h"
+#include "BellScheduler.h"
+#include "ClockService.h"
+#include "SleepPlanner.h"
+#include "WallClock.h"
+#include "StallTest.h" // STALL_BUZZER_PIN
+
+// ==========================================
+// LIGHT SLEEP TEST
+// ==========================================
+//
+// The scheduler task's loop from main.cpp (planned waits, RTC reads at SQW
+// edges, the skipped edge after a sleep) over two school days on simulated
+// time, with a DS3231 that keeps true time and an oscillator that runs
+// SLEEP_AWAKE_PPM fast while awake:
+//
+//   awake    waits SLEEP_POLL_MS or for the next edge, as without sleep
+//   fast     sleeps between bells; the sleep timer runs SLEEP_CLOCK_PPM fast
+//   slow     ... and SLEEP_CLOCK_PPM slow (SleepPlanner's assumed worst case)
+//
+// Edges that come while asleep are lost. The network task counts as always
+// waiting, so "asleep" is the scheduler's own share. Each bell's start is
+// compared against the true minute boundary.
+//
+// Passes if every bell rang in every run and no sleeping run rang further
+// from its boundary than one poll period plus 1 ms, which is where the
+// awake run already is.
+
+static const uint64_t SLEEP_POLL_MS = 10;
+static const int64_t SLEEP_AWAKE_PPM = 20;
+static const uint64_t SLEEP_RUN_US = 48ULL * 3600 * 1000000;
+static const int64_t SLEEP_START_US = (1792368000LL + 6 * 3600) * 1000000; // Mon 2026-10-19 06:00 local
+static const uint32_t SLEEP_BELL_MS = 5000;
+static const uint64_t SLEEP_REVALIDATE_MS = 10 * 60 * 1000;
+static const uint64_t SLEEP_SQW_RESUME_US = 2500000;
+
+struct SleepResult {
+    uint32_t bells = 0;
+    int64_t maxSkewUs = 0;     // Signed skew with the largest magnitude
+    uint64_t asleepUs = 0;
+    uint64_t monoUs = 0;
+    uint32_t sleeps = 0;
+    uint32_t maxOffsetUs = 0;  // Clock error found by the RTC read after a sleep
+    uint32_t maxWaitMs = 0;
+};
+
+static ScheduleIndex* schoolDaySchedule() {
+    ScheduleIndexBuilder b;
+    static const int times[][2] = {{7, 45}, {8, 30}, {9, 15}, {10, 0}, {10, 45}, {11, 30}, {12, 15}, {13, 0}, {13, 45}};
+    for (const auto& t : times) b.add(t[0], t[1], 0x3E, 0, nullptr); // Mon-Fri
+    ScheduleIndex* index = new ScheduleIndex();
+    b.build(*index);
+    return index;
+}
+
+static SleepResult runSleep(bool sleeping, int64_t sleepPpm) {
+    hal::SimClock mono; // The ESP32's monotonic clock
+    hal::FakeGpio gpio;
+    hal::FakeDFPlayer player;
+    hal::FakePower power;
+    BellScheduler sched(mono, gpio, player, STALL_BUZZER_PIN, SLEEP_BELL_MS);
+    ClockService clock;
+    SleepPlanner planner(power);
+    sched.publish(schoolDaySchedule());
+    planner.sleep(SLEEP_NETWORK, 0, 0);
+
+    SleepResult r;
+    uint64_t t = 0; // True time since SLEEP_START_US
+    auto advance = [&](uint64_t trueUs, int64_t ppm) {
+        t += trueUs;
+        mono.advance(trueUs + (int64_t)trueUs * ppm / 1000000);
+    };
+    auto rtcSample = [&]() {
+        ClockSample s = {SLEEP_START_US + (int64_t)t, mono.micros(), 1000};
+        clock.discipline(s, mono.micros());
+    };
+    rtcSample(); // At an edge: the run starts on a whole second
+
+    uint64_t lastRtcRead = 0, lastSyncUs = 0, awakeSinceUs = 0, lastEdgeUs = 0;
+    bool resync = false;
+    uint32_t skipEdges = 0;
+    uint32_t waitMs = SLEEP_POLL_MS;
+    uint32_t fires = 0;
+    while (t < SLEEP_RUN_US) {
+        bool planned = waitMs > SLEEP_POLL_MS;
+        bool edge = false;
+        if (planned) {
+            sched.plannedWait();
+            planner.sleep(SLEEP_SCHEDULER, mono.micros(), waitMs);
+            r.sleeps++;
+            if (waitMs > r.maxWaitMs) r.maxWaitMs = waitMs;
+            advance((uint64_t)waitMs * 1000 * 1000000 / (1000000 + SLEEP_AWAKE_PPM + sleepPpm), SLEEP_AWAKE_PPM + sleepPpm);
+            planner.wake(SLEEP_SCHEDULER, mono.micros(), true);
+            if (mono.micros() - lastEdgeUs > WallClock::TICK_TIMEOUT_US) {
+                resync = true;
+                skipEdges = 1;
+                awakeSinceUs = mono.micros();
+            }
+        } else {
+            uint64_t toEdge = 1000000 - t % 1000000;
+            uint64_t toTimer = SLEEP_POLL_MS * 1000 * 1000000 / (1000000 + SLEEP_AWAKE_PPM);
+            edge = toEdge <= toTimer;
+            advance(edge ? toEdge : toTimer, SLEEP_AWAKE_PPM);
+            if (edge) lastEdgeUs = mono.micros();
+        }
+        uint64_t now = mono.micros();
+        if (edge && skipEdges) {
+            skipEdges--;
+            edge = false;
+        }
+
+        bool sqw = now - lastEdgeUs <= WallClock::TICK_TIMEOUT_US || (resync && now - awakeSinceUs < SLEEP_SQW_RESUME_US);
+        bool due = resync || now / 1000 - lastRtcRead >= SLEEP_REVALIDATE_MS;
+        if (due && edge && sqw) {
+            lastRtcRead = now / 1000;
+            rtcSample();
+            if (resync) {
+                uint32_t offset = (uint32_t)llabs(clock.lastOffsetUs());
+                if (offset > r.maxOffsetUs) r.maxOffsetUs = offset;
+            }
+            lastSyncUs = now;
+            resync = false;
+        }
+
+        sched.poll(clock.minuteOfWeek(now));
+        if (sched.stats().fires.load() != fires) {
+            fires = sched.stats().fires.load();
+            r.bells++;
+            int64_t into = (SLEEP_START_US + (int64_t)t) % 60000000;
+            int64_t skew = into < 30000000 ? into : into - 60000000;
+            if (llabs(skew) > llabs(r.maxSkewUs)) r.maxSkewUs = skew;
+        }
+
+        waitMs = SLEEP_POLL_MS;
+        if (sleeping && sched.idle()) {
+            uint32_t wait = SleepPlanner::schedulerWaitMs(sched, clock, now, now - lastSyncUs);
+            uint64_t sinceRead = now / 1000 - lastRtcRead;
+            uint32_t untilRead = sinceRead >= SLEEP_REVALIDATE_MS ? 0 : (uint32_t)(SLEEP_REVALIDATE_MS - sinceRead);
+            if (untilRead < wait) wait = untilRead;
+            if (wait > waitMs) waitMs = wait;
+        }
+    }
+    r.monoUs = mono.micros();
+    r.asleepUs = planner.asleepUs(r.monoUs);
+
+    ScheduleIndex* old;
+    while (sched.retired().pop(old)) delete old;
+    return r;
+}
+
+static bool printSleep(const char* name, const SleepResult& r, uint32_t expectedBells) {
+    bool ok = r.bells == expectedBells && llabs(r.maxSkewUs) <= (int64_t)SLEEP_POLL_MS * 1000 + 1000;
+    printf("sleep/%-6s %s: %u/%u bells, worst skew %+.2f ms, asleep %.1f %% in %u waits (longest %u ms), "
+           "clock off by max %.2f ms after a sleep\n",
+           name, ok ? "PASS" : "FAIL", r.bells, expectedBells, r.maxSkewUs / 1000.0,
+           r.monoUs ? 100.0 * r.asleepUs / r.monoUs : 0.0, r.sleeps, r.maxWaitMs, r.maxOffsetUs / 1000.0);
+    return ok;
+}
+
+static int runSleepTest() {
+    const uint32_t bells = 18; // Monday and Tuesday
+    printf("Two school days, %u bells, sleep timer off by up to %u ppm\n", bells, SleepPlanner::SLEEP_CLOCK_PPM);
+    bool ok = printSleep("awake", runSleep(false, 0), bells);
+    ok = printSleep("fast", runSleep(true, SleepPlanner::SLEEP_CLOCK_PPM), bells) && ok;
+    ok = printSleep("slow", runSleep(true, -(int64_t)SleepPlanner::SLEEP_CLOCK_PPM), bells) && ok;
+    return ok ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,398 @@
+#ifndef SOAK_TEST_H
+#define SOAK_TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <ArduinoJson.h>
+#include "Bench.h"
+#include "DeviceApi.h"
+#include "JsonArena.h"
+#include "Metrics.h"
+
+// ==========================================
+// HEAP SOAK TEST
+// ==========================================
+//
+// --soak-test [days] (default 30) runs the steady-state network loop on
+// simulated time: device_tick every 5 s with telemetry, a metrics snapshot
+// every 60 s, a command every hour (acked with the next tick) and a full
+// batch of 10 once a day. That is 17,280 polls a day. It runs twice, each
+// against SoakHeap, a first-fit model of the ESP32's free heap after WiFi
+// and TLS are up. Other subsystems hold blocks of random size and lifetime
+// in it the whole time:
+//
+//   before   the old request path: request body in a JsonDocument and a heap
+//            string, response in a default JsonDocument, plus HTTPClient's
+//            URL, header and response-line Strings (sizes approximated)
+//   after    DeviceApi as it is now (RequestBody, response in a JsonArena
+//            of TICK_ARENA_SIZE), as deviceTick() calls it
+//
+// The largest free block is sampled every hour. It reports the block count
+// and largest free block (first hour, minimum, end) for each run, and the
+// real heap allocations the "after" loop made (the malloc hook in main.cpp).
+//
+// Returns 0 if the after run made no heap allocation after its first tick,
+// its arena never spilled, and every command was acked.
+
+static const uint32_t SOAK_TICK_MS = 5000;
+static const uint32_t SOAK_METRICS_MS = 60 * 1000;
+static const uint32_t SOAK_TICKS_PER_HOUR = 3600 * 1000 / SOAK_TICK_MS;
+static const size_t SOAK_HEAP_SIZE = 110 * 1024;
+static const size_t SOAK_BACKGROUND_SLOTS = 256;
+
+// First-fit heap over one buffer, an 8-byte header per block; adjacent free
+// blocks are merged on free (forwards) and while searching. An
+// ArduinoJson::Allocator, so a JsonDocument can live in it.
+class SoakHeap : public ArduinoJson::Allocator {
+public:
+    explicit SoakHeap(size_t size) : mem(size / 8) {
+        Block* b = at(0);
+        b->size = (uint32_t)(mem.size() * 8);
+        b->used = 0;
+    }
+
+    void* allocate(size_t size) override {
+        uint32_t need = blockSize(size);
+        for (uint32_t off = 0; off < bytes(); off += at(off)->size) {
+            Block* b = at(off);
+            if (b->used) continue;
+            mergeAfter(off);
+            if (b->size < need) continue;
+            split(off, need);
+            b->used = 1;
+            blocks++;
+            return payload(off);
+        }
+        failures++;
+        return nullptr;
+    }
+
+    void deallocate(void* ptr) override {
+        if (!ptr) return;
+        uint32_t off = offsetOf(ptr);
+        at(off)->used = 0;
+        mergeAfter(off);
+    }
+
+    void* reallocate(void* ptr, size_t size) override {
+        if (!ptr) return allocate(size);
+        uint32_t off = offsetOf(ptr);
+        Block* b = at(off);
+        uint32_t need = blockSize(size);
+        if (b->size >= need) {
+            split(off, need);
+            return ptr;
+        }
+        uint32_t next = off + b->size;
+        if (next < bytes() && !at(next)->used) {
+            mergeAfter(next);
+            if (b->size + at(next)->size >= need) {
+                b->size += at(next)->size; // Grow into the free block behind it
+                split(off, need);
+                return ptr;
+            }
+        }
+        void* moved = allocate(size);
+        if (!moved) return nullptr;
+        memcpy(moved, ptr, b->size - HEADER);
+        deallocate(ptr);
+        return moved;
+    }
+
+    size_t largestFree() {
+        uint32_t best = 0;
+        for (uint32_t off = 0; off < bytes(); off += at(off)->size) {
+            if (at(off)->used) continue;
+            mergeAfter(off);
+            if (at(off)->size > best) best = at(off)->size;
+        }
+        return best > HEADER ? best - HEADER : 0;
+    }
+
+    uint64_t blocks = 0;   // Allocations served
+    uint32_t failures = 0; // Allocations that found no block
+
+private:
+    struct Block {
+        uint32_t size; // Including the header
+        uint32_t used;
+    };
+    static const uint32_t HEADER = sizeof(Block);
+
+    static uint32_t blockSize(size_t size) { return (uint32_t)((size + 7) & ~(size_t)7) + HEADER; }
+    uint32_t bytes() const { return (uint32_t)(mem.size() * 8); }
+    Block* at(uint32_t off) { return (Block*)((uint8_t*)mem.data() + off); }
+    void* payload(uint32_t off) { return (uint8_t*)mem.data() + off + HEADER; }
+    uint32_t offsetOf(void* ptr) { return (uint32_t)((uint8_t*)ptr - (uint8_t*)mem.data()) - HEADER; }
+
+    void mergeAfter(uint32_t off) {
+        Block* b = at(off);
+        while (off + b->size < bytes() && !at(off + b->size)->used) b->size += at(off + b->size)->size;
+    }
+
+    // Cuts the tail off a block if it is worth a block of its own
+    void split(uint32_t off, uint32_t need) {
+        Block* b = at(off);
+        if (b->size < need + HEADER + 16) return;
+        Block* rest = at(off + need);
+        rest->size = b->size - need;
+        rest->used = 0;
+        b->size = need;
+        mergeAfter(off + need);
+    }
+
+    std::vector<uint64_t> mem;
+};
+
+// Serves device_tick responses from a fixed buffer and counts the acks in
+// each request; allocates nothing per request
+class SoakHttpClient : public hal::HttpClient {
+public:
+    // Next response: `count` RING commands numbered from `firstId`
+    void serve(uint32_t firstId, size_t count) {
+        size_t n = snprintf(response, sizeof(response), "{\"commands\":[");
+        for (size_t i = 0; i < count; i++) {
+            n += snprintf(response + n, sizeof(response) - n,
+                          "%s{\"id\":%u,\"command\":\"RING\",\"payload\":{\"duration\":5}}", i ? "," : "",
+                          firstId + (uint32_t)i);
+        }
+        n += snprintf(response + n, sizeof(response) - n, "],\"config_stale\":false}");
+        len = n;
+    }
+
+    bool begin(const char*) override {
+        pos = 0;
+        return true;
+    }
+    void addHeader(const char*, const char*) override {}
+    int post(const char* body, size_t) override {
+        httpStats.requests++;
+        for (const char* p = body; (p = strstr(p, "\"executed\"")) != nullptr; p++) acked++;
+        return 200;
+    }
+    int get() override { return 404; }
+    int read() override { return pos < len ? (uint8_t)response[pos++] : -1; }
+    size_t readBytes(char* out, size_t length) override {
+        size_t n = std::min(length, len - pos);
+        memcpy(out, response + pos, n);
+        pos += n;
+        return n;
+    }
+    int32_t contentLength() override { return (int32_t)len; }
+    void end() override {}
+
+    uint32_t acked = 0;
+
+private:
+    char response[1024];
+    size_t len = 0;
+    size_t pos = 0;
+};
+
+// Other subsystems' blocks: log lines and frames that live for seconds to an
+// hour, now and then a buffer that stays for days
+class SoakBackground {
+public:
+    explicit SoakBackground(SoakHeap& heap) : heap(heap) {}
+
+    void step(uint32_t tick) {
+        for (Slot& s : slots) {
+            if (s.ptr && tick >= s.freeAt) {
+                heap.deallocate(s.ptr);
+                s.ptr = nullptr;
+            }
+        }
+        if (next() % 4 == 0) hold(16 + next() % 496, tick + 1 + next() % SOAK_TICKS_PER_HOUR);
+        if (next() % 2000 == 0) hold(1024 + next() % 7168, tick + SOAK_TICKS_PER_HOUR * (24 + next() % 48));
+    }
+
+private:
+    struct Slot {
+        void* ptr = nullptr;
+        uint32_t freeAt = 0;
+    };
+
+    void hold(size_t size, uint32_t freeAt) {
+        for (Slot& s : slots) {
+            if (s.ptr) continue;
+            s.ptr = heap.allocate(size);
+            s.freeAt = freeAt;
+            return;
+        }
+    }
+
+    uint32_t next() {
+        state = state * 1103515245u + 12345u;
+        return state >> 8;
+    }
+
+    SoakHeap& heap;
+    Slot slots[SOAK_BACKGROUND_SLOTS];
+    uint32_t state = 0x50A4;
+};
+
+struct SoakResult {
+    uint64_t blocks = 0;        // Model heap allocations by the poll path and everything else
+    size_t firstHourFree = 0;   // Largest free block after the first hour
+    size_t minFree = SIZE_MAX;
+    size_t endFree = 0;
+    uint32_t failures = 0;      // Allocations the model heap could not serve
+    uint64_t mallocs = 0;       // Real allocations after the first tick (after run only)
+    uint32_t commands = 0;
+    uint32_t acked = 0;
+    uint32_t spills = 0;
+    size_t arenaPeak = 0;
+};
+
+static void soakTelemetry(char* out, size_t size, uint32_t nowMs, uint32_t requests) {
+    snprintf(out, size,
+             "{\"rssi\":%d,\"free_heap\":%u,\"uptime_s\":%u,\"realtime\":false,\"http_requests\":%u,"
+             "\"http_failures\":0,\"sched_max_gap_us\":%u,\"journal_pending\":0,\"journal_lost\":0}",
+             -55 - (int)(nowMs / 5000 % 20), 180000u - nowMs / 100000 % 4096, nowMs / 1000, requests,
+             1200u + nowMs % 800);
+}
+
+// The old DeviceApi::tick() and HTTPClient's Strings, allocating from `heap`
+static int soakLegacyTick(SoakHeap& heap, DeviceApi& api, const char* deviceId, const char* telemetry,
+                          const char* metricsJson, const CommandAck* acks, size_t ackCount, JsonDocument& out) {
+    JsonDocument req(&heap);
+    req["p_device_id"] = deviceId;
+    req["p_status"] = "online";
+    req["p_config_hash"] = "0123456789abcdef0123456789abcdef";
+    req["p_telemetry"] = serialized(telemetry);
+    if (metricsJson) req["p_metrics"] = serialized(metricsJson);
+    if (ackCount) {
+        JsonArray list = req["p_acks"].to<JsonArray>();
+        for (size_t i = 0; i < ackCount; i++) {
+            JsonObject a = list.add<JsonObject>();
+            a["id"] = strtoll(acks[i].id, nullptr, 10);
+            a["status"] = acks[i].ok ? "executed" : "failed";
+            a["executed_at"] = acks[i].executedAt;
+        }
+    }
+    req["p_limit"] = 10;
+
+    size_t length = measureJson(req);
+    char* body = (char*)heap.allocate(length + 1);
+    if (!body) return -1;
+    serializeJson(req, body, length + 1);
+
+    // HTTPClient: URL parts, the header String grown by concatenation, then
+    // one String per response header line
+    void* uri = heap.allocate(48);
+    void* host = heap.allocate(40);
+    void* headers = heap.allocate(64);
+    headers = heap.reallocate(headers, 320);
+    headers = heap.reallocate(headers, 600);
+    int code = api.call("device_tick", body, &out);
+    for (int i = 0; i < 12; i++) heap.deallocate(heap.allocate(24 + (i * 13) % 64));
+    heap.deallocate(headers);
+    heap.deallocate(host);
+    heap.deallocate(uri);
+    heap.deallocate(body);
+    return code;
+}
+
+static SoakResult runSoak(bool after, uint32_t days) {
+    SoakHeap heap(SOAK_HEAP_SIZE);
+    SoakBackground background(heap);
+    SoakHttpClient http;
+    DeviceApi api(http, "https://soak.local", "soak-key");
+    static Metrics metrics;
+    MetricsReport report(metrics);
+    api.setMetrics(&metrics);
+    static JsonArena<TICK_ARENA_SIZE> arena;
+
+    const char* deviceId = "0b7c5f2e-9a41-4d7e-8c3a-2f6e1d9b8a70";
+    static char telemetry[640];
+    static char metricsJson[1536];
+    CommandAck acks[10];
+    size_t ackCount = 0;
+    uint32_t nextId = 1;
+    uint32_t lastMetricsMs = 0;
+    uint64_t mallocsBefore = 0;
+
+    SoakResult r;
+    uint32_t ticks = days * 24 * SOAK_TICKS_PER_HOUR;
+    for (uint32_t t = 0; t < ticks; t++) {
+        if (t == 1) mallocsBefore = allocStats().count; // First tick sets up statics
+        uint32_t nowMs = t * SOAK_TICK_MS;
+        background.step(t);
+
+        size_t count = t % (24 * SOAK_TICKS_PER_HOUR) == 100 ? 10 : t % SOAK_TICKS_PER_HOUR == 50 ? 1 : 0;
+        http.serve(nextId, count);
+        nextId += (uint32_t)count;
+        r.commands += (uint32_t)count;
+
+        soakTelemetry(telemetry, sizeof(telemetry), nowMs, http.stats().requests);
+        bool withMetrics = nowMs - lastMetricsMs >= SOAK_METRICS_MS && report.take(nowMs, metricsJson, sizeof(metricsJson));
+
+        JsonDocument doc(after ? (ArduinoJson::Allocator*)&arena : &heap);
+        int code = after ? api.tick(deviceId, "online", "0123456789abcdef0123456789abcdef", telemetry, acks, ackCount,
+                                    10, doc, withMetrics ? metricsJson : nullptr)
+                         : soakLegacyTick(heap, api, deviceId, telemetry, withMetrics ? metricsJson : nullptr, acks,
+                                          ackCount, doc);
+        if (code == 200) ackCount = 0;
+        for (JsonVariantConst item : doc["commands"].as<JsonArrayConst>()) {
+            Command cmd;
+            if (parseCommand(item, cmd) != COMMAND_OK || ackCount == 10) continue;
+            CommandAck& ack = acks[ackCount++];
+            snprintf(ack.id, sizeof(ack.id), "%s", cmd.id);
+            ack.ok = true;
+            ack.executedAt = 1769400000 + nowMs / 1000;
+        }
+        if (code == 200 && withMetrics) {
+            report.commit();
+            lastMetricsMs = nowMs;
+        }
+
+        if ((t + 1) % SOAK_TICKS_PER_HOUR == 0) {
+            size_t largest = heap.largestFree();
+            if (t + 1 == SOAK_TICKS_PER_HOUR) r.firstHourFree = largest;
+            if (largest < r.minFree) r.minFree = largest;
+            r.endFree = largest;
+        }
+    }
+    if (after) r.mallocs = allocStats().count - mallocsBefore;
+
+    // Last acks go out with one more tick
+    http.serve(nextId, 0);
+    JsonDocument doc(&arena);
+    api.tick(deviceId, "online", "", telemetry, acks, ackCount, 10, doc);
+
+    r.blocks = heap.blocks;
+    r.failures = heap.failures;
+    r.acked = http.acked;
+    r.spills = arena.spills();
+    r.arenaPeak = arena.peak();
+    return r;
+}
+
+static int runSoakTest(uint32_t days) {
+    printf("soak: %u days, device_tick every %u s, %u KB heap model\n", days, SOAK_TICK_MS / 1000,
+           (unsigned)(SOAK_HEAP_SIZE / 1024));
+    SoakResult results[2];
+    for (int after = 0; after < 2; after++) {
+        SoakResult& r = results[after];
+        r = runSoak(after != 0, days);
+        printf("soak/%-6s %llu heap blocks, largest free block %u KB after 1 h, min %u KB, %u KB at the end, "
+               "%u failed allocations\n",
+               after ? "after" : "before", (unsigned long long)r.blocks, (unsigned)(r.firstHourFree / 1024),
+               (unsigned)(r.minFree / 1024), (unsigned)(r.endFree / 1024), r.failures);
+    }
+    const SoakResult& a = results[1];
+    printf("soak/after  %llu real heap allocations after the first tick, arena peak %u of %u bytes, "
+           "%u spills, %u/%u commands acked\n",
+           (unsigned long long)a.mallocs, (unsigned)a.arenaPeak, (unsigned)TICK_ARENA_SIZE, a.spills, a.acked,
+           a.commands);
+
+    bool ok = a.mallocs == 0 && a.spills == 0 && a.acked == a.commands && a.failures == 0;
+    printf("%s: steady-state poll loop %s\n", ok ? "PASS" : "FAIL",
+           ok ? "made no heap allocations" : "allocated, spilled or lost an ack");
+    return ok ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef STALL_TEST_H
+#define STALL_TEST_H
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "hal/NativeHal.h"
+#include "BellScheduler.h"
+
+// ==========================================
+// NETWORK STALL TEST
+// ==========================================
+//
+// Runs BellScheduler against a schedule that rings every minute, with a
+// simulated minute of STALL_MINUTE_US, while a "network" thread submits
+// RINGs, publishes a new schedule and repeatedly stalls for STALL_US (a
+// slow TLS handshake). Measures how late each scheduled bell fires after
+// its minute boundary:
+//
+//   threaded    scheduler and network on separate threads (the firmware's
+//               task split); bells must stay within STALL_BOUND_US and
+//               none may be missed
+//   single-loop both in one loop, as before the split, for comparison
+//
+// Returns 0 if the threaded run met the bound.
+
+static const uint32_t STALL_MINUTE_US = 50 * 1000;
+static const uint32_t STALL_US = 300 * 1000;
+static const uint32_t STALL_BOUND_US = 20 * 1000;
+static const uint32_t STALL_RUN_US = 3 * 1000 * 1000;
+static const uint8_t STALL_BUZZER_PIN = 27;
+
+struct StallResult {
+    uint32_t minutes = 0;     // Minute boundaries that passed
+    uint32_t fires = 0;       // Bells rung from the schedule
+    uint32_t maxLateUs = 0;   // Worst boundary -> bell delay
+    uint32_t maxActionUs = 0; // Worst submit -> output delay for RINGs
+    uint32_t actions = 0;
+};
+
+static ScheduleIndex* everyMinuteSchedule() {
+    ScheduleIndexBuilder builder;
+    builder.reserve(MINUTES_PER_DAY);
+    for (int h = 0; h < 24; h++) {
+        for (int m = 0; m < 60; m++) builder.add(h, m, 0x7F, 5, nullptr);
+    }
+    ScheduleIndex* index = new ScheduleIndex();
+    builder.build(*index);
+    return index;
+}
+
+// One pass of the firmware's network work: drain scheduler output, submit
+// a RING, and every few passes stall as a blocking TLS handshake would
+static void networkPass(BellScheduler& sched, hal::StdClock& clock, uint32_t pass) {
+    ScheduleIndex* old;
+    while (sched.retired().pop(old)) delete old;
+    BellEvent e;
+    while (sched.events().pop(e)) {}
+
+    sched.submit(ACTION_RING, 20);
+    if (pass == 5) sched.publish(everyMinuteSchedule());
+    if (pass % 3 == 0) clock.delay(STALL_US / 1000);
+    else clock.delay(10);
+}
+
+static void schedulerPass(BellScheduler& sched, hal::StdClock& clock, hal::FakeDFPlayer& player,
+                          StallResult& r, unsigned long& plays) {
+    uint64_t now = clock.micros();
+    uint32_t minute = (uint32_t)(now / STALL_MINUTE_US);
+    sched.poll((uint16_t)(minute % MINUTES_PER_WEEK));
+    r.minutes = minute + 1;
+
+    // Scheduled bells and RINGs both call play(); scheduled ones are the
+    // first play of each minute
+    if (player.plays != plays) {
+        plays = player.plays;
+        uint32_t late = (uint32_t)(now - (uint64_t)minute * STALL_MINUTE_US);
+        if (sched.stats().fires.load() > r.fires) {
+            r.fires = sched.stats().fires.load();
+            if (late > r.maxLateUs) r.maxLateUs = late;
+        }
+    }
+}
+
+static StallResult runStall(bool threaded) {
+    hal::StdClock clock;
+    hal::FakeGpio gpio;
+    hal::FakeDFPlayer player;
+    BellScheduler sched(clock, gpio, player, STALL_BUZZER_PIN, 20);
+    sched.publish(everyMinuteSchedule());
+
+    StallResult r;
+    unsigned long plays = 0;
+    if (threaded) {
+        std::atomic<bool> done{false};
+        std::thread network([&]() {
+            for (uint32_t pass = 0; !done.load(); pass++) networkPass(sched, clock, pass);
+        });
+        while (clock.micros() < STALL_RUN_US) {
+            schedulerPass(sched, clock, player, r, plays);
+            clock.delay(1);
+        }
+        done = true;
+        network.join();
+    } else {
+        for (uint32_t pass = 0; clock.micros() < STALL_RUN_US; pass++) {
+            schedulerPass(sched, clock, player, r, plays);
+            networkPass(sched, clock, pass);
+        }
+    }
+
+    r.maxActionUs = sched.stats().maxActionLatencyUs.load();
+    r.actions = sched.stats().actions.load();
+    ScheduleIndex* old;
+    while (sched.retired().pop(old)) delete old;
+    return r;
+}
+
+static void printStall(const char* name, const StallResult& r) {
+    printf("stall/%-12s %u/%u minutes rang, bell late by max %.1f ms, RING queue wait max %.1f ms (%u RINGs)\n",
+           name, r.fires, r.minutes, r.maxLateUs / 1000.0, r.maxActionUs / 1000.0, r.actions);
+}
+
+static int runStallTest() {
+    printf("Network stalls of %u ms, simulated minute %u ms, bound %u ms\n", STALL_US / 1000,
+           STALL_MINUTE_US / 1000, STALL_BOUND_US / 1000);
+    StallResult single = runStall(false);
+    printStall("single-loop", single);
+    StallResult threaded = runStall(true);
+    printStall("threaded", threaded);
+
+    bool ok = threaded.maxLateUs <= STALL_BOUND_US && threaded.fires + 1 >= threaded.minutes;
+    printf("%s: threaded bells %s\n", ok ? "PASS" : "FAIL",
+           ok ? "stayed within the bound" : "were late or missed");
+    return ok ? 0 : 1;
+}
+
+#endif
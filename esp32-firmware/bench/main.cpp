@@ -0,0 +1,546 @@
+// AutoBell firmware micro-benchmarks (host build).
+//
+//   pio run -e native && .pio/build/native/program [options]
+//
+// Options:
+//   --filter <text>     Only run benchmarks whose name contains <text>
+//   --min-time <ms>     Minimum measuring time per benchmark (default 200)
+//   --save <file>       Write results as a baseline file
+//   --baseline <file>   Compare against a baseline file; exit 1 on regression
+//   --threshold <pct>   Allowed slowdown / allocation growth in percent
+//                       (default BENCH_REGRESSION_PCT from platformio.ini)
+//   --stall-test        Only run the network stall test (StallTest.h);
+//                       exit 1 if bells were late or missed
+//   --clock-test        Only run the clock discipline test (ClockTest.h);
+//                       exit 1 on a skipped/repeated minute or a bad estimate
+//   --outage-test       Only run the WiFi outage test (OutageTest.h);
+//                       exit 1 if bells were late or missed while offline
+//   --audio-test        Only run the audio cache test (AudioTest.h);
+//                       exit 1 on a late bell, a wrong sound or over budget
+//   --player-test       Only run the DFPlayer driver test (PlayerTest.h);
+//                       exit 1 if a call waited or a bell was not confirmed
+//   --journal-test      Only run the event journal test (JournalTest.h);
+//                       exit 1 if an event was lost, duplicated or unbounded
+//   --swap-test         Only run the schedule swap test (ScheduleSwapTest.h);
+//                       exit 1 if a bad schedule got through or a bell was
+//                       missed during a swap
+//   --sleep-test        Only run the light sleep test (SleepTest.h);
+//                       exit 1 if a bell rang late or not at all
+//   --soak-test [days]  Only run the heap soak test (SoakTest.h), 30 days
+//                       by default; exit 1 if the poll loop allocated
+//   --ntp-test          Only run the SNTP and RTC trim test (NtpTest.h);
+//                       exit 1 if a round missed the true offset or the
+//                       RTC was not trimmed
+//   --ota-test <url>    Only run the OTA download test (OtaTest.h) against
+//                       scripts/ota-fileserver.js at <url>, e.g.
+//                       http://127.0.0.1:8080; exit 1 on a failed check
+//   --fleet <url> [fleet options]
+//                       Only run the fleet load simulator (FleetSim.h)
+//                       against a backend, e.g. scripts/fleet-standin.js at
+//                       http://127.0.0.1:54321; options after the URL are
+//                       listed in FleetSim.h; exit 1 if any request failed
+//   --delta-make <old.bin> <new.bin> <out.patch>
+//                       Write a delta firmware patch and verify it round
+//                       trips (DeltaTool.h); exit 1 if it does not
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <new>
+#include <ArduinoJson.h>
+#include "Bench.h"
+#include "hal/NativeHal.h"
+#include "ScheduleIndex.h"
+#include "DeviceApi.h"
+#include "ScheduleImage.h"
+#include "StallTest.h"
+#include "ClockTest.h"
+#include "OutageTest.h"
+#include "AudioTest.h"
+#include "PlayerTest.h"
+#include "JournalTest.h"
+#include "ScheduleSwapTest.h"
+#include "SleepTest.h"
+#include "SoakTest.h"
+#include "NtpTest.h"
+#include "OtaTest.h"
+#include "DeltaTool.h"
+#include "FleetSim.h"
+#include "Metrics.h"
+
+#ifndef BENCH_REGRESSION_PCT
+#define BENCH_REGRESSION_PCT 15
+#endif
+
+// ==========================================
+// ALLOCATION COUNTING
+// ==========================================
+// On glibc every allocation (malloc, ArduinoJson's default allocator and
+// operator new) goes through malloc, so hook that. Elsewhere only
+// operator new is counted.
+
+static AllocStats g_alloc = {0, 0};
+
+AllocStats allocStats() { return g_alloc; }
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) {
+    g_alloc.count++;
+    g_alloc.bytes += size;
+    return __libc_malloc(size);
+}
+void* calloc(size_t n, size_t size) {
+    g_alloc.count++;
+    g_alloc.bytes += n * size;
+    return __libc_calloc(n, size);
+}
+void* realloc(void* ptr, size_t size) {
+    g_alloc.count++;
+    g_alloc.bytes += size;
+    return __libc_realloc(ptr, size);
+}
+void free(void* ptr) { __libc_free(ptr); }
+}
+#else
+void* operator new(size_t size) {
+    g_alloc.count++;
+    g_alloc.bytes += size;
+    void* p = malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#endif
+
+// ==========================================
+// FIXTURES
+// ==========================================
+
+// Deterministic pseudo-random numbers so runs are comparable
+static uint32_t lcgState = 12345;
+static uint32_t nextRand() {
+    lcgState = lcgState * 1103515245u + 12345u;
+    return lcgState >> 8;
+}
+
+struct Bell {
+    int hour;
+    int minute;
+    std::vector<int> days;
+};
+
+static std::vector<Bell> makeBells(size_t n) {
+    lcgState = 12345;
+    std::vector<Bell> bells;
+    for (size_t i = 0; i < n; i++) {
+        Bell b;
+        b.hour = 7 + nextRand() % 10;
+        b.minute = nextRand() % 60;
+        for (int d = 1; d <= 5; d++) b.days.push_back(d); // Mon..Fri
+        if (nextRand() % 4 == 0) b.days.push_back(6);
+        bells.push_back(b);
+    }
+    return bells;
+}
+
+#define BENCH_CONFIG_HASH "9e107d9d372bb6826bd81d3542a419d6"
+
+static std::string makeConfigJson(const std::vector<Bell>& bells) {
+    std::string json = "{\"status\":\"ok\",\"config_hash\":\"" BENCH_CONFIG_HASH "\","
+                       "\"school_id\":\"6f1c2a8e-1111-4c1e-9d1b-0a5e2f3b4c5d\","
+                       "\"timezone_offset\":300,\"schedules\":[";
+    char item[256];
+    for (size_t i = 0; i < bells.size(); i++) {
+        const Bell& b = bells[i];
+        std::string days;
+        for (size_t d = 0; d < b.days.size(); d++) {
+            if (d) days += ",";
+            days += std::to_string(b.days[d]);
+        }
+        snprintf(item, sizeof(item),
+                 "%s{\"bell_time\":\"%02d:%02d:00\",\"day_of_week\":[%s],\"days_of_week\":[%s],"
+                 "\"audio_url\":\"school/bells/period-%u.mp3\",\"duration\":5}",
+                 i ? "," : "", b.hour, b.minute, days.c_str(), days.c_str(), (unsigned)(i % 8));
+        json += item;
+    }
+    json += "]}";
+    return json;
+}
+
+// The matcher loop() used before the compiled index, kept as the reference
+static int legacyMatch(const std::vector<Bell>& bells, int day, int h, int m) {
+    int matches = 0;
+    for (const auto& sch : bells) {
+        if (sch.hour == h && sch.minute == m) {
+            bool dayMatch = false;
+            for (int d : sch.days) {
+                if (d == day) {
+                    dayMatch = true;
+                    break;
+                }
+            }
+            if (dayMatch) matches++;
+        }
+    }
+    return matches;
+}
+
+static const char* RING_COMMAND = "[{\"id\":4217,\"command\":\"RING\",\"payload\":{}}]";
+static const char* OTA_COMMAND =
+    "[{\"id\":4218,\"command\":\"UPDATE_FIRMWARE\",\"payload\":{\"url\":\"https://example.com/fw.bin\"}}]";
+
+// A dashboard backlog: CONFIG, RING, SYNC_TIME, ... as get_next_command
+// returns them one at a time, and as one get_pending_commands batch
+static const size_t BACKLOG = 10;
+static const unsigned long POLL_INTERVAL_MS = 5000; // COMMAND_POLL_INTERVAL in main.cpp
+
+static std::string backlogCommand(size_t i) {
+    static const char* names[] = {"CONFIG", "RING", "SYNC_TIME", "TEST_BUZZER"};
+    char item[96];
+    snprintf(item, sizeof(item), "{\"id\":%u,\"command\":\"%s\",\"payload\":{}}", (unsigned)(5000 + i),
+             names[i % 4]);
+    return item;
+}
+
+static std::string backlogBatch() {
+    std::string json = "[";
+    for (size_t i = 0; i < BACKLOG; i++) json += (i ? "," : "") + backlogCommand(i);
+    return json + "]";
+}
+
+// ==========================================
+// BASELINE FILES
+// ==========================================
+// One benchmark per line: <name> <ns/op> <bytes/op>
+
+static bool saveBaseline(const char* path, const std::vector<BenchResult>& results) {
+    FILE* f = fopen(path, "w");
+    if (!f) return false;
+    for (const BenchResult& r : results) fprintf(f, "%s %.1f %.1f\n", r.name.c_str(), r.nsPerOp, r.bytesPerOp);
+    fclose(f);
+    return true;
+}
+
+static bool loadBaseline(const char* path, std::vector<BenchResult>& out) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    char name[128];
+    double ns, bytes;
+    while (fscanf(f, "%127s %lf %lf", name, &ns, &bytes) == 3) out.push_back({name, ns, bytes, 0});
+    fclose(f);
+    return true;
+}
+
+// ==========================================
+// MAIN
+// ==========================================
+
+int main(int argc, char** argv) {
+    const char* filter = "";
+    const char* savePath = nullptr;
+    const char* baselinePath = nullptr;
+    double threshold = BENCH_REGRESSION_PCT;
+    uint32_t minMillis = 200;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--filter") && hasValue) filter = argv[++i];
+        else if (!strcmp(argv[i], "--save") && hasValue) savePath = argv[++i];
+        else if (!strcmp(argv[i], "--baseline") && hasValue) baselinePath = argv[++i];
+        else if (!strcmp(argv[i], "--threshold") && hasValue) threshold = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--min-time") && hasValue) minMillis = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--stall-test")) return runStallTest();
+        else if (!strcmp(argv[i], "--clock-test")) return runClockTest();
+        else if (!strcmp(argv[i], "--outage-test")) return runOutageTest();
+        else if (!strcmp(argv[i], "--audio-test")) return runAudioTest();
+        else if (!strcmp(argv[i], "--player-test")) return runPlayerTest();
+        else if (!strcmp(argv[i], "--journal-test")) return runJournalTest();
+        else if (!strcmp(argv[i], "--swap-test")) return runScheduleSwapTest();
+        else if (!strcmp(argv[i], "--sleep-test")) return runSleepTest();
+        else if (!strcmp(argv[i], "--soak-test")) return runSoakTest(hasValue && isdigit((unsigned char)argv[i + 1][0]) ? atoi(argv[i + 1]) : 30);
+        else if (!strcmp(argv[i], "--ntp-test")) return runNtpTest();
+        else if (!strcmp(argv[i], "--ota-test") && hasValue) return runOtaTest(argv[++i]);
+        else if (!strcmp(argv[i], "--fleet") && hasValue) return runFleetSim(argc, argv, i + 1);
+        else if (!strcmp(argv[i], "--delta-make") && i + 3 < argc) return runDeltaMake(argv[i + 1], argv[i + 2], argv[i + 3]);
+        else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    auto run = [&](const std::string& name, auto&& fn) {
+        if (!strstr(name.c_str(), filter)) return;
+        BenchResult r = runBench(name, fn, minMillis);
+        printf("%-28s %12.1f ns/op %10.1f B/op %8.2f allocs/op\n", r.name.c_str(), r.nsPerOp, r.bytesPerOp,
+               r.allocsPerOp);
+        results.push_back(r);
+    };
+
+    // --- Schedule matcher: legacy scan vs compiled index ---
+    const size_t sizes[] = {10, 100, 1000};
+    for (size_t n : sizes) {
+        std::vector<Bell> bells = makeBells(n);
+
+        ScheduleIndexBuilder builder;
+        for (const Bell& b : bells) {
+            uint8_t mask = 0;
+            for (int d : b.days) mask |= 1 << d;
+            builder.add(b.hour, b.minute, mask, 5, nullptr);
+        }
+        ScheduleIndex index;
+        builder.build(index);
+
+        // Each op checks the next minute of the week, like loop() does
+        uint32_t legacyMinute = 0;
+        run("match/legacy/" + std::to_string(n), [&]() {
+            uint32_t mow = legacyMinute++ % MINUTES_PER_WEEK;
+            doNotOptimize(legacyMatch(bells, mow / MINUTES_PER_DAY, (mow % MINUTES_PER_DAY) / 60, mow % 60));
+        });
+        uint32_t indexMinute = 0;
+        run("match/index/" + std::to_string(n), [&]() {
+            uint16_t mow = indexMinute++ % MINUTES_PER_WEEK;
+            doNotOptimize(index.fires(mow));
+        });
+    }
+
+    // --- parseSchedules(): filtered deserialize + compile, as on boot ---
+    const size_t parseSizes[] = {100, 500};
+    for (size_t n : parseSizes) {
+        std::string json = makeConfigJson(makeBells(n));
+        ScheduleIndex index;
+        run("parse/" + std::to_string(n), [&]() {
+            JsonDocument doc;
+            deserializeJson(doc, json, DeserializationOption::Filter(scheduleFilter()));
+            compileSchedules(doc["schedules"].as<JsonArrayConst>(), index);
+            doNotOptimize(index.fireCount());
+        });
+    }
+
+    // --- Boot load from the binary image (compare with parse/500) ---
+    {
+        hal::HostFileSystem fs("/tmp");
+        JsonDocument doc;
+        deserializeJson(doc, makeConfigJson(makeBells(500)), DeserializationOption::Filter(scheduleFilter()));
+        ScheduleIndex index;
+        compileSchedules(doc["schedules"].as<JsonArrayConst>(), index);
+        saveScheduleImage(fs, "/autobell-bench.bin", "/autobell-bench.bin.tmp", index);
+        run("image/load/500", [&]() {
+            ScheduleIndex loaded;
+            loadScheduleImage(fs, "/autobell-bench.bin", loaded);
+            doNotOptimize(loaded.fireCount());
+        });
+        fs.remove("/autobell-bench.bin");
+    }
+
+    // --- Command JSON handling from pollCommands() ---
+    run("command/empty", [&]() {
+        JsonDocument doc;
+        deserializeJson(doc, "[]");
+        Command cmd;
+        doNotOptimize(parseCommand(doc.as<JsonVariantConst>(), cmd));
+    });
+    run("command/ring", [&]() {
+        JsonDocument doc;
+        deserializeJson(doc, RING_COMMAND);
+        Command cmd;
+        doNotOptimize(parseCommand(doc.as<JsonVariantConst>(), cmd));
+    });
+    run("command/update_firmware", [&]() {
+        JsonDocument doc;
+        deserializeJson(doc, OTA_COMMAND);
+        Command cmd;
+        parseCommand(doc.as<JsonVariantConst>(), cmd);
+        doNotOptimize(strlen(cmd.payload["url"] | ""));
+    });
+
+    // --- Metrics: the cost of recording (left on in production) and of a snapshot ---
+    {
+        static Metrics metrics;
+        MetricsReport report(metrics);
+        uint32_t value = 0;
+        run("metrics/record", [&]() {
+            value = value * 1103515245u + 12345u;
+            metrics.record(M_NET_LOOP_US, value >> 12);
+        });
+        char snapshot[1536];
+        uint32_t nowMs = 0;
+        run("metrics/snapshot", [&]() {
+            metrics.record(M_RPC_TICK_US, 250000);
+            doNotOptimize(report.take(nowMs += 60000, snapshot, sizeof(snapshot)));
+            report.commit();
+        });
+    }
+
+    // --- Full RPC paths through the HAL stand-ins ---
+    hal::FakeHttpClient http;
+    http.route("/rpc/get_next_command", 200, RING_COMMAND);
+    http.route("/rpc/ack_command", 204, "");
+    http.route("/rpc/update_heartbeat", 204, "");
+    http.route("/rpc/get_device_config", 200, makeConfigJson(makeBells(500)));
+    DeviceApi api(http, "https://bench.local", "bench-key");
+    const char* deviceId = "0b7c5f2e-9a41-4d7e-8c3a-2f6e1d9b8a70";
+
+    run("rpc/poll+ack", [&]() {
+        JsonDocument doc;
+        api.getNextCommand(deviceId, doc);
+        Command cmd;
+        if (parseCommand(doc.as<JsonVariantConst>(), cmd) == COMMAND_OK) api.ackCommand(cmd.id);
+        doNotOptimize(http.stats().requests);
+    });
+    run("rpc/heartbeat", [&]() { doNotOptimize(api.heartbeat(deviceId, "online")); });
+
+    // deviceTick(): heartbeat + telemetry + acks + command poll in one request
+    http.route("/rpc/device_tick", 200, "{\"commands\":" + std::string(RING_COMMAND) + ",\"config_stale\":false}");
+    CommandAck tickAck = {"4216", true, 1769400000};
+    run("rpc/tick", [&]() {
+        JsonDocument doc;
+        api.tick(deviceId, "online", BENCH_CONFIG_HASH, "{\"rssi\":-61,\"free_heap\":181240}", &tickAck, 1, 10,
+                 doc);
+        Command cmd;
+        size_t n = 0;
+        for (JsonVariantConst item : doc["commands"].as<JsonArrayConst>()) n += parseCommand(item, cmd) == COMMAND_OK;
+        doNotOptimize(n + (doc["config_stale"] | false));
+    });
+    // The same with the response in a JsonArena, as deviceTick() parses it
+    static JsonArena<TICK_ARENA_SIZE> tickArena;
+    run("rpc/tick/arena", [&]() {
+        JsonDocument doc(&tickArena);
+        api.tick(deviceId, "online", BENCH_CONFIG_HASH, "{\"rssi\":-61,\"free_heap\":181240}", &tickAck, 1, 10,
+                 doc);
+        Command cmd;
+        size_t n = 0;
+        for (JsonVariantConst item : doc["commands"].as<JsonArrayConst>()) n += parseCommand(item, cmd) == COMMAND_OK;
+        doNotOptimize(n + (doc["config_stale"] | false));
+    });
+
+    // --- Draining a 10-command backlog: one per poll tick vs one batch ---
+    std::vector<std::string> singles;
+    for (size_t i = 0; i < BACKLOG; i++) singles.push_back("[" + backlogCommand(i) + "]");
+    singles.push_back("[]");
+    std::string batch = backlogBatch();
+    http.route("/rpc/ack_commands", 200, "10");
+
+    // Old pollCommands(): get_next_command + ack_command per tick until empty
+    auto drainSingle = [&]() {
+        size_t ticks = 0;
+        for (const std::string& response : singles) {
+            http.route("/rpc/get_next_command", 200, response);
+            JsonDocument doc;
+            api.getNextCommand(deviceId, doc);
+            ticks++;
+            Command cmd;
+            if (parseCommand(doc.as<JsonVariantConst>(), cmd) != COMMAND_OK) break;
+            api.ackCommand(cmd.id);
+        }
+        return ticks;
+    };
+    // New pollCommands(): one get_pending_commands, one ack_commands
+    auto drainBatch = [&]() {
+        http.route("/rpc/get_pending_commands", 200, batch);
+        JsonDocument doc;
+        api.getPendingCommands(deviceId, (int)BACKLOG, doc);
+        CommandAck acks[BACKLOG];
+        size_t n = 0;
+        for (JsonVariantConst item : doc.as<JsonArrayConst>()) {
+            Command cmd;
+            if (parseCommand(item, cmd) != COMMAND_OK || n == BACKLOG) continue;
+            strcpy(acks[n].id, cmd.id);
+            acks[n].ok = true;
+            acks[n].executedAt = 1769400000;
+            n++;
+        }
+        api.ackCommands(deviceId, acks, n);
+        return (size_t)1;
+    };
+
+    uint32_t before = http.stats().requests;
+    size_t singleTicks = drainSingle();
+    uint32_t singleRequests = http.stats().requests - before;
+    before = http.stats().requests;
+    size_t batchTicks = drainBatch();
+    uint32_t batchRequests = http.stats().requests - before;
+    printf("drain/%u: single %u requests over %u poll ticks (last command runs %lu s after the first), "
+           "batch %u requests in %u tick\n",
+           (unsigned)BACKLOG, singleRequests, (unsigned)singleTicks,
+           (unsigned long)(BACKLOG - 1) * POLL_INTERVAL_MS / 1000, batchRequests, (unsigned)batchTicks);
+
+    run("drain/10/single", [&]() { doNotOptimize(drainSingle()); });
+    run("drain/10/batch", [&]() { doNotOptimize(drainBatch()); });
+
+    // Same shape as syncSchedules(): filtered parse off the connection, then
+    // the compiled config written to a temp file that is renamed over the cache
+    hal::HostFileSystem fs("/tmp");
+    ScheduleIndex synced;
+    run("rpc/sync/500", [&]() {
+        JsonDocument doc;
+        api.getDeviceConfig("24:6F:28:A1:B2:C3", "", doc);
+        compileSchedules(doc["schedules"].as<JsonArrayConst>(), synced);
+        std::unique_ptr<hal::File> tmp = fs.open("/autobell-bench-schedules.tmp", "w");
+        if (tmp) {
+            serializeJson(doc, *tmp);
+            tmp->close();
+        }
+        fs.rename("/autobell-bench-schedules.tmp", "/autobell-bench-schedules.json");
+        doNotOptimize(synced.fireCount());
+    });
+    fs.remove("/autobell-bench-schedules.json");
+
+    // Periodic sync when the device's config_hash is still current: the
+    // server sends the short reply and no file is written or compiled
+    hal::FakeHttpClient unchangedHttp;
+    unchangedHttp.route("/rpc/get_device_config", 200,
+                        "{\"status\":\"unchanged\",\"config_hash\":\"" BENCH_CONFIG_HASH "\"}");
+    DeviceApi unchangedApi(unchangedHttp, "https://bench.local", "bench-key");
+    run("rpc/sync/unchanged", [&]() {
+        JsonDocument doc;
+        unchangedApi.getDeviceConfig("24:6F:28:A1:B2:C3", BENCH_CONFIG_HASH, doc);
+        if (!configUnchanged(doc.as<JsonVariantConst>())) {
+            compileSchedules(doc["schedules"].as<JsonArrayConst>(), synced);
+        }
+        doNotOptimize(synced.fireCount());
+    });
+
+    if (savePath) {
+        if (!saveBaseline(savePath, results)) {
+            fprintf(stderr, "Could not write %s\n", savePath);
+            return 2;
+        }
+        printf("Baseline saved to %s\n", savePath);
+    }
+
+    if (!baselinePath) return 0;
+
+    std::vector<BenchResult> baseline;
+    if (!loadBaseline(baselinePath, baseline)) {
+        fprintf(stderr, "Could not read %s\n", baselinePath);
+        return 2;
+    }
+
+    int regressions = 0;
+    for (const BenchResult& r : results) {
+        for (const BenchResult& b : baseline) {
+            if (b.name != r.name) continue;
+            double limit = 1.0 + threshold / 100.0;
+            bool slower = b.nsPerOp > 0 && r.nsPerOp > b.nsPerOp * limit;
+            bool heavier = r.bytesPerOp > b.bytesPerOp * limit;
+            if (slower || heavier) {
+                printf("REGRESSION %s: %.1f -> %.1f ns/op, %.1f -> %.1f B/op (threshold %.0f%%)\n", r.name.c_str(),
+                       b.nsPerOp, r.nsPerOp, b.bytesPerOp, r.bytesPerOp, threshold);
+                regressions++;
+            }
+        }
+    }
+    printf("%d regression(s) against %s\n", regressions, baselinePath);
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,589 @@
+#ifndef AUDIO_CACHE_H
+#define AUDIO_CACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include "hal/Hal.h"
+#include "ScheduleIndex.h"
+#include "Sha256.h"
+
+// ==========================================
+// AUDIO ASSET CACHE
+// ==========================================
+//
+// Each bell's own sound (audio_url: a path in the audio-files bucket) kept
+// on the DFPlayer's SD card, so a bell never waits on the network:
+//
+//   /mp3/0001.mp3 ...  one file per distinct content, played with
+//                      DFPlayer::playFile(track)
+//   /audio.idx         manifest, one line per storage path:
+//                      track size lastUse sha256 path
+//
+// Files are keyed by the SHA-256 of their bytes, so paths that serve the
+// same sound share one track. The dashboard uploads every file under a new
+// random name, so a path that is cached is never downloaded again.
+//
+// plan() takes the schedule; step() runs in the network task and downloads
+// the missing sounds, the soonest bell first, AUDIO_STEP_BYTES per call.
+// After each download files are evicted until the cache is back under its
+// byte budget: first the least recently used of those no schedule entry
+// wants, then those whose next bell is furthest away, but only ones that
+// ring after the new file. A file never makes room for one that rings
+// later, so a budget too small for the whole week holds the next bells'
+// sounds instead of trading files back and forth. A download that does not
+// fit is dropped, and tried again once bells have rung and it does.
+//
+// The scheduler never calls in here: resolve() writes the tracks into a
+// ScheduleIndex before it is published. A bell whose sound is not cached
+// plays the default track.
+
+const uint16_t AUDIO_TRACK_MAX = 3000;    // DFPlayer /mp3 folder numbering
+const size_t AUDIO_PATH_MAX = 96;         // Longer paths are not cached
+const size_t AUDIO_MAX_ASSETS = 64;
+const size_t AUDIO_STEP_BYTES = 16 * 1024;
+const size_t AUDIO_MANIFEST_MAX = 16 * 1024;
+const uint32_t AUDIO_RETRY_MIN_MS = 30 * 1000;
+const uint32_t AUDIO_RETRY_MAX_MS = 60 * 60 * 1000;
+
+const char* const AUDIO_MANIFEST = "/audio.idx";
+const char* const AUDIO_MANIFEST_TMP = "/audio.idx.tmp";
+const char* const AUDIO_PART = "/audio.part";
+
+enum AudioStep : uint8_t {
+    AUDIO_IDLE,    // Nothing missing, or waiting out a backoff
+    AUDIO_BUSY,    // Part of a file downloaded
+    AUDIO_ADDED,   // A file is cached: resolve() the schedule again
+    AUDIO_FAILED   // See error(); retried after a backoff
+};
+
+struct AudioAsset {
+    char path[AUDIO_PATH_MAX];
+    char sha256[SHA256_HEX_LEN + 1];
+    uint16_t track;
+    uint32_t size;
+    uint32_t lastUse; // useClock at the last bell or download
+};
+
+class AudioCache {
+public:
+    // Sounds are fetched from serverUrl + bucketPath + audio_url (or from
+    // audio_url itself when it is a full URL)
+    AudioCache(hal::HttpClient& http, hal::FileSystem& card, const char* serverUrl, const char* bucketPath,
+               uint32_t budgetBytes)
+        : http(http), card(card), serverUrl(serverUrl), bucketPath(bucketPath), budgetBytes(budgetBytes) {}
+
+    // Loads the manifest (the card must be mounted). Entries whose file is
+    // gone are dropped.
+    bool begin() {
+        ready = true;
+        card.remove(AUDIO_PART);
+        if (!load(AUDIO_MANIFEST) && !load(AUDIO_MANIFEST_TMP)) return true; // Empty card
+        size_t before = assets.size();
+        for (size_t i = 0; i < assets.size();) {
+            char name[16];
+            fileName(assets[i].track, name);
+            if (card.exists(name)) {
+                i++;
+            } else {
+                assets.erase(assets.begin() + i);
+            }
+        }
+        if (assets.size() != before) save();
+        return true;
+    }
+
+    bool enabled() const { return ready; }
+
+    // Track for a storage path, 0 if not cached
+    uint16_t track(const char* path) const {
+        const AudioAsset* a = find(path);
+        return a ? a->track : 0;
+    }
+
+    // Copies the tracks into an index that is about to be published
+    void resolve(ScheduleIndex& index) const {
+        for (size_t i = 0; i < index.entryCount(); i++) {
+            const BellEntry& e = index.entry(i);
+            index.setTrack(i, e.audioOffset == NO_AUDIO ? 0 : track(index.audioUrl(e)));
+        }
+    }
+
+    // The sounds to keep cached, with when they ring
+    void plan(const ScheduleIndex& index) {
+        std::vector<AudioWant> before;
+        before.swap(wants);
+        wantFires.clear();
+        std::vector<uint16_t> wantOf(index.entryCount(), NO_WANT);
+        for (size_t i = 0; i < index.entryCount(); i++) {
+            const BellEntry& e = index.entry(i);
+            const char* path = index.audioUrl(e);
+            if (!path[0] || strlen(path) >= AUDIO_PATH_MAX) continue;
+            size_t w = 0;
+            while (w < wants.size() && strcmp(wants[w].path, path) != 0) w++;
+            if (w == wants.size()) {
+                AudioWant want;
+                strcpy(want.path, path);
+                want.skip = false;
+                want.size = 0;
+                for (const AudioWant& old : before) {
+                    if (strcmp(old.path, path) == 0) want = old; // Keep what was learned
+                }
+                wants.push_back(want);
+            }
+            wantOf[i] = (uint16_t)w;
+        }
+        for (size_t f = 0; f < index.fireCount(); f++) {
+            const FireTime& t = index.fireData()[f];
+            if (wantOf[t.entry] != NO_WANT) wantFires.push_back({t.minuteOfWeek, wantOf[t.entry]});
+        }
+        unsettle();
+        retryAt = lastMs;
+        failures = 0;
+    }
+
+    // True while something remains to download (step() has work)
+    bool pending() const { return ready && (downloading || !settled || dirty); }
+
+    // Time until step() has work, UINT32_MAX with nothing pending: the
+    // failure backoff, and `minuteLeftMs` (the rest of the minute) while
+    // nothing fits until the next one. Takes the minute step() would.
+    uint32_t idleMs(uint16_t minuteOfWeek, uint32_t nowMs, uint32_t minuteLeftMs) const {
+        if (!pending()) return UINT32_MAX;
+        if (downloading || dirty) return 0;
+        uint16_t minute = minuteOfWeek < MINUTES_PER_WEEK ? minuteOfWeek : 0;
+        uint32_t wait = (int32_t)(retryAt - nowMs) > 0 ? retryAt - nowMs : 0;
+        if (minute == waitMinute && minuteLeftMs > wait) wait = minuteLeftMs;
+        return wait;
+    }
+
+    // A bell played `track`: most recently used. Its next bell moved to
+    // next week, so what fits may have changed.
+    void touch(uint16_t t) {
+        if (!t) return;
+        useClock++;
+        for (AudioAsset& a : assets) {
+            if (a.track == t) a.lastUse = useClock;
+        }
+        dirty = true;
+        unsettle();
+    }
+
+    // Downloads at most AUDIO_STEP_BYTES. `minuteOfWeek` orders the
+    // downloads (BellScheduler::NO_MINUTE while the time is unknown).
+    AudioStep step(uint16_t minuteOfWeek, uint32_t nowMs) {
+        lastMs = nowMs;
+        if (!ready) return AUDIO_IDLE;
+        nowMinute = minuteOfWeek < MINUTES_PER_WEEK ? minuteOfWeek : 0;
+        if (!downloading) {
+            if (dirty) save();
+            if (settled || nowMinute == waitMinute || (int32_t)(nowMs - retryAt) < 0) return AUDIO_IDLE;
+            bool missing;
+            int w = nextMissing(missing);
+            if (w < 0) {
+                settled = !missing;
+                waitMinute = nowMinute; // Something does not fit yet: look again next minute
+                return AUDIO_IDLE;
+            }
+            if (!open(w)) return failed(nowMs);
+        }
+        return transfer(nowMs);
+    }
+
+    // Stops a download in progress (the connection is needed elsewhere)
+    void abort() {
+        if (!downloading) return;
+        closeDownload();
+        card.remove(AUDIO_PART);
+    }
+
+    size_t count() const { return assets.size(); }
+    uint32_t usedBytes() const {
+        uint32_t used = 0;
+        for (size_t i = 0; i < assets.size(); i++) {
+            if (firstOfTrack(i)) used += assets[i].size;
+        }
+        return used;
+    }
+    uint32_t budget() const { return budgetBytes; }
+    uint32_t evictions() const { return evicted; }
+    uint32_t downloads() const { return fetched; }
+    const AudioAsset* asset(size_t i) const { return i < assets.size() ? &assets[i] : nullptr; }
+    const char* lastPath() const { return dlPath; } // The current or last download
+    const char* error() const { return lastError; }
+
+private:
+    static const uint16_t NO_WANT = 0xFFFF;
+    static const uint16_t NO_MINUTE = 0xFFFF;
+
+    struct AudioWant {
+        char path[AUDIO_PATH_MAX];
+        bool skip;     // Not downloadable (4xx, empty, larger than the budget) until the next plan()
+        uint32_t size; // Learned from a download, 0 = unknown
+    };
+
+    static void fileName(uint16_t track, char* out) { snprintf(out, 16, "/mp3/%04u.mp3", track); }
+
+    const AudioAsset* find(const char* path) const {
+        for (const AudioAsset& a : assets) {
+            if (strcmp(a.path, path) == 0) return &a;
+        }
+        return nullptr;
+    }
+
+    bool firstOfTrack(size_t i) const {
+        for (size_t j = 0; j < i; j++) {
+            if (assets[j].track == assets[i].track) return false;
+        }
+        return true;
+    }
+
+    // Minutes until each wanted sound next rings (MINUTES_PER_WEEK if never)
+    void untilNext(std::vector<uint16_t>& until) const {
+        until.assign(wants.size(), MINUTES_PER_WEEK);
+        for (const FireTime& f : wantFires) {
+            uint16_t in = (uint16_t)((f.minuteOfWeek + MINUTES_PER_WEEK - nowMinute) % MINUTES_PER_WEEK);
+            if (in < until[f.entry]) until[f.entry] = in;
+        }
+    }
+
+    void unsettle() {
+        settled = false;
+        waitMinute = NO_MINUTE;
+    }
+
+    // Soonest-ringing sound that is missing and fits
+    int nextMissing(bool& missing) const {
+        std::vector<uint16_t> until;
+        untilNext(until);
+        int best = -1;
+        missing = false;
+        for (size_t w = 0; w < wants.size(); w++) {
+            if (wants[w].skip || find(wants[w].path)) continue;
+            missing = true;
+            if (best >= 0 && until[w] >= until[best]) continue;
+            if (wants[w].size && !fits(wants[w].size, until[w], until)) continue; // Known from a dropped try
+            best = (int)w;
+        }
+        return best;
+    }
+
+    // Next ring of a track, MINUTES_PER_WEEK if no entry wants it
+    uint16_t ringsIn(uint16_t t, const std::vector<uint16_t>& until) const {
+        uint16_t soonest = MINUTES_PER_WEEK;
+        for (const AudioAsset& a : assets) {
+            if (a.track != t) continue;
+            for (size_t w = 0; w < wants.size(); w++) {
+                if (until[w] < soonest && strcmp(wants[w].path, a.path) == 0) soonest = until[w];
+            }
+        }
+        return soonest;
+    }
+
+    uint32_t lastUseOf(uint16_t t) const {
+        uint32_t use = 0;
+        for (const AudioAsset& a : assets) {
+            if (a.track == t && a.lastUse > use) use = a.lastUse;
+        }
+        return use;
+    }
+
+    // A file may make room for one ringing at `in` minutes if no bell wants
+    // it, or if its own bell comes later
+    bool evictable(uint16_t t, uint16_t in, const std::vector<uint16_t>& until) const {
+        uint16_t rings = ringsIn(t, until);
+        return rings == MINUTES_PER_WEEK || rings > in;
+    }
+
+    // Would `size` bytes ringing at `in` fit after evicting what it may?
+    bool fits(uint32_t size, uint16_t in, const std::vector<uint16_t>& until) const {
+        uint32_t keep = 0;
+        size_t files = 0;
+        for (size_t i = 0; i < assets.size(); i++) {
+            if (!firstOfTrack(i) || evictable(assets[i].track, in, until)) continue;
+            keep += assets[i].size;
+            files++;
+        }
+        return keep + size <= budgetBytes && files < AUDIO_MAX_ASSETS;
+    }
+
+    // Marks the download's path as not downloadable (until the next plan())
+    void skip() {
+        for (AudioWant& w : wants) {
+            if (strcmp(w.path, dlPath) == 0) w.skip = true;
+        }
+    }
+
+    void learnSize(uint32_t size) {
+        for (AudioWant& w : wants) {
+            if (strcmp(w.path, dlPath) == 0) w.size = size;
+        }
+    }
+
+    bool open(int w) {
+        strcpy(dlPath, wants[w].path);
+        const char* path = dlPath;
+        char url[320];
+        if (strstr(path, "://")) {
+            snprintf(url, sizeof(url), "%s", path);
+        } else {
+            snprintf(url, sizeof(url), "%s%s%s", serverUrl, bucketPath, path);
+        }
+        if (!http.begin(url)) return fail("bad url");
+        int code = http.get();
+        if (code != 200) {
+            http.end();
+            if (code >= 400 && code < 500) skip();
+            return fail(code < 0 ? "connection failed" : "HTTP error");
+        }
+        expected = http.contentLength();
+        if (expected == 0 || (expected > 0 && (uint32_t)expected > budgetBytes)) {
+            http.end();
+            skip();
+            return fail(expected == 0 ? "empty file" : "larger than the cache");
+        }
+        part = card.open(AUDIO_PART, "w");
+        if (!part) {
+            http.end();
+            return fail("cannot write the card");
+        }
+        sha.reset();
+        got = 0;
+        downloading = true;
+        return true;
+    }
+
+    AudioStep transfer(uint32_t nowMs) {
+        uint8_t buf[1024];
+        size_t moved = 0;
+        while (moved < AUDIO_STEP_BYTES) {
+            size_t n = http.readBytes((char*)buf, sizeof(buf));
+            if (n > 0) {
+                if (part->write(buf, n) != n) {
+                    abort();
+                    fail("cannot write the card");
+                    return failed(nowMs);
+                }
+                sha.update(buf, n);
+                got += n;
+                moved += n;
+                if (got > budgetBytes) {
+                    abort();
+                    skip();
+                    fail("larger than the cache");
+                    return failed(nowMs);
+                }
+            }
+            if (n < sizeof(buf)) break; // End of the body (or a dropped connection)
+        }
+        if (moved == AUDIO_STEP_BYTES) return AUDIO_BUSY;
+
+        closeDownload();
+        if (expected >= 0 && got != (uint32_t)expected) {
+            card.remove(AUDIO_PART);
+            fail("download cut short");
+            return failed(nowMs);
+        }
+        if (got == 0) {
+            card.remove(AUDIO_PART);
+            skip();
+            fail("empty file");
+            return failed(nowMs);
+        }
+        if (!store()) return failed(nowMs);
+        failures = 0;
+        fetched++;
+        return AUDIO_ADDED;
+    }
+
+    void closeDownload() {
+        http.end();
+        if (part) part->close();
+        part.reset();
+        downloading = false;
+    }
+
+    // The finished download becomes (or joins) a track
+    bool store() {
+        uint8_t digest[SHA256_SIZE];
+        AudioAsset a;
+        sha.finish(digest);
+        sha256Hex(digest, a.sha256);
+        strcpy(a.path, dlPath);
+        a.size = got;
+        a.lastUse = ++useClock;
+        a.track = 0;
+        for (const AudioAsset& other : assets) {
+            if (strcmp(other.sha256, a.sha256) == 0) a.track = other.track; // Same sound, other path
+        }
+        if (a.track) {
+            card.remove(AUDIO_PART);
+        } else {
+            a.track = freeTrack();
+            char name[16];
+            fileName(a.track, name);
+            if (!a.track || !card.rename(AUDIO_PART, name)) {
+                card.remove(AUDIO_PART);
+                return fail(a.track ? "cannot write the card" : "no free track");
+            }
+        }
+        assets.push_back(a);
+        bool kept = evict(a.track);
+        save();
+        if (!kept) learnSize(a.size); // Not tried again until it fits
+        return kept || fail("no room before its bell");
+    }
+
+    uint16_t freeTrack() const {
+        for (uint16_t t = 1; t <= AUDIO_TRACK_MAX; t++) {
+            bool used = false;
+            for (const AudioAsset& a : assets) used = used || a.track == t;
+            if (!used) return t;
+        }
+        return 0;
+    }
+
+    // Evicts until the cache fits: files no bell wants, least recently used
+    // first, then files whose bell comes after `added`'s, the latest bell
+    // first. False if `added` had to go again.
+    bool evict(uint16_t added) {
+        std::vector<uint16_t> until;
+        untilNext(until);
+        uint16_t in = ringsIn(added, until);
+        while (usedBytes() > budgetBytes || assets.size() > AUDIO_MAX_ASSETS) {
+            int victim = -1;
+            uint16_t victimRings = 0;
+            uint32_t victimUse = 0;
+            for (size_t i = 0; i < assets.size(); i++) {
+                uint16_t t = assets[i].track;
+                if (t == added || !firstOfTrack(i) || !evictable(t, in, until)) continue;
+                uint16_t rings = ringsIn(t, until); // MINUTES_PER_WEEK if unwanted, so those go first
+                uint32_t use = lastUseOf(t);
+                if (victim < 0 || rings > victimRings || (rings == victimRings && use < victimUse)) {
+                    victim = (int)i;
+                    victimRings = rings;
+                    victimUse = use;
+                }
+            }
+            uint16_t t = victim >= 0 ? assets[victim].track : added;
+            removeTrack(t);
+            if (t == added) return false;
+        }
+        return true;
+    }
+
+    void removeTrack(uint16_t t) {
+        char name[16];
+        fileName(t, name);
+        card.remove(name);
+        for (size_t i = 0; i < assets.size();) {
+            if (assets[i].track == t) {
+                assets.erase(assets.begin() + i);
+            } else {
+                i++;
+            }
+        }
+        evicted++;
+        unsettle();
+    }
+
+    AudioStep failed(uint32_t nowMs) {
+        failures++;
+        uint32_t backoff = AUDIO_RETRY_MIN_MS << (failures < 8 ? failures - 1 : 7);
+        retryAt = nowMs + (backoff < AUDIO_RETRY_MAX_MS ? backoff : AUDIO_RETRY_MAX_MS);
+        return AUDIO_FAILED;
+    }
+
+    bool fail(const char* why) {
+        lastError = why;
+        return false;
+    }
+
+    // --- Manifest ---
+
+    bool load(const char* path) {
+        std::unique_ptr<hal::File> f = card.open(path, "r");
+        if (!f) return false;
+        size_t size = f->size();
+        if (size == 0 || size > AUDIO_MANIFEST_MAX) return false;
+        std::vector<char> text(size + 1);
+        text[f->readBytes(text.data(), size)] = '\0';
+        f->close();
+
+        unsigned long clock;
+        char* line = text.data();
+        char* next = strchr(line, '\n');
+        if (!next || sscanf(line, "AUDIO1 %lu", &clock) != 1) return false;
+        assets.clear();
+        useClock = (uint32_t)clock;
+        for (line = next + 1; (next = strchr(line, '\n')) != nullptr; line = next + 1) {
+            *next = '\0';
+            AudioAsset a;
+            unsigned track;
+            unsigned long size, lastUse;
+            int pathAt = 0;
+            if (sscanf(line, "%u %lu %lu %64s %n", &track, &size, &lastUse, a.sha256, &pathAt) != 4 || !pathAt ||
+                track == 0 || track > AUDIO_TRACK_MAX || strlen(line + pathAt) >= AUDIO_PATH_MAX ||
+                assets.size() >= AUDIO_MAX_ASSETS) {
+                continue;
+            }
+            strcpy(a.path, line + pathAt);
+            a.track = (uint16_t)track;
+            a.size = (uint32_t)size;
+            a.lastUse = (uint32_t)lastUse;
+            assets.push_back(a);
+        }
+        return true;
+    }
+
+    // Temp file, then renamed over the manifest
+    bool save() {
+        dirty = false;
+        std::unique_ptr<hal::File> f = card.open(AUDIO_MANIFEST_TMP, "w");
+        if (!f) return false;
+        char line[AUDIO_PATH_MAX + SHA256_HEX_LEN + 48];
+        int n = snprintf(line, sizeof(line), "AUDIO1 %lu\n", (unsigned long)useClock);
+        bool ok = f->write((const uint8_t*)line, n) == (size_t)n;
+        for (const AudioAsset& a : assets) {
+            n = snprintf(line, sizeof(line), "%u %lu %lu %s %s\n", a.track, (unsigned long)a.size,
+                         (unsigned long)a.lastUse, a.sha256, a.path);
+            ok = ok && f->write((const uint8_t*)line, n) == (size_t)n;
+        }
+        f->close();
+        return ok && card.rename(AUDIO_MANIFEST_TMP, AUDIO_MANIFEST);
+    }
+
+    hal::HttpClient& http;
+    hal::FileSystem& card;
+    const char* serverUrl;
+    const char* bucketPath;
+    uint32_t budgetBytes;
+
+    std::vector<AudioAsset> assets;
+    std::vector<AudioWant> wants;
+    std::vector<FireTime> wantFires; // (minuteOfWeek, index into wants), sorted
+    uint32_t useClock = 0;
+    bool ready = false;
+    bool settled = true; // Every wanted sound is cached or skipped
+    bool dirty = false;  // touch() since the last save()
+    uint16_t nowMinute = 0;
+    uint16_t waitMinute = NO_MINUTE; // Nothing fitted at this minute
+    uint32_t lastMs = 0;
+
+    bool downloading = false;
+    char dlPath[AUDIO_PATH_MAX] = "";
+    std::unique_ptr<hal::File> part;
+    Sha256 sha;
+    int32_t expected = -1;
+    uint32_t got = 0;
+
+    uint32_t retryAt = 0;
+    uint32_t failures = 0;
+    uint32_t fetched = 0;
+    uint32_t evicted = 0;
+    const char* lastError = "";
+};
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef BELL_SCHEDULER_H
+#define BELL_SCHEDULER_H
+
+#include <stdint.h>
+#include <atomic>
+#include "hal/Hal.h"
+#include "ScheduleIndex.h"
+#include "SpscQueue.h"
+
+// ==========================================
+// BELL SCHEDULER (real-time side)
+// ==========================================
+//
+// Owns the bell outputs (DFPlayer, buzzer) and the active ScheduleIndex.
+// poll() is meant to run alone in a high-priority task; the network side
+// only talks to it through SPSC queues, so a slow handshake or DNS timeout
+// there can delay neither the minute check nor a pushed RING:
+//
+//   network -> scheduler   actions()    RING / BUZZER / STOP
+//                          schedules()  new ScheduleIndex*, ownership moves
+//   scheduler -> network   retired()    replaced ScheduleIndex*, to delete
+//                          events()     bells fired and actions run, with latency
+//
+// A scheduled bell plays its entry's cached audio (BellEntry::track, set by
+// AudioCache before the index is published; the default track 1 without
+// one) for the entry's duration, then stops the player.
+//
+// Nothing in poll() allocates, frees, logs or does I/O other than driving
+// the outputs.
+
+enum BellActionType : uint8_t {
+    ACTION_RING,   // DFPlayer track 1 + buzzer
+    ACTION_BUZZER, // Buzzer only (TEST_BUZZER)
+    ACTION_STOP    // Silence everything
+};
+
+struct BellAction {
+    BellActionType type;
+    uint32_t durationMs; // Buzzer time, 0 = until ACTION_STOP
+    uint64_t queuedUs;   // Clock::micros() at submit, for latency stats
+};
+
+enum BellEventType : uint8_t {
+    EVENT_SCHEDULED, // Bell from the schedule
+    EVENT_ACTION,    // Action from the queue
+    EVENT_BUZZER_OFF
+};
+
+struct BellEvent {
+    BellEventType type;
+    uint8_t action;        // BellActionType for EVENT_ACTION
+    uint16_t minuteOfWeek; // EVENT_SCHEDULED
+    uint16_t entry;        // EVENT_SCHEDULED: index into the ScheduleIndex entries
+    uint16_t track;        // EVENT_SCHEDULED: cached audio played, 0 = default bell
+    uint32_t latencyUs;    // Queue wait for actions, time since the previous poll for bells
+};
+
+// Counters written by the scheduler, readable from any task
+struct SchedulerStats {
+    std::atomic<uint32_t> polls{0};
+    std::atomic<uint32_t> fires{0};
+    std::atomic<uint32_t> actions{0};
+    std::atomic<uint32_t> maxActionLatencyUs{0};
+    std::atomic<uint32_t> maxPollGapUs{0};
+};
+
+class BellScheduler {
+public:
+    static const uint16_t NO_MINUTE = 0xFFFF;
+    static const uint32_t NO_BELL = 0xFFFFFFFF;
+
+    BellScheduler(hal::Clock& clock, hal::Gpio& gpio, hal::DFPlayer& player, uint8_t buzzerPin,
+                  uint32_t defaultDurationMs)
+        : clock(clock), gpio(gpio), player(player), buzzerPin(buzzerPin), defaultDurationMs(defaultDurationMs) {}
+
+    // --- Network side (single producer / consumer each) ---
+
+    bool submit(BellActionType type, uint32_t durationMs) {
+        BellAction a = {type, durationMs, clock.micros()};
+        return actionQueue.push(a);
+    }
+    bool publish(ScheduleIndex* index) { return scheduleQueue.push(index); }
+    SpscQueue<ScheduleIndex*, 4>& retired() { return retiredQueue; }
+    SpscQueue<BellEvent, 32>& events() { return eventQueue; }
+    const SchedulerStats& stats() const { return counters; }
+
+    // --- Scheduler task ---
+
+    // Applies queued schedules and actions, times out the buzzer and rings
+    // if `minuteOfWeek` is a new minute with a bell (NO_MINUTE while the
+    // time is unknown).
+    void poll(uint16_t minuteOfWeek) {
+        uint64_t now = clock.micros();
+        uint32_t gap = lastPollUs ? (uint32_t)(now - lastPollUs) : 0;
+        lastPollUs = now;
+        counters.polls.fetch_add(1, std::memory_order_relaxed);
+        raiseMax(counters.maxPollGapUs, gap);
+
+        ScheduleIndex* next;
+        while (scheduleQueue.pop(next)) {
+            // Queues are the same size, so retired only fills if the network
+            // task stops draining it; then the old index is simply kept alive
+            if (active) retiredQueue.push(active);
+            active = next;
+        }
+
+        BellAction action;
+        while (actionQueue.pop(action)) run(action, now);
+
+        if (buzzerOn && buzzerDurationMs && clock.millis() - buzzerStartMs >= buzzerDurationMs) {
+            if (playing) player.stop(); // The audio ends with the bell
+            playing = false;
+            buzzerOff();
+            emit(EVENT_BUZZER_OFF, 0, NO_MINUTE, 0, 0, 0);
+        }
+
+        if (minuteOfWeek != lastMinute) {
+            lastMinute = minuteOfWeek;
+            if (minuteOfWeek < MINUTES_PER_WEEK && active && active->fires(minuteOfWeek)) {
+                const FireTime* f = active->firstAt(minuteOfWeek);
+                const BellEntry& e = active->entry(f->entry);
+                ring(e.duration ? e.duration * 1000u : defaultDurationMs, e.track);
+                counters.fires.fetch_add(1, std::memory_order_relaxed);
+                emit(EVENT_SCHEDULED, 0, minuteOfWeek, f->entry, e.track, gap);
+            }
+        }
+    }
+
+    bool buzzing() const { return buzzerOn; }
+
+    // Nothing in progress or queued: the task may wait for the next bell
+    bool idle() const { return !buzzerOn && !playing && actionQueue.size() == 0 && scheduleQueue.size() == 0; }
+
+    // Minutes from the start of `minuteOfWeek` to the start of the next
+    // bell's minute; 0 if this minute's bell has not rung yet, NO_BELL
+    // without a schedule. Scheduler task only.
+    uint32_t minutesToNextBell(uint16_t minuteOfWeek) const {
+        if (!active || !active->fireCount() || minuteOfWeek >= MINUTES_PER_WEEK) return NO_BELL;
+        if (minuteOfWeek != lastMinute && active->fires(minuteOfWeek)) return 0;
+        uint16_t next = active->nextFireAfter(minuteOfWeek);
+        return next > minuteOfWeek ? next - minuteOfWeek : next + MINUTES_PER_WEEK - minuteOfWeek;
+    }
+
+    // The task is about to wait on purpose (light sleep): the gap before
+    // the next poll is not a stall
+    void plannedWait() { lastPollUs = 0; }
+
+private:
+    void run(const BellAction& a, uint64_t now) {
+        switch (a.type) {
+            case ACTION_RING:
+                ring(a.durationMs, 0);
+                break;
+            case ACTION_BUZZER:
+                buzzerOnFor(a.durationMs);
+                break;
+            case ACTION_STOP:
+                player.stop();
+                playing = false;
+                buzzerOff();
+                break;
+        }
+        uint32_t latency = now > a.queuedUs ? (uint32_t)(now - a.queuedUs) : 0;
+        counters.actions.fetch_add(1, std::memory_order_relaxed);
+        raiseMax(counters.maxActionLatencyUs, latency);
+        emit(EVENT_ACTION, a.type, NO_MINUTE, 0, 0, latency);
+    }
+
+    void ring(uint32_t durationMs, uint16_t track) {
+        if (track) {
+            player.playFile(track);
+        } else {
+            player.play(1);
+        }
+        playing = true;
+        buzzerOnFor(durationMs);
+    }
+
+    void buzzerOnFor(uint32_t durationMs) {
+        // Tone works for passive and active buzzers
+        gpio.tone(buzzerPin, 1000);
+        buzzerOn = true;
+        buzzerStartMs = clock.millis();
+        buzzerDurationMs = durationMs;
+    }
+
+    void buzzerOff() {
+        gpio.noTone(buzzerPin);
+        gpio.write(buzzerPin, 0);
+        buzzerOn = false;
+    }
+
+    void emit(BellEventType type, uint8_t action, uint16_t minute, uint16_t entry, uint16_t track,
+              uint32_t latencyUs) {
+        BellEvent e = {type, action, minute, entry, track, latencyUs};
+        eventQueue.push(e); // Dropped (and counted) if the network task is behind
+    }
+
+    static void raiseMax(std::atomic<uint32_t>& slot, uint32_t value) {
+        if (value > slot.load(std::memory_order_relaxed)) slot.store(value, std::memory_order_relaxed);
+    }
+
+    hal::Clock& clock;
+    hal::Gpio& gpio;
+    hal::DFPlayer& player;
+    uint8_t buzzerPin;
+    uint32_t defaultDurationMs;
+
+    SpscQueue<BellAction, 16> actionQueue;
+    SpscQueue<ScheduleIndex*, 4> scheduleQueue;
+    SpscQueue<ScheduleIndex*, 4> retiredQueue;
+    SpscQueue<BellEvent, 32> eventQueue;
+    SchedulerStats counters;
+
+    ScheduleIndex* active = nullptr;
+    uint16_t lastMinute = NO_MINUTE;
+    uint64_t lastPollUs = 0;
+    bool buzzerOn = false;
+    bool playing = false; // Started by ring(), stopped when its time is up
+    uint32_t buzzerStartMs = 0;
+    uint32_t buzzerDurationMs = 0;
+};
+
+#endif
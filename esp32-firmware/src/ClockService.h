@@ -0,0 +1,156 @@
+#ifndef CLOCK_SERVICE_H
+#define CLOCK_SERVICE_H
+
+#include <stdint.h>
+#include "WallClock.h"
+
+// ==========================================
+// CLOCK SERVICE
+// ==========================================
+//
+// Local time computed from the monotonic clock (esp_timer, µs) and
+// disciplined by RTC reads and NTP samples. Answering "what time is it" is
+// a few integer operations and never touches I2C or the network:
+//
+//   local(mono) = baseLocal + e + e * drift + slew(e),   e = mono - baseMono
+//
+// * drift: how fast the monotonic oscillator runs against the reference,
+//   estimated from pairs of samples far enough apart that their
+//   uncertainty stays below DRIFT_RESOLUTION_PPB.
+// * slew: an offset found by a sample is worked off at SLEW_PPB instead of
+//   jumping, so local time stays monotonic and passes every minute
+//   boundary exactly once.
+// * Offsets above STEP_THRESHOLD_US (and the first sample) are stepped;
+//   a step is the only time a minute can be skipped or repeated.
+//
+// Not thread-safe: one task owns it (the scheduler); others hand it
+// samples through a queue.
+
+// A reading of the reference clock
+struct ClockSample {
+    int64_t localUs;        // What the source said, local epoch µs
+    uint64_t monoUs;        // Monotonic time the reading was valid at
+    uint32_t uncertaintyUs; // How far off the reading may be
+};
+
+class ClockService {
+public:
+    static const int64_t STEP_THRESHOLD_US = 120LL * 1000000; // Larger offsets are stepped
+    static const int64_t SLEW_PPB = 20000000;                 // 2 %: up to 1.2 s per minute
+    static const int64_t MAX_DRIFT_PPB = 500000;              // ±500 ppm, beyond that the sample is bad
+    static const int64_t DRIFT_RESOLUTION_PPB = 5000;         // Only estimate drift to within 5 ppm
+
+    bool isSet() const { return set; }
+
+    int64_t nowUs(uint64_t monoUs) const {
+        if (!set) return 0;
+        int64_t e = monoUs > baseMono ? (int64_t)(monoUs - baseMono) : 0;
+        return baseLocal + scale(e) + slewAt(e);
+    }
+
+    uint32_t nowSeconds(uint64_t monoUs) const { return (uint32_t)(nowUs(monoUs) / 1000000); }
+    uint16_t minuteOfWeek(uint64_t monoUs) const { return WallClock::minuteOfWeek(nowSeconds(monoUs)); }
+
+    // Monotonic µs until local time reaches `localUs`, erring early: drift
+    // is taken out and a slew still under way is counted against the wait.
+    // For planning a wake-up, not for timing a bell.
+    uint64_t monoUntil(int64_t localUs, uint64_t monoNowUs) const {
+        if (!set) return 0;
+        int64_t ahead = localUs - nowUs(monoNowUs);
+        int64_t e = monoNowUs > baseMono ? (int64_t)(monoNowUs - baseMono) : 0;
+        int64_t mono = ahead - ahead * drift / 1000000000LL - abs64(slewOffset - slewAt(e));
+        return mono > 0 ? (uint64_t)mono : 0;
+    }
+
+    // Applies a sample at monotonic time `monoNowUs` (>= sample.monoUs)
+    void discipline(const ClockSample& s, uint64_t monoNowUs) {
+        int64_t sampleNow = s.localUs + scale((int64_t)(monoNowUs - s.monoUs));
+        if (!set) {
+            step(sampleNow, monoNowUs, s);
+            return;
+        }
+        int64_t current = nowUs(monoNowUs);
+        int64_t offset = sampleNow - current;
+        lastOffset = offset;
+        if (abs64(offset) > STEP_THRESHOLD_US) {
+            step(sampleNow, monoNowUs, s);
+            return;
+        }
+
+        // An offset larger than drift could explain means the reference
+        // itself moved (NTP rewrote the RTC): start drift over from here
+        int64_t sinceLast = (int64_t)(s.monoUs - lastSampleMono);
+        int64_t explainable = 2 * (int64_t)s.uncertaintyUs + sinceLast / 1000 * MAX_DRIFT_PPB / 1000000;
+        if (abs64(offset) > explainable) {
+            anchor = s;
+        } else {
+            estimateDrift(s);
+        }
+        lastSampleMono = s.monoUs;
+
+        // Rebase at the current value (continuous), then slew the offset
+        baseLocal = current;
+        baseMono = monoNowUs;
+        slewOffset = abs64(offset) > (int64_t)s.uncertaintyUs ? offset : 0;
+        slewDuration = abs64(slewOffset) * 1000000000LL / SLEW_PPB;
+        if (slewOffset) slewCount++;
+    }
+
+    int32_t driftPpb() const { return (int32_t)drift; }
+    int64_t lastOffsetUs() const { return lastOffset; }
+    uint32_t steps() const { return stepCount; }
+    uint32_t slews() const { return slewCount; }
+
+private:
+    void step(int64_t local, uint64_t monoNowUs, const ClockSample& s) {
+        baseLocal = local;
+        baseMono = monoNowUs;
+        slewOffset = 0;
+        slewDuration = 0;
+        anchor = s;
+        lastSampleMono = s.monoUs;
+        set = true;
+        stepCount++;
+    }
+
+    void estimateDrift(const ClockSample& s) {
+        int64_t monoDelta = (int64_t)(s.monoUs - anchor.monoUs);
+        int64_t uncertainty = (int64_t)anchor.uncertaintyUs + s.uncertaintyUs;
+        if (monoDelta <= 0 || uncertainty * 1000000000LL / monoDelta > DRIFT_RESOLUTION_PPB) return;
+
+        // Rare and off the hot path, so double is fine here
+        double measured = (double)(s.localUs - anchor.localUs - monoDelta) * 1e9 / (double)monoDelta;
+        if (measured > MAX_DRIFT_PPB || measured < -MAX_DRIFT_PPB) {
+            anchor = s;
+            return;
+        }
+        drift = driftKnown ? drift + ((int64_t)measured - drift) / 4 : (int64_t)measured;
+        driftKnown = true;
+        anchor = s;
+    }
+
+    int64_t scale(int64_t e) const { return e + e * drift / 1000000000LL; }
+
+    int64_t slewAt(int64_t e) const {
+        if (slewOffset == 0) return 0;
+        if (e >= slewDuration) return slewOffset;
+        return slewOffset * e / slewDuration;
+    }
+
+    static int64_t abs64(int64_t v) { return v < 0 ? -v : v; }
+
+    bool set = false;
+    int64_t baseLocal = 0;
+    uint64_t baseMono = 0;
+    int64_t drift = 0; // ppb
+    bool driftKnown = false;
+    int64_t slewOffset = 0;
+    int64_t slewDuration = 0;
+    ClockSample anchor = {0, 0, 0};
+    uint64_t lastSampleMono = 0;
+    int64_t lastOffset = 0;
+    uint32_t stepCount = 0;
+    uint32_t slewCount = 0;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef CONNECTIVITY_MANAGER_H
+#define CONNECTIVITY_MANAGER_H
+
+#include <stdint.h>
+#include <atomic>
+
+// ==========================================
+// CONNECTIVITY MANAGER
+// ==========================================
+//
+// WiFi reconnect state machine that never blocks. Link events come in from
+// the WiFi event task (linkUp()/linkDown()); the network task calls
+// update() every pass and starts a connection attempt (WiFi.begin()) when
+// it returns CONN_ATTEMPT. Failed attempts back off exponentially from
+// BACKOFF_MIN_MS to BACKOFF_MAX_MS with jitter, so a fleet that lost the
+// same AP does not retry in lockstep.
+//
+//   OFFLINE --attempt--> CONNECTING --link up--> ONLINE
+//      ^                     |                     |
+//      +-- backoff elapsed --+-- fail / timeout    +-- link down (backoff)
+//
+// Cloud work is gated on online(); the bell scheduler does not depend on it.
+
+enum ConnState : uint8_t {
+    CONN_OFFLINE,    // Waiting for the backoff to elapse
+    CONN_CONNECTING, // Attempt in flight
+    CONN_ONLINE
+};
+
+enum ConnAction : uint8_t {
+    CONN_NONE,
+    CONN_ATTEMPT // Caller should start a connection attempt now
+};
+
+class ConnectivityManager {
+public:
+    static const uint32_t BACKOFF_MIN_MS = 1000;
+    static const uint32_t BACKOFF_MAX_MS = 5 * 60 * 1000;
+    static const uint32_t CONNECT_TIMEOUT_MS = 15 * 1000;
+
+    explicit ConnectivityManager(uint32_t seed = 1) : rng(seed ? seed : 1) {}
+
+    // --- WiFi event task ---
+    void linkUp() { up.store(true, std::memory_order_release); }
+    void linkDown() {
+        up.store(false, std::memory_order_release);
+        downEvents.fetch_add(1, std::memory_order_release);
+    }
+
+    // --- Network task ---
+    ConnAction update(uint32_t nowMs) {
+        changedFlag = false;
+        bool link = up.load(std::memory_order_acquire);
+        uint32_t downs = downEvents.load(std::memory_order_acquire);
+
+        if (link) {
+            if (current != CONN_ONLINE) enter(CONN_ONLINE, nowMs);
+            failures = 0;
+            seenDowns = downs;
+            return CONN_NONE;
+        }
+
+        switch (current) {
+            case CONN_ONLINE:
+                outageCount++;
+                seenDowns = downs;
+                scheduleRetry(nowMs);
+                return CONN_NONE;
+            case CONN_CONNECTING:
+                // A disconnect event during the attempt (no AP, bad
+                // password) fails it early; otherwise wait for the timeout
+                if (downs != seenDowns || nowMs - stateSince >= CONNECT_TIMEOUT_MS) {
+                    seenDowns = downs;
+                    failures++;
+                    scheduleRetry(nowMs);
+                }
+                return CONN_NONE;
+            case CONN_OFFLINE:
+                if ((int32_t)(nowMs - retryAt) < 0) return CONN_NONE;
+                seenDowns = downs;
+                attemptCount++;
+                enter(CONN_CONNECTING, nowMs);
+                return CONN_ATTEMPT;
+        }
+        return CONN_NONE;
+    }
+
+    bool online() const { return current == CONN_ONLINE; }
+    ConnState state() const { return current; }
+    bool changed() const { return changedFlag; } // State changed in the last update()
+    uint32_t retryInMs(uint32_t nowMs) const {
+        return current == CONN_OFFLINE && (int32_t)(retryAt - nowMs) > 0 ? retryAt - nowMs : 0;
+    }
+    uint32_t attempts() const { return attemptCount; }
+    uint32_t outages() const { return outageCount; }
+    uint32_t failedAttempts() const { return failures; } // Since the last success
+
+private:
+    void enter(ConnState s, uint32_t nowMs) {
+        current = s;
+        stateSince = nowMs;
+        changedFlag = true;
+    }
+
+    // Equal jitter: half the backoff fixed, half random
+    void scheduleRetry(uint32_t nowMs) {
+        uint32_t backoff = BACKOFF_MIN_MS;
+        for (uint32_t i = 0; i < failures && backoff < BACKOFF_MAX_MS; i++) backoff *= 2;
+        if (backoff > BACKOFF_MAX_MS) backoff = BACKOFF_MAX_MS;
+        retryAt = nowMs + backoff / 2 + next() % (backoff / 2 + 1);
+        enter(CONN_OFFLINE, nowMs);
+    }
+
+    uint32_t next() { // xorshift32
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return rng;
+    }
+
+    std::atomic<bool> up{false};
+    std::atomic<uint32_t> downEvents{0};
+    uint32_t seenDowns = 0;
+
+    ConnState current = CONN_OFFLINE;
+    uint32_t stateSince = 0;
+    uint32_t retryAt = 0;
+    uint32_t failures = 0;
+    uint32_t attemptCount = 0;
+    uint32_t outageCount = 0;
+    bool changedFlag = false;
+    uint32_t rng;
+};
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef DFPLAYER_DRIVER_H
+#define DFPLAYER_DRIVER_H
+
+#include <stdint.h>
+#include <atomic>
+#include "hal/Hal.h"
+#include "SpscQueue.h"
+
+// ==========================================
+// DFPLAYER DRIVER
+// ==========================================
+//
+// Speaks the DFPlayer Mini's serial protocol directly instead of through
+// the DFRobot library, whose calls sit on the UART waiting for the module.
+// play(), playFile(), stop() and volume() only queue a command and return;
+// poll(), called on every scheduler pass, runs one exchange at a time:
+//
+//   send with ACK requested --- 0x41 ACK --> done
+//                                  `-------> play: ask for the status (0x42)
+//                                            until it says playing; the time
+//                                            since play() is the latency
+//   no ACK in DF_ACK_TIMEOUT_MS       resend, DF_MAX_ATTEMPTS sends in all
+//   0x40 error 1 (module busy)        resend after DF_BUSY_RETRY_MS, for up
+//                                     to DF_BUSY_GIVE_UP_MS (card being read)
+//   any other 0x40                    the command failed
+//
+// A newer play/stop replaces one still waiting in the queue, so a burst of
+// RINGs cannot pile up behind a slow module. Frames the module sends on its
+// own are tracked as well: 0x3D track finished, 0x3A/0x3B card in/out and
+// 0x3F devices online (sent at power-up, and the answer to begin()).
+//
+// Frame: 7E FF 06 cmd ack paramH paramL sumH sumL EF; sum is the two's
+// complement of the bytes from FF to paramL.
+//
+// Used from one task only: setup() before the scheduler task starts, then
+// the scheduler task. events() and stats() are for the network task.
+
+static const uint8_t DF_QUEUE_SIZE = 8;
+static const uint32_t DF_ACK_TIMEOUT_MS = 200;      // 10-byte frame each way at 9600 baud is ~21 ms
+static const uint8_t DF_MAX_ATTEMPTS = 3;
+static const uint32_t DF_BUSY_RETRY_MS = 250;
+static const uint32_t DF_BUSY_GIVE_UP_MS = 3000;
+static const uint32_t DF_STATUS_INTERVAL_MS = 20;   // Between status queries while a play starts
+static const uint32_t DF_START_TIMEOUT_MS = 1000;   // ACK to playing
+static const uint32_t DF_FINISHED_REPEAT_MS = 200;  // The module reports each finish twice
+
+enum DFCommand : uint8_t {
+    DF_CMD_PLAY = 0x03,          // Nth file on the card, in copy order
+    DF_CMD_VOLUME = 0x06,        // 0..30
+    DF_CMD_PLAY_MP3 = 0x12,      // /mp3/NNNN.mp3
+    DF_CMD_STOP = 0x16,
+    DF_CMD_CARD_INSERTED = 0x3A, // From the module
+    DF_CMD_CARD_REMOVED = 0x3B,
+    DF_CMD_FINISHED = 0x3D,
+    DF_CMD_DEVICES = 0x3F,       // Query, and the answer: bit 1 = SD card
+    DF_CMD_ERROR = 0x40,
+    DF_CMD_ACK = 0x41,
+    DF_CMD_STATUS = 0x42         // Query, and the answer: low byte 1 = playing
+};
+
+static const uint16_t DF_ERROR_BUSY = 1;
+static const uint16_t DF_DEVICE_SD = 0x02;
+
+enum DFEventType : uint8_t {
+    DF_EVENT_PLAYING,  // A play was confirmed; latencyUs since play()
+    DF_EVENT_FINISHED, // A track ended by itself (param = track)
+    DF_EVENT_FAILED,   // A command was given up (error = module error, 0 = no answer)
+    DF_EVENT_CARD      // The card went online (param 1) or offline (param 0)
+};
+
+struct DFEvent {
+    DFEventType type;
+    uint8_t command;
+    uint16_t param;
+    uint16_t error;
+    uint32_t latencyUs;
+};
+
+// Counters written by the driver, readable from any task
+struct DFPlayerStats {
+    std::atomic<uint32_t> commands{0};  // Acknowledged
+    std::atomic<uint32_t> retries{0};
+    std::atomic<uint32_t> failures{0};
+    std::atomic<uint32_t> superseded{0}; // Plays/stops replaced before they were sent
+    std::atomic<uint32_t> dropped{0};    // Queue full
+    std::atomic<uint32_t> badFrames{0};
+    std::atomic<uint32_t> lastLatencyUs{0};
+    std::atomic<uint32_t> maxLatencyUs{0};
+    std::atomic<bool> cardOnline{false};
+};
+
+class DFPlayerDriver : public hal::DFPlayer {
+public:
+    DFPlayerDriver(hal::SerialPort& serial, hal::Clock& clock) : serial(serial), clock(clock) {}
+
+    // Never waits for the module: asks which devices are online, and the
+    // answer arrives as a DF_EVENT_CARD
+    bool begin() override { return enqueue(DF_CMD_DEVICES, 0); }
+    void volume(uint8_t level) override { enqueue(DF_CMD_VOLUME, level > 30 ? 30 : level); }
+    void play(uint16_t track) override { enqueue(DF_CMD_PLAY, track); }
+    void playFile(uint16_t track) override { enqueue(DF_CMD_PLAY_MP3, track); }
+    void stop() override { enqueue(DF_CMD_STOP, 0); }
+
+    // Reads what the module sent, then sends, resends or gives up on the
+    // command at the head of the queue. Does not wait for anything.
+    void poll() {
+        uint64_t now = clock.micros();
+        int c;
+        while ((c = serial.read()) >= 0) receive((uint8_t)c, now);
+        if (!queued) return;
+
+        const Request& r = queue[0];
+        switch (state) {
+            case IDLE:
+                if (now < resendAtUs) break;
+                if (!attempts) firstSentUs = now;
+                attempts++;
+                send(r.command, r.param, true);
+                state = WAIT_ACK;
+                deadlineUs = now + DF_ACK_TIMEOUT_MS * 1000ull;
+                break;
+            case WAIT_ACK:
+                if (now >= deadlineUs) retry(now, 0);
+                break;
+            case CONFIRMING:
+                if (now >= deadlineUs) {
+                    fail(0);
+                } else if (now >= resendAtUs) {
+                    send(DF_CMD_STATUS, 0, false);
+                    resendAtUs = now + DF_ACK_TIMEOUT_MS * 1000ull; // Ask again if the answer is lost
+                }
+                break;
+        }
+    }
+
+    bool idle() const { return !queued; }
+    SpscQueue<DFEvent, 16>& events() { return eventQueue; }
+    const DFPlayerStats& stats() const { return counters; }
+
+private:
+    enum State : uint8_t { IDLE, WAIT_ACK, CONFIRMING };
+
+    struct Request {
+        uint8_t command;
+        uint16_t param;
+        uint64_t queuedUs;
+    };
+
+    static bool isTransport(uint8_t command) {
+        return command == DF_CMD_PLAY || command == DF_CMD_PLAY_MP3 || command == DF_CMD_STOP;
+    }
+
+    bool enqueue(uint8_t command, uint16_t param) {
+        uint64_t now = clock.micros();
+        if (isTransport(command)) {
+            // A play that is only being confirmed is done with: the new
+            // command goes out next
+            if (queued && state == CONFIRMING) done();
+            uint8_t kept = 0;
+            for (uint8_t i = 0; i < queued; i++) {
+                bool inFlight = i == 0 && state != IDLE;
+                if (!inFlight && isTransport(queue[i].command)) {
+                    counters.superseded.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                queue[kept++] = queue[i];
+            }
+            queued = kept;
+        } else if (command == DF_CMD_VOLUME) {
+            for (uint8_t i = (state == IDLE ? 0 : 1); i < queued; i++) {
+                if (queue[i].command == command) {
+                    queue[i].param = param;
+                    return true;
+                }
+            }
+        }
+        if (queued == DF_QUEUE_SIZE) {
+            counters.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        queue[queued++] = {command, param, now};
+        return true;
+    }
+
+    void send(uint8_t command, uint16_t param, bool ack) {
+        uint8_t f[10] = {0x7E, 0xFF, 0x06, command, (uint8_t)(ack ? 1 : 0), (uint8_t)(param >> 8), (uint8_t)param,
+                         0, 0, 0xEF};
+        uint16_t sum = checksum(f);
+        f[7] = (uint8_t)(sum >> 8);
+        f[8] = (uint8_t)sum;
+        serial.write(f, sizeof(f));
+    }
+
+    static uint16_t checksum(const uint8_t* f) {
+        uint16_t sum = 0;
+        for (int i = 1; i < 7; i++) sum += f[i];
+        return (uint16_t)(0 - sum);
+    }
+
+    // Collects 10-byte frames; on a bad one, resyncs at the next 0x7E
+    void receive(uint8_t b, uint64_t now) {
+        if (!rxLength && b != 0x7E) return;
+        rx[rxLength++] = b;
+        if (rxLength < sizeof(rx)) return;
+
+        if (rx[1] == 0xFF && rx[2] == 0x06 && rx[9] == 0xEF && checksum(rx) == (uint16_t)(rx[7] << 8 | rx[8])) {
+            rxLength = 0;
+            handle(rx[3], (uint16_t)(rx[5] << 8 | rx[6]), now);
+            return;
+        }
+        counters.badFrames.fetch_add(1, std::memory_order_relaxed);
+        uint8_t start = 1;
+        while (start < rxLength && rx[start] != 0x7E) start++;
+        for (uint8_t i = start; i < rxLength; i++) rx[i - start] = rx[i];
+        rxLength -= start;
+    }
+
+    void handle(uint8_t command, uint16_t param, uint64_t now) {
+        switch (command) {
+            case DF_CMD_ACK:
+                if (state != WAIT_ACK) break;
+                counters.commands.fetch_add(1, std::memory_order_relaxed);
+                if (queue[0].command == DF_CMD_PLAY || queue[0].command == DF_CMD_PLAY_MP3) {
+                    state = CONFIRMING;
+                    deadlineUs = now + DF_START_TIMEOUT_MS * 1000ull;
+                    resendAtUs = now; // Ask for the status on the next poll
+                } else {
+                    done();
+                }
+                break;
+            case DF_CMD_STATUS:
+                if (state != CONFIRMING) break;
+                if ((param & 0xFF) == 1) {
+                    uint32_t latency = (uint32_t)(now - queue[0].queuedUs);
+                    counters.lastLatencyUs.store(latency, std::memory_order_relaxed);
+                    if (latency > counters.maxLatencyUs.load(std::memory_order_relaxed)) {
+                        counters.maxLatencyUs.store(latency, std::memory_order_relaxed);
+                    }
+                    emit(DF_EVENT_PLAYING, queue[0].command, queue[0].param, 0, latency);
+                    done();
+                } else {
+                    resendAtUs = now + DF_STATUS_INTERVAL_MS * 1000ull;
+                }
+                break;
+            case DF_CMD_ERROR:
+                if (state == IDLE) break; // Nothing of ours outstanding
+                if (param == DF_ERROR_BUSY && now - firstSentUs < DF_BUSY_GIVE_UP_MS * 1000ull) {
+                    attempts--; // Not the command's fault
+                    retry(now, param, DF_BUSY_RETRY_MS);
+                } else {
+                    fail(param);
+                }
+                break;
+            case DF_CMD_FINISHED:
+                if (param == lastFinished && now - lastFinishedUs < DF_FINISHED_REPEAT_MS * 1000ull) break;
+                lastFinished = param;
+                lastFinishedUs = now;
+                emit(DF_EVENT_FINISHED, command, param, 0, 0);
+                break;
+            case DF_CMD_CARD_INSERTED:
+                setCard(true);
+                break;
+            case DF_CMD_CARD_REMOVED:
+                setCard(false);
+                break;
+            case DF_CMD_DEVICES:
+                setCard(param & DF_DEVICE_SD);
+                break;
+        }
+    }
+
+    void retry(uint64_t now, uint16_t error, uint32_t delayMs = 0) {
+        if (attempts >= DF_MAX_ATTEMPTS) {
+            fail(error);
+            return;
+        }
+        counters.retries.fetch_add(1, std::memory_order_relaxed);
+        state = IDLE;
+        resendAtUs = now + delayMs * 1000ull;
+    }
+
+    void fail(uint16_t error) {
+        counters.failures.fetch_add(1, std::memory_order_relaxed);
+        emit(DF_EVENT_FAILED, queue[0].command, queue[0].param, error, 0);
+        done();
+    }
+
+    // Drops the head of the queue
+    void done() {
+        for (uint8_t i = 1; i < queued; i++) queue[i - 1] = queue[i];
+        queued--;
+        state = IDLE;
+        attempts = 0;
+        resendAtUs = 0;
+    }
+
+    void setCard(bool online) {
+        if (cardKnown && counters.cardOnline.load(std::memory_order_relaxed) == online) return;
+        cardKnown = true;
+        counters.cardOnline.store(online, std::memory_order_relaxed);
+        emit(DF_EVENT_CARD, DF_CMD_DEVICES, online ? 1 : 0, 0, 0);
+    }
+
+    void emit(DFEventType type, uint8_t command, uint16_t param, uint16_t error, uint32_t latencyUs) {
+        DFEvent e = {type, command, param, error, latencyUs};
+        eventQueue.push(e); // Dropped (and counted) if the network task is behind
+    }
+
+    hal::SerialPort& serial;
+    hal::Clock& clock;
+
+    Request queue[DF_QUEUE_SIZE];
+    uint8_t queued = 0;
+    State state = IDLE;
+    uint8_t attempts = 0;
+    uint64_t firstSentUs = 0;
+    uint64_t deadlineUs = 0;
+    uint64_t resendAtUs = 0;
+
+    uint8_t rx[10];
+    uint8_t rxLength = 0;
+    uint16_t lastFinished = 0;
+    uint64_t lastFinishedUs = 0;
+    bool cardKnown = false;
+
+    SpscQueue<DFEvent, 16> eventQueue;
+    DFPlayerStats counters;
+};
+
+#endif
@@ -0,0 +1,297 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ==========================================
+// DELTA PATCHES
+// ==========================================
+//
+// Firmware delta between two builds, applied while it downloads. The new
+// image is rebuilt from the running one (the source), so only the changes
+// travel. Generated on the host by `program --delta-make` (bench/DeltaTool.h).
+//
+// Format (integers little-endian, varints LEB128, svarints zigzag LEB128):
+//
+//   header   "ABD1", u32 source size, u32 target size,
+//            source sha256[32], target sha256[32]
+//   records  until target size bytes have been produced:
+//              varint diffLen, varint extraLen, svarint seek
+//              diff   diffLen target bytes = source bytes + delta, with the
+//                     delta as (varint zeros, varint n, n bytes) runs
+//              extra  extraLen literal bytes
+//            The source position starts at 0, moves past the diff bytes,
+//            then by seek. A record may only seek (both lengths 0).
+//
+// The diff form (bsdiff's idea) matters for firmware: after a small change
+// most moved code differs from the old copy only in a few address bytes,
+// which become short delta runs between long zero runs.
+//
+// DeltaDecoder takes the patch in pieces of any size. Its whole state is
+// DeltaState (plain data, no pointers), so a caller can save it and continue
+// after a reboot. RAM use is DeltaDecoder itself (DELTA_SCRATCH bytes).
+
+const uint32_t DELTA_MAGIC = 0x31444241; // "ABD1"
+const size_t DELTA_HEADER_SIZE = 4 + 4 + 4 + 32 + 32;
+const size_t DELTA_SCRATCH = 512;
+
+enum DeltaPhase : uint8_t {
+    DELTA_HEADER,
+    DELTA_DIFF_LEN,
+    DELTA_EXTRA_LEN,
+    DELTA_SEEK,
+    DELTA_ZEROS,     // Reading a zero-run length
+    DELTA_ZERO_RUN,  // Copying source bytes unchanged
+    DELTA_LIT_LEN,   // Reading a delta-run length
+    DELTA_LIT_RUN,   // Source bytes + delta bytes from the patch
+    DELTA_EXTRA,
+    DELTA_DONE,
+    DELTA_ERROR
+};
+
+struct DeltaState {
+    uint8_t phase;
+    uint8_t varShift;
+    uint8_t header[DELTA_HEADER_SIZE];
+    uint32_t headerGot;
+    uint32_t varValue;
+    uint32_t diffLeft;
+    uint32_t extraLeft;
+    uint32_t runLeft;
+    int32_t seek;
+    uint32_t srcPos;
+    uint32_t produced;
+};
+
+struct DeltaHeader {
+    uint32_t sourceSize;
+    uint32_t targetSize;
+    const uint8_t* sourceSha256;
+    const uint8_t* targetSha256;
+};
+
+// Where the decoder reads the running image and writes the new one
+class DeltaSink {
+public:
+    virtual ~DeltaSink() {}
+    virtual bool readSource(uint32_t offset, uint8_t* data, size_t length) = 0;
+    virtual bool emit(const uint8_t* data, size_t length) = 0;
+};
+
+class DeltaDecoder {
+public:
+    explicit DeltaDecoder(DeltaSink& sink) : sink(sink) { reset(); }
+
+    void reset() {
+        memset(&st, 0, sizeof(st));
+        st.phase = DELTA_HEADER;
+        lastError = "";
+    }
+
+    // Continue from a saved state (same patch, same source)
+    void restore(const DeltaState& saved) {
+        st = saved;
+        lastError = "";
+    }
+    const DeltaState& state() const { return st; }
+
+    bool headerReady() const { return st.headerGot == DELTA_HEADER_SIZE; }
+    DeltaHeader header() const {
+        return {le32(st.header + 4), le32(st.header + 8), st.header + 12, st.header + 44};
+    }
+
+    bool done() const { return st.phase == DELTA_DONE; }
+    bool failed() const { return st.phase == DELTA_ERROR; }
+    const char* error() const { return lastError; }
+    uint32_t produced() const { return st.produced; }
+
+    // Consumes all of `data`; false on a malformed patch or sink failure.
+    // Bytes past the end of the patch are an error.
+    bool feed(const uint8_t* data, size_t length) {
+        size_t pos = 0;
+        while (st.phase != DELTA_ERROR) {
+            switch (st.phase) {
+                case DELTA_HEADER: {
+                    if (pos == length) return true;
+                    size_t n = DELTA_HEADER_SIZE - st.headerGot;
+                    if (n > length - pos) n = length - pos;
+                    memcpy(st.header + st.headerGot, data + pos, n);
+                    st.headerGot += n;
+                    pos += n;
+                    if (st.headerGot < DELTA_HEADER_SIZE) return true;
+                    if (le32(st.header) != DELTA_MAGIC) return fail("not a delta patch");
+                    nextRecord();
+                    break;
+                }
+                case DELTA_DIFF_LEN:
+                case DELTA_EXTRA_LEN:
+                case DELTA_SEEK:
+                case DELTA_ZEROS:
+                case DELTA_LIT_LEN:
+                    if (pos == length) return true;
+                    if (!varint(data[pos++])) break;
+                    afterVarint();
+                    break;
+                case DELTA_ZERO_RUN: {
+                    // Needs no patch bytes: runs to the end of the zero run
+                    size_t n = st.runLeft < DELTA_SCRATCH ? st.runLeft : DELTA_SCRATCH;
+                    if (!source(scratch, n) || !emit(scratch, n)) break;
+                    st.runLeft -= n;
+                    if (st.runLeft == 0) st.phase = DELTA_LIT_LEN;
+                    break;
+                }
+                case DELTA_LIT_RUN: {
+                    if (pos == length) return true;
+                    size_t n = st.runLeft < DELTA_SCRATCH ? st.runLeft : DELTA_SCRATCH;
+                    if (n > length - pos) n = length - pos;
+                    if (!source(scratch, n)) break;
+                    for (size_t i = 0; i < n; i++) scratch[i] += data[pos + i];
+                    if (!emit(scratch, n)) break;
+                    pos += n;
+                    st.runLeft -= n;
+                    if (st.runLeft == 0) nextRun();
+                    break;
+                }
+                case DELTA_EXTRA: {
+                    if (pos == length) return true;
+                    size_t n = st.extraLeft;
+                    if (n > length - pos) n = length - pos;
+                    if (!emit(data + pos, n)) break;
+                    pos += n;
+                    st.extraLeft -= n;
+                    if (st.extraLeft == 0) afterExtra();
+                    break;
+                }
+                case DELTA_DONE:
+                    return pos == length || fail("data after the end of the patch");
+                default:
+                    return fail("bad decoder state");
+            }
+        }
+        return false;
+    }
+
+private:
+    static uint32_t le32(const uint8_t* p) {
+        return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    }
+
+    bool fail(const char* why) {
+        lastError = why;
+        st.phase = DELTA_ERROR;
+        return false;
+    }
+
+    // One LEB128 byte; true once the value is complete
+    bool varint(uint8_t b) {
+        if (st.varShift > 28) return fail("varint too long");
+        st.varValue |= (uint32_t)(b & 0x7F) << st.varShift;
+        st.varShift += 7;
+        return !(b & 0x80);
+    }
+
+    uint32_t takeVarint() {
+        uint32_t v = st.varValue;
+        st.varValue = 0;
+        st.varShift = 0;
+        return v;
+    }
+
+    void nextRecord() {
+        st.phase = st.produced == header().targetSize ? DELTA_DONE : DELTA_DIFF_LEN;
+    }
+
+    void afterVarint() {
+        uint32_t v = takeVarint();
+        uint32_t room = header().targetSize - st.produced;
+        switch (st.phase) {
+            case DELTA_DIFF_LEN:
+                if (v > room) {
+                    fail("record past the target size");
+                    return;
+                }
+                st.diffLeft = v;
+                st.phase = DELTA_EXTRA_LEN;
+                break;
+            case DELTA_EXTRA_LEN:
+                if (v > room - st.diffLeft) {
+                    fail("record past the target size");
+                    return;
+                }
+                st.extraLeft = v;
+                st.phase = DELTA_SEEK;
+                break;
+            case DELTA_SEEK:
+                st.seek = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+                nextRun();
+                break;
+            case DELTA_ZEROS:
+                if (v > st.diffLeft) {
+                    fail("run past the diff");
+                    return;
+                }
+                st.runLeft = v;
+                st.diffLeft -= v;
+                st.phase = v ? DELTA_ZERO_RUN : DELTA_LIT_LEN;
+                break;
+            case DELTA_LIT_LEN:
+                if (v > st.diffLeft) {
+                    fail("run past the diff");
+                    return;
+                }
+                st.runLeft = v;
+                st.diffLeft -= v;
+                if (v) {
+                    st.phase = DELTA_LIT_RUN;
+                } else {
+                    nextRun();
+                }
+                break;
+            default:
+                fail("bad decoder state");
+        }
+    }
+
+    // Next zero/delta run pair, or on to the extra bytes
+    void nextRun() {
+        if (st.diffLeft > 0) {
+            st.phase = DELTA_ZEROS;
+        } else if (st.extraLeft > 0) {
+            st.phase = DELTA_EXTRA;
+        } else {
+            afterExtra();
+        }
+    }
+
+    void afterExtra() {
+        int64_t next = (int64_t)st.srcPos + st.seek;
+        if (next < 0 || next > (int64_t)header().sourceSize) {
+            fail("seek outside the source");
+            return;
+        }
+        st.srcPos = (uint32_t)next;
+        nextRecord();
+    }
+
+    bool source(uint8_t* out, size_t n) {
+        if (st.srcPos + n > header().sourceSize) return fail("read past the source");
+        if (!sink.readSource(st.srcPos, out, n)) return fail("source read failed");
+        st.srcPos += n;
+        return true;
+    }
+
+    bool emit(const uint8_t* data, size_t n) {
+        if (!sink.emit(data, n)) return fail("write failed");
+        st.produced += n;
+        return true;
+    }
+
+    DeltaSink& sink;
+    DeltaState st;
+    const char* lastError = "";
+    uint8_t scratch[DELTA_SCRATCH];
+};
+
+#endif
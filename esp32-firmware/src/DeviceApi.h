@@ -0,0 +1,460 @@
+#ifndef DEVICE_API_H
+#define DEVICE_API_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <ArduinoJson.h>
+#include "hal/Hal.h"
+#include "ScheduleIndex.h"
+#include "Metrics.h"
+
+// Reader handed to ArduinoJson: pulls the body off the connection in small
+// chunks instead of one read() per byte.
+class HttpBodyReader {
+public:
+    explicit HttpBodyReader(hal::HttpClient& source) : source(source) {}
+
+    int read() {
+        if (pos == len && !fill()) return -1;
+        return (uint8_t)buffer[pos++];
+    }
+
+    size_t readBytes(char* out, size_t length) {
+        size_t n = 0;
+        while (n < length) {
+            if (pos == len && !fill()) break;
+            size_t chunk = std::min(length - n, len - pos);
+            memcpy(out + n, buffer + pos, chunk);
+            pos += chunk;
+            n += chunk;
+        }
+        return n;
+    }
+
+private:
+    bool fill() {
+        len = source.readBytes(buffer, sizeof(buffer));
+        pos = 0;
+        return len > 0;
+    }
+
+    hal::HttpClient& source;
+    char buffer[256];
+    size_t pos = 0;
+    size_t len = 0;
+};
+
+// md5 hex digest returned by get_device_config as "config_hash"
+const size_t CONFIG_HASH_LEN = 32;
+
+// Only the fields compileSchedules() and the config_hash check use are kept
+// when parsing a config
+inline JsonVariantConst scheduleFilter() {
+    static JsonDocument filter;
+    if (filter.isNull()) {
+        filter["status"] = true;
+        filter["config_hash"] = true;
+        filter["schedules"][0]["bell_time"] = true;
+        filter["schedules"][0]["days_of_week"] = true;
+        filter["schedules"][0]["audio_url"] = true;
+        filter["schedules"][0]["duration"] = true;
+    }
+    return filter.as<JsonVariantConst>();
+}
+
+// ==========================================
+// DEVICE API (Supabase RPCs)
+// ==========================================
+//
+// Request building and response parsing for the device-facing RPCs.
+// Portable: runs against hal::HttpClient, so the same code is used on the
+// ESP32 and in the host benchmarks (env:native).
+
+// One entry of an ack_commands batch
+struct CommandAck {
+    char id[24];         // command_queue.id, as text
+    bool ok;             // executed / failed
+    uint32_t executedAt; // Unix seconds (UTC), 0 = let the server use now()
+};
+
+// Largest request body: device_tick with telemetry, a metrics snapshot and a
+// full batch of acks
+const size_t REQUEST_BODY_SIZE = 3584;
+// JsonArena size for a device_tick response: a full batch of commands with
+// small payloads, on the ESP32 and on 64-bit hosts
+const size_t TICK_ARENA_SIZE = 6144;
+// Returned by the RPCs when a body does not fit REQUEST_BODY_SIZE (nothing is
+// sent; transport errors are -1)
+const int REQUEST_TOO_LARGE = -20;
+
+// Writes a flat JSON object into a caller's buffer, the way serializeJson()
+// would print it, without a JsonDocument or a heap string. A value that does
+// not fit marks the body as failed instead of cutting it off.
+class RequestBody {
+public:
+    RequestBody(char* buffer, size_t size) : buf(buffer), size(size) { put('{'); }
+
+    RequestBody& str(const char* key, const char* value) {
+        name(key);
+        put('"');
+        for (const char* p = value ? value : ""; *p; p++) {
+            uint8_t c = (uint8_t)*p;
+            if (c == '"' || c == '\\') {
+                put('\\');
+                put((char)c);
+            } else if (c == '\n') {
+                append("\\n");
+            } else if (c == '\r') {
+                append("\\r");
+            } else if (c == '\t') {
+                append("\\t");
+            } else if (c < 0x20) {
+                char esc[8];
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                append(esc);
+            } else {
+                put((char)c);
+            }
+        }
+        put('"');
+        return *this;
+    }
+
+    // `json` is already serialized (an object from snprintf, a snapshot)
+    RequestBody& raw(const char* key, const char* json) {
+        name(key);
+        append(json);
+        return *this;
+    }
+
+    RequestBody& num(const char* key, long long value) {
+        char digits[24];
+        snprintf(digits, sizeof(digits), "%lld", value);
+        return raw(key, digits);
+    }
+
+    // [{"id":<id>,"status":"executed"|"failed","executed_at":<s>},...]
+    RequestBody& acks(const char* key, const CommandAck* list, size_t count) {
+        name(key);
+        put('[');
+        for (size_t i = 0; i < count; i++) {
+            char item[96];
+            snprintf(item, sizeof(item), "%s{\"id\":%lld,\"status\":\"%s\",\"executed_at\":%lu}", i ? "," : "",
+                     strtoll(list[i].id, nullptr, 10), list[i].ok ? "executed" : "failed",
+                     (unsigned long)list[i].executedAt);
+            append(item);
+        }
+        put(']');
+        return *this;
+    }
+
+    // The finished body, or nullptr if it did not fit
+    const char* finish() {
+        put('}');
+        if (overflow) return nullptr;
+        buf[len] = '\0';
+        return buf;
+    }
+
+private:
+    void name(const char* key) {
+        if (len > 1) put(',');
+        put('"');
+        append(key);
+        put('"');
+        put(':');
+    }
+
+    void append(const char* text) {
+        while (*text) put(*text++);
+    }
+
+    void put(char c) {
+        if (len + 1 < size) {
+            buf[len++] = c;
+        } else {
+            overflow = true;
+        }
+    }
+
+    char* buf;
+    size_t size;
+    size_t len = 0;
+    bool overflow = false;
+};
+
+class DeviceApi {
+public:
+    // URL prefix and Authorization header are built once here; requests
+    // after that make no heap allocations of their own
+    DeviceApi(hal::HttpClient& http, const char* baseUrl, const char* apiKey)
+        : http(http), apiKey(apiKey), authHeader(std::string("Bearer ") + apiKey) {
+        int n = snprintf(url, sizeof(url), "%s/rest/v1/rpc/", baseUrl);
+        urlPrefix = n < 0 ? 0 : std::min((size_t)n, sizeof(url) - 1);
+    }
+
+    // Records each RPC's latency (post() to end()) in `m`
+    void setMetrics(Metrics* m) { metrics = m; }
+
+    // POSTs `body` to /rest/v1/rpc/<rpc>. On HTTP 200, if `out` is given, the
+    // response is deserialized straight from the connection into it, keeping
+    // only what `filter` selects (everything if null).
+    // Returns the HTTP status (negative on transport error).
+    int call(const char* rpc, const char* body, JsonDocument* out = nullptr,
+             JsonVariantConst filter = JsonVariantConst()) {
+        snprintf(url + urlPrefix, sizeof(url) - urlPrefix, "%s", rpc);
+
+        lastParseError = DeserializationError::Ok;
+        errorText[0] = '\0';
+
+        http.begin(url);
+        http.addHeader("apikey", apiKey);
+        http.addHeader("Authorization", authHeader.c_str());
+        http.addHeader("Content-Type", "application/json");
+
+        int code = http.post(body, strlen(body));
+        if (code == 200 && out) {
+            HttpBodyReader reader(http);
+            if (filter.isNull()) {
+                lastParseError = deserializeJson(*out, reader);
+            } else {
+                lastParseError = deserializeJson(*out, reader, DeserializationOption::Filter(filter));
+            }
+        } else if (code != 200 && code != 204) {
+            size_t n = http.readBytes(errorText, sizeof(errorText) - 1);
+            errorText[n] = '\0';
+        }
+        http.end();
+        if (metrics) {
+            HistogramId id = !strcmp(rpc, "device_tick")                ? M_RPC_TICK_US
+                             : !strcmp(rpc, "get_device_config")        ? M_RPC_CONFIG_US
+                             : !strcmp(rpc, "register_device_from_esp") ? M_RPC_REGISTER_US
+                                                                        : M_RPC_OTHER_US;
+            metrics->record(id, http.stats().lastLatencyUs);
+            if (code < 0) metrics->add(M_HTTP_FAILURES);
+        }
+        return code;
+    }
+
+    int registerDevice(const char* mac, const char* schoolCode, const char* name, JsonDocument& out) {
+        const char* body = RequestBody(bodyBuffer, sizeof(bodyBuffer))
+                               .str("p_mac_address", mac)
+                               .str("p_school_code", schoolCode) // Sends "" if empty
+                               .str("p_device_name", name)
+                               .finish();
+        return body ? call("register_device_from_esp", body, &out) : REQUEST_TOO_LARGE;
+    }
+
+    // Streams the config through scheduleFilter(). With a non-empty
+    // `knownHash` the server answers {"status":"unchanged"} if the config
+    // still matches (see configUnchanged()).
+    int getDeviceConfig(const char* mac, const char* knownHash, JsonDocument& out) {
+        char body[128];
+        if (knownHash && knownHash[0]) {
+            snprintf(body, sizeof(body), "{\"device_mac\": \"%s\", \"p_config_hash\": \"%.*s\"}", mac,
+                     (int)CONFIG_HASH_LEN, knownHash);
+        } else {
+            snprintf(body, sizeof(body), "{\"device_mac\": \"%s\"}", mac);
+        }
+        return call("get_device_config", body, &out, scheduleFilter());
+    }
+
+    int getNextCommand(const char* deviceId, JsonDocument& out) {
+        char body[80];
+        snprintf(body, sizeof(body), "{\"p_device_id\": \"%s\"}", deviceId);
+        return call("get_next_command", body, &out);
+    }
+
+    int ackCommand(const char* commandId) {
+        char body[64];
+        snprintf(body, sizeof(body), "{\"p_command_id\": %s}", commandId);
+        return call("ack_command", body);
+    }
+
+    // Up to `limit` pending commands in queue order, as a JSON array
+    int getPendingCommands(const char* deviceId, int limit, JsonDocument& out) {
+        char body[112];
+        snprintf(body, sizeof(body), "{\"p_device_id\": \"%s\", \"p_limit\": %d}", deviceId, limit);
+        return call("get_pending_commands", body, &out);
+    }
+
+    // Acks a whole batch in one request
+    int ackCommands(const char* deviceId, const CommandAck* acks, size_t count) {
+        const char* body =
+            RequestBody(bodyBuffer, sizeof(bodyBuffer)).str("p_device_id", deviceId).acks("p_acks", acks, count).finish();
+        return body ? call("ack_commands", body) : REQUEST_TOO_LARGE;
+    }
+
+    // Heartbeat, command poll and config check in one round trip. `acks` are
+    // applied before the pending commands are read; `telemetry` and
+    // `metrics` (a MetricsReport snapshot, stored in device_logs) are JSON
+    // objects or null. Response: {"commands": [...], "config_stale": bool}
+    int tick(const char* deviceId, const char* status, const char* configHash, const char* telemetry,
+             const CommandAck* acks, size_t ackCount, int limit, JsonDocument& out,
+             const char* metricsJson = nullptr) {
+        RequestBody req(bodyBuffer, sizeof(bodyBuffer));
+        req.str("p_device_id", deviceId).str("p_status", status);
+        if (configHash && configHash[0]) req.str("p_config_hash", configHash);
+        if (telemetry) req.raw("p_telemetry", telemetry);
+        if (metricsJson) req.raw("p_metrics", metricsJson);
+        if (ackCount) req.acks("p_acks", acks, ackCount);
+        const char* body = req.num("p_limit", limit).finish();
+        return body ? call("device_tick", body, &out) : REQUEST_TOO_LARGE;
+    }
+
+    int heartbeat(const char* deviceId, const char* status) {
+        char body[112];
+        snprintf(body, sizeof(body), "{\"p_device_id\": \"%s\", \"p_status\": \"%s\"}", deviceId, status);
+        return call("update_heartbeat", body);
+    }
+
+    // Result of deserializing the last 200 response
+    DeserializationError parseError() const { return lastParseError; }
+    // Start of the last error response body, for logging
+    const char* errorBody() const { return errorText; }
+
+private:
+    hal::HttpClient& http;
+    const char* apiKey;
+    std::string authHeader;
+    char url[160];
+    size_t urlPrefix = 0;
+    char bodyBuffer[REQUEST_BODY_SIZE];
+    DeserializationError lastParseError;
+    char errorText[128] = "";
+    Metrics* metrics = nullptr;
+};
+
+// ==========================================
+// RESPONSE PARSING
+// ==========================================
+
+enum CommandStatus {
+    COMMAND_NONE,     // Nothing pending
+    COMMAND_OK,
+    COMMAND_MALFORMED // Object without a 'command' field
+};
+
+struct Command {
+    char id[24];     // command_queue.id, as text ("" if missing)
+    char name[24];   // RING, TEST_BUZZER, SYNC_TIME, CONFIG, REBOOT, UPDATE_FIRMWARE
+    JsonVariantConst payload;
+};
+
+// Extracts the command from a get_next_command response (single object or
+// array), or from one element of a get_pending_commands array
+inline CommandStatus parseCommand(JsonVariantConst data, Command& out) {
+    if (data.is<JsonArrayConst>()) {
+        if (data.size() == 0) return COMMAND_NONE; // Normal, no commands pending
+        data = data[0];
+    }
+    if (!data.is<JsonObjectConst>()) return COMMAND_NONE;
+
+    const char* name = data["command"];
+    if (!name) return COMMAND_MALFORMED;
+
+    JsonVariantConst id = data["id"];
+    if (id.is<long long>()) {
+        snprintf(out.id, sizeof(out.id), "%lld", id.as<long long>());
+    } else if (id.is<const char*>()) {
+        snprintf(out.id, sizeof(out.id), "%s", id.as<const char*>());
+    } else {
+        out.id[0] = '\0';
+    }
+    snprintf(out.name, sizeof(out.name), "%s", name);
+    out.payload = data["payload"];
+    return COMMAND_OK;
+}
+
+enum ScheduleStatus {
+    SCHEDULE_OK,
+    SCHEDULE_NOT_ARRAY,    // "schedules" missing or not an array
+    SCHEDULE_BAD_TIME,     // bell_time not "HH:MM" or "HH:MM:SS" within a day
+    SCHEDULE_BAD_DAYS,     // days_of_week not an array of 0..6
+    SCHEDULE_BAD_DURATION, // duration neither null nor 0..65535 seconds
+    SCHEDULE_TOO_LARGE     // Over the index's entry or audio URL limits
+};
+
+inline const char* scheduleStatusName(ScheduleStatus status) {
+    switch (status) {
+        case SCHEDULE_OK:           return "ok";
+        case SCHEDULE_NOT_ARRAY:    return "schedules is not an array";
+        case SCHEDULE_BAD_TIME:     return "bad bell_time";
+        case SCHEDULE_BAD_DAYS:     return "bad days_of_week";
+        case SCHEDULE_BAD_DURATION: return "bad duration";
+        case SCHEDULE_TOO_LARGE:    return "too many entries or audio URLs";
+    }
+    return "?";
+}
+
+// "HH:MM" or "HH:MM:SS" (Postgres time::text); the seconds are ignored
+inline bool parseBellTime(const char* str, int& hour, int& minute) {
+    int h, m, sec = 0, n = 0;
+    if (!str || sscanf(str, "%2d:%2d%n", &h, &m, &n) != 2) return false;
+    if (str[n] == ':') {
+        int k = 0;
+        if (sscanf(str + n, ":%2d%n", &sec, &k) != 1) return false;
+        n += k;
+    }
+    if (str[n] || h < 0 || h > 23 || m < 0 || m > 59 || sec < 0 || sec > 59) return false;
+    hour = h;
+    minute = m;
+    return true;
+}
+
+// Compiles the "schedules" array of a get_device_config response into `out`.
+// All or nothing: the first invalid entry rejects the whole array, leaves
+// `out` untouched and is reported through `badEntry`, so a broken update
+// can never replace a working timetable with a partial one.
+inline ScheduleStatus compileSchedules(JsonArrayConst arr, ScheduleIndex& out, size_t* badEntry = nullptr) {
+    if (arr.isNull()) return SCHEDULE_NOT_ARRAY;
+
+    ScheduleIndexBuilder builder;
+    builder.reserve(arr.size());
+    size_t i = 0;
+    for (JsonObjectConst obj : arr) {
+        ScheduleStatus status = SCHEDULE_OK;
+        int h = 0, m = 0;
+        uint8_t dayMask = 0;
+        JsonArrayConst days = obj["days_of_week"].as<JsonArrayConst>();
+        JsonVariantConst duration = obj["duration"];
+
+        if (!parseBellTime(obj["bell_time"].as<const char*>(), h, m)) {
+            status = SCHEDULE_BAD_TIME;
+        } else if (days.isNull()) {
+            status = SCHEDULE_BAD_DAYS;
+        } else if (!duration.isNull() && !(duration.is<long>() && duration.as<long>() >= 0 &&
+                                           duration.as<long>() <= 0xFFFF)) {
+            status = SCHEDULE_BAD_DURATION;
+        }
+        for (JsonVariantConst d : days) {
+            if (status != SCHEDULE_OK) break;
+            if (!d.is<int>() || d.as<int>() < 0 || d.as<int>() > 6) status = SCHEDULE_BAD_DAYS;
+            else dayMask |= (uint8_t)(1 << d.as<int>());
+        }
+        if (status == SCHEDULE_OK &&
+            !builder.add(h, m, dayMask, (uint16_t)(duration | 0), obj["audio_url"].as<const char*>())) {
+            status = SCHEDULE_TOO_LARGE;
+        }
+        if (status != SCHEDULE_OK) {
+            if (badEntry) *badEntry = i;
+            return status;
+        }
+        i++;
+    }
+
+    builder.build(out);
+    return SCHEDULE_OK;
+}
+
+// True for the short reply get_device_config sends when the caller's
+// config_hash is still current
+inline bool configUnchanged(JsonVariantConst config) {
+    const char* status = config["status"];
+    return status && strcmp(status, "unchanged") == 0;
+}
+
+#endif
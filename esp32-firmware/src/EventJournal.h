@@ -0,0 +1,356 @@
+#ifndef EVENT_JOURNAL_H
+#define EVENT_JOURNAL_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include "hal/Hal.h"
+
+// ==========================================
+// EVENT JOURNAL
+// ==========================================
+//
+// Append-only record of what the device did, kept on LittleFS through
+// outages and reboots until JournalUploader has replayed it to the server:
+//
+//   JOURNAL_BELL     a scheduled bell rang
+//   JOURNAL_COMMAND  a command ran; its ack is pending until...
+//   JOURNAL_ACKED    ...a tick delivered the ack (local only, not uploaded)
+//
+// Records are 48 bytes with a sequence number and a checksum, appended to
+// two segment files of JOURNAL_SEGMENT_RECORDS each. When the active one is
+// full the older one is restarted, so the journal stays under 2 x 6 KB;
+// records dropped that way before they were uploaded count in lost().
+// Writes are flushed every JOURNAL_SYNC_RECORDS records or JOURNAL_SYNC_MS
+// rather than per record, to spare the flash; a power cut loses at most
+// that tail, and a torn record at the end fails its checksum and is cut
+// off by begin().
+//
+// "/journal.pos" holds the journal id and the last uploaded seq; it is
+// rewritten once per uploaded batch. The id is random per journal, so
+// (device, journal id, seq) names a record even if the flash is wiped and
+// numbering starts over.
+//
+// Network task only.
+
+static const uint16_t JOURNAL_SEGMENT_RECORDS = 128;
+static const uint8_t JOURNAL_SYNC_RECORDS = 8;
+static const uint32_t JOURNAL_SYNC_MS = 30000;
+static const uint8_t JOURNAL_MAX_UNACKED = 16;
+
+static const char* const JOURNAL_SEGMENT_PATHS[2] = {"/journal.0", "/journal.1"};
+static const char* const JOURNAL_POS = "/journal.pos";
+static const char* const JOURNAL_POS_TMP = "/journal.pos.tmp";
+
+enum JournalType : uint8_t {
+    JOURNAL_BELL = 1,
+    JOURNAL_COMMAND = 2,
+    JOURNAL_ACKED = 3,
+    JOURNAL_SEGMENT = 0x5A // First record of a segment file: seq = first seq, commandId = journal id
+};
+
+struct JournalRecord {
+    uint32_t seq;
+    uint32_t time;         // Unix seconds (UTC), 0 if the clock was not set
+    uint8_t type;          // JournalType
+    uint8_t ok;            // COMMAND: executed
+    uint16_t minuteOfWeek; // BELL
+    uint16_t entry;        // BELL: schedule entry
+    uint16_t track;        // BELL: cached audio played, 0 = default
+    int64_t commandId;     // COMMAND, ACKED
+    char command[22];      // COMMAND: name
+    uint16_t check;
+};
+static_assert(sizeof(JournalRecord) == 48, "JournalRecord is stored as is");
+
+class EventJournal {
+public:
+    explicit EventJournal(hal::FileSystem& fs) : fs(fs) {}
+
+    // Finds the segments, cuts off a torn tail and loads the upload
+    // position. `seed` names a new journal if there is none.
+    bool begin(uint32_t seed) {
+        journalId = 0;
+        for (uint8_t s = 0; s < 2; s++) scanSegment(s);
+
+        if (!valid[0] && !valid[1]) {
+            journalId = seed ? seed : 1;
+            active = 0;
+            if (!startSegment(0, 1)) return false;
+            fs.remove(JOURNAL_SEGMENT_PATHS[1]);
+        } else {
+            active = (!valid[1] || (valid[0] && firstSeq[0] > firstSeq[1])) ? 0 : 1;
+            uint8_t other = 1 - active;
+            // A segment from another journal, or one that does not end
+            // where the active one starts, is of no use
+            if (valid[other] && (ids[other] != ids[active] || firstSeq[other] + count[other] != firstSeq[active])) {
+                valid[other] = false;
+                count[other] = 0;
+                fs.remove(JOURNAL_SEGMENT_PATHS[other]);
+            }
+            journalId = ids[active];
+        }
+        nextSeq = firstSeq[active] + count[active];
+        ready = true;
+        loadPosition();
+        return true;
+    }
+
+    bool isReady() const { return ready; }
+    uint32_t id() const { return journalId; }
+    uint32_t pending() const { return nextSeq - 1 - uploadedSeq; }
+    uint32_t uploaded() const { return uploadedSeq; }
+    uint32_t lost() const { return lostCount; }
+    uint32_t size() const { return count[0] + count[1]; }
+
+    bool appendBell(uint32_t time, uint16_t minuteOfWeek, uint16_t entry, uint16_t track, uint32_t nowMs) {
+        JournalRecord r = {};
+        r.type = JOURNAL_BELL;
+        r.time = time;
+        r.minuteOfWeek = minuteOfWeek;
+        r.entry = entry;
+        r.track = track;
+        return append(r, nowMs);
+    }
+
+    bool appendCommand(uint32_t time, int64_t commandId, const char* name, bool ok, uint32_t nowMs) {
+        JournalRecord r = {};
+        r.type = JOURNAL_COMMAND;
+        r.time = time;
+        r.commandId = commandId;
+        r.ok = ok ? 1 : 0;
+        snprintf(r.command, sizeof(r.command), "%s", name);
+        return append(r, nowMs);
+    }
+
+    bool appendAcked(int64_t commandId, uint32_t nowMs) {
+        JournalRecord r = {};
+        r.type = JOURNAL_ACKED;
+        r.commandId = commandId;
+        return append(r, nowMs);
+    }
+
+    // Flushes once the oldest unflushed record is JOURNAL_SYNC_MS old
+    void tick(uint32_t nowMs) {
+        if (unsynced && nowMs - firstUnsyncedMs >= JOURNAL_SYNC_MS) sync();
+    }
+
+    // Time until tick() flushes, UINT32_MAX with nothing unflushed
+    uint32_t syncInMs(uint32_t nowMs) const {
+        if (!unsynced) return UINT32_MAX;
+        return nowMs - firstUnsyncedMs >= JOURNAL_SYNC_MS ? 0 : JOURNAL_SYNC_MS - (nowMs - firstUnsyncedMs);
+    }
+
+    void sync() {
+        if (out) out->flush();
+        unsynced = 0;
+    }
+
+    // Up to `max` records from seq `from` on, oldest first (flushes first)
+    size_t read(uint32_t from, JournalRecord* records, size_t max) {
+        sync();
+        size_t n = 0;
+        forEach([&](const JournalRecord& r) {
+            if (r.seq >= from && n < max) records[n++] = r;
+            return n < max;
+        });
+        return n;
+    }
+
+    // The server has every record up to `seq`
+    bool markUploaded(uint32_t seq) {
+        if (seq <= uploadedSeq || seq >= nextSeq) return false;
+        uploadedSeq = seq;
+        return savePosition();
+    }
+
+    // Commands whose ack never reached the server (at most
+    // JOURNAL_MAX_UNACKED, the latest), oldest first
+    template <typename F>
+    void forEachUnacked(F f) {
+        JournalRecord unacked[JOURNAL_MAX_UNACKED];
+        size_t n = 0;
+        forEach([&](const JournalRecord& r) {
+            if (r.type == JOURNAL_COMMAND) {
+                if (n == JOURNAL_MAX_UNACKED) {
+                    memmove(unacked, unacked + 1, sizeof(unacked[0]) * (n - 1));
+                    n--;
+                }
+                unacked[n++] = r;
+            } else if (r.type == JOURNAL_ACKED) {
+                for (size_t i = 0; i < n; i++) {
+                    if (unacked[i].commandId != r.commandId) continue;
+                    memmove(unacked + i, unacked + i + 1, sizeof(unacked[0]) * (n - i - 1));
+                    n--;
+                    break;
+                }
+            }
+            return true;
+        });
+        for (size_t i = 0; i < n; i++) f(unacked[i]);
+    }
+
+private:
+    static uint16_t checksum(const JournalRecord& r) {
+        // Fletcher-16 over everything but the check field
+        const uint8_t* p = (const uint8_t*)&r;
+        uint16_t a = 0x5A, b = 0;
+        for (size_t i = 0; i < offsetof(JournalRecord, check); i++) {
+            a = (a + p[i]) % 255;
+            b = (b + a) % 255;
+        }
+        return (uint16_t)(b << 8 | a);
+    }
+
+    bool append(JournalRecord& r, uint32_t nowMs) {
+        if (!ready) return false;
+        if (count[active] >= JOURNAL_SEGMENT_RECORDS && !rotate()) return false;
+        if (!out) out = fs.open(JOURNAL_SEGMENT_PATHS[active], "a");
+        if (!out) return false;
+
+        r.seq = nextSeq;
+        r.check = checksum(r);
+        if (out->write((const uint8_t*)&r, sizeof(r)) != sizeof(r)) {
+            out.reset();
+            return false;
+        }
+        nextSeq++;
+        count[active]++;
+        if (!unsynced++) firstUnsyncedMs = nowMs;
+        if (unsynced >= JOURNAL_SYNC_RECORDS) sync();
+        return true;
+    }
+
+    // Restarts the older segment as the active one
+    bool rotate() {
+        sync();
+        out.reset();
+        uint8_t older = 1 - active;
+        if (valid[older]) {
+            uint32_t end = firstSeq[older] + count[older];
+            uint32_t from = uploadedSeq + 1 > firstSeq[older] ? uploadedSeq + 1 : firstSeq[older];
+            if (end > from) lostCount += end - from;
+        }
+        if (!startSegment(older, nextSeq)) return false;
+        active = older;
+        // The remaining segment is now the oldest data
+        if (uploadedSeq + 1 < firstSeq[1 - active]) uploadedSeq = firstSeq[1 - active] - 1;
+        return true;
+    }
+
+    bool startSegment(uint8_t s, uint32_t first) {
+        std::unique_ptr<hal::File> f = fs.open(JOURNAL_SEGMENT_PATHS[s], "w");
+        if (!f) return false;
+        JournalRecord h = {};
+        h.seq = first;
+        h.type = JOURNAL_SEGMENT;
+        h.commandId = journalId;
+        h.check = checksum(h);
+        bool ok = f->write((const uint8_t*)&h, sizeof(h)) == sizeof(h);
+        f->close();
+        valid[s] = ok;
+        ids[s] = journalId;
+        firstSeq[s] = first;
+        count[s] = 0;
+        return ok;
+    }
+
+    // Reads a segment's header and counts its intact records; rewrites it
+    // without a torn or corrupt tail
+    void scanSegment(uint8_t s) {
+        valid[s] = false;
+        count[s] = 0;
+        std::unique_ptr<hal::File> f = fs.open(JOURNAL_SEGMENT_PATHS[s], "r");
+        if (!f) return;
+        size_t fileSize = f->size();
+        JournalRecord h;
+        if (f->readBytes((char*)&h, sizeof(h)) != sizeof(h) || h.type != JOURNAL_SEGMENT || h.check != checksum(h)) {
+            return;
+        }
+        valid[s] = true;
+        ids[s] = (uint32_t)h.commandId;
+        firstSeq[s] = h.seq;
+        JournalRecord r;
+        while (count[s] < JOURNAL_SEGMENT_RECORDS && f->readBytes((char*)&r, sizeof(r)) == sizeof(r) &&
+               r.check == checksum(r) && r.seq == firstSeq[s] + count[s]) {
+            count[s]++;
+        }
+        f->close();
+        if (fileSize != sizeof(JournalRecord) * (1 + count[s])) truncateSegment(s);
+    }
+
+    void truncateSegment(uint8_t s) {
+        static const char* TMP = "/journal.tmp";
+        std::unique_ptr<hal::File> in = fs.open(JOURNAL_SEGMENT_PATHS[s], "r");
+        std::unique_ptr<hal::File> copy = fs.open(TMP, "w");
+        if (!in || !copy) return;
+        JournalRecord r;
+        for (uint16_t i = 0; i <= count[s]; i++) {
+            if (in->readBytes((char*)&r, sizeof(r)) != sizeof(r)) break;
+            copy->write((const uint8_t*)&r, sizeof(r));
+        }
+        in->close();
+        copy->close();
+        fs.rename(TMP, JOURNAL_SEGMENT_PATHS[s]);
+    }
+
+    // Calls f(record) oldest first until it returns false
+    template <typename F>
+    void forEach(F f) {
+        uint8_t order[2] = {(uint8_t)(1 - active), active};
+        for (uint8_t s : order) {
+            if (!valid[s] || !count[s]) continue;
+            std::unique_ptr<hal::File> in = fs.open(JOURNAL_SEGMENT_PATHS[s], "r");
+            if (!in) continue;
+            JournalRecord r;
+            in->readBytes((char*)&r, sizeof(r)); // Header
+            for (uint16_t i = 0; i < count[s]; i++) {
+                if (in->readBytes((char*)&r, sizeof(r)) != sizeof(r) || r.check != checksum(r)) break;
+                if (!f(r)) return;
+            }
+        }
+    }
+
+    void loadPosition() {
+        uint32_t oldest = valid[1 - active] ? firstSeq[1 - active] : firstSeq[active];
+        uploadedSeq = oldest - 1;
+        std::unique_ptr<hal::File> f = fs.open(JOURNAL_POS, "r");
+        if (!f) return;
+        char text[32] = "";
+        text[f->readBytes(text, sizeof(text) - 1)] = '\0';
+        unsigned id = 0, seq = 0;
+        if (sscanf(text, "%u %u", &id, &seq) == 2 && id == journalId && seq >= oldest - 1 && seq < nextSeq) {
+            uploadedSeq = seq;
+        }
+    }
+
+    bool savePosition() {
+        std::unique_ptr<hal::File> f = fs.open(JOURNAL_POS_TMP, "w");
+        if (!f) return false;
+        char text[32];
+        int n = snprintf(text, sizeof(text), "%u %u\n", (unsigned)journalId, (unsigned)uploadedSeq);
+        bool ok = f->write((const uint8_t*)text, n) == (size_t)n;
+        f->close();
+        return ok && fs.rename(JOURNAL_POS_TMP, JOURNAL_POS);
+    }
+
+    hal::FileSystem& fs;
+    std::unique_ptr<hal::File> out; // Append handle on the active segment
+
+    bool ready = false;
+    uint32_t journalId = 0;
+    bool valid[2] = {};
+    uint32_t ids[2] = {};
+    uint32_t firstSeq[2] = {};
+    uint16_t count[2] = {};
+    uint8_t active = 0;
+    uint32_t nextSeq = 1;
+    uint32_t uploadedSeq = 0;
+    uint32_t lostCount = 0;
+    uint8_t unsynced = 0;
+    uint32_t firstUnsyncedMs = 0;
+};
+
+#endif
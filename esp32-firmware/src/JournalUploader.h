@@ -0,0 +1,163 @@
+#ifndef JOURNAL_UPLOADER_H
+#define JOURNAL_UPLOADER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "EventJournal.h"
+#include "DeviceApi.h"
+
+// ==========================================
+// JOURNAL UPLOADER
+// ==========================================
+//
+// Replays EventJournal to upload_device_events, JOURNAL_BATCH records per
+// request and at most one request per step():
+//
+//   - after boot and after every reconnect (reconnected()), batches go out
+//     back to back until the journal is caught up;
+//   - otherwise only full batches, or a partial one once its oldest record
+//     waited JOURNAL_UPLOAD_MS, so an online device does not pay a round
+//     trip per bell;
+//   - a failed request backs off from JOURNAL_RETRY_MIN_MS, doubling up to
+//     JOURNAL_RETRY_MAX_MS.
+//
+// The server keys events on (device, journal id, seq) and ignores ones it
+// already has, so a batch whose response was lost is simply sent again.
+// ACKED records only move the upload position.
+//
+// The request body is built in a fixed buffer: no allocation per upload.
+// Network task only.
+
+static const size_t JOURNAL_BATCH = 32;
+static const uint32_t JOURNAL_UPLOAD_MS = 10 * 60 * 1000;
+static const uint32_t JOURNAL_RETRY_MIN_MS = 30 * 1000;
+static const uint32_t JOURNAL_RETRY_MAX_MS = 10 * 60 * 1000;
+
+enum JournalStep : uint8_t {
+    JOURNAL_IDLE,     // Nothing due
+    JOURNAL_UPLOADED, // One batch accepted
+    JOURNAL_FAILED    // Request failed, retried after the backoff
+};
+
+class JournalUploader {
+public:
+    JournalUploader(EventJournal& journal, DeviceApi& api) : journal(journal), api(api) {}
+
+    // Upload everything right away (the device just got back online)
+    void reconnected() {
+        draining = true;
+        retryAtMs = 0;
+        retrying = false;
+    }
+
+    JournalStep step(const char* deviceId, uint32_t nowMs) {
+        if (!journal.isReady()) return JOURNAL_IDLE;
+        uint32_t pending = journal.pending();
+        if (!pending) {
+            draining = false;
+            waiting = false;
+            return JOURNAL_IDLE;
+        }
+        if (!waiting) {
+            waiting = true;
+            waitingSinceMs = nowMs;
+        }
+        if (retrying && (int32_t)(nowMs - retryAtMs) < 0) return JOURNAL_IDLE;
+        if (!draining && pending < JOURNAL_BATCH && nowMs - waitingSinceMs < JOURNAL_UPLOAD_MS) {
+            return JOURNAL_IDLE;
+        }
+
+        size_t n = journal.read(journal.uploaded() + 1, records, JOURNAL_BATCH);
+        if (!n) return JOURNAL_IDLE;
+        size_t events = 0;
+        // Every record fits in 128 bytes, so writeBody() cannot run out of
+        // room; if it ever did, skipping the batch beats stalling forever
+        if (writeBody(deviceId, n, events) && events) {
+            int code = api.call("upload_device_events", body);
+            if (code != 200 && code != 204) {
+                failures++;
+                retryAtMs = nowMs + backoffMs;
+                retrying = true;
+                backoffMs = backoffMs * 2 > JOURNAL_RETRY_MAX_MS ? JOURNAL_RETRY_MAX_MS : backoffMs * 2;
+                lastCode = code;
+                return JOURNAL_FAILED;
+            }
+        }
+        journal.markUploaded(records[n - 1].seq);
+        sent += events;
+        retrying = false;
+        backoffMs = JOURNAL_RETRY_MIN_MS;
+        waitingSinceMs = nowMs; // The rest is newer
+        if (!journal.pending()) draining = false;
+        return JOURNAL_UPLOADED;
+    }
+
+    // Time until step() has a batch to send, UINT32_MAX with nothing pending
+    uint32_t idleMs(uint32_t nowMs) const {
+        uint32_t pending = journal.isReady() ? journal.pending() : 0;
+        if (!pending) return UINT32_MAX;
+        uint32_t at = nowMs;
+        if (!draining && pending < JOURNAL_BATCH) at = (waiting ? waitingSinceMs : nowMs) + JOURNAL_UPLOAD_MS;
+        if (retrying && (int32_t)(retryAtMs - at) > 0) at = retryAtMs;
+        return (int32_t)(at - nowMs) > 0 ? at - nowMs : 0;
+    }
+
+    uint32_t uploadedEvents() const { return sent; }
+    uint32_t failedRequests() const { return failures; }
+    int lastError() const { return lastCode; }
+
+private:
+    // {"p_device_id":"...","p_journal":N,"p_events":[{"seq":1,"type":"bell","at":...},...]}
+    bool writeBody(const char* deviceId, size_t n, size_t& events) {
+        size_t used = 0;
+        auto append = [&](int written) {
+            used = written < 0 || used + (size_t)written >= sizeof(body) ? sizeof(body) : used + (size_t)written;
+        };
+        append(snprintf(body, sizeof(body), "{\"p_device_id\":\"%s\",\"p_journal\":%u,\"p_events\":[", deviceId,
+                        (unsigned)journal.id()));
+        for (size_t i = 0; i < n && used < sizeof(body); i++) {
+            const JournalRecord& r = records[i];
+            const char* sep = events ? "," : "";
+            if (r.type == JOURNAL_BELL) {
+                append(snprintf(body + used, sizeof(body) - used,
+                                "%s{\"seq\":%u,\"type\":\"bell\",\"at\":%u,\"minute_of_week\":%u,\"entry\":%u,"
+                                "\"track\":%u}",
+                                sep, (unsigned)r.seq, (unsigned)r.time, r.minuteOfWeek, r.entry, r.track));
+            } else if (r.type == JOURNAL_COMMAND) {
+                char name[sizeof(r.command)];
+                size_t k = 0;
+                for (size_t j = 0; j < sizeof(r.command) && r.command[j]; j++) {
+                    if (r.command[j] != '"' && r.command[j] != '\\') name[k++] = r.command[j];
+                }
+                name[k] = '\0';
+                append(snprintf(body + used, sizeof(body) - used,
+                                "%s{\"seq\":%u,\"type\":\"command\",\"at\":%u,\"command_id\":%lld,"
+                                "\"command\":\"%s\",\"ok\":%s}",
+                                sep, (unsigned)r.seq, (unsigned)r.time, (long long)r.commandId, name,
+                                r.ok ? "true" : "false"));
+            } else {
+                continue;
+            }
+            events++;
+        }
+        if (used < sizeof(body)) append(snprintf(body + used, sizeof(body) - used, "]}"));
+        return used < sizeof(body);
+    }
+
+    EventJournal& journal;
+    DeviceApi& api;
+    JournalRecord records[JOURNAL_BATCH];
+    char body[JOURNAL_BATCH * 128 + 128];
+
+    bool draining = true; // Boot counts as a reconnect
+    bool waiting = false;
+    uint32_t waitingSinceMs = 0;
+    bool retrying = false;
+    uint32_t retryAtMs = 0;
+    uint32_t backoffMs = JOURNAL_RETRY_MIN_MS;
+    uint32_t sent = 0;
+    uint32_t failures = 0;
+    int lastCode = 0;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ArduinoJson.h>
+
+// ==========================================
+// JSON ARENA (fixed storage for a JsonDocument)
+// ==========================================
+//
+// ArduinoJson allocator over a buffer that lives as long as the firmware,
+// for documents that are parsed over and over (the tick response, Realtime
+// frames). A JsonDocument on the default allocator mallocs its pools and
+// strings on every parse; at ~17,000 polls a day those short-lived blocks
+// interleave with long-lived ones and fragment the heap.
+//
+// Bump allocation with a size header per block. A block is given back when
+// it is the last one; once nothing is live (the document was cleared or
+// destroyed, which deserializeJson() does first) the arena rewinds to empty.
+// A request that does not fit goes to the heap and is counted in spills(),
+// so an oversized response still parses.
+//
+//   JsonDocument doc(&tickArena);   // one document at a time per arena
+
+template <size_t N>
+class JsonArena : public ArduinoJson::Allocator {
+public:
+    void* allocate(size_t size) override {
+        size_t need = HEADER + align(size);
+        if (top + need > N) {
+            spillCount++;
+            return malloc(size);
+        }
+        uint8_t* block = storage + top;
+        memcpy(block, &size, sizeof(size));
+        top += need;
+        live++;
+        if (top > highWater) highWater = top;
+        return block + HEADER;
+    }
+
+    void deallocate(void* ptr) override {
+        if (!ptr) return;
+        if (!owns(ptr)) {
+            free(ptr);
+            return;
+        }
+        uint8_t* block = (uint8_t*)ptr - HEADER;
+        if (block + HEADER + align(sizeOf(ptr)) == storage + top) top = block - storage; // Last one: give back
+        if (--live == 0) top = 0;
+    }
+
+    void* reallocate(void* ptr, size_t size) override {
+        if (!ptr) return allocate(size);
+        if (!owns(ptr)) return realloc(ptr, size);
+
+        size_t old = sizeOf(ptr);
+        uint8_t* block = (uint8_t*)ptr - HEADER;
+        bool last = block + HEADER + align(old) == storage + top;
+        if (size <= old || (last && (size_t)(block - storage) + HEADER + align(size) <= N)) {
+            if (last) top = (block - storage) + HEADER + align(size); // Grow or shrink in place
+            if (top > highWater) highWater = top;
+            memcpy(block, &size, sizeof(size));
+            return ptr;
+        }
+        void* moved = allocate(size);
+        if (!moved) return nullptr;
+        memcpy(moved, ptr, old);
+        deallocate(ptr);
+        return moved;
+    }
+
+    // Requests served from the heap because the arena was full
+    uint32_t spills() const { return spillCount; }
+    // Most of the arena ever in use, to size N
+    size_t peak() const { return highWater; }
+
+private:
+    static const size_t ALIGN = alignof(max_align_t) < 8 ? 8 : alignof(max_align_t);
+    static const size_t HEADER = ALIGN; // Keeps the payload aligned
+
+    static size_t align(size_t n) { return (n + ALIGN - 1) & ~(ALIGN - 1); }
+
+    bool owns(void* ptr) const { return (uint8_t*)ptr >= storage && (uint8_t*)ptr < storage + N; }
+
+    static size_t sizeOf(void* ptr) {
+        size_t size;
+        memcpy(&size, (uint8_t*)ptr - HEADER, sizeof(size));
+        return size;
+    }
+
+    alignas(ALIGN) uint8_t storage[N];
+    size_t top = 0;
+    size_t live = 0;
+    size_t highWater = 0;
+    uint32_t spillCount = 0;
+};
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+// ==========================================
+// METRICS REGISTRY
+// ==========================================
+//
+// A fixed set of counters, gauges and histograms in static memory. Any task
+// may record: each call is one or two relaxed atomic operations, no lock,
+// no allocation, so recording stays on in production.
+//
+// Histograms are log2-bucketed: bucket 0 holds 0, bucket b holds values in
+// [2^(b-1), 2^b). 33 buckets cover uint32 at a factor-of-two resolution,
+// which is what "why is this device late" needs.
+//
+// Counters and buckets only ever grow. MetricsReport (network task) turns
+// them into per-interval snapshots: take() writes the change since the last
+// commit() as compact JSON, and commit() is only called once the server has
+// it, so a failed heartbeat loses nothing.
+
+enum CounterId : uint8_t {
+    M_BELLS,           // Scheduled bells rung
+    M_TLS_HANDSHAKES,  // New HTTPS connections, all clients
+    M_HTTP_FAILURES,
+    M_WIFI_RECONNECTS,
+    M_AWAKE_MS,        // Time some task was working
+    M_ASLEEP_MS,       // Time every task was in a planned wait (light sleep allowed)
+    M_COUNTERS
+};
+
+enum GaugeId : uint8_t {
+    M_FREE_HEAP,
+    M_MIN_HEAP,        // Lowest since boot
+    M_LARGEST_BLOCK,   // Biggest allocation that would succeed
+    M_RSSI,
+    M_RTC_AGING,       // DS3231 aging offset register (RtcTrim)
+    M_GAUGES
+};
+
+enum HistogramId : uint8_t {
+    M_NET_LOOP_US,     // One networkLoop() pass
+    M_SCHED_PASS_US,   // One scheduler task pass
+    M_BELL_SKEW_US,    // Bell start after its scheduled second
+    M_RPC_TICK_US,     // device_tick
+    M_RPC_CONFIG_US,   // get_device_config
+    M_RPC_REGISTER_US, // register_device_from_esp
+    M_RPC_OTHER_US,
+    M_WAKE_SKEW_US,    // Scheduler wait that timed out, past its planned end
+    M_SLEEP_OFFSET_US, // Clock error found by the first RTC read after a sleep
+    M_NTP_BOUND_US,    // How far off an SNTP round's result may be
+    M_RTC_ERROR_US,    // RTC against UTC at the SQW edge after a round
+    M_HISTOGRAMS
+};
+
+static const char* const METRIC_COUNTER_NAMES[M_COUNTERS] = {"bells", "tls", "http_fail", "wifi_reconnects",
+                                                                "awake_ms", "asleep_ms"};
+static const char* const METRIC_GAUGE_NAMES[M_GAUGES] = {"heap", "heap_min", "heap_block", "rssi",
+                                                            "rtc_aging"};
+static const char* const METRIC_HISTOGRAM_NAMES[M_HISTOGRAMS] = {"net_loop_us", "sched_pass_us", "bell_skew_us",
+                                                                 "rpc_tick_us", "rpc_config_us", "rpc_register_us",
+                                                                 "rpc_other_us", "wake_skew_us", "sleep_offset_us",
+                                                                 "ntp_bound_us", "rtc_error_us"};
+
+static const uint8_t METRIC_BUCKETS = 33;
+
+class Metrics {
+public:
+    void add(CounterId id, uint32_t n = 1) { counters[id].fetch_add(n, std::memory_order_relaxed); }
+    void set(GaugeId id, int32_t value) { gauges[id].store(value, std::memory_order_relaxed); }
+
+    void record(HistogramId id, uint32_t value) {
+        Histogram& h = histograms[id];
+        h.buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        // Racy max: a concurrent larger value may be overwritten, never a
+        // problem for a diagnostic
+        if (value > h.max.load(std::memory_order_relaxed)) h.max.store(value, std::memory_order_relaxed);
+    }
+
+    static uint8_t bucketOf(uint32_t value) { return value ? (uint8_t)(32 - __builtin_clz(value)) : 0; }
+    // Largest value that lands in `bucket`
+    static uint32_t bucketTop(uint8_t bucket) { return bucket >= 32 ? UINT32_MAX : (1u << bucket) - 1; }
+
+    uint32_t counter(CounterId id) const { return counters[id].load(std::memory_order_relaxed); }
+    int32_t gauge(GaugeId id) const { return gauges[id].load(std::memory_order_relaxed); }
+    uint32_t bucket(HistogramId id, uint8_t b) const {
+        return histograms[id].buckets[b].load(std::memory_order_relaxed);
+    }
+    // Largest value recorded since the last call
+    uint32_t takeMax(HistogramId id) { return histograms[id].max.exchange(0, std::memory_order_relaxed); }
+
+private:
+    struct Histogram {
+        std::atomic<uint32_t> buckets[METRIC_BUCKETS];
+        std::atomic<uint32_t> max;
+    };
+
+    std::atomic<uint32_t> counters[M_COUNTERS] = {};
+    std::atomic<int32_t> gauges[M_GAUGES] = {};
+    Histogram histograms[M_HISTOGRAMS] = {};
+};
+
+// Per-interval snapshots of a Metrics registry. One task only.
+//
+//   {"s":60,"c":{"bells":4,...},"g":{"heap":181240,...},
+//    "h":{"net_loop_us":{"n":5731,"p50":2047,"p99":262143,"max":180512,
+//                        "b":{"9":12,"10":5002,...}},...}}
+//
+// "s" is the interval in seconds; counters and histograms cover only that
+// interval (histograms that saw nothing are left out); p50/p99 are the top
+// of the bucket the percentile falls in, capped at max; "b" maps bucket to
+// count so the server can merge intervals.
+class MetricsReport {
+public:
+    explicit MetricsReport(Metrics& metrics) : metrics(metrics) {}
+
+    // Writes the snapshot into `out`, without the "b" maps if it does not
+    // fit otherwise; false if even that did not fit (nothing is lost: the
+    // next take() covers this interval too)
+    bool take(uint32_t nowMs, char* out, size_t size) {
+        for (uint8_t c = 0; c < M_COUNTERS; c++) taken.counters[c] = metrics.counter((CounterId)c);
+        for (uint8_t h = 0; h < M_HISTOGRAMS; h++) {
+            for (uint8_t b = 0; b < METRIC_BUCKETS; b++) taken.buckets[h][b] = metrics.bucket((HistogramId)h, b);
+            uint32_t m = metrics.takeMax((HistogramId)h);
+            if (m > carriedMax[h]) carriedMax[h] = m;
+        }
+        takenAtMs = nowMs;
+        return write(out, size, true) || write(out, size, false);
+    }
+
+    // The last take() reached the server
+    void commit() {
+        committed = taken;
+        committedAtMs = takenAtMs;
+        memset(carriedMax, 0, sizeof(carriedMax));
+    }
+
+private:
+    struct Totals {
+        uint32_t counters[M_COUNTERS];
+        uint32_t buckets[M_HISTOGRAMS][METRIC_BUCKETS];
+    };
+
+    // snprintf into a fixed buffer, remembering whether anything was cut
+    class Writer {
+    public:
+        Writer(char* out, size_t size) : out(out), size(size) {
+            if (size) out[0] = '\0';
+        }
+
+        template <typename... Args>
+        void append(const char* format, Args... args) {
+            if (used >= size) return;
+            int n = snprintf(out + used, size - used, format, args...);
+            used = n < 0 ? size : used + (size_t)n;
+        }
+        void append(const char* text) { append("%s", text); }
+        bool ok() const { return used < size; }
+
+    private:
+        char* out;
+        size_t size;
+        size_t used = 0;
+    };
+
+    bool write(char* out, size_t size, bool withBuckets) {
+        Writer w(out, size);
+        w.append("{\"s\":%u,\"c\":{", (unsigned)((takenAtMs - committedAtMs) / 1000));
+        for (uint8_t c = 0; c < M_COUNTERS; c++) {
+            w.append("%s\"%s\":%u", c ? "," : "", METRIC_COUNTER_NAMES[c],
+                     (unsigned)(taken.counters[c] - committed.counters[c]));
+        }
+        w.append("},\"g\":{");
+        for (uint8_t g = 0; g < M_GAUGES; g++) {
+            w.append("%s\"%s\":%d", g ? "," : "", METRIC_GAUGE_NAMES[g], (int)metrics.gauge((GaugeId)g));
+        }
+        w.append("},\"h\":{");
+        bool first = true;
+        for (uint8_t h = 0; h < M_HISTOGRAMS; h++) {
+            uint32_t delta[METRIC_BUCKETS];
+            uint32_t n = 0;
+            for (uint8_t b = 0; b < METRIC_BUCKETS; b++) {
+                delta[b] = taken.buckets[h][b] - committed.buckets[h][b];
+                n += delta[b];
+            }
+            if (!n) continue;
+            w.append("%s\"%s\":{\"n\":%u,\"p50\":%u,\"p99\":%u,\"max\":%u", first ? "" : ",",
+                     METRIC_HISTOGRAM_NAMES[h], (unsigned)n, (unsigned)percentile(delta, n, 50, carriedMax[h]),
+                     (unsigned)percentile(delta, n, 99, carriedMax[h]), (unsigned)carriedMax[h]);
+            if (withBuckets) {
+                const char* sep = ",\"b\":{";
+                for (uint8_t b = 0; b < METRIC_BUCKETS; b++) {
+                    if (!delta[b]) continue;
+                    w.append("%s\"%u\":%u", sep, b, (unsigned)delta[b]);
+                    sep = ",";
+                }
+                w.append("}");
+            }
+            w.append("}");
+            first = false;
+        }
+        w.append("}}");
+        return w.ok();
+    }
+
+    static uint32_t percentile(const uint32_t* buckets, uint32_t n, uint32_t pct, uint32_t max) {
+        uint64_t rank = ((uint64_t)n * pct + 99) / 100; // 1-based
+        uint64_t seen = 0;
+        for (uint8_t b = 0; b < METRIC_BUCKETS; b++) {
+            seen += buckets[b];
+            if (seen >= rank) {
+                uint32_t top = Metrics::bucketTop(b);
+                return max && top > max ? max : top;
+            }
+        }
+        return max;
+    }
+
+    Metrics& metrics;
+    Totals committed = {};
+    Totals taken = {};
+    uint32_t carriedMax[M_HISTOGRAMS] = {};
+    uint32_t committedAtMs = 0;
+    uint32_t takenAtMs = 0;
+};
+
+#endif
@@ -0,0 +1,400 @@
+#ifndef OTA_ENGINE_H
+#define OTA_ENGINE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <strings.h>
+#include <memory>
+#include "hal/Hal.h"
+#include "Sha256.h"
+#include "DeltaPatch.h"
+
+// ==========================================
+// RESUMABLE OTA
+// ==========================================
+//
+// Downloads a firmware image in OTA_CHUNK_SIZE pieces with HTTP Range
+// requests and writes them straight into the inactive slot. Each step()
+// moves at most one chunk, so the network task keeps running between
+// chunks. Progress is saved after every chunk, so a dropped connection
+// retries only that chunk, and a reboot resumes where it stopped. A resume
+// re-hashes the part already in flash instead of trusting saved hash state.
+// A chunk whose progress could not be saved is retried as a save, with the
+// same backoff, before the next chunk is fetched. A download that fails for
+// good (flash error, bad image, OTA_MAX_FAILURES in a row) drops its state,
+// so neither the next boot nor the same command resumes into it again.
+//
+// A chunk is written and hashed only once it has arrived complete. At the
+// end, the size and SHA-256 from the UPDATE_FIRMWARE payload must both
+// match before the slot becomes the boot image. The new image is confirmed
+// by the post-boot health check in main.cpp, or rolled back.
+//
+// startDelta() downloads a DeltaPatch.h patch instead and rebuilds the image
+// from the running one. It is only accepted if the running image hashes to
+// the patch's base. The decoder state is saved with the progress, so a delta
+// resumes like a full image does. Given the full image's URL too, a patch
+// that fails once it has started (bad data, another target, hash mismatch,
+// also after a reboot) is dropped and the full image is downloaded instead.
+//
+// State file (little-endian, fixed size): see OtaState.
+
+const uint32_t OTA_STATE_MAGIC = 0x3341544F; // "OTA3"
+const size_t OTA_URL_LEN = 256;
+const uint32_t OTA_CHUNK_SIZE = 16 * 1024; // Multiple of OtaPartition::SECTOR_SIZE
+const uint32_t OTA_RETRY_MIN_MS = 1000;
+const uint32_t OTA_RETRY_MAX_MS = 60 * 1000;
+const uint32_t OTA_MAX_FAILURES = 30; // Consecutive failed chunks before giving up
+
+enum OtaStatus : uint8_t {
+    OTA_IDLE,
+    OTA_DOWNLOADING,
+    OTA_READY,  // Verified and set as the boot image; restart to run it
+    OTA_FAILED  // See error()
+};
+
+struct OtaState {
+    uint32_t magic;
+    uint32_t partition;    // OtaPartition::id() the bytes were written to
+    uint32_t size;         // Image
+    uint32_t offset;       // Image bytes written so far
+    uint32_t downloadSize; // The image, or the patch for a delta
+    uint32_t downloaded;   // Download bytes processed, chunk aligned
+    uint8_t delta;         // url is a patch against the running image
+    char sha256[SHA256_HEX_LEN + 1];
+    char url[OTA_URL_LEN];
+    char imageUrl[OTA_URL_LEN]; // Delta: the full image to fall back to, "" = none
+    DeltaState patch;      // Decoder state after `downloaded` bytes
+};
+
+class OtaEngine : private DeltaSink {
+public:
+    OtaEngine(hal::HttpClient& http, hal::OtaPartition& partition, hal::FileSystem& fs, const char* statePath,
+              const char* tmpPath)
+        : http(http), partition(partition), fs(fs), statePath(statePath), tmpPath(tmpPath), decoder(*this) {}
+
+    // UPDATE_FIRMWARE. Continues a partial download of the same image
+    // (same size and hash; the URL may differ, e.g. a fresh signed link).
+    bool start(const char* url, uint32_t size, const char* sha256) {
+        return prepare(url, size, sha256, false, size);
+    }
+
+    // UPDATE_FIRMWARE with a patch. Fails without side effects if the
+    // running image is not the patch's base; then use start(). A failure
+    // after that falls back to `imageUrl` (the payload's url) if given.
+    bool startDelta(const char* patchUrl, uint32_t patchSize, const char* baseSha256, uint32_t size,
+                    const char* sha256, const char* imageUrl = nullptr) {
+        if (!validHash(baseSha256) || patchSize <= DELTA_HEADER_SIZE) return fail("bad payload");
+        char running[SHA256_HEX_LEN + 1];
+        if (!runningHash(running)) return fail("cannot read the running image");
+        if (strcasecmp(running, baseSha256) != 0) return fail("running image is not the patch base");
+        return prepare(patchUrl, size, sha256, true, patchSize, imageUrl);
+    }
+
+    // At boot: picks up an interrupted download. False if there is none.
+    bool resume() {
+        if (!loadState(st)) return false;
+        begin();
+        return true;
+    }
+
+    // Downloads at most one chunk (or waits out the retry backoff)
+    OtaStatus step(uint32_t nowMs) {
+        advance(nowMs);
+        if (state == OTA_FAILED && st.delta && st.imageUrl[0]) fallBack();
+        return state;
+    }
+
+    OtaStatus status() const { return state; }
+    bool isDelta() const { return st.delta; }
+    uint32_t downloaded() const { return st.downloaded; }
+    bool active() const { return state == OTA_DOWNLOADING; }
+    uint32_t offset() const { return st.offset; }
+    uint32_t size() const { return st.size; }
+    uint32_t retryCount() const { return retries; }
+    uint32_t resumedAt() const { return resumeOffset; } // Download offset the last start()/resume() continued from
+    const char* error() const { return lastError; }
+    uint32_t fallbackCount() const { return fallbacks; } // Deltas replaced by the full image
+    const char* deltaError() const { return lastDeltaError; } // Why the last of them failed
+
+private:
+    void advance(uint32_t nowMs) {
+        if (state != OTA_DOWNLOADING || (int32_t)(nowMs - retryAt) < 0) return;
+        if (!hashed && !rehash()) return;
+
+        bool ok = unsaved || fetchChunk();
+        if (state != OTA_DOWNLOADING) return; // Flash or patch error: no retry
+        if (ok && st.downloaded < st.downloadSize) {
+            unsaved = !saveState();
+            ok = !unsaved;
+        }
+        if (!ok) {
+            failures++;
+            retries++;
+            if (failures >= OTA_MAX_FAILURES) {
+                fail(unsaved ? "cannot save state" : "download keeps failing");
+                return;
+            }
+            uint32_t backoff = OTA_RETRY_MIN_MS << (failures < 7 ? failures - 1 : 6);
+            retryAt = nowMs + (backoff < OTA_RETRY_MAX_MS ? backoff : OTA_RETRY_MAX_MS);
+            return;
+        }
+        failures = 0;
+        if (st.downloaded == st.downloadSize) finish();
+    }
+
+    // A delta that failed after it started: its state is gone (fail()), so
+    // the full image starts from scratch over whatever the patch wrote
+    void fallBack() {
+        char url[OTA_URL_LEN];
+        char sha256[SHA256_HEX_LEN + 1];
+        memcpy(url, st.imageUrl, sizeof(url));
+        memcpy(sha256, st.sha256, sizeof(sha256));
+        st.imageUrl[0] = '\0'; // Once
+        lastDeltaError = lastError;
+        fallbacks++;
+        prepare(url, st.size, sha256, false, st.size);
+    }
+
+    bool prepare(const char* url, uint32_t size, const char* sha256, bool delta, uint32_t downloadSize,
+                 const char* imageUrl = nullptr) {
+        if (!url || strlen(url) >= OTA_URL_LEN || !validHash(sha256)) return fail("bad payload");
+        if (size == 0 || size > partition.capacity()) return fail("image does not fit");
+
+        OtaState saved;
+        bool same = loadState(saved) && saved.size == size && strcasecmp(saved.sha256, sha256) == 0 &&
+                    saved.delta == delta && saved.downloadSize == downloadSize;
+        if (!same) {
+            memset(&st, 0, sizeof(st));
+            st.magic = OTA_STATE_MAGIC;
+            st.partition = partition.id();
+            st.size = size;
+            st.downloadSize = downloadSize;
+            st.delta = delta;
+            for (size_t i = 0; i <= SHA256_HEX_LEN; i++) st.sha256[i] = (char)tolower(sha256[i]);
+            decoder.reset();
+            st.patch = decoder.state();
+        } else {
+            st = saved;
+        }
+        memset(st.url, 0, sizeof(st.url));
+        strncpy(st.url, url, sizeof(st.url) - 1);
+        memset(st.imageUrl, 0, sizeof(st.imageUrl));
+        if (delta && imageUrl && strlen(imageUrl) < OTA_URL_LEN) strcpy(st.imageUrl, imageUrl);
+        if (!saveState()) return fail("cannot save state");
+        begin();
+        return true;
+    }
+
+    void begin() {
+        state = OTA_DOWNLOADING;
+        decoder.restore(st.patch);
+        outLen = 0;
+        hashed = false;
+        unsaved = false;
+        failures = 0;
+        retries = 0;
+        retryAt = 0;
+        resumeOffset = st.downloaded;
+        lastError = "";
+    }
+
+    // Hash of [0, offset) from flash, after a resume
+    bool rehash() {
+        sha.reset();
+        for (uint32_t pos = 0; pos < st.offset; pos += OTA_CHUNK_SIZE) {
+            uint32_t n = st.offset - pos < OTA_CHUNK_SIZE ? st.offset - pos : OTA_CHUNK_SIZE;
+            if (!partition.read(pos, buf, n)) return fail("flash read failed");
+            sha.update(buf, n);
+        }
+        hashed = true;
+        return true;
+    }
+
+    bool fetchChunk() {
+        uint32_t left = st.downloadSize - st.downloaded;
+        uint32_t len = left < OTA_CHUNK_SIZE ? left : OTA_CHUNK_SIZE;
+        char range[48];
+        snprintf(range, sizeof(range), "bytes=%u-%u", (unsigned)st.downloaded, (unsigned)(st.downloaded + len - 1));
+
+        if (!http.begin(st.url)) return false;
+        http.addHeader("Range", range);
+        int code = http.get();
+        // 200 is only usable when the chunk is the whole image
+        if (code != 206 && !(code == 200 && st.downloaded == 0 && len == st.downloadSize)) {
+            http.end();
+            return false;
+        }
+        uint32_t got = 0;
+        while (got < len) {
+            size_t n = http.readBytes((char*)buf + got, len - got);
+            if (n == 0) break;
+            got += n;
+        }
+        http.end();
+        if (got != len) return false; // Partial chunk: nothing written, retried whole
+
+        if (!st.delta) {
+            if (!writeImage(buf, len)) return false;
+        } else {
+            // The decoder writes through emit(); everything it produced is
+            // on flash before the state is saved
+            if (!decoder.feed(buf, len)) return fail(decoder.error());
+            if (!flushOut()) return false;
+            if (decoder.headerReady() && !headerMatches()) return fail("patch is for another image");
+            st.patch = decoder.state();
+        }
+        st.downloaded += len;
+        return true;
+    }
+
+    bool writeImage(const uint8_t* data, uint32_t len) {
+        if (st.offset + len > st.size) return fail("image larger than announced");
+        if (!partition.write(st.offset, data, len)) return fail("flash write failed");
+        sha.update(data, len);
+        st.offset += len;
+        return true;
+    }
+
+    // --- DeltaSink: the running image in, the new image out (buffered so
+    // --- flash sees sector-sized writes rather than every short run)
+    bool readSource(uint32_t offset, uint8_t* data, size_t length) override {
+        return partition.readRunning(offset, data, length);
+    }
+
+    bool emit(const uint8_t* data, size_t length) override {
+        while (length > 0) {
+            size_t n = sizeof(out) - outLen < length ? sizeof(out) - outLen : length;
+            memcpy(out + outLen, data, n);
+            outLen += n;
+            data += n;
+            length -= n;
+            if (outLen == sizeof(out) && !flushOut()) return false;
+        }
+        return true;
+    }
+
+    bool flushOut() {
+        bool ok = outLen == 0 || writeImage(out, outLen);
+        outLen = 0;
+        return ok;
+    }
+
+    bool headerMatches() {
+        DeltaHeader h = decoder.header();
+        uint8_t expected[SHA256_SIZE];
+        for (size_t i = 0; i < SHA256_SIZE; i++) {
+            char byte[3] = {st.sha256[2 * i], st.sha256[2 * i + 1], 0};
+            expected[i] = (uint8_t)strtoul(byte, nullptr, 16);
+        }
+        return h.targetSize == st.size && h.sourceSize == partition.runningSize() &&
+               memcmp(h.targetSha256, expected, SHA256_SIZE) == 0;
+    }
+
+    bool runningHash(char* hex) {
+        uint32_t size = partition.runningSize();
+        if (size == 0) return false;
+        sha.reset();
+        for (uint32_t pos = 0; pos < size; pos += OTA_CHUNK_SIZE) {
+            uint32_t n = size - pos < OTA_CHUNK_SIZE ? size - pos : OTA_CHUNK_SIZE;
+            if (!partition.readRunning(pos, buf, n)) return false;
+            sha.update(buf, n);
+        }
+        uint8_t digest[SHA256_SIZE];
+        sha.finish(digest);
+        sha256Hex(digest, hex);
+        hashed = false; // sha now holds the running image
+        return true;
+    }
+
+    void finish() {
+        uint8_t digest[SHA256_SIZE];
+        char hex[SHA256_HEX_LEN + 1];
+        sha.finish(digest);
+        sha256Hex(digest, hex);
+        fs.remove(statePath); // Next attempt starts clean either way
+        if (st.offset != st.size || (st.delta && !decoder.done())) {
+            fail("image shorter than announced");
+        } else if (strcmp(hex, st.sha256) != 0) {
+            fail("sha256 mismatch");
+        } else if (!partition.activate(st.size)) {
+            fail("image rejected");
+        } else {
+            state = OTA_READY;
+        }
+    }
+
+    // During a download every failure is final (network errors are retried
+    // in step()): its state goes, so it is not resumed again
+    bool fail(const char* why) {
+        if (state == OTA_DOWNLOADING) fs.remove(statePath);
+        lastError = why;
+        state = OTA_FAILED;
+        return false;
+    }
+
+    bool loadState(OtaState& out) {
+        std::unique_ptr<hal::File> file = fs.open(statePath, "r");
+        if (!file) return false;
+        bool ok = file->readBytes((char*)&out, sizeof(out)) == sizeof(out);
+        file->close();
+        out.sha256[SHA256_HEX_LEN] = '\0';
+        out.url[OTA_URL_LEN - 1] = '\0';
+        // Another slot (the running image changed) or garbage: start over
+        if (!ok || out.magic != OTA_STATE_MAGIC || out.partition != partition.id() || out.offset > out.size ||
+            out.downloaded > out.downloadSize || out.downloaded % OTA_CHUNK_SIZE != 0 ||
+            (!out.delta && out.offset != out.downloaded) || out.size > partition.capacity() ||
+            !validHash(out.sha256)) {
+            fs.remove(statePath);
+            return false;
+        }
+        return true;
+    }
+
+    bool saveState() {
+        std::unique_ptr<hal::File> file = fs.open(tmpPath, "w");
+        if (!file) return false;
+        bool ok = file->write((const uint8_t*)&st, sizeof(st)) == sizeof(st);
+        file->close();
+        if (!ok || !fs.rename(tmpPath, statePath)) {
+            fs.remove(tmpPath);
+            return false;
+        }
+        return true;
+    }
+
+    static bool validHash(const char* hex) {
+        if (!hex || strlen(hex) != SHA256_HEX_LEN) return false;
+        for (size_t i = 0; i < SHA256_HEX_LEN; i++) {
+            if (!isxdigit((unsigned char)hex[i])) return false;
+        }
+        return true;
+    }
+
+    hal::HttpClient& http;
+    hal::OtaPartition& partition;
+    hal::FileSystem& fs;
+    const char* statePath;
+    const char* tmpPath;
+
+    OtaState st = {};
+    OtaStatus state = OTA_IDLE;
+    Sha256 sha;
+    bool hashed = false;
+    bool unsaved = false; // Last chunk is on flash but not in the state file
+    uint32_t failures = 0;
+    uint32_t retries = 0;
+    uint32_t retryAt = 0;
+    uint32_t resumeOffset = 0;
+    const char* lastError = "";
+    const char* lastDeltaError = "";
+    uint32_t fallbacks = 0;
+    DeltaDecoder decoder;
+    uint8_t buf[OTA_CHUNK_SIZE];
+    uint8_t out[hal::OtaPartition::SECTOR_SIZE]; // Delta output on its way to flash
+    size_t outLen = 0;
+};
+
+#endif
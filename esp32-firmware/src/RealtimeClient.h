@@ -0,0 +1,210 @@
+#ifndef REALTIME_CLIENT_H
+#define REALTIME_CLIENT_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WebSocketsClient.h>
+#include "JsonArena.h"
+
+// ==========================================
+// SUPABASE REALTIME (Phoenix channels over WebSocket)
+// ==========================================
+//
+// Long-lived socket to /realtime/v1/websocket that joins the device's
+// broadcast channels (API_CONTRACT.md section 4) and hands every broadcast
+// event to a callback. Speaks the Phoenix v1 JSON protocol:
+//   -> {"topic":"realtime:device:<MAC>","event":"phx_join","payload":{...},"ref":"1"}
+//   <- {"topic":"realtime:device:<MAC>","event":"phx_reply","payload":{"status":"ok"},"ref":"1"}
+//   <- {"topic":"realtime:device:<MAC>","event":"broadcast",
+//       "payload":{"type":"broadcast","event":"manual_ring","payload":{...}}}
+//   -> {"topic":"phoenix","event":"heartbeat","payload":{},"ref":"2"} every 25 s
+//
+// A heartbeat that is still unanswered when the next one is due means the
+// socket is dead; it is dropped and the library reconnects.
+//
+// Incoming frames are parsed in a JsonArena rather than a fresh JsonDocument
+// each (the WebSockets library still holds each frame in a short-lived
+// buffer of its own while the handler runs).
+
+class RealtimeClient {
+public:
+    typedef void (*EventHandler)(const char* topic, const char* event, JsonVariantConst payload);
+
+    static const int MAX_TOPICS = 2;
+    static const unsigned long HEARTBEAT_INTERVAL = 25 * 1000;
+    static const unsigned long RECONNECT_INTERVAL = 5 * 1000;
+
+    void begin(const char* host, uint16_t port, bool tls, const char* apiKey, EventHandler handler) {
+        this->apiKey = apiKey;
+        this->handler = handler;
+
+        snprintf(path, sizeof(path), "/realtime/v1/websocket?apikey=%s&vsn=1.0.0", apiKey);
+        ws.onEvent([this](WStype_t type, uint8_t* data, size_t length) { onSocketEvent(type, data, length); });
+        ws.setReconnectInterval(RECONNECT_INTERVAL);
+        if (tls) {
+            ws.beginSSL(host, port, path);
+        } else {
+            ws.begin(host, port, path);
+        }
+        started = true;
+    }
+
+    // Channel to join, without the "realtime:" prefix (e.g. "device:AA:BB:...").
+    // Joined on every (re)connect; call before or after begin().
+    void addChannel(const char* channel) {
+        for (int i = 0; i < topicCount; i++) {
+            if (strcmp(topics[i].name + 9, channel) == 0) return;
+        }
+        if (topicCount >= MAX_TOPICS) return;
+        snprintf(topics[topicCount].name, sizeof(topics[topicCount].name), "realtime:%s", channel);
+        topics[topicCount].joined = false;
+        if (connected) join(topics[topicCount]);
+        topicCount++;
+    }
+
+    void loop() {
+        if (!started) return;
+        ws.loop();
+        if (!connected) return;
+
+        if (millis() - lastHeartbeat >= HEARTBEAT_INTERVAL) {
+            if (heartbeatPending) {
+                Serial.println("Realtime: heartbeat timed out, reconnecting");
+                ws.disconnect();
+                return;
+            }
+            lastHeartbeat = millis();
+            heartbeatRef = nextRef++;
+            char msg[96];
+            snprintf(msg, sizeof(msg), "{\"topic\":\"phoenix\",\"event\":\"heartbeat\",\"payload\":{},\"ref\":\"%lu\"}",
+                     heartbeatRef);
+            heartbeatPending = ws.sendTXT(msg);
+        }
+    }
+
+    // True while the socket is open and at least one channel is joined
+    bool isUp() const {
+        if (!connected) return false;
+        for (int i = 0; i < topicCount; i++) {
+            if (topics[i].joined) return true;
+        }
+        return false;
+    }
+
+    // Broadcasts `event` with `payload` (a JSON object) on a joined topic
+    bool broadcast(const char* topic, const char* event, const char* payload) {
+        if (!connected) return false;
+        String msg;
+        msg.reserve(128 + strlen(payload));
+        msg += "{\"topic\":\"";
+        msg += topic;
+        msg += "\",\"event\":\"broadcast\",\"payload\":{\"type\":\"broadcast\",\"event\":\"";
+        msg += event;
+        msg += "\",\"payload\":";
+        msg += payload;
+        msg += "},\"ref\":\"";
+        msg += String(nextRef++);
+        msg += "\"}";
+        return ws.sendTXT(msg);
+    }
+
+    unsigned long connects() const { return connectCount; }
+
+private:
+    struct Topic {
+        char name[64];
+        bool joined;
+        unsigned long joinRef;
+    };
+
+    void join(Topic& t) {
+        t.joined = false;
+        t.joinRef = nextRef++;
+        JsonDocument msg;
+        msg["topic"] = t.name;
+        msg["event"] = "phx_join";
+        JsonObject config = msg["payload"]["config"].to<JsonObject>();
+        config["broadcast"]["self"] = false;
+        config["broadcast"]["ack"] = false;
+        config["presence"]["key"] = "";
+        config["private"] = false;
+        msg["payload"]["access_token"] = apiKey;
+        msg["ref"] = String(t.joinRef);
+        String out;
+        serializeJson(msg, out);
+        ws.sendTXT(out);
+    }
+
+    void onSocketEvent(WStype_t type, uint8_t* data, size_t length) {
+        switch (type) {
+            case WStype_CONNECTED:
+                Serial.println("Realtime: connected");
+                connected = true;
+                connectCount++;
+                heartbeatPending = false;
+                lastHeartbeat = millis();
+                for (int i = 0; i < topicCount; i++) join(topics[i]);
+                break;
+            case WStype_DISCONNECTED:
+                if (connected) Serial.println("Realtime: disconnected");
+                connected = false;
+                for (int i = 0; i < topicCount; i++) topics[i].joined = false;
+                break;
+            case WStype_TEXT:
+                onMessage((const char*)data, length);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void onMessage(const char* data, size_t length) {
+        JsonDocument doc(&arena);
+        if (deserializeJson(doc, data, length)) return;
+
+        const char* topic = doc["topic"] | "";
+        const char* event = doc["event"] | "";
+        unsigned long ref = strtoul(doc["ref"] | "0", nullptr, 10);
+
+        if (strcmp(event, "phx_reply") == 0) {
+            bool ok = strcmp(doc["payload"]["status"] | "", "ok") == 0;
+            if (strcmp(topic, "phoenix") == 0 && ref == heartbeatRef) {
+                heartbeatPending = false;
+                return;
+            }
+            for (int i = 0; i < topicCount; i++) {
+                if (topics[i].joinRef == ref && strcmp(topics[i].name, topic) == 0) {
+                    topics[i].joined = ok;
+                    Serial.printf("Realtime: %s %s\n", topic, ok ? "joined" : "join rejected");
+                }
+            }
+        } else if (strcmp(event, "phx_error") == 0 || strcmp(event, "phx_close") == 0) {
+            for (int i = 0; i < topicCount; i++) {
+                if (strcmp(topics[i].name, topic) == 0) {
+                    Serial.printf("Realtime: %s closed (%s), rejoining\n", topic, event);
+                    join(topics[i]);
+                }
+            }
+        } else if (strcmp(event, "broadcast") == 0) {
+            JsonVariantConst inner = doc["payload"];
+            if (handler) handler(topic, inner["event"] | "", inner["payload"]);
+        }
+    }
+
+    WebSocketsClient ws;
+    JsonArena<3072> arena; // Frames are parsed one at a time
+    EventHandler handler = nullptr;
+    const char* apiKey = "";
+    char path[300];
+    Topic topics[MAX_TOPICS];
+    int topicCount = 0;
+    bool started = false;
+    bool connected = false;
+    bool heartbeatPending = false;
+    unsigned long heartbeatRef = 0;
+    unsigned long lastHeartbeat = 0;
+    unsigned long nextRef = 1;
+    unsigned long connectCount = 0;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef RTC_TRIM_H
+#define RTC_TRIM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// ==========================================
+// RTC TRIM (DS3231 aging offset)
+// ==========================================
+//
+// Learns how fast this unit's DS3231 runs from NTP checks and trims its
+// aging offset register so the RTC keeps time offline. Each check is the
+// RTC's error against UTC at an SQW edge, with the NTP bound. Two checks
+// `span` seconds apart give the rate
+//
+//   rate = (error - baseError) / span     +/- (bound + baseBound) / span
+//
+// Once that is known to MAX_RATE_BOUND_PPB (a day or more with pool
+// servers), the register moves by rate / PPB_PER_STEP (positive slows the
+// oscillator) and measuring starts over at the new rate.
+//
+// Rewriting the RTC (error over SET_ERROR_US, or SYNC_TIME) does not change
+// its rate, so the measurement carries on: the base is moved by the step
+// and widened by SET_BOUND_US for the write. The tolerance is what keeps
+// spans long enough to learn from while the rate is still untrimmed.
+//
+// The state is small and saved to Preferences after every check, so the
+// learning survives reboots (spans are in UTC, not uptime).
+
+struct RtcTrimState {
+    uint32_t baseUtc;      // Unix seconds of the base check, 0 = none
+    int64_t baseErrorUs;   // RTC minus UTC then
+    uint32_t baseBoundUs;
+    int32_t ratePpb;       // Last rate measured to MAX_RATE_BOUND_PPB, RTC fast > 0
+    int8_t aging;          // Register value the base was taken with
+};
+
+enum RtcTrimAction : uint8_t {
+    TRIM_NONE = 0,
+    TRIM_SET_TIME = 1,  // Error over SET_ERROR_US: rewrite the RTC, then timeSet()
+    TRIM_AGING = 2      // Write aging() into the register
+};
+
+class RtcTrim {
+public:
+    static const uint32_t MIN_SPAN_S = 24 * 3600;
+    static const uint32_t MAX_RATE_BOUND_PPB = 100;
+    static const int32_t PPB_PER_STEP = 100;     // About 0.1 ppm per LSB at 25 C (datasheet)
+    static const int32_t MAX_STEP = 20;          // Per trim; a new DS3231 is within 2 ppm
+    static const int32_t MAX_RATE_PPB = 20000;   // Beyond this (and the bound) the RTC was set or lost power
+    static const uint32_t SET_ERROR_US = 20000;
+    static const uint32_t SET_BOUND_US = 500;    // Timing of a rewrite at a second boundary
+
+    // `registerValue` is what the chip holds now; a saved state taken with
+    // another value (new chip, lost power) starts over
+    void begin(const RtcTrimState& saved, int8_t registerValue) {
+        st = saved;
+        if (st.aging != registerValue) {
+            st = RtcTrimState();
+            st.aging = registerValue;
+        }
+    }
+
+    // One check: RTC minus UTC at `utc`, good to `boundUs`. Returns
+    // RtcTrimAction flags.
+    uint8_t check(uint32_t utc, int64_t errorUs, uint32_t boundUs) {
+        uint8_t actions = TRIM_NONE;
+        if (st.baseUtc == 0 || utc <= st.baseUtc) {
+            rebase(utc, errorUs, boundUs);
+        } else {
+            uint32_t span = utc - st.baseUtc;
+            int64_t rate = (errorUs - st.baseErrorUs) * 1000 / (int64_t)span;
+            uint64_t rateBound = ((uint64_t)boundUs + st.baseBoundUs) * 1000 / span;
+            if (llabs(rate) > MAX_RATE_PPB + (int64_t)rateBound) {
+                rebase(utc, errorUs, boundUs);
+            } else if (span >= MIN_SPAN_S && rateBound <= MAX_RATE_BOUND_PPB) {
+                st.ratePpb = (int32_t)rate;
+                int32_t step = (int32_t)((rate + (rate >= 0 ? PPB_PER_STEP / 2 : -PPB_PER_STEP / 2)) / PPB_PER_STEP);
+                if (step > MAX_STEP) step = MAX_STEP;
+                if (step < -MAX_STEP) step = -MAX_STEP;
+                int32_t next = st.aging + step;
+                if (next > 127) next = 127;
+                if (next < -128) next = -128;
+                if (next != st.aging) {
+                    st.aging = (int8_t)next;
+                    rebase(utc, errorUs, boundUs);
+                    actions |= TRIM_AGING;
+                }
+                // Otherwise the base stays and the next span is longer
+            }
+        }
+        if (llabs(errorUs) > SET_ERROR_US) actions |= TRIM_SET_TIME;
+        return actions;
+    }
+
+    // The RTC was rewritten, moving it by `stepUs`
+    void timeSet(int64_t stepUs) {
+        if (st.baseUtc == 0) return;
+        st.baseErrorUs += stepUs;
+        st.baseBoundUs += SET_BOUND_US;
+    }
+
+    int8_t aging() const { return st.aging; }
+    int32_t ratePpb() const { return st.ratePpb; }
+    const RtcTrimState& state() const { return st; }
+
+private:
+    void rebase(uint32_t utc, int64_t errorUs, uint32_t boundUs) {
+        st.baseUtc = utc;
+        st.baseErrorUs = errorUs;
+        st.baseBoundUs = boundUs;
+    }
+
+    RtcTrimState st = {};
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef SCHEDULE_IMAGE_H
+#define SCHEDULE_IMAGE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "hal/Hal.h"
+#include "ScheduleIndex.h"
+
+// ==========================================
+// BINARY SCHEDULE IMAGE
+// ==========================================
+//
+// Compact on-flash copy of the compiled schedule, loaded at boot with one
+// read and no JSON parsing. Little-endian layout:
+//
+//   header  (56 bytes, see ScheduleImageHeader)
+//   entries (entryCount x 8 bytes):
+//       u16 minuteOfDay, u16 duration, u16 audioOffset, u8 dayMask, u8 0
+//   audio   (audioSize bytes of NUL-terminated paths)
+//
+// `crc` is the CRC32 of everything after the header. Files with another
+// magic/version or a bad CRC are rejected so the caller falls back to the
+// JSON cache.
+//
+// v2 adds the server's config_hash, so a device that boots from the image
+// can still send it with the next get_device_config and get "unchanged".
+
+const uint32_t SCHEDULE_IMAGE_MAGIC   = 0x49534241; // "ABSI"
+const uint16_t SCHEDULE_IMAGE_VERSION = 2;
+const size_t   SCHEDULE_IMAGE_ENTRY   = 8;
+const size_t   SCHEDULE_IMAGE_HASH    = 32; // config_hash, md5 hex
+
+struct ScheduleImageHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t profileHash; // FNV-1a of the payload: identifies the timetable
+    uint16_t entryCount;
+    uint16_t reserved;
+    uint32_t audioSize;
+    uint32_t crc;
+    char configHash[SCHEDULE_IMAGE_HASH]; // Not NUL-terminated, zero-padded
+};
+
+enum ScheduleImageResult {
+    IMAGE_OK,
+    IMAGE_MISSING,
+    IMAGE_OLD_VERSION,
+    IMAGE_CORRUPT
+};
+
+inline uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+inline uint32_t fnv1a(const uint8_t* data, size_t len, uint32_t hash = 2166136261u) {
+    while (len--) hash = (hash ^ *data++) * 16777619u;
+    return hash;
+}
+
+namespace detail {
+inline void putU16(std::vector<uint8_t>& b, uint16_t v) {
+    b.push_back(v & 0xFF);
+    b.push_back(v >> 8);
+}
+inline uint16_t getU16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+} // namespace detail
+
+// Serializes `index` into the payload part of an image (entries + audio)
+inline void encodeSchedulePayload(const ScheduleIndex& index, std::vector<uint8_t>& payload,
+                                  uint32_t& audioSize) {
+    std::vector<uint8_t> audio;
+    payload.clear();
+    payload.reserve(index.entryCount() * SCHEDULE_IMAGE_ENTRY);
+
+    for (size_t i = 0; i < index.entryCount(); i++) {
+        const BellEntry& e = index.entry(i);
+        uint16_t offset = NO_AUDIO;
+        if (e.audioOffset != NO_AUDIO) {
+            const char* url = index.audioUrl(e);
+            offset = (uint16_t)audio.size();
+            audio.insert(audio.end(), url, url + strlen(url) + 1);
+        }
+        detail::putU16(payload, e.minuteOfDay);
+        detail::putU16(payload, e.duration);
+        detail::putU16(payload, offset);
+        payload.push_back(e.dayMask);
+        payload.push_back(0);
+    }
+    audioSize = (uint32_t)audio.size();
+    payload.insert(payload.end(), audio.begin(), audio.end());
+}
+
+// FNV-1a of the encoded timetable, as stored in the image header
+inline uint32_t scheduleProfileHash(const ScheduleIndex& index) {
+    std::vector<uint8_t> payload;
+    uint32_t audioSize;
+    encodeSchedulePayload(index, payload, audioSize);
+    return fnv1a(payload.data(), payload.size());
+}
+
+// Writes the image to `tmpPath` and renames it over `path`, so a power cut
+// leaves either the old or the new image, never a torn one. `configHash` is
+// the config_hash the timetable was downloaded with ("" if unknown).
+inline bool saveScheduleImage(hal::FileSystem& fs, const char* path, const char* tmpPath,
+                              const ScheduleIndex& index, const char* configHash = "") {
+    ScheduleImageHeader h;
+    memset(&h, 0, sizeof(h));
+    std::vector<uint8_t> payload;
+    uint32_t audioSize;
+    encodeSchedulePayload(index, payload, audioSize);
+
+    h.magic = SCHEDULE_IMAGE_MAGIC;
+    h.version = SCHEDULE_IMAGE_VERSION;
+    h.headerSize = sizeof(ScheduleImageHeader);
+    h.profileHash = fnv1a(payload.data(), payload.size());
+    h.entryCount = (uint16_t)index.entryCount();
+    h.reserved = 0;
+    h.audioSize = audioSize;
+    h.crc = crc32(payload.data(), payload.size());
+    strncpy(h.configHash, configHash ? configHash : "", sizeof(h.configHash));
+
+    std::unique_ptr<hal::File> file = fs.open(tmpPath, "w");
+    if (!file) return false;
+    bool ok = file->write((const uint8_t*)&h, sizeof(h)) == sizeof(h) &&
+              file->write(payload.data(), payload.size()) == payload.size();
+    file->close();
+
+    if (!ok || !fs.rename(tmpPath, path)) {
+        fs.remove(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+// Reads and verifies the image in one read and rebuilds `out` from it.
+// `out` is only touched on IMAGE_OK. `configHash`, if given, must hold
+// SCHEDULE_IMAGE_HASH + 1 chars.
+inline ScheduleImageResult loadScheduleImage(hal::FileSystem& fs, const char* path, ScheduleIndex& out,
+                                             uint32_t* profileHash = nullptr, char* configHash = nullptr) {
+    if (!fs.exists(path)) return IMAGE_MISSING;
+    std::unique_ptr<hal::File> file = fs.open(path, "r");
+    if (!file) return IMAGE_MISSING;
+
+    size_t size = file->size();
+    if (size < sizeof(ScheduleImageHeader)) return IMAGE_CORRUPT;
+
+    std::vector<uint8_t> buf(size);
+    size_t got = file->readBytes((char*)buf.data(), size);
+    file->close();
+    if (got != size) return IMAGE_CORRUPT;
+
+    ScheduleImageHeader h;
+    memcpy(&h, buf.data(), sizeof(h));
+    if (h.magic != SCHEDULE_IMAGE_MAGIC) return IMAGE_CORRUPT;
+    if (h.version != SCHEDULE_IMAGE_VERSION || h.headerSize != sizeof(h)) return IMAGE_OLD_VERSION;
+
+    const uint8_t* payload = buf.data() + sizeof(h);
+    size_t payloadSize = size - sizeof(h);
+    if (payloadSize != (size_t)h.entryCount * SCHEDULE_IMAGE_ENTRY + h.audioSize) return IMAGE_CORRUPT;
+    if (crc32(payload, payloadSize) != h.crc) return IMAGE_CORRUPT;
+
+    const char* audio = (const char*)payload + (size_t)h.entryCount * SCHEDULE_IMAGE_ENTRY;
+    if (h.audioSize && audio[h.audioSize - 1] != '\0') return IMAGE_CORRUPT;
+
+    ScheduleIndexBuilder builder;
+    builder.reserve(h.entryCount);
+    for (size_t i = 0; i < h.entryCount; i++) {
+        const uint8_t* p = payload + i * SCHEDULE_IMAGE_ENTRY;
+        uint16_t minuteOfDay = detail::getU16(p);
+        uint16_t audioOffset = detail::getU16(p + 4);
+        if (audioOffset != NO_AUDIO && audioOffset >= h.audioSize) return IMAGE_CORRUPT;
+        if (!builder.add(minuteOfDay / 60, minuteOfDay % 60, p[6], detail::getU16(p + 2),
+                         audioOffset == NO_AUDIO ? nullptr : audio + audioOffset)) {
+            return IMAGE_CORRUPT;
+        }
+    }
+    builder.build(out);
+    if (profileHash) *profileHash = h.profileHash;
+    if (configHash) {
+        memcpy(configHash, h.configHash, SCHEDULE_IMAGE_HASH);
+        configHash[SCHEDULE_IMAGE_HASH] = '\0';
+    }
+    return IMAGE_OK;
+}
+
+#endif
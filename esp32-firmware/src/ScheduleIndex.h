@@ -0,0 +1,154 @@
+#ifndef SCHEDULE_INDEX_H
+#define SCHEDULE_INDEX_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+// ==========================================
+// COMPILED SCHEDULE INDEX
+// ==========================================
+//
+// The schedule is compiled once (on sync / boot) into an immutable index so
+// the once-a-minute check in loop() is a single bit test instead of a scan
+// over every entry and its days.
+//
+// Days follow the RTC / database convention: 0=Sun, 1=Mon ... 6=Sat.
+// Minute-of-week 0 is Sunday 00:00.
+
+const uint16_t MINUTES_PER_DAY  = 24 * 60;
+const uint16_t MINUTES_PER_WEEK = 7 * MINUTES_PER_DAY;
+const uint16_t NO_AUDIO         = 0xFFFF;
+
+// One bell time from the profile (packed, no per-entry heap allocations)
+struct BellEntry {
+    uint16_t minuteOfDay; // 0..1439
+    uint16_t duration;    // Seconds, 0 = device default
+    uint16_t audioOffset; // Offset into the audio string pool, NO_AUDIO if none
+    uint16_t track;       // Cached audio (AudioCache), 0 = default bell
+    uint8_t  dayMask;     // Bit d set = rings on day d
+};
+
+// One (minute-of-week, entry) pair. Sorted by minuteOfWeek.
+struct FireTime {
+    uint16_t minuteOfWeek;
+    uint16_t entry;
+};
+
+class ScheduleIndex {
+public:
+    ScheduleIndex() { memset(bitmap, 0, sizeof(bitmap)); }
+
+    static uint16_t minuteOfWeek(int day, int hour, int minute) {
+        return (uint16_t)(day * MINUTES_PER_DAY + hour * 60 + minute);
+    }
+
+    // O(1): does any bell fire at this minute of the week?
+    bool fires(uint16_t mow) const {
+        if (mow >= MINUTES_PER_WEEK) return false;
+        return (bitmap[mow >> 3] >> (mow & 7)) & 1;
+    }
+
+    // Fire times at a given minute as a [first, last) range.
+    // Only worth calling when fires() returned true.
+    const FireTime* firstAt(uint16_t mow) const {
+        return std::lower_bound(fireTimes.data(), fireTimes.data() + fireTimes.size(), mow,
+                                [](const FireTime& f, uint16_t v) { return f.minuteOfWeek < v; });
+    }
+    const FireTime* endAt(uint16_t mow) const {
+        return std::upper_bound(fireTimes.data(), fireTimes.data() + fireTimes.size(), mow,
+                                [](uint16_t v, const FireTime& f) { return v < f.minuteOfWeek; });
+    }
+
+    // First minute after `mow` with a bell, wrapping into next week (the
+    // same minute a week later if it is the only one). Needs fireCount() > 0.
+    uint16_t nextFireAfter(uint16_t mow) const {
+        const FireTime* end = fireTimes.data() + fireTimes.size();
+        const FireTime* next = std::upper_bound(fireTimes.data(), end, mow,
+                                                [](uint16_t v, const FireTime& f) { return v < f.minuteOfWeek; });
+        return next != end ? next->minuteOfWeek : fireTimes[0].minuteOfWeek;
+    }
+
+    size_t entryCount() const { return entries.size(); }
+    size_t fireCount() const { return fireTimes.size(); }
+    const BellEntry& entry(size_t i) const { return entries[i]; }
+    const FireTime* fireData() const { return fireTimes.data(); }
+
+    const char* audioUrl(const BellEntry& e) const {
+        return e.audioOffset == NO_AUDIO ? "" : &audioPool[e.audioOffset];
+    }
+
+    // Only before the index is published (AudioCache::resolve())
+    void setTrack(size_t i, uint16_t track) { entries[i].track = track; }
+
+private:
+    friend class ScheduleIndexBuilder;
+
+    uint8_t bitmap[MINUTES_PER_WEEK / 8]; // 10,080 bits = 1260 bytes
+    std::vector<BellEntry> entries;
+    std::vector<FireTime> fireTimes;
+    std::vector<char> audioPool;
+};
+
+// Collects entries and produces a ScheduleIndex in one go.
+class ScheduleIndexBuilder {
+public:
+    void reserve(size_t n) { entries.reserve(n); }
+
+    // Returns false if the entry is out of range or its audio URL does not
+    // fit the pool (ignored)
+    bool add(int hour, int minute, uint8_t dayMask, uint16_t duration, const char* audioUrl) {
+        if (hour < 0 || hour > 23 || minute < 0 || minute > 59) return false;
+        if (entries.size() >= NO_AUDIO) return false;
+        size_t urlSize = audioUrl && audioUrl[0] ? strlen(audioUrl) + 1 : 0;
+        if (urlSize && audioPool.size() + urlSize > NO_AUDIO) return false;
+
+        BellEntry e;
+        e.minuteOfDay = (uint16_t)(hour * 60 + minute);
+        e.duration = duration;
+        e.dayMask = dayMask & 0x7F;
+        e.audioOffset = NO_AUDIO;
+        e.track = 0;
+
+        if (urlSize) {
+            e.audioOffset = (uint16_t)audioPool.size();
+            audioPool.insert(audioPool.end(), audioUrl, audioUrl + urlSize);
+        }
+        entries.push_back(e);
+        return true;
+    }
+
+    // Compiles the collected entries into `out` (replacing its contents)
+    void build(ScheduleIndex& out) {
+        memset(out.bitmap, 0, sizeof(out.bitmap));
+        out.fireTimes.clear();
+
+        size_t fires = 0;
+        for (const BellEntry& e : entries) fires += __builtin_popcount(e.dayMask);
+        out.fireTimes.reserve(fires);
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            const BellEntry& e = entries[i];
+            for (int d = 0; d < 7; d++) {
+                if (!(e.dayMask & (1 << d))) continue;
+                uint16_t mow = (uint16_t)(d * MINUTES_PER_DAY + e.minuteOfDay);
+                out.bitmap[mow >> 3] |= (uint8_t)(1 << (mow & 7));
+                out.fireTimes.push_back({mow, (uint16_t)i});
+            }
+        }
+        std::stable_sort(out.fireTimes.begin(), out.fireTimes.end(),
+                         [](const FireTime& a, const FireTime& b) { return a.minuteOfWeek < b.minuteOfWeek; });
+
+        out.entries.swap(entries);
+        out.audioPool.swap(audioPool);
+        entries.clear();
+        audioPool.clear();
+    }
+
+private:
+    std::vector<BellEntry> entries;
+    std::vector<char> audioPool;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef SLEEP_PLANNER_H
+#define SLEEP_PLANNER_H
+
+#include <stdint.h>
+#include <atomic>
+#include "hal/Hal.h"
+#include "BellScheduler.h"
+#include "ClockService.h"
+
+// ==========================================
+// SLEEP PLANNER
+// ==========================================
+//
+// Instead of waking every 10 ms, each task works out when it next has
+// something to do and blocks until then (or until it is notified). While
+// both are blocked the chip may light-sleep (hal::Power). This class holds
+// the scheduler's side of that arithmetic and the accounting for both.
+//
+// The scheduler is awake again, polling as usual, `guard` before each bell:
+//
+//   guard = RESYNC_MS + (since last RTC edge read + time to the bell)
+//                       * SLEEP_CLOCK_PPM / ClockService::SLEW_PPB
+//
+// The timer that ends a light sleep runs on the RC slow clock, calibrated
+// against the crystal before each sleep (typically tens of ppm off), so
+// the clock can come back slightly wrong. RESYNC_MS covers skipping one
+// SQW edge and re-reading the RTC on the next; the rest is how long
+// ClockService needs to slew out the worst error the sleep could have
+// left. The bell itself is timed awake, as it is without sleep.
+//
+// Accounting: time in which every task sat in a planned wait counts as
+// asleep. The chip may still have been kept awake by WiFi or another lock,
+// so it is an upper bound. How late a timed-out wait ended against its
+// plan is the wake-up skew. sleep() and wake() are called from tasks on
+// both cores and share a spinlock a few instructions long.
+
+enum SleepTask : uint8_t {
+    SLEEP_SCHEDULER,
+    SLEEP_NETWORK,
+    SLEEP_TASKS
+};
+
+class SleepPlanner {
+public:
+    static const uint32_t MAX_WAIT_MS = 60 * 1000;
+    static const uint32_t RESYNC_MS = 4000;
+    static const uint32_t SLEEP_CLOCK_PPM = 500; // Assumed worst case of the sleep timer
+
+    explicit SleepPlanner(hal::Power& power) : power(power) {}
+
+    // How long the scheduler may wait as far as bells go: until the guard
+    // before the next one, at most MAX_WAIT_MS, 0 inside the guard.
+    // `sinceSyncUs` is the time since the clock was last set from an RTC
+    // edge (0 without one).
+    static uint32_t schedulerWaitMs(const BellScheduler& bells, const ClockService& clock, uint64_t monoUs,
+                                    uint64_t sinceSyncUs) {
+        if (!clock.isSet()) return 0;
+        uint32_t minutes = bells.minutesToNextBell(clock.minuteOfWeek(monoUs));
+        if (minutes == BellScheduler::NO_BELL) return MAX_WAIT_MS;
+        int64_t local = clock.nowUs(monoUs);
+        int64_t bellUs = local - local % 60000000 + (int64_t)minutes * 60000000;
+        return bellWaitMs(clock.monoUntil(bellUs, monoUs), sinceSyncUs);
+    }
+
+    // The same for a bell `untilBellUs` of monotonic time away
+    static uint32_t bellWaitMs(uint64_t untilBellUs, uint64_t sinceSyncUs) {
+        uint64_t guard = (uint64_t)RESYNC_MS * 1000 + slewUs(sinceSyncUs + untilBellUs);
+        if (untilBellUs <= guard) return 0;
+        uint64_t ms = (untilBellUs - guard) / 1000;
+        return ms > MAX_WAIT_MS ? MAX_WAIT_MS : (uint32_t)ms;
+    }
+
+    // `task` is about to block for up to `waitMs`: gives up its share
+    void sleep(SleepTask task, uint64_t nowUs, uint32_t waitMs) {
+        plannedWakeUs[task] = nowUs + (uint64_t)waitMs * 1000;
+        lock();
+        asleep |= (uint8_t)(1 << task);
+        if (asleep == ALL_ASLEEP) allSinceUs = nowUs;
+        unlock();
+        power.release();
+    }
+
+    // ... and runs again. Returns how late a wait that timed out ended
+    // against its plan, 0 if something woke it first.
+    uint32_t wake(SleepTask task, uint64_t nowUs, bool timedOut) {
+        power.hold();
+        lock();
+        if (asleep == ALL_ASLEEP && nowUs > allSinceUs) totalUs += nowUs - allSinceUs;
+        asleep &= (uint8_t)~(1 << task);
+        unlock();
+        if (!timedOut || nowUs <= plannedWakeUs[task]) return 0;
+        uint64_t late = nowUs - plannedWakeUs[task];
+        return late > UINT32_MAX ? UINT32_MAX : (uint32_t)late;
+    }
+
+    // Time every task was in a planned wait at once, since boot
+    uint64_t asleepUs(uint64_t nowUs) {
+        lock();
+        uint64_t t = totalUs + (asleep == ALL_ASLEEP && nowUs > allSinceUs ? nowUs - allSinceUs : 0);
+        unlock();
+        return t;
+    }
+
+private:
+    static const uint8_t ALL_ASLEEP = (1 << SLEEP_TASKS) - 1;
+
+    // Error the sleep timer can build up over `spanUs`, as slewing time
+    static uint64_t slewUs(uint64_t spanUs) {
+        return spanUs * SLEEP_CLOCK_PPM * 1000 / (uint64_t)ClockService::SLEW_PPB;
+    }
+
+    void lock() {
+        while (busy.test_and_set(std::memory_order_acquire)) {}
+    }
+    void unlock() { busy.clear(std::memory_order_release); }
+
+    hal::Power& power;
+    std::atomic_flag busy = ATOMIC_FLAG_INIT;
+    uint8_t asleep = 0;
+    uint64_t allSinceUs = 0;
+    uint64_t totalUs = 0;
+    uint64_t plannedWakeUs[SLEEP_TASKS] = {}; // Each written by its own task only
+};
+
+#endif
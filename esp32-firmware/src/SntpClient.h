@@ -0,0 +1,341 @@
+#ifndef SNTP_CLIENT_H
+#define SNTP_CLIENT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "hal/Hal.h"
+
+// ==========================================
+// SNTP CLIENT
+// ==========================================
+//
+// Time from several NTP servers at once (RFC 4330 client, RFC 5905 sample
+// arithmetic). Every round sends BURST requests to each server, spacingMs
+// apart, and for each exchange works out
+//
+//   offset = ((T2 - t1) + (T3 - t4)) / 2    server UTC minus our clock
+//   delay  = (t4 - t1) - (T3 - T2)          round trip on the wire
+//
+// with t1 / t4 our send and arrival on the monotonic clock and T2 / T3 the
+// server's receive and transmit stamps. The offset is off by at most half
+// the delay (all of it on one leg), plus what the server declares about
+// itself (root delay / 2 + root dispersion). That sum is the sample's bound.
+//
+// Per server only the burst's sample with the smallest delay is kept, as
+// queuing only ever adds delay. Across servers the interval
+// [offset - bound, offset + bound] that most of them overlap is found
+// (Marzullo); a server whose interval misses it is a falseticker and is
+// dropped, and without a majority the round fails. The result is the
+// mean of the survivors weighted by 1 / bound^2, with the tightest
+// survivor's bound widened by its distance from that mean.
+//
+// Replies are matched on a random transmit stamp that the server echoes,
+// so late replies to an earlier request are ignored. A kiss-o'-death
+// (stratum 0) takes the server out of the round. One step() is at most one
+// exchange: it blocks for the reply, up to REPLY_TIMEOUT_MS.
+
+struct SntpResult {
+    int64_t offsetUs;  // UTC = monotonic + offsetUs
+    uint32_t boundUs;  // The offset is off by at most this
+    uint64_t monoUs;   // When the round ended
+    uint8_t servers;   // Servers that answered
+    uint8_t used;      // ... and agreed
+};
+
+struct SntpStats {
+    uint32_t rounds;
+    uint32_t failures;     // Rounds without a majority
+    uint32_t sent;
+    uint32_t timeouts;
+    uint32_t rejected;     // Replies that failed the checks
+    uint32_t kisses;       // Kiss-o'-death replies
+    uint32_t falsetickers; // Servers outvoted in selection
+};
+
+enum SntpStep : uint8_t {
+    SNTP_IDLE,   // No round due
+    SNTP_BUSY,   // Round under way
+    SNTP_DONE,   // Round finished, result() is new
+    SNTP_FAILED  // Round finished without an answer; retried after RETRY_MS
+};
+
+class SntpClient {
+public:
+    static const uint8_t MAX_SERVERS = 6;
+    static const uint8_t BURST = 3;
+    static const uint32_t SPACING_MS = 2000;        // Between a burst's requests (as ntpd's iburst)
+    static const uint32_t REPLY_TIMEOUT_MS = 750;
+    static const uint32_t RETRY_MS = 5 * 60 * 1000;
+    static const uint32_t MAX_BOUND_US = 1000000;   // RFC 5905 MAXDIST
+    static const uint32_t PRECISION_US = 100;       // Arrival stamp after the datagram is in
+
+    SntpClient(hal::Udp& udp, hal::Clock& clock, uint32_t intervalMs, uint32_t spacingMs = SPACING_MS)
+        : udp(udp), clock(clock), intervalMs(intervalMs), spacingMs(spacingMs) {}
+
+    // `host` must outlive the client (a literal)
+    bool addServer(const char* host, uint16_t port = 123) {
+        if (serverCount >= MAX_SERVERS) return false;
+        servers[serverCount] = Server();
+        servers[serverCount].host = host;
+        servers[serverCount].port = port;
+        serverCount++;
+        return true;
+    }
+
+    // Starts a round on the next step() unless one is running (SYNC_TIME);
+    // later rounds follow every intervalMs
+    void start() {
+        scheduled = true;
+        nextRoundMs = clock.millis();
+    }
+
+    SntpStep step() {
+        uint32_t now = clock.millis();
+        if (!inRound) {
+            if (!scheduled || serverCount == 0 || (int32_t)(now - nextRoundMs) < 0) return SNTP_IDLE;
+            beginRound(now);
+        }
+        if ((int32_t)(now - burstAtMs) < 0) return SNTP_BUSY;
+
+        Server& s = servers[nextServer];
+        if (burst == 0) s.resolved = udp.resolve(s.host, s.address);
+        if (s.resolved && !s.kissed) exchange(s);
+
+        if (++nextServer == serverCount) {
+            nextServer = 0;
+            burstAtMs += spacingMs;
+            if (++burst == BURST) return endRound();
+        }
+        return SNTP_BUSY;
+    }
+
+    // How long until step() has something to send
+    uint32_t waitMs() const {
+        if (!scheduled || serverCount == 0) return UINT32_MAX;
+        int32_t left = (int32_t)((inRound ? burstAtMs : nextRoundMs) - clock.millis());
+        return left > 0 ? (uint32_t)left : 0;
+    }
+
+    bool busy() const { return inRound; }
+    bool synced() const { return hasResult; }
+    const SntpResult& result() const { return last; }
+    const SntpStats& stats() const { return counters; }
+
+    // UTC in microseconds at monotonic time `monoUs`, from the last result
+    int64_t utcUs(uint64_t monoUs) const { return (int64_t)monoUs + last.offsetUs; }
+
+private:
+    struct Sample {
+        int64_t offsetUs;
+        uint32_t delayUs;
+        uint32_t boundUs;
+    };
+
+    struct Server {
+        const char* host = "";
+        uint16_t port = 123;
+        uint32_t address = 0;
+        bool resolved = false;
+        bool kissed = false;
+        bool answered = false;
+        Sample best = {};
+    };
+
+    void beginRound(uint32_t now) {
+        inRound = true;
+        burst = 0;
+        nextServer = 0;
+        burstAtMs = now;
+        for (uint8_t i = 0; i < serverCount; i++) {
+            servers[i].kissed = false;
+            servers[i].answered = false;
+        }
+    }
+
+    void exchange(Server& s) {
+        uint8_t packet[48] = {};
+        packet[0] = 0x23; // LI 0, version 4, mode 3 (client)
+        uint64_t cookie = random64();
+        putU64(packet + 40, cookie);
+
+        uint64_t t1 = clock.micros();
+        if (!udp.send(s.address, s.port, packet, sizeof(packet))) {
+            counters.timeouts++;
+            return;
+        }
+        counters.sent++;
+
+        uint8_t reply[68]; // 48, or more with extension fields / MAC
+        for (;;) {
+            uint64_t waited = (clock.micros() - t1) / 1000;
+            if (waited >= REPLY_TIMEOUT_MS) break;
+            uint64_t t4 = 0;
+            int n = udp.receive(reply, sizeof(reply), REPLY_TIMEOUT_MS - (uint32_t)waited, t4);
+            if (n <= 0) break;
+            if (n < 48 || getU64(reply + 24) != cookie) continue; // A stray or an earlier request's reply
+            accept(s, reply, t1, t4);
+            return;
+        }
+        counters.timeouts++;
+    }
+
+    void accept(Server& s, const uint8_t* p, uint64_t t1, uint64_t t4) {
+        uint8_t leap = p[0] >> 6, version = (p[0] >> 3) & 7, mode = p[0] & 7, stratum = p[1];
+        if (mode != 4 || version < 3) {
+            counters.rejected++;
+            return;
+        }
+        if (stratum == 0) { // Kiss-o'-death ("RATE", "DENY", ...): leave it alone this round
+            counters.kisses++;
+            s.kissed = true;
+            return;
+        }
+        int64_t t2 = ntpToUs(p + 32), t3 = ntpToUs(p + 40);
+        if (leap == 3 || stratum > 15 || t2 <= 0 || t3 < t2) { // Unsynchronized or nonsense
+            counters.rejected++;
+            return;
+        }
+        uint32_t rootDelayUs = fixedToUs(getU32(p + 4));
+        uint32_t rootDispersionUs = fixedToUs(getU32(p + 8));
+
+        int64_t rtt = (int64_t)(t4 - t1) - (t3 - t2);
+        Sample sample;
+        sample.offsetUs = ((t2 - (int64_t)t1) + (t3 - (int64_t)t4)) / 2;
+        sample.delayUs = rtt > 0 ? (uint32_t)std::min<int64_t>(rtt, UINT32_MAX) : 0;
+        uint64_t bound = (uint64_t)sample.delayUs / 2 + rootDelayUs / 2 + rootDispersionUs + PRECISION_US;
+        if (bound > MAX_BOUND_US) {
+            counters.rejected++;
+            return;
+        }
+        sample.boundUs = (uint32_t)bound;
+        if (!s.answered || sample.delayUs < s.best.delayUs) s.best = sample;
+        s.answered = true;
+    }
+
+    SntpStep endRound() {
+        inRound = false;
+        counters.rounds++;
+        SntpResult r;
+        if (!select(r)) {
+            counters.failures++;
+            nextRoundMs = clock.millis() + std::min(intervalMs, RETRY_MS);
+            return SNTP_FAILED;
+        }
+        last = r;
+        hasResult = true;
+        nextRoundMs = clock.millis() + intervalMs;
+        return SNTP_DONE;
+    }
+
+    // Marzullo's intersection over the servers' best samples, then the
+    // weighted mean of the ones that agree
+    bool select(SntpResult& out) {
+        struct Edge {
+            int64_t at;
+            int8_t step; // +1 interval opens, -1 closes
+        };
+        Edge edges[2 * MAX_SERVERS];
+        uint8_t n = 0, e = 0;
+        for (uint8_t i = 0; i < serverCount; i++) {
+            if (!servers[i].answered) continue;
+            const Sample& s = servers[i].best;
+            edges[e++] = {s.offsetUs - s.boundUs, +1};
+            edges[e++] = {s.offsetUs + s.boundUs, -1};
+            n++;
+        }
+        if (n == 0) return false;
+        for (uint8_t i = 1; i < e; i++) { // Insertion sort; closed intervals, so opens go first on a tie
+            Edge x = edges[i];
+            uint8_t j = i;
+            for (; j > 0 && (edges[j - 1].at > x.at || (edges[j - 1].at == x.at && edges[j - 1].step < x.step)); j--) {
+                edges[j] = edges[j - 1];
+            }
+            edges[j] = x;
+        }
+        int count = 0, best = 0;
+        int64_t lo = 0, hi = 0;
+        for (uint8_t i = 0; i < e; i++) {
+            count += edges[i].step;
+            if (count > best) {
+                best = count;
+                lo = edges[i].at;
+                hi = edges[i + 1].at; // An open is never last
+            }
+        }
+        if (best * 2 <= n) return false; // No majority
+
+        double sum = 0, weights = 0;
+        for (uint8_t i = 0; i < serverCount; i++) {
+            const Sample& s = servers[i].best;
+            if (!servers[i].answered || s.offsetUs - s.boundUs > lo || s.offsetUs + s.boundUs < hi) continue;
+            double w = 1.0 / ((double)s.boundUs * s.boundUs);
+            sum += w * (double)s.offsetUs;
+            weights += w;
+        }
+        int64_t offset = (int64_t)(sum / weights);
+        uint64_t bound = UINT32_MAX;
+        uint8_t used = 0;
+        for (uint8_t i = 0; i < serverCount; i++) {
+            const Sample& s = servers[i].best;
+            if (!servers[i].answered || s.offsetUs - s.boundUs > lo || s.offsetUs + s.boundUs < hi) continue;
+            bound = std::min<uint64_t>(bound, s.boundUs + (uint64_t)llabs(s.offsetUs - offset));
+            used++;
+        }
+        counters.falsetickers += n - used;
+        out = {offset, (uint32_t)bound, clock.micros(), n, used};
+        return true;
+    }
+
+    // 64-bit NTP timestamp -> Unix microseconds. Seconds below 2^31 are taken
+    // to be past the 2036 era rollover.
+    static int64_t ntpToUs(const uint8_t* p) {
+        uint64_t seconds = getU32(p);
+        uint32_t fraction = getU32(p + 4);
+        if (seconds == 0 && fraction == 0) return 0;
+        if (seconds < 0x80000000UL) seconds += 1ULL << 32;
+        return (int64_t)(seconds - 2208988800ULL) * 1000000 + (int64_t)(((uint64_t)fraction * 1000000) >> 32);
+    }
+
+    // 16.16 seconds, saturating (anything near the cap fails MAX_BOUND_US)
+    static uint32_t fixedToUs(uint32_t v) { return (uint32_t)std::min<uint64_t>(((uint64_t)v * 1000000) >> 16, UINT32_MAX); }
+
+    static uint32_t getU32(const uint8_t* p) {
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+    static uint64_t getU64(const uint8_t* p) { return (uint64_t)getU32(p) << 32 | getU32(p + 4); }
+    static void putU64(uint8_t* p, uint64_t v) {
+        for (int i = 7; i >= 0; i--, v >>= 8) p[i] = (uint8_t)v;
+    }
+
+    // xorshift64*, seeded from the clock: enough to tell our replies apart
+    uint64_t random64() {
+        if (!seed) seed = clock.micros() * 0x9E3779B97F4A7C15ULL | 1;
+        seed ^= seed >> 12;
+        seed ^= seed << 25;
+        seed ^= seed >> 27;
+        return seed * 0x2545F4914F6CDD1DULL;
+    }
+
+    hal::Udp& udp;
+    hal::Clock& clock;
+    uint32_t intervalMs;
+    uint32_t spacingMs;
+    Server servers[MAX_SERVERS];
+    uint8_t serverCount = 0;
+
+    bool scheduled = false;
+    bool inRound = false;
+    uint8_t burst = 0;
+    uint8_t nextServer = 0;
+    uint32_t burstAtMs = 0;
+    uint32_t nextRoundMs = 0;
+    uint64_t seed = 0;
+
+    bool hasResult = false;
+    SntpResult last = {};
+    SntpStats counters = {};
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free single-producer/single-consumer ring buffer. Exactly one task
+// may push and exactly one (other) task may pop; neither side ever blocks
+// or takes a lock, so a stalled producer cannot hold up the consumer.
+// N must be a power of two; the queue holds N items.
+
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    // Producer side. False (and counted in dropped()) when full.
+    bool push(const T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) {
+            drops.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. False when empty.
+    bool pop(T& out) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        out = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+    uint32_t dropped() const { return drops.load(std::memory_order_relaxed); }
+
+private:
+    T items[N];
+    std::atomic<size_t> head{0}; // Written by the producer only
+    std::atomic<size_t> tail{0}; // Written by the consumer only
+    std::atomic<uint32_t> drops{0};
+};
+
+#endif
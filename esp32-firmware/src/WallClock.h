@@ -0,0 +1,75 @@
+#ifndef WALL_CLOCK_H
+#define WALL_CLOCK_H
+
+#include <stdint.h>
+#include <atomic>
+#include "ScheduleIndex.h"
+
+// ==========================================
+// WALL CLOCK (1 Hz SQW)
+// ==========================================
+//
+// Local time in RAM, advanced by one second per DS3231 SQW edge. tick() is
+// the whole ISR. The scheduler re-reads the RTC (set()) right after an
+// edge, when the seconds register cannot roll over under the read, and
+// uses the edge time to discipline ClockService. Times are local epoch
+// seconds, the way the RTC and NTPClient keep them.
+
+class WallClock {
+public:
+    static const uint32_t SECONDS_PER_DAY = 86400;
+    static const uint32_t TICK_TIMEOUT_US = 1500000; // Longer without an edge = SQW not working
+
+    // ISR: one edge = one second. `nowUs` is the low 32 bits of the
+    // monotonic clock (a 64-bit atomic would not be lock-free on the ESP32).
+    void tick(uint32_t nowUs) {
+        seconds.fetch_add(1, std::memory_order_relaxed);
+        lastTickUs.store(nowUs, std::memory_order_relaxed);
+        edges.fetch_add(1, std::memory_order_release);
+    }
+
+    // Sets the time read from the RTC. Counts a correction if it disagreed.
+    void set(uint32_t localEpoch) {
+        if (valid.load(std::memory_order_relaxed) && seconds.load(std::memory_order_relaxed) != localEpoch) {
+            fixes.fetch_add(1, std::memory_order_relaxed);
+        }
+        seconds.store(localEpoch, std::memory_order_relaxed);
+        valid.store(true, std::memory_order_release);
+    }
+
+    bool isSet() const { return valid.load(std::memory_order_acquire); }
+    uint32_t now() const { return seconds.load(std::memory_order_relaxed); }
+
+    // True while edges keep arriving
+    bool ticking(uint64_t monoUs) const {
+        return edges.load(std::memory_order_acquire) > 0 && sinceTickUs(monoUs) <= TICK_TIMEOUT_US;
+    }
+
+    // Monotonic time of the last edge, given the current one (< 71 min apart)
+    uint64_t lastTickAt(uint64_t monoUs) const { return monoUs - sinceTickUs(monoUs); }
+
+    uint32_t tickCount() const { return edges.load(std::memory_order_relaxed); }
+    uint32_t corrections() const { return fixes.load(std::memory_order_relaxed); }
+
+    uint16_t minuteOfWeek() const { return minuteOfWeek(now()); }
+
+    // 1970-01-01 was a Thursday; days are 0=Sun ... 6=Sat like the schedule
+    static uint16_t minuteOfWeek(uint32_t localEpoch) {
+        uint32_t day = (localEpoch / SECONDS_PER_DAY + 4) % 7;
+        uint32_t secondOfDay = localEpoch % SECONDS_PER_DAY;
+        return ScheduleIndex::minuteOfWeek((int)day, (int)(secondOfDay / 3600), (int)(secondOfDay / 60 % 60));
+    }
+
+private:
+    uint32_t sinceTickUs(uint64_t monoUs) const {
+        return (uint32_t)monoUs - lastTickUs.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<uint32_t> seconds{0};
+    std::atomic<uint32_t> lastTickUs{0};
+    std::atomic<uint32_t> edges{0};
+    std::atomic<uint32_t> fixes{0};
+    std::atomic<bool> valid{false};
+};
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef ESP32_HAL_H
+#define ESP32_HAL_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <LittleFS.h>
+#include <SD.h>
+#include <esp_timer.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <esp_pm.h>
+#include <esp_idf_version.h>
+#include <lwip/sockets.h>
+#include "Hal.h"
+#include "Esp32HttpSession.h"
+
+// ESP32 / Arduino implementations of the HAL interfaces (see Hal.h)
+
+namespace hal {
+
+class Esp32Clock : public Clock {
+public:
+    uint32_t millis() override { return ::millis(); }
+    uint64_t micros() override { return (uint64_t)esp_timer_get_time(); }
+    void delay(uint32_t ms) override { ::delay(ms); }
+};
+
+class Esp32Gpio : public Gpio {
+public:
+    void pinMode(uint8_t pin, uint8_t mode) override { ::pinMode(pin, mode); }
+    void write(uint8_t pin, uint8_t level) override { digitalWrite(pin, level); }
+    int read(uint8_t pin) override { return digitalRead(pin); }
+    void tone(uint8_t pin, unsigned int frequency) override { ::tone(pin, frequency); }
+    void noTone(uint8_t pin) override { ::noTone(pin); }
+};
+
+class Esp32File : public File {
+public:
+    explicit Esp32File(fs::File f) : file(f) {}
+    ~Esp32File() override { close(); }
+    int read() override { return file.read(); }
+    size_t readBytes(char* buffer, size_t length) override { return file.readBytes(buffer, length); }
+    size_t write(const uint8_t* data, size_t length) override { return file.write(data, length); }
+    size_t size() override { return file.size(); }
+    void flush() override { file.flush(); }
+    void close() override { if (file) file.close(); }
+
+private:
+    fs::File file;
+};
+
+class LittleFsFileSystem : public FileSystem {
+public:
+    bool begin() { return LittleFS.begin(true); }
+    bool exists(const char* path) override { return LittleFS.exists(path); }
+    std::unique_ptr<File> open(const char* path, const char* mode) override {
+        fs::File f = LittleFS.open(path, mode);
+        if (!f) return nullptr;
+        return std::unique_ptr<File>(new Esp32File(f));
+    }
+    bool rename(const char* from, const char* to) override { return LittleFS.rename(from, to); }
+    bool remove(const char* path) override { return LittleFS.remove(path); }
+};
+
+// SD card on the VSPI bus (SCK 18, MISO 19, MOSI 23) for AudioCache. FAT
+// will not rename over an existing file, so the target is removed first.
+class SdFileSystem : public FileSystem {
+public:
+    bool begin(uint8_t csPin) { return SD.begin(csPin); }
+    bool exists(const char* path) override { return SD.exists(path); }
+    std::unique_ptr<File> open(const char* path, const char* mode) override {
+        fs::File f = SD.open(path, mode);
+        if (!f) return nullptr;
+        return std::unique_ptr<File>(new Esp32File(f));
+    }
+    bool rename(const char* from, const char* to) override {
+        if (SD.exists(to)) SD.remove(to);
+        return SD.rename(from, to);
+    }
+    bool remove(const char* path) override { return SD.remove(path); }
+};
+
+// The next OTA slot, written with raw partition writes (esp_ota_begin()
+// cannot continue a half-written image after a reboot). activate() runs
+// esp_ota_set_boot_partition(), which also checks the image format.
+class Esp32OtaPartition : public OtaPartition {
+public:
+    uint32_t id() override { return slot() ? slot()->address : 0; }
+    size_t capacity() override { return slot() ? slot()->size : 0; }
+
+    bool write(size_t offset, const uint8_t* data, size_t length) override {
+        const esp_partition_t* p = slot();
+        if (!p || offset + length > p->size) return false;
+        for (size_t sector = (offset + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE; sector < offset + length;
+             sector += SECTOR_SIZE) {
+            if (esp_partition_erase_range(p, sector, SECTOR_SIZE) != ESP_OK) return false;
+        }
+        return esp_partition_write(p, offset, data, length) == ESP_OK;
+    }
+
+    bool read(size_t offset, uint8_t* data, size_t length) override {
+        const esp_partition_t* p = slot();
+        return p && esp_partition_read(p, offset, data, length) == ESP_OK;
+    }
+
+    bool activate(size_t imageSize) override {
+        const esp_partition_t* p = slot();
+        return p && esp_ota_set_boot_partition(p) == ESP_OK;
+    }
+
+    uint32_t runningSize() override { return ESP.getSketchSize(); } // Image length, as in the .bin
+    bool readRunning(size_t offset, uint8_t* data, size_t length) override {
+        return esp_partition_read(esp_ota_get_running_partition(), offset, data, length) == ESP_OK;
+    }
+
+    bool pendingVerify() override {
+        esp_ota_img_states_t state;
+        return esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+               state == ESP_OTA_IMG_PENDING_VERIFY;
+    }
+    void markValid() override { esp_ota_mark_app_valid_cancel_rollback(); }
+    void rollback() override {
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+        ESP.restart(); // Only reached if there is nothing to roll back to
+    }
+
+private:
+    const esp_partition_t* slot() { return esp_ota_get_next_update_partition(nullptr); }
+};
+
+// HardwareSerial's RX side is drained into its ring buffer by the UART
+// driver; 10-byte DFPlayer frames fit the TX FIFO, so write() returns at once.
+class Esp32SerialPort : public SerialPort {
+public:
+    explicit Esp32SerialPort(HardwareSerial& serial) : serial(serial) {}
+
+    void begin(unsigned long baud, int rxPin, int txPin) { serial.begin(baud, SERIAL_8N1, rxPin, txPin); }
+    int read() override { return serial.available() ? serial.read() : -1; }
+    size_t write(const uint8_t* data, size_t length) override { return serial.write(data, length); }
+
+private:
+    HardwareSerial& serial;
+};
+
+// Automatic light sleep (esp_pm with tickless idle): the chip sleeps
+// whenever every task is blocked and no lock is held, and WiFi stays
+// associated in modem sleep. One counting ESP_PM_NO_LIGHT_SLEEP lock stands
+// for all shares. Needs an SDK built with CONFIG_PM_ENABLE and
+// CONFIG_FREERTOS_USE_TICKLESS_IDLE; without them begin() fails and the
+// chip never sleeps.
+class Esp32Power : public Power {
+public:
+    // `holders` tasks start out holding a share
+    bool begin(uint8_t holders, int maxMhz = 240, int minMhz = 80) {
+        if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "tasks", &lock) != ESP_OK) return false;
+        for (uint8_t i = 0; i < holders; i++) esp_pm_lock_acquire(lock);
+#if ESP_IDF_VERSION_MAJOR >= 5
+        esp_pm_config_t config = {maxMhz, minMhz, true};
+#else
+        esp_pm_config_esp32_t config = {maxMhz, minMhz, true};
+#endif
+        return esp_pm_configure(&config) == ESP_OK;
+    }
+
+    void hold() override { if (lock) esp_pm_lock_acquire(lock); }
+    void release() override { if (lock) esp_pm_lock_release(lock); }
+
+private:
+    esp_pm_lock_handle_t lock = nullptr;
+};
+
+// BSD socket from lwIP rather than WiFiUDP, whose parsePacket() only polls:
+// a blocking recv() returns as soon as lwIP hands the datagram over, so the
+// arrival stamp is good to tens of microseconds (SNTP round-trip times).
+class Esp32Udp : public Udp {
+public:
+    ~Esp32Udp() override {
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool resolve(const char* host, uint32_t& address) override {
+        IPAddress ip;
+        if (!WiFi.hostByName(host, ip)) return false;
+        address = (uint32_t)ip;
+        return true;
+    }
+
+    bool send(uint32_t address, uint16_t port, const uint8_t* data, size_t length) override {
+        if (!open()) return false;
+        sockaddr_in to = {};
+        to.sin_family = AF_INET;
+        to.sin_port = htons(port);
+        to.sin_addr.s_addr = address;
+        return sendto(fd, data, length, 0, (sockaddr*)&to, sizeof(to)) == (int)length;
+    }
+
+    int receive(uint8_t* buffer, size_t size, uint32_t timeoutMs, uint64_t& atUs) override {
+        if (!open()) return -1;
+        timeval tv = {(time_t)(timeoutMs / 1000), (suseconds_t)(timeoutMs % 1000 * 1000)};
+        if (tv.tv_sec == 0 && tv.tv_usec == 0) tv.tv_usec = 1000; // 0 would mean forever
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        int n = recv(fd, buffer, size, 0);
+        atUs = (uint64_t)esp_timer_get_time();
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        return n;
+    }
+
+private:
+    bool open() {
+        if (fd < 0) fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        return fd >= 0;
+    }
+
+    int fd = -1;
+};
+
+} // namespace hal
+
+#endif
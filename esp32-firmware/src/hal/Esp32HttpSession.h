@@ -0,0 +1,279 @@
+#ifndef ESP32_HTTP_SESSION_H
+#define ESP32_HTTP_SESSION_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <esp_timer.h>
+#include "Hal.h"
+
+namespace hal {
+
+// ==========================================
+// PERSISTENT HTTPS SESSION
+// ==========================================
+//
+// One WiFiClientSecure shared by every RPC. Requests go out as HTTP/1.1
+// with keep-alive, so after the first handshake each poll is a plain
+// request/response on the open TLS connection. If the server has closed
+// the idle connection the request is retried once on a fresh one.
+//
+// The arduino-esp32 core does not expose mbedTLS session tickets on
+// WiFiClientSecure, so a dropped connection costs a full handshake; keeping
+// the connection open is what removes the per-request handshakes.
+//
+// HTTP/1.1 is spoken directly on the socket with fixed buffers: URL parts,
+// headers, the request head and response lines all live in this object.
+// HTTPClient built every request and parsed every response line in
+// Arduino Strings, a dozen heap blocks per poll that fragmented the heap
+// over weeks of uptime; a request on an open connection now allocates
+// nothing (the TLS handshake on a new one still does, inside mbedTLS).
+//
+// HTTP/1.1 bodies may be chunked, so read()/readBytes() decode chunked
+// transfer encoding themselves. end() drains whatever the caller did not
+// read so the connection stays in sync for the next request.
+
+class Esp32HttpSession : public HttpClient {
+public:
+    explicit Esp32HttpSession(uint32_t timeoutMs = 5000) : timeoutMs(timeoutMs) {
+        client.setInsecure(); // Same trust model as HTTPClient::begin(url) used before
+    }
+
+    // https://host[:port]/path only; a different host or port closes the
+    // kept-alive connection
+    bool begin(const char* url) override {
+        remaining = 0;
+        length = -1;
+        chunked = false;
+        chunkLeft = 0;
+        bodyDone = true;
+        closeAfter = false;
+        headerLen = 0;
+        headers[0] = '\0';
+        valid = false;
+
+        if (strncmp(url, "https://", 8) != 0) return false;
+        const char* h = url + 8;
+        const char* slash = strchr(h, '/');
+        const char* hostEnd = slash ? slash : h + strlen(h);
+        const char* colon = (const char*)memchr(h, ':', hostEnd - h);
+        size_t hostLen = (colon ? colon : hostEnd) - h;
+        uint16_t newPort = colon ? (uint16_t)atoi(colon + 1) : 443;
+        if (hostLen == 0 || hostLen >= sizeof(host) || strlen(slash ? slash : "/") >= sizeof(path)) return false;
+
+        if (hostLen != strlen(host) || strncmp(host, h, hostLen) != 0 || newPort != port) {
+            client.stop();
+            memcpy(host, h, hostLen);
+            host[hostLen] = '\0';
+            port = newPort;
+        }
+        snprintf(path, sizeof(path), "%s", slash ? slash : "/");
+        valid = true;
+        return true;
+    }
+
+    void addHeader(const char* name, const char* value) override {
+        int n = snprintf(headers + headerLen, sizeof(headers) - headerLen, "%s: %s\r\n", name, value);
+        if (n < 0 || (size_t)n >= sizeof(headers) - headerLen) {
+            valid = false; // Sent incomplete is worse than not sent
+            return;
+        }
+        headerLen += n;
+    }
+
+    int post(const char* body, size_t length) override { return send("POST", body, length); }
+    int get() override { return send("GET", nullptr, 0); }
+
+    int read() override {
+        char c;
+        return readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
+    }
+
+    size_t readBytes(char* buffer, size_t length) override {
+        size_t n = 0;
+        while (n < length && !bodyDone) {
+            if (chunked && chunkLeft == 0 && !nextChunk()) {
+                bodyDone = true;
+                break;
+            }
+            size_t want = length - n;
+            if (chunked && want > chunkLeft) want = chunkLeft;
+            if (!chunked && remaining > 0 && want > (size_t)remaining) want = remaining;
+
+            size_t got = receive(buffer + n, want);
+            if (got == 0) {
+                bodyDone = true; // Timeout or closed
+                broken = remaining >= 0 || chunked; // Closing is the end of a read-until-close body
+                break;
+            }
+            n += got;
+            if (chunked) {
+                chunkLeft -= got;
+                if (chunkLeft == 0) skipLine(); // CRLF after the chunk data
+            } else if (remaining > 0) {
+                remaining -= got;
+                if (remaining == 0) bodyDone = true;
+            }
+        }
+        return n;
+    }
+
+    int32_t contentLength() override { return length; }
+
+    void end() override {
+        char sink[64];
+        while (!bodyDone && readBytes(sink, sizeof(sink)) > 0) {}
+        if (broken || closeAfter || (!chunked && remaining < 0)) client.stop(); // Out of sync or read-until-close
+        broken = false;
+
+        if (started) {
+            recordLatency((uint32_t)(esp_timer_get_time() - started));
+            started = 0;
+        }
+    }
+
+private:
+    int send(const char* method, const char* body, size_t bodyLength) {
+        started = esp_timer_get_time();
+        httpStats.requests++;
+
+        int headLen = valid ? writeHead(method, body ? (long)bodyLength : -1) : -1;
+        int code = -1;
+        for (int attempt = 0; attempt < 2 && headLen > 0; attempt++) {
+            bool reused = client.connected();
+            if (!reused && !client.connect(host, port, (int32_t)timeoutMs)) break;
+            if (writeAll(head, headLen) && (!body || writeAll(body, bodyLength))) code = readHead();
+            if (code > 0) {
+                if (!reused) httpStats.handshakes++;
+                break;
+            }
+            client.stop();
+            if (!reused) break;
+            httpStats.reconnects++; // Server dropped the kept-alive connection: retry once
+        }
+
+        if (code <= 0) {
+            httpStats.failures++;
+            client.stop();
+            bodyDone = true;
+            return -1;
+        }
+        if (code == 204 || code == 304) remaining = 0; // Never has a body
+        length = chunked ? -1 : remaining;
+        bodyDone = !chunked && remaining == 0;
+        return code;
+    }
+
+    // Request line and headers into `head`; its length, or -1 if it did not fit
+    int writeHead(const char* method, long bodyLength) {
+        char portPart[8] = "";
+        if (port != 443) snprintf(portPart, sizeof(portPart), ":%u", port);
+        char lengthPart[40] = "";
+        if (bodyLength >= 0) snprintf(lengthPart, sizeof(lengthPart), "Content-Length: %ld\r\n", bodyLength);
+        int n = snprintf(head, sizeof(head),
+                         "%s %s HTTP/1.1\r\nHost: %s%s\r\nConnection: keep-alive\r\nUser-Agent: AutoBell\r\n"
+                         "Accept-Encoding: identity\r\n%s%s\r\n",
+                         method, path, host, portPart, lengthPart, headers);
+        return n > 0 && (size_t)n < sizeof(head) ? n : -1;
+    }
+
+    bool writeAll(const char* data, size_t length) {
+        size_t sent = 0;
+        while (sent < length) {
+            size_t n = client.write((const uint8_t*)data + sent, length - sent);
+            if (n == 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    // Status line and headers; returns the status code or -1
+    int readHead() {
+        remaining = -1; // Until close, unless the headers say otherwise
+        chunked = false;
+        closeAfter = false;
+        if (!readLine() || strncmp(line, "HTTP/1.", 7) != 0) return -1;
+        closeAfter = line[7] == '0'; // HTTP/1.0: no keep-alive
+        const char* sp = strchr(line, ' ');
+        int code = sp ? atoi(sp + 1) : -1;
+
+        for (;;) {
+            if (!readLine()) return -1;
+            if (line[0] == '\0') return code;
+            if (strncasecmp(line, "Content-Length:", 15) == 0) {
+                remaining = atoi(line + 15);
+            } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line + 18, "chunked")) {
+                chunked = true;
+            } else if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line + 11, "close")) {
+                closeAfter = true;
+            }
+        }
+    }
+
+    // One CRLF-terminated line into `line` (cut off if longer); false on
+    // timeout or close
+    bool readLine() {
+        size_t n = 0;
+        char c;
+        for (;;) {
+            if (receive(&c, 1) != 1) return false;
+            if (c == '\n') break;
+            if (c != '\r' && n < sizeof(line) - 1) line[n++] = c;
+        }
+        line[n] = '\0';
+        return true;
+    }
+
+    // Reads a chunk-size line; false on the terminating 0-size chunk
+    bool nextChunk() {
+        if (!readLine() || line[0] == '\0') {
+            broken = true;
+            return false;
+        }
+        chunkLeft = strtoul(line, nullptr, 16);
+        if (chunkLeft == 0) {
+            skipLine(); // Empty line after the last chunk (no trailers expected)
+            return false;
+        }
+        return true;
+    }
+
+    void skipLine() { readLine(); }
+
+    // Up to `length` bytes, waiting at most timeoutMs for the first; 0 on
+    // timeout or close
+    size_t receive(char* out, size_t length) {
+        uint32_t waitStart = millis();
+        for (;;) {
+            int avail = client.available();
+            if (avail > 0) {
+                int n = client.read((uint8_t*)out, (size_t)avail < length ? (size_t)avail : length);
+                return n > 0 ? (size_t)n : 0;
+            }
+            if (!client.connected() || millis() - waitStart >= timeoutMs) return 0;
+            delay(1);
+        }
+    }
+
+    WiFiClientSecure client;
+    uint32_t timeoutMs;
+    char host[96] = "";
+    uint16_t port = 0;
+    char path[320];
+    char headers[640];
+    size_t headerLen = 0;
+    char head[1152];
+    char line[256];
+    bool valid = false;
+    int remaining = 0;      // Body bytes left; -1 = until close
+    int32_t length = -1;
+    bool chunked = false;
+    size_t chunkLeft = 0;
+    bool bodyDone = true;
+    bool broken = false;
+    bool closeAfter = false;
+    int64_t started = 0;
+};
+
+} // namespace hal
+
+#endif
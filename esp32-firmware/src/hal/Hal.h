@@ -0,0 +1,165 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+
+// ==========================================
+// HARDWARE ABSTRACTION LAYER
+// ==========================================
+//
+// Thin interfaces over the things the firmware touches, so the protocol and
+// scheduling code can run on the host (env:native) as well as on the ESP32.
+//   - hal/Esp32Hal.h  : Arduino / ESP32 implementations (used by main.cpp)
+//   - hal/NativeHal.h : Linux stand-ins (used by bench/)
+
+namespace hal {
+
+class Clock {
+public:
+    virtual ~Clock() {}
+    virtual uint32_t millis() = 0;
+    virtual uint64_t micros() = 0;
+    virtual void delay(uint32_t ms) = 0;
+};
+
+class Gpio {
+public:
+    virtual ~Gpio() {}
+    virtual void pinMode(uint8_t pin, uint8_t mode) = 0;
+    virtual void write(uint8_t pin, uint8_t level) = 0;
+    virtual int read(uint8_t pin) = 0;
+    virtual void tone(uint8_t pin, unsigned int frequency) = 0;
+    virtual void noTone(uint8_t pin) = 0;
+};
+
+// Transport counters kept by every HttpClient
+struct HttpStats {
+    uint32_t requests;
+    uint32_t failures;       // Transport errors (status < 0)
+    uint32_t handshakes;     // New connections (TCP + TLS)
+    uint32_t reconnects;     // Retries after the server dropped a kept-alive connection
+    uint32_t lastLatencyUs;  // post() to end() of the last request
+    uint32_t maxLatencyUs;
+    uint64_t totalLatencyUs;
+};
+
+// One request at a time: begin() -> addHeader()* -> post()/get() -> read*() -> end().
+// read()/readBytes() stream the response body, which also makes an
+// HttpClient usable directly as an ArduinoJson reader.
+class HttpClient {
+public:
+    virtual ~HttpClient() {}
+    virtual bool begin(const char* url) = 0;
+    virtual void addHeader(const char* name, const char* value) = 0;
+    virtual int post(const char* body, size_t length) = 0; // HTTP status, <0 on transport error
+    virtual int get() = 0;
+    virtual int read() = 0;                                 // -1 at end of body
+    virtual size_t readBytes(char* buffer, size_t length) = 0;
+    virtual int32_t contentLength() = 0;                    // Of the last response, -1 if not given
+    virtual void end() = 0;
+
+    const HttpStats& stats() const { return httpStats; }
+
+protected:
+    void recordLatency(uint32_t us) {
+        httpStats.lastLatencyUs = us;
+        httpStats.totalLatencyUs += us;
+        if (us > httpStats.maxLatencyUs) httpStats.maxLatencyUs = us;
+    }
+
+    HttpStats httpStats = {};
+};
+
+class File {
+public:
+    virtual ~File() {}
+    virtual int read() = 0;
+    virtual size_t readBytes(char* buffer, size_t length) = 0;
+    virtual size_t write(const uint8_t* data, size_t length) = 0;
+    virtual size_t size() = 0;
+    virtual void flush() = 0; // Commits what was written so far to the medium
+    virtual void close() = 0;
+
+    // Single-byte write, so a File can be an ArduinoJson writer as well as a reader
+    size_t write(uint8_t c) { return write(&c, 1); }
+};
+
+class FileSystem {
+public:
+    virtual ~FileSystem() {}
+    virtual bool exists(const char* path) = 0;
+    virtual std::unique_ptr<File> open(const char* path, const char* mode) = 0; // "r", "w" or "a"
+    virtual bool rename(const char* from, const char* to) = 0;
+    virtual bool remove(const char* path) = 0;
+};
+
+// The inactive firmware slot. Written sequentially from any sector boundary
+// (each sector is erased as the write enters it), so an interrupted
+// download can resume where it stopped.
+class OtaPartition {
+public:
+    static const size_t SECTOR_SIZE = 4096;
+
+    virtual ~OtaPartition() {}
+    virtual uint32_t id() = 0; // Identifies the slot; changes if the running image does
+    virtual size_t capacity() = 0;
+    virtual bool write(size_t offset, const uint8_t* data, size_t length) = 0;
+    virtual bool read(size_t offset, uint8_t* data, size_t length) = 0;
+    virtual bool activate(size_t imageSize) = 0; // Boot from it on the next restart
+
+    // The running image, the source of delta updates
+    virtual uint32_t runningSize() = 0;
+    virtual bool readRunning(size_t offset, uint8_t* data, size_t length) = 0;
+
+    // Health check of the running image after an update
+    virtual bool pendingVerify() = 0; // First boot of a new image, not yet confirmed
+    virtual void markValid() = 0;
+    virtual void rollback() = 0;      // Back to the previous image (reboots)
+};
+
+// A UART. Neither call waits: read() returns -1 when nothing has arrived,
+// write() hands the bytes to the driver's TX buffer.
+class SerialPort {
+public:
+    virtual ~SerialPort() {}
+    virtual int read() = 0;
+    virtual size_t write(const uint8_t* data, size_t length) = 0;
+};
+
+// Audio player. Calls queue the request (see DFPlayerDriver) and return.
+class DFPlayer {
+public:
+    virtual ~DFPlayer() {}
+    virtual bool begin() = 0;
+    virtual void volume(uint8_t level) = 0; // 0..30
+    virtual void play(uint16_t track) = 0;      // Nth file on the card, in copy order
+    virtual void playFile(uint16_t track) = 0;  // /mp3/NNNN.mp3 (AudioCache files)
+    virtual void stop() = 0;
+};
+
+// Permission to light-sleep. A task holds a share while it works and
+// releases it only for a wait it planned; the chip may sleep while no
+// share is held (and every task is blocked).
+class Power {
+public:
+    virtual ~Power() {}
+    virtual void hold() = 0;
+    virtual void release() = 0;
+};
+
+// UDP over IPv4 (SNTP). Addresses are in network byte order. receive()
+// waits up to `timeoutMs` and stamps the arrival with the monotonic clock
+// (Clock::micros()) as soon as the datagram is handed over.
+class Udp {
+public:
+    virtual ~Udp() {}
+    virtual bool resolve(const char* host, uint32_t& address) = 0;
+    virtual bool send(uint32_t address, uint16_t port, const uint8_t* data, size_t length) = 0;
+    virtual int receive(uint8_t* buffer, size_t size, uint32_t timeoutMs, uint64_t& atUs) = 0; // 0 on timeout, <0 on error
+};
+
+} // namespace hal
+
+#endif
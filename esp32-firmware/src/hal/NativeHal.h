@@ -0,0 +1,405 @@
+#ifndef NATIVE_HAL_H
+#define NATIVE_HAL_H
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include "Hal.h"
+
+// Linux stand-ins for the HAL interfaces (see Hal.h). Used by env:native.
+
+namespace hal {
+
+class StdClock : public Clock {
+public:
+    uint32_t millis() override { return (uint32_t)(micros() / 1000); }
+    uint64_t micros() override {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - start).count();
+    }
+    void delay(uint32_t ms) override { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+private:
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+};
+
+// Simulated time for tests that replay hours in milliseconds. Only moves
+// when delay() or advance() is called.
+class SimClock : public Clock {
+public:
+    uint32_t millis() override { return (uint32_t)(now / 1000); }
+    uint64_t micros() override { return now; }
+    void delay(uint32_t ms) override { now += (uint64_t)ms * 1000; }
+    void advance(uint64_t us) { now += us; }
+
+private:
+    uint64_t now = 0;
+};
+
+// Records pin levels and tones instead of driving hardware
+class FakeGpio : public Gpio {
+public:
+    static const int PIN_COUNT = 40;
+
+    void pinMode(uint8_t pin, uint8_t mode) override { if (pin < PIN_COUNT) modes[pin] = mode; }
+    void write(uint8_t pin, uint8_t level) override { if (pin < PIN_COUNT) levels[pin] = level; }
+    int read(uint8_t pin) override { return pin < PIN_COUNT ? levels[pin] : 0; }
+    void tone(uint8_t pin, unsigned int frequency) override { if (pin < PIN_COUNT) tones[pin] = frequency; }
+    void noTone(uint8_t pin) override { if (pin < PIN_COUNT) tones[pin] = 0; }
+
+    uint8_t modes[PIN_COUNT] = {};
+    uint8_t levels[PIN_COUNT] = {};
+    unsigned int tones[PIN_COUNT] = {};
+};
+
+// Serves canned responses keyed by URL suffix (e.g. "/rpc/get_next_command")
+class FakeHttpClient : public HttpClient {
+public:
+    void route(const std::string& urlSuffix, int code, const std::string& body) {
+        for (Route& r : routes) {
+            if (r.suffix == urlSuffix) { r.code = code; r.body = body; return; }
+        }
+        routes.push_back({urlSuffix, code, body});
+    }
+
+    bool begin(const char* u) override {
+        url = u;
+        response = nullptr;
+        pos = 0;
+        return true;
+    }
+    void addHeader(const char*, const char*) override {}
+
+    int post(const char* body, size_t length) override {
+        lastBody.assign(body, length);
+        return respond();
+    }
+    int get() override {
+        lastBody.clear();
+        return respond();
+    }
+
+    int read() override {
+        if (!response || pos >= response->body.size()) return -1;
+        return (uint8_t)response->body[pos++];
+    }
+
+    size_t readBytes(char* buffer, size_t length) override {
+        if (!response) return 0;
+        size_t n = response->body.size() - pos;
+        if (n > length) n = length;
+        memcpy(buffer, response->body.data() + pos, n);
+        pos += n;
+        return n;
+    }
+
+    int32_t contentLength() override { return response ? (int32_t)response->body.size() : -1; }
+
+    void end() override { response = nullptr; }
+
+    std::string lastBody;
+
+private:
+    int respond() {
+        httpStats.requests++;
+        if (httpStats.requests == 1) httpStats.handshakes++; // One kept-alive "connection"
+        for (const Route& r : routes) {
+            if (url.size() >= r.suffix.size() &&
+                url.compare(url.size() - r.suffix.size(), r.suffix.size(), r.suffix) == 0) {
+                response = &r;
+                return r.code;
+            }
+        }
+        return 404;
+    }
+
+    struct Route {
+        std::string suffix;
+        int code;
+        std::string body;
+    };
+    std::vector<Route> routes;
+    std::string url;
+    const Route* response = nullptr;
+    size_t pos = 0;
+};
+
+class HostFile : public File {
+public:
+    explicit HostFile(FILE* f) : fp(f) {}
+    ~HostFile() override { close(); }
+    int read() override { return fp ? fgetc(fp) : -1; }
+    size_t readBytes(char* buffer, size_t length) override { return fp ? fread(buffer, 1, length, fp) : 0; }
+    size_t write(const uint8_t* data, size_t length) override { return fp ? fwrite(data, 1, length, fp) : 0; }
+    size_t size() override {
+        if (!fp) return 0;
+        long here = ftell(fp);
+        fseek(fp, 0, SEEK_END);
+        long n = ftell(fp);
+        fseek(fp, here, SEEK_SET);
+        return (size_t)n;
+    }
+    void flush() override {
+        if (fp) fflush(fp);
+    }
+    void close() override {
+        if (fp) fclose(fp);
+        fp = nullptr;
+    }
+
+private:
+    FILE* fp;
+};
+
+// Maps LittleFS paths ("/schedules.json") under a host directory
+class HostFileSystem : public FileSystem {
+public:
+    explicit HostFileSystem(const std::string& root) : root(root) {}
+
+    bool exists(const char* path) override {
+        FILE* f = fopen(full(path).c_str(), "rb");
+        if (!f) return false;
+        fclose(f);
+        return true;
+    }
+    std::unique_ptr<File> open(const char* path, const char* mode) override {
+        FILE* f = fopen(full(path).c_str(), mode[0] == 'w' ? "wb" : mode[0] == 'a' ? "ab" : "rb");
+        if (!f) return nullptr;
+        return std::unique_ptr<File>(new HostFile(f));
+    }
+    bool rename(const char* from, const char* to) override {
+        return ::rename(full(from).c_str(), full(to).c_str()) == 0;
+    }
+    bool remove(const char* path) override { return ::remove(full(path).c_str()) == 0; }
+
+private:
+    std::string full(const char* path) const { return root + path; }
+    std::string root;
+};
+
+// OTA slot kept in memory, with flash semantics: writes only clear bits,
+// so data written without erasing the sector first shows up corrupted
+class MemoryOtaPartition : public OtaPartition {
+public:
+    explicit MemoryOtaPartition(size_t size, uint32_t slotId = 0x110000) : flash(size, 0x00), slot(slotId) {}
+
+    uint32_t id() override { return slot; }
+    size_t capacity() override { return flash.size(); }
+    bool write(size_t offset, const uint8_t* data, size_t length) override {
+        if (offset + length > flash.size()) return false;
+        for (size_t sector = (offset + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE; sector < offset + length;
+             sector += SECTOR_SIZE) {
+            memset(flash.data() + sector, 0xFF, SECTOR_SIZE < flash.size() - sector ? SECTOR_SIZE : flash.size() - sector);
+        }
+        for (size_t i = 0; i < length; i++) flash[offset + i] &= data[i];
+        bytesWritten += length;
+        return true;
+    }
+    bool read(size_t offset, uint8_t* data, size_t length) override {
+        if (offset + length > flash.size()) return false;
+        memcpy(data, flash.data() + offset, length);
+        return true;
+    }
+    bool activate(size_t imageSize) override {
+        activatedSize = imageSize;
+        return true;
+    }
+    uint32_t runningSize() override { return (uint32_t)running.size(); }
+    bool readRunning(size_t offset, uint8_t* data, size_t length) override {
+        if (offset + length > running.size()) return false;
+        memcpy(data, running.data() + offset, length);
+        return true;
+    }
+    bool pendingVerify() override { return false; }
+    void markValid() override {}
+    void rollback() override {}
+
+    std::vector<uint8_t> flash;
+    std::vector<uint8_t> running; // The "running image" for delta updates
+    size_t activatedSize = 0; // 0 = not activated
+    size_t bytesWritten = 0;
+
+private:
+    uint32_t slot;
+};
+
+class FakeDFPlayer : public DFPlayer {
+public:
+    bool begin() override { return true; }
+    void volume(uint8_t level) override { vol = level; }
+    void play(uint16_t track) override { lastTrack = track; lastFile = 0; plays++; }
+    void playFile(uint16_t track) override { lastFile = track; lastTrack = 0; plays++; }
+    void stop() override { lastTrack = 0; lastFile = 0; stops++; }
+
+    uint8_t vol = 0;
+    uint16_t lastTrack = 0;
+    uint16_t lastFile = 0; // From playFile()
+    unsigned long stops = 0;
+    unsigned long plays = 0;
+};
+
+// The DFPlayer Mini's side of the UART, on simulated time: answers each
+// frame DFPlayerDriver writes after `replyMs` (ACK when asked for, status,
+// devices, errors), plays tracks for `trackMs` after `startMs` and reports
+// the end twice, like the module. Faults on demand: no card, busy until
+// `busyUntilMs`, every `dropEvery`th frame ignored, every `garbleEvery`th
+// reply with a flipped byte.
+class FakeDFPlayerModule : public SerialPort {
+public:
+    explicit FakeDFPlayerModule(Clock& clock) : clock(clock) {}
+
+    int read() override {
+        update();
+        if (outbox.empty() || outbox.front().readyMs > clock.millis()) return -1;
+        uint8_t b = outbox.front().byte;
+        outbox.erase(outbox.begin());
+        return b;
+    }
+
+    size_t write(const uint8_t* data, size_t length) override {
+        for (size_t i = 0; i < length; i++) {
+            if (!inLength && data[i] != 0x7E) continue;
+            in[inLength++] = data[i];
+            if (inLength == sizeof(in)) {
+                inLength = 0;
+                receive();
+            }
+        }
+        return length;
+    }
+
+    void insertCard(bool present) {
+        card = present;
+        reply(present ? 0x3A : 0x3B, 0x02);
+    }
+
+    // Behaviour
+    bool card = true;
+    uint16_t tracks = 10;         // Files on the card
+    uint32_t replyMs = 15;        // Frame time plus processing
+    uint32_t startMs = 80;        // Command to sound
+    uint32_t trackMs = 3000;
+    uint32_t busyUntilMs = 0;     // Answers everything with error 1 before this
+    uint32_t dropEvery = 0;       // Ignore every Nth frame received
+    uint32_t garbleEvery = 0;     // Corrupt every Nth frame sent
+
+    // What happened
+    uint32_t frames = 0;          // Received
+    uint32_t plays = 0;
+    uint32_t stops = 0;
+    uint8_t volume = 0;
+    uint16_t lastTrack = 0;       // 0x03
+    uint16_t lastFile = 0;        // 0x12
+
+    bool playing() const { return playStartMs && clock.millis() >= playStartMs && clock.millis() < playEndMs; }
+
+private:
+    struct Pending {
+        uint32_t readyMs;
+        uint8_t byte;
+    };
+
+    void receive() {
+        frames++;
+        if (dropEvery && frames % dropEvery == 0) return;
+        uint16_t sum = 0;
+        for (int i = 1; i < 7; i++) sum += in[i];
+        if (in[9] != 0xEF || (uint16_t)(0 - sum) != (uint16_t)(in[7] << 8 | in[8])) {
+            reply(0x40, 4); // Checksum
+            return;
+        }
+        uint8_t command = in[3];
+        bool ack = in[4] != 0;
+        uint16_t param = (uint16_t)(in[5] << 8 | in[6]);
+        uint32_t now = clock.millis();
+        if (now < busyUntilMs) {
+            reply(0x40, 1);
+            return;
+        }
+
+        switch (command) {
+            case 0x03:
+            case 0x12:
+                if (!card || param == 0 || param > tracks) {
+                    reply(0x40, 6); // File not found
+                    return;
+                }
+                if (ack) reply(0x41, 0);
+                plays++;
+                if (command == 0x03) lastTrack = param;
+                else lastFile = param;
+                current = param;
+                playStartMs = now + startMs;
+                playEndMs = playStartMs + trackMs;
+                finishSent = false;
+                return;
+            case 0x16:
+                if (ack) reply(0x41, 0);
+                stops++;
+                playStartMs = 0;
+                return;
+            case 0x06:
+                if (ack) reply(0x41, 0);
+                volume = (uint8_t)param;
+                return;
+            case 0x3F:
+                if (ack) reply(0x41, 0);
+                reply(0x3F, card ? 0x02 : 0x00);
+                return;
+            case 0x42:
+                reply(0x42, (uint16_t)(0x0200 | (playing() ? 1 : 0)));
+                return;
+            default:
+                if (ack) reply(0x41, 0);
+        }
+    }
+
+    // A track that played out reports it (twice)
+    void update() {
+        if (!playStartMs || finishSent || clock.millis() < playEndMs) return;
+        finishSent = true;
+        playStartMs = 0;
+        reply(0x3D, current, playEndMs);
+        reply(0x3D, current, playEndMs);
+    }
+
+    void reply(uint8_t command, uint16_t param, uint32_t at = 0) {
+        uint8_t f[10] = {0x7E, 0xFF, 0x06, command, 0, (uint8_t)(param >> 8), (uint8_t)param, 0, 0, 0xEF};
+        uint16_t sum = 0;
+        for (int i = 1; i < 7; i++) sum += f[i];
+        sum = (uint16_t)(0 - sum);
+        f[7] = (uint8_t)(sum >> 8);
+        f[8] = (uint8_t)sum;
+        if (garbleEvery && ++sent % garbleEvery == 0) f[6] ^= 0x5A;
+
+        uint32_t ready = (at ? at : clock.millis()) + replyMs;
+        if (!outbox.empty() && outbox.back().readyMs > ready) ready = outbox.back().readyMs; // In order
+        for (uint8_t b : f) outbox.push_back({ready, b});
+    }
+
+    Clock& clock;
+    uint8_t in[10];
+    size_t inLength = 0;
+    std::vector<Pending> outbox;
+    uint32_t sent = 0;
+    uint16_t current = 0; // Track playing
+    uint32_t playStartMs = 0;
+    uint32_t playEndMs = 0;
+    bool finishSent = false;
+};
+
+// Counts the shares held instead of sleeping
+class FakePower : public Power {
+public:
+    void hold() override { held++; }
+    void release() override { held--; }
+
+    int held = 0;
+};
+
+} // namespace hal
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef POSIX_HTTP_CLIENT_H
+#define POSIX_HTTP_CLIENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+#include <chrono>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "Hal.h"
+
+namespace hal {
+
+// ==========================================
+// POSIX HTTP CLIENT (host tests)
+// ==========================================
+//
+// Plain-HTTP/1.1 client over a BSD socket with keep-alive, for bench tests
+// against local servers (scripts/ota-fileserver.js). Same contract and
+// stats as Esp32HttpSession. Bodies need a Content-Length; a dropped
+// connection ends the body early, which is what the resume tests rely on.
+
+class PosixHttpClient : public HttpClient {
+public:
+    explicit PosixHttpClient(int timeoutMs = 5000) : timeoutMs(timeoutMs) {}
+    ~PosixHttpClient() override { disconnect(); }
+
+    bool begin(const char* url) override {
+        headers.clear();
+        remaining = 0;
+        length = -1;
+        // http://host[:port]/path
+        if (strncmp(url, "http://", 7) != 0) return false;
+        const char* hostStart = url + 7;
+        const char* pathStart = strchr(hostStart, '/');
+        std::string hostPort = pathStart ? std::string(hostStart, pathStart) : std::string(hostStart);
+        path = pathStart ? pathStart : "/";
+        size_t colon = hostPort.find(':');
+        std::string newHost = hostPort.substr(0, colon);
+        std::string newPort = colon == std::string::npos ? "80" : hostPort.substr(colon + 1);
+        if (newHost != host || newPort != port) disconnect();
+        host = newHost;
+        port = newPort;
+        return true;
+    }
+
+    void addHeader(const char* name, const char* value) override {
+        headers += name;
+        headers += ": ";
+        headers += value;
+        headers += "\r\n";
+    }
+
+    int post(const char* body, size_t length) override { return send("POST", body, length); }
+    int get() override { return send("GET", nullptr, 0); }
+
+    int read() override {
+        char c;
+        return readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
+    }
+
+    size_t readBytes(char* buffer, size_t length) override {
+        size_t n = 0;
+        while (n < length && remaining > 0) {
+            size_t want = length - n;
+            if (want > remaining) want = remaining;
+            ssize_t got = recvSome(buffer + n, want);
+            if (got <= 0) {
+                disconnect(); // Closed or timed out mid-body
+                remaining = 0;
+                break;
+            }
+            n += (size_t)got;
+            remaining -= (size_t)got;
+        }
+        return n;
+    }
+
+    int32_t contentLength() override { return length; }
+
+    void end() override {
+        char sink[512];
+        while (remaining > 0 && readBytes(sink, sizeof(sink)) > 0) {}
+        if (closeAfter) disconnect();
+        if (started.time_since_epoch().count()) {
+            recordLatency((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - started).count());
+            started = {};
+        }
+    }
+
+private:
+    int send(const char* method, const char* body, size_t length) {
+        started = std::chrono::steady_clock::now();
+        httpStats.requests++;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            bool reused = fd >= 0;
+            if (!reused && !connectNow()) break;
+            std::string req = std::string(method) + " " + path + " HTTP/1.1\r\nHost: " + host +
+                              (port == "80" ? "" : ":" + port) + "\r\nConnection: keep-alive\r\n" + headers;
+            if (body) req += "Content-Length: " + std::to_string(length) + "\r\n";
+            req += "\r\n";
+            if (body) req.append(body, length);
+            int code = sendAll(req) ? readHead() : -1;
+            if (code > 0) {
+                if (!reused) httpStats.handshakes++;
+                return code;
+            }
+            disconnect();
+            if (!reused) break;
+            httpStats.reconnects++; // Server dropped the kept-alive connection: retry once
+        }
+        httpStats.failures++;
+        return -1;
+    }
+
+    bool connectNow() {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) return false;
+        for (addrinfo* a = res; a && fd < 0; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd < 0) continue;
+            timeval tv = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            if (::connect(fd, a->ai_addr, a->ai_addrlen) != 0) disconnect();
+        }
+        freeaddrinfo(res);
+        bufPos = bufLen = 0;
+        return fd >= 0;
+    }
+
+    void disconnect() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+        bufPos = bufLen = 0;
+    }
+
+    bool sendAll(const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent += (size_t)n;
+        }
+        return true;
+    }
+
+    // Status line and headers; returns the status code or -1
+    int readHead() {
+        std::string line;
+        int code = -1;
+        bool first = true;
+        remaining = 0;
+        length = -1;
+        closeAfter = false;
+        for (;;) {
+            if (!readLine(line)) return -1;
+            if (first) {
+                const char* sp = strchr(line.c_str(), ' ');
+                code = sp ? atoi(sp + 1) : -1;
+                first = false;
+            } else if (line.empty()) {
+                return code;
+            } else if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0) {
+                remaining = strtoull(line.c_str() + 15, nullptr, 10);
+                length = (int32_t)remaining;
+            } else if (strncasecmp(line.c_str(), "Connection:", 11) == 0 && strstr(line.c_str(), "close")) {
+                closeAfter = true;
+            }
+        }
+    }
+
+    bool readLine(std::string& line) {
+        line.clear();
+        char c;
+        while (recvSome(&c, 1) == 1) {
+            if (c == '\n') return true;
+            if (c != '\r') line += c;
+        }
+        return false;
+    }
+
+    // Buffered recv
+    ssize_t recvSome(char* out, size_t length) {
+        if (bufPos == bufLen) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) return n;
+            bufPos = 0;
+            bufLen = (size_t)n;
+        }
+        size_t n = bufLen - bufPos;
+        if (n > length) n = length;
+        memcpy(out, buf + bufPos, n);
+        bufPos += n;
+        return (ssize_t)n;
+    }
+
+    int timeoutMs;
+    int fd = -1;
+    std::string host;
+    std::string port;
+    std::string path;
+    std::string headers;
+    size_t remaining = 0;
+    int32_t length = -1;
+    bool closeAfter = false;
+    char buf[16 * 1024];
+    size_t bufPos = 0;
+    size_t bufLen = 0;
+    std::chrono::steady_clock::time_point started;
+};
+
+} // namespace hal
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef POSIX_UDP_H
+#define POSIX_UDP_H
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "Hal.h"
+
+namespace hal {
+
+// ==========================================
+// POSIX UDP (host tests)
+// ==========================================
+//
+// One unbound IPv4 datagram socket, opened on first use. Arrivals are
+// stamped with the Clock the code under test uses, so offsets come out in
+// its time base. Same contract as Esp32Udp.
+
+class PosixUdp : public Udp {
+public:
+    explicit PosixUdp(Clock& clock) : clock(clock) {}
+    ~PosixUdp() override {
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool resolve(const char* host, uint32_t& address) override {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo* res = nullptr;
+        if (getaddrinfo(host, nullptr, &hints, &res) != 0 || !res) return false;
+        address = ((sockaddr_in*)res->ai_addr)->sin_addr.s_addr;
+        freeaddrinfo(res);
+        return true;
+    }
+
+    bool send(uint32_t address, uint16_t port, const uint8_t* data, size_t length) override {
+        if (!open()) return false;
+        sockaddr_in to = {};
+        to.sin_family = AF_INET;
+        to.sin_port = htons(port);
+        to.sin_addr.s_addr = address;
+        return sendto(fd, data, length, 0, (sockaddr*)&to, sizeof(to)) == (ssize_t)length;
+    }
+
+    int receive(uint8_t* buffer, size_t size, uint32_t timeoutMs, uint64_t& atUs) override {
+        if (!open()) return -1;
+        timeval tv = {(time_t)(timeoutMs / 1000), (suseconds_t)(timeoutMs % 1000 * 1000)};
+        if (tv.tv_sec == 0 && tv.tv_usec == 0) tv.tv_usec = 1; // 0 would mean forever
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        ssize_t n = recv(fd, buffer, size, 0);
+        atUs = clock.micros();
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        return (int)n;
+    }
+
+private:
+    bool open() {
+        if (fd < 0) fd = socket(AF_INET, SOCK_DGRAM, 0);
+        return fd >= 0;
+    }
+
+    Clock& clock;
+    int fd = -1;
+};
+
+} // namespace hal
+
+#endif
@@ -0,0 +1,429 @@
+// Load test for the device-facing command queue RPCs, on a local Postgres.
+//
+// Builds a stand-in for the Supabase schema (just the tables and helpers
+// device_tick touches), seeds every school with a timetable (an active
+// profile with --bells bells, and an inactive one), applies the real
+// migrations on top of it, then drives device_tick the way a fleet polling
+// every 5 s does while command_queue's executed history grows. Each device
+// sends its school's current config_hash, so the tick costs what it does
+// in steady state, config check included:
+//
+//   for each --stages size: fill command_queue with executed rows up to
+//   that size, then --rounds rounds in which --pending-pct of the devices
+//   get a new command and every device ticks once (acking what its
+//   previous tick delivered), --concurrency requests at a time.
+//
+// Prints p50/p99 tick latency per stage, then:
+//   race     two simultaneous ticks for each of 200 devices with one new
+//            command each; counts commands delivered to both
+//   archive  archive_commands() on the whole history, with 100 rows already
+//            in the archive (a rerun), and one more round; every executed
+//            row must end up moved and counted
+//   save     --saves profile saves the way the dashboard's ProfileEditor
+//            makes them: delete all of the active profile's bell_times and
+//            insert --save-bells new ones; the stored config_hash must then
+//            match the timetable
+//   metrics  a day of metrics snapshots (one per device per minute) from 4
+//            days ago, rolled up by prune_device_metrics(); every snapshot
+//            must be counted in device_metrics_daily and gone from device_logs
+//
+// --legacy stops before 20260126000007_command_queue_scale.sql, to measure
+// the previous tick (no pending index, no claiming, no archive, and the
+// config hash built from the timetable on every tick).
+//
+// Usage:
+//   createdb autobell_load
+//   node scripts/command-queue-load.js --db postgres://localhost/autobell_load \
+//       [--devices 5000] [--stages 0,100000,1000000] [--rounds 3] \
+//       [--pending-pct 2] [--concurrency 32] [--devices-per-school 4] \
+//       [--bells 40] [--saves 5] [--save-bells 300] [--legacy]
+//
+// The stand-in tables are dropped and recreated in the database's public
+// schema: point it at a scratch database, never at Supabase.
+
+const crypto = require('crypto');
+const fs = require('fs');
+const path = require('path');
+const { Pool } = require('pg');
+
+const args = process.argv.slice(2);
+function arg(name, def) {
+  const i = args.indexOf(name);
+  return i >= 0 && args[i + 1] !== undefined ? args[i + 1] : def;
+}
+const DB = arg('--db', process.env.DATABASE_URL);
+const DEVICES = Number(arg('--devices', 5000));
+const STAGES = arg('--stages', '0,100000,1000000').split(',').map(Number);
+const ROUNDS = Number(arg('--rounds', 3));
+const PENDING_PCT = Number(arg('--pending-pct', 2));
+const CONCURRENCY = Number(arg('--concurrency', 32));
+const PER_SCHOOL = Number(arg('--devices-per-school', 4));
+const BELLS = Number(arg('--bells', 40));
+const SCHOOLS = Math.max(1, Math.ceil(DEVICES / PER_SCHOOL));
+const SAVES = Math.max(1, Number(arg('--saves', 5)));
+const SAVE_BELLS = Number(arg('--save-bells', 300));
+const LEGACY = args.includes('--legacy');
+const RACE_DEVICES = Math.min(200, DEVICES);
+
+const MIGRATIONS = path.resolve(__dirname, '../supabase/migrations');
+const APPLIED = [
+  '20260126000003_batch_commands.sql',
+  '20260126000004_device_tick.sql',
+  '20260126000005_device_metrics.sql',
+  ...(LEGACY
+    ? []
+    : [
+        '20260126000007_command_queue_scale.sql',
+        '20260126000008_stored_config_hash.sql',
+        '20260126000009_archive_commands_conflict.sql',
+        '20260126000010_statement_config_hash.sql',
+        '20260126000012_device_metrics_retention.sql',
+      ]),
+];
+
+if (!DB) {
+  console.error('Usage: node scripts/command-queue-load.js --db postgres://localhost/<scratch database>');
+  process.exit(2);
+}
+if (/supabase\.(co|com)/.test(DB)) {
+  console.error('Refusing to run against a Supabase database: the stand-in drops tables');
+  process.exit(2);
+}
+
+// Only what the migrations and device_tick reference, as in the real schema
+const STANDIN = `
+DROP TABLE IF EXISTS public.command_queue_archive, public.command_queue, public.device_logs,
+                     public.bell_devices, public.bell_times, public.bell_profiles, public.audio_files,
+                     public.schools CASCADE;
+
+DO $$
+BEGIN
+  IF NOT EXISTS (SELECT 1 FROM pg_roles WHERE rolname = 'anon') THEN CREATE ROLE anon NOLOGIN; END IF;
+  IF NOT EXISTS (SELECT 1 FROM pg_roles WHERE rolname = 'authenticated') THEN CREATE ROLE authenticated NOLOGIN; END IF;
+  IF NOT EXISTS (SELECT 1 FROM pg_roles WHERE rolname = 'service_role') THEN CREATE ROLE service_role NOLOGIN; END IF;
+END;
+$$;
+
+CREATE OR REPLACE FUNCTION public.get_my_school_id() RETURNS uuid LANGUAGE sql STABLE AS 'SELECT NULL::uuid';
+CREATE OR REPLACE FUNCTION public.is_super_admin() RETURNS boolean LANGUAGE sql STABLE AS 'SELECT false';
+
+-- As in 20260122000000_initial_schema.sql and 20260125000001_add_active_profile.sql
+CREATE TABLE public.schools (
+  id uuid PRIMARY KEY,
+  name text NOT NULL
+);
+
+CREATE TABLE public.audio_files (
+  id uuid PRIMARY KEY,
+  storage_path text NOT NULL,
+  duration integer,
+  school_id uuid REFERENCES public.schools(id) ON DELETE CASCADE NOT NULL
+);
+
+CREATE TABLE public.bell_profiles (
+  id uuid PRIMARY KEY,
+  school_id uuid REFERENCES public.schools(id) ON DELETE CASCADE NOT NULL,
+  is_active boolean DEFAULT false,
+  created_at timestamp with time zone DEFAULT now()
+);
+CREATE INDEX idx_bell_profiles_school_id ON public.bell_profiles(school_id);
+
+CREATE TABLE public.bell_times (
+  id uuid DEFAULT gen_random_uuid() PRIMARY KEY,
+  profile_id uuid REFERENCES public.bell_profiles(id) ON DELETE CASCADE NOT NULL,
+  bell_time time NOT NULL,
+  day_of_week integer[] NOT NULL,
+  audio_file_id uuid REFERENCES public.audio_files(id) ON DELETE SET NULL
+);
+CREATE INDEX idx_bell_times_profile_id ON public.bell_times(profile_id);
+
+CREATE TABLE public.bell_devices (
+  id uuid PRIMARY KEY,
+  school_id uuid REFERENCES public.schools(id),
+  mac_address text,
+  status text,
+  last_heartbeat timestamp with time zone,
+  telemetry jsonb
+);
+
+CREATE TABLE public.device_logs (
+  id uuid DEFAULT gen_random_uuid() PRIMARY KEY,
+  device_id uuid REFERENCES public.bell_devices(id) ON DELETE CASCADE NOT NULL,
+  message text NOT NULL,
+  level text DEFAULT 'info',
+  created_at timestamp with time zone DEFAULT now()
+);
+
+-- As in 20260122000009_add_command_queue.sql
+CREATE TABLE public.command_queue (
+  id bigint generated by default as identity primary key,
+  device_id uuid REFERENCES public.bell_devices(id) ON DELETE CASCADE NOT NULL,
+  command text NOT NULL,
+  payload jsonb DEFAULT '{}'::jsonb,
+  status text DEFAULT 'pending',
+  created_at timestamp with time zone DEFAULT now(),
+  executed_at timestamp with time zone
+);
+
+INSERT INTO public.schools (id, name)
+SELECT md5('school-' || g)::uuid, 'Load ' || g FROM generate_series(0, $SCHOOLS - 1) g;
+
+INSERT INTO public.audio_files (id, storage_path, duration, school_id)
+SELECT md5('audio-' || g)::uuid, 'load/' || g || '/bell.mp3', 10, md5('school-' || g)::uuid
+FROM generate_series(0, $SCHOOLS - 1) g;
+
+-- Profile 0 is active, profile 1 is not
+INSERT INTO public.bell_profiles (id, school_id, is_active)
+SELECT md5('profile-' || g || '-' || p)::uuid, md5('school-' || g)::uuid, p = 0
+FROM generate_series(0, $SCHOOLS - 1) g, generate_series(0, 1) p;
+
+INSERT INTO public.bell_times (profile_id, bell_time, day_of_week, audio_file_id)
+SELECT md5('profile-' || g || '-' || p)::uuid, time '07:30' + b * interval '10 minutes', '{1,2,3,4,5}',
+       CASE WHEN b % 2 = 0 THEN md5('audio-' || g)::uuid END
+FROM generate_series(0, $SCHOOLS - 1) g, generate_series(0, 1) p, generate_series(0, $BELLS - 1) b;
+
+INSERT INTO public.bell_devices (id, school_id, mac_address, status)
+SELECT md5('device-' || g)::uuid, md5('school-' || (g % $SCHOOLS))::uuid, 'LOAD:' || g, 'offline'
+FROM generate_series(0, $DEVICES - 1) g;
+
+ANALYZE public.schools, public.audio_files, public.bell_profiles, public.bell_times, public.bell_devices;
+`;
+
+function deviceId(i) {
+  const h = crypto.createHash('md5').update(`device-${i}`).digest('hex');
+  return `${h.slice(0, 8)}-${h.slice(8, 12)}-${h.slice(12, 16)}-${h.slice(16, 20)}-${h.slice(20)}`;
+}
+
+function percentile(sorted, p) {
+  if (!sorted.length) return 0;
+  return sorted[Math.min(sorted.length - 1, Math.ceil((sorted.length * p) / 100) - 1)];
+}
+
+const configHash = new Map(); // device -> its school's config_hash, as the firmware holds it
+
+async function tick(pool, device, acks) {
+  const start = process.hrtime.bigint();
+  const { rows } = await pool.query(
+    "SELECT public.device_tick($1, 'online', $2, NULL, $3::jsonb, 10) AS r",
+    [device, configHash.get(device), acks.length ? JSON.stringify(acks) : null]
+  );
+  const ms = Number(process.hrtime.bigint() - start) / 1e6;
+  if (rows[0].r.config_stale) staleTicks++;
+  return { ms, commands: rows[0].r.commands || [] };
+}
+
+// Runs fn(i) for i in [0, n) with `limit` in flight
+async function runAll(n, limit, fn) {
+  let next = 0;
+  const workers = Array.from({ length: Math.min(limit, n) }, async () => {
+    while (next < n) await fn(next++);
+  });
+  await Promise.all(workers);
+}
+
+async function enqueue(pool, count, command) {
+  // Every (100 / PENDING_PCT)th device, offset per round so the load moves
+  await pool.query(
+    `INSERT INTO public.command_queue (device_id, command, payload)
+     SELECT md5('device-' || ((g * $2 + $3) % $4))::uuid, $5, '{}'::jsonb FROM generate_series(0, $1 - 1) g`,
+    [count, Math.max(1, Math.round(100 / PENDING_PCT)), Math.floor(Math.random() * DEVICES), DEVICES, command]
+  );
+}
+
+const unacked = new Map(); // device -> acks for its next tick
+let staleTicks = 0;
+let archiveLost = 0;
+let saveMismatch = 0;
+let metricsLost = 0;
+
+async function round(pool, devices) {
+  const latencies = [];
+  let delivered = 0;
+  const start = Date.now();
+  await runAll(devices.length, CONCURRENCY, async (i) => {
+    const device = devices[i];
+    const acks = unacked.get(device) || [];
+    const r = await tick(pool, device, acks);
+    latencies.push(r.ms);
+    delivered += r.commands.length;
+    unacked.set(device, r.commands.map((c) => ({ id: c.id, status: 'executed', executed_at: 0 })));
+  });
+  return { latencies, delivered, seconds: (Date.now() - start) / 1000 };
+}
+
+async function tableStats(pool) {
+  const { rows } = await pool.query(
+    "SELECT count(*)::int AS total, count(*) FILTER (WHERE status = 'pending')::int AS pending FROM public.command_queue"
+  );
+  return rows[0];
+}
+
+function report(label, rows, result) {
+  const sorted = result.latencies.slice().sort((a, b) => a - b);
+  console.log(
+    `${label.padEnd(10)} ${String(rows.total).padStart(9)} ${String(rows.pending).padStart(8)} ` +
+      `${percentile(sorted, 50).toFixed(2).padStart(8)} ${percentile(sorted, 99).toFixed(2).padStart(8)} ` +
+      `${(result.latencies.length / result.seconds).toFixed(0).padStart(8)} ${String(result.delivered).padStart(9)}`
+  );
+}
+
+async function main() {
+  const pool = new Pool({ connectionString: DB, max: CONCURRENCY });
+  const devices = Array.from({ length: DEVICES }, (_, i) => deviceId(i));
+
+  console.log(
+    `Setting up the stand-in (${DEVICES} devices in ${SCHOOLS} schools, ${BELLS} bells each, ` +
+      `${LEGACY ? 'legacy tick' : 'claiming dequeue, stored config hash'})...`
+  );
+  await pool.query(
+    STANDIN.replaceAll('$DEVICES', String(DEVICES)).replaceAll('$SCHOOLS', String(SCHOOLS)).replaceAll('$BELLS', String(BELLS))
+  );
+  for (const file of APPLIED) await pool.query(fs.readFileSync(path.join(MIGRATIONS, file), 'utf8'));
+  const { rows: hashes } = await pool.query(
+    "SELECT id::text AS id, public.device_config_json(id)->>'config_hash' AS hash FROM public.bell_devices"
+  );
+  for (const h of hashes) configHash.set(h.id, h.hash);
+
+  console.log(`${'stage'.padEnd(10)} ${'rows'.padStart(9)} ${'pending'.padStart(8)} ${'p50 ms'.padStart(8)} ` +
+    `${'p99 ms'.padStart(8)} ${'ticks/s'.padStart(8)} ${'delivered'.padStart(9)}`);
+  const perRound = Math.max(1, Math.round((DEVICES * PENDING_PCT) / 100));
+  for (const size of STAGES) {
+    const { total } = await tableStats(pool);
+    if (size > total) {
+      // Executed history from the last 30 days, spread over the fleet
+      await pool.query(
+        `INSERT INTO public.command_queue (device_id, command, payload, status, created_at, executed_at)
+         SELECT md5('device-' || (g % $2))::uuid, 'RING', '{}'::jsonb, 'executed',
+                now() - random() * interval '30 days', now()
+         FROM generate_series(1, $1) g`,
+        [size - total, DEVICES]
+      );
+      await pool.query('ANALYZE public.command_queue');
+    }
+    const merged = { latencies: [], delivered: 0, seconds: 0 };
+    for (let r = 0; r < ROUNDS; r++) {
+      await enqueue(pool, perRound, 'RING');
+      const result = await round(pool, devices);
+      merged.latencies.push(...result.latencies);
+      merged.delivered += result.delivered;
+      merged.seconds += result.seconds;
+    }
+    report(String(size), await tableStats(pool), merged);
+  }
+
+  // Settle what the last round delivered, then race two ticks per device
+  await round(pool, devices);
+  const race = devices.slice(0, RACE_DEVICES);
+  await pool.query(
+    `INSERT INTO public.command_queue (device_id, command, payload)
+     SELECT md5('device-' || g)::uuid, 'RACE', '{}'::jsonb FROM generate_series(0, $1 - 1) g`,
+    [RACE_DEVICES]
+  );
+  let twice = 0;
+  let raced = 0;
+  await runAll(race.length, Math.max(1, Math.floor(CONCURRENCY / 2)), async (i) => {
+    const [a, b] = await Promise.all([tick(pool, race[i], []), tick(pool, race[i], [])]);
+    const idsA = new Set(a.commands.filter((c) => c.command === 'RACE').map((c) => c.id));
+    const idsB = b.commands.filter((c) => c.command === 'RACE').map((c) => c.id);
+    raced += idsA.size + idsB.length;
+    twice += idsB.filter((id) => idsA.has(id)).length;
+  });
+  console.log(`race: ${RACE_DEVICES} commands, ${raced} deliveries, ${twice} delivered to both ticks`);
+  console.log(`config: ${staleTicks} ticks reported a stale config (expected 0)`);
+
+  if (!LEGACY) {
+    const before = await tableStats(pool);
+    await pool.query(
+      `INSERT INTO public.command_queue_archive (id, device_id, command, payload, status, created_at, executed_at,
+                                                 delivered_at, delivery_count)
+       SELECT id, device_id, command, payload, status, created_at, executed_at, delivered_at, delivery_count
+       FROM public.command_queue WHERE status <> 'pending' LIMIT 100`
+    );
+    const start = Date.now();
+    let moved = 0;
+    for (;;) {
+      const { rows } = await pool.query("SELECT public.archive_commands(interval '0 seconds', 50000) AS n");
+      if (!rows[0].n) break;
+      moved += rows[0].n;
+    }
+    await pool.query('VACUUM ANALYZE public.command_queue');
+    const after = await tableStats(pool);
+    archiveLost = before.total - before.pending - moved + (after.total - after.pending);
+    console.log(
+      `archive: moved ${moved} of ${before.total} rows in ${((Date.now() - start) / 1000).toFixed(1)} s, ` +
+        `${after.total - after.pending} executed rows left, ${archiveLost} miscounted (expected 0)`
+    );
+    await enqueue(pool, perRound, 'RING');
+    report('archived', await tableStats(pool), await round(pool, devices));
+
+    // One transaction per save, each on the next school's active profile
+    const client = await pool.connect();
+    const saveMs = [];
+    for (let i = 0; i < SAVES; i++) {
+      const school = i % SCHOOLS;
+      const profile = `md5('profile-${school}-0')::uuid`;
+      const start = process.hrtime.bigint();
+      await client.query('BEGIN');
+      await client.query(`DELETE FROM public.bell_times WHERE profile_id = ${profile}`);
+      await client.query(
+        `INSERT INTO public.bell_times (profile_id, bell_time, day_of_week, audio_file_id)
+         SELECT ${profile}, time '06:00' + b * interval '3 minutes', ARRAY[1 + b % 7],
+                CASE WHEN b % 2 = 0 THEN md5('audio-${school}')::uuid END
+         FROM generate_series(0, $1 - 1) b`,
+        [SAVE_BELLS]
+      );
+      await client.query('COMMIT');
+      saveMs.push(Number(process.hrtime.bigint() - start) / 1e6);
+      const { rows } = await client.query(
+        `SELECT config_hash IS DISTINCT FROM public.school_config_json(id)->>'config_hash' AS stale
+         FROM public.schools WHERE id = md5('school-${school}')::uuid`
+      );
+      if (rows[0].stale) saveMismatch++;
+    }
+    client.release();
+    saveMs.sort((a, b) => a - b);
+    console.log(
+      `save: ${SAVES} saves of ${SAVE_BELLS} bells (delete + insert), p50 ${percentile(saveMs, 50).toFixed(2)} ms, ` +
+        `max ${saveMs[saveMs.length - 1].toFixed(2)} ms, ${saveMismatch} stale hashes (expected 0)`
+    );
+
+    // A day of snapshots (1440 per device), past the 3 days kept
+    await pool.query(
+      `INSERT INTO public.device_logs (device_id, message, level, metrics, created_at)
+       SELECT md5('device-' || d)::uuid, 'metrics', 'metrics',
+              jsonb_build_object('s', 60, 'c', jsonb_build_object('bells', 1),
+                                 'h', jsonb_build_object('rpc_tick_us', jsonb_build_object('n', 12, 'max', 300000,
+                                                                                          'b', jsonb_build_object('18', 9, '19', 3)))),
+              date_trunc('day', now()) - interval '4 days' + m * interval '1 minute'
+       FROM generate_series(0, $1 - 1) d, generate_series(0, 1439) m`,
+      [DEVICES]
+    );
+    const pruneStart = Date.now();
+    let pruned = 0;
+    for (;;) {
+      const { rows } = await pool.query('SELECT public.prune_device_metrics() AS n');
+      if (!rows[0].n) break;
+      pruned += rows[0].n;
+    }
+    const { rows: left } = await pool.query(
+      `SELECT (SELECT count(*)::int FROM public.device_logs WHERE level = 'metrics') AS raw,
+              (SELECT coalesce(sum(total), 0)::int FROM public.device_metrics_daily WHERE metric = 'snapshots') AS rolled,
+              (SELECT coalesce(sum(total), 0)::int FROM public.device_metrics_daily
+               WHERE metric = 'h:rpc_tick_us' AND bucket = 18) AS bucket18`
+    );
+    const expected = DEVICES * 1440;
+    metricsLost = Math.abs(expected - left[0].rolled) + left[0].raw + Math.abs(expected * 9 - left[0].bucket18);
+    console.log(
+      `metrics: pruned ${pruned} of ${expected} snapshots in ${((Date.now() - pruneStart) / 1000).toFixed(1)} s, ` +
+        `${left[0].raw} left, ${left[0].rolled} rolled up, ${metricsLost} miscounted (expected 0)`
+    );
+  }
+
+  await pool.end();
+  process.exit((!LEGACY && twice > 0) || staleTicks > 0 || archiveLost !== 0 || saveMismatch > 0 || metricsLost !== 0 ? 1 : 0);
+}
+
+main().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
@@ -0,0 +1,170 @@
+// In-memory stand-in for the Supabase RPCs the ESP32 firmware calls, for
+// running the fleet simulator (esp32-firmware/bench/FleetSim.h) without a
+// database.
+//
+// Implements over plain HTTP, with the same request and response shapes as
+// the SQL functions:
+//   POST /rest/v1/rpc/register_device_from_esp
+//   POST /rest/v1/rpc/get_device_config      (config_hash, "unchanged")
+//   POST /rest/v1/rpc/device_tick            (acks, 30 s claim lease)
+//   POST /rest/v1/rpc/upload_device_events
+//
+// Usage:
+//   node scripts/fleet-standin.js [--port 54321] [--school DEMO] [--latency-ms 0]
+//
+// Devices registering with --school's code are assigned and active; any other
+// code leaves them unassigned until POST /api/assign.
+//
+// HTTP control endpoints:
+//   POST /api/enqueue  {"count": 100, "command": "RING"} queues a command for
+//                      `count` random registered devices
+//   POST /api/config   changes every school's schedule (config_stale on the
+//                      next tick)
+//   POST /api/assign   assigns every unassigned device to --school
+//   GET  /api/stats    request counts
+//
+// No dependencies, so it runs with plain `node`.
+
+const http = require('http');
+const crypto = require('crypto');
+
+const args = process.argv.slice(2);
+function arg(name, def) {
+  const i = args.indexOf(name);
+  return i >= 0 && args[i + 1] !== undefined ? args[i + 1] : def;
+}
+const PORT = Number(arg('--port', 54321));
+const SCHOOL_CODE = arg('--school', 'DEMO');
+const LATENCY_MS = Number(arg('--latency-ms', 0));
+const SCHOOL_ID = '5c4001a1-0000-4000-8000-000000000001';
+const LEASE_MS = 30000;
+
+const devices = new Map(); // mac -> { id, mac, name, schoolId, lastTick }
+const byId = new Map();    // id -> device
+const commands = new Map(); // device id -> [{ id, command, payload, deliveredAt }]
+const stats = {};
+let nextCommandId = 1;
+let configVersion = 1;
+
+function config() {
+  const schedules = [];
+  for (const t of ['08:00', '08:45', '09:30', '10:15', '11:00', '12:30', '13:15', '14:00']) {
+    schedules.push({ bell_time: `${t}:00`, day_of_week: 1, days_of_week: [1, 2, 3, 4, 5],
+                     audio_url: `bells/v${configVersion}.mp3`, duration: 5 });
+  }
+  const hash = crypto.createHash('md5').update(JSON.stringify(schedules)).digest('hex');
+  return { status: 'ok', config_hash: hash, school_id: SCHOOL_ID, timezone_offset: 300, schedules };
+}
+
+function register(body) {
+  const mac = body.p_mac_address;
+  let d = devices.get(mac);
+  let message = 'OK';
+  if (!d) {
+    d = { id: crypto.randomUUID(), mac, name: body.p_device_name, schoolId: null };
+    devices.set(mac, d);
+    byId.set(d.id, d);
+  }
+  if (body.p_school_code === SCHOOL_CODE) {
+    d.schoolId = SCHOOL_ID;
+  } else if (body.p_school_code) {
+    message = 'Warning: Invalid School Code provided. Device set to Unassigned.';
+  }
+  return [{ id: d.id, school_id: d.schoolId, school_code: d.schoolId ? SCHOOL_CODE : null,
+            name: d.name, status: 'online', message }];
+}
+
+function deviceConfig(body) {
+  const d = devices.get(body.device_mac);
+  if (!d) return { error: 'Device not found' };
+  const c = config();
+  if (body.p_config_hash && body.p_config_hash === c.config_hash) {
+    return { status: 'unchanged', config_hash: c.config_hash };
+  }
+  return c;
+}
+
+function tick(body) {
+  const d = byId.get(body.p_device_id);
+  if (!d) return { error: 'Device not found' };
+  d.lastTick = Date.now();
+  const queue = commands.get(d.id) || [];
+  const acked = new Set((body.p_acks || []).map((a) => Number(a.id)));
+  const pending = queue.filter((c) => !acked.has(c.id));
+  commands.set(d.id, pending);
+
+  const now = Date.now();
+  const limit = Math.min(Math.max(body.p_limit || 10, 1), 50);
+  const out = [];
+  for (const c of pending) {
+    if (out.length === limit) break;
+    if (c.deliveredAt && now - c.deliveredAt < LEASE_MS) continue;
+    c.deliveredAt = now;
+    out.push({ id: c.id, command: c.command, payload: c.payload });
+  }
+  return { commands: out, config_stale: body.p_config_hash !== config().config_hash };
+}
+
+const RPCS = {
+  register_device_from_esp: register,
+  get_device_config: deviceConfig,
+  device_tick: tick,
+  upload_device_events: (body) => (Array.isArray(body.p_events) ? body.p_events.length : 0),
+};
+
+function control(path, body) {
+  if (path === '/api/enqueue') {
+    const ids = [...byId.keys()];
+    const count = Math.min(body.count || 1, ids.length);
+    for (let i = 0; i < count; i++) {
+      const id = ids[Math.floor(Math.random() * ids.length)];
+      if (!commands.has(id)) commands.set(id, []);
+      commands.get(id).push({ id: nextCommandId++, command: body.command || 'RING', payload: body.payload || {} });
+    }
+    return { queued: count };
+  }
+  if (path === '/api/config') return { version: ++configVersion };
+  if (path === '/api/assign') {
+    let n = 0;
+    for (const d of devices.values()) if (!d.schoolId) { d.schoolId = SCHOOL_ID; n++; }
+    return { assigned: n };
+  }
+  if (path === '/api/stats') return { devices: devices.size, requests: stats };
+  return null;
+}
+
+function send(res, status, value) {
+  const text = JSON.stringify(value);
+  res.writeHead(status, { 'Content-Type': 'application/json', 'Content-Length': Buffer.byteLength(text) });
+  res.end(text);
+}
+
+const server = http.createServer((req, res) => {
+  const chunks = [];
+  req.on('data', (c) => chunks.push(c));
+  req.on('end', () => {
+    let body = {};
+    try {
+      if (chunks.length) body = JSON.parse(Buffer.concat(chunks).toString());
+    } catch (err) {
+      return send(res, 400, { message: 'bad JSON' });
+    }
+    const rpc = req.url.startsWith('/rest/v1/rpc/') ? req.url.slice(13) : null;
+    if (rpc && RPCS[rpc]) {
+      stats[rpc] = (stats[rpc] || 0) + 1;
+      const result = RPCS[rpc](body);
+      return LATENCY_MS ? setTimeout(() => send(res, 200, result), LATENCY_MS) : send(res, 200, result);
+    }
+    const result = control(req.url, body);
+    if (result) return send(res, 200, result);
+    send(res, 404, { message: `no route ${req.url}` });
+  });
+});
+server.keepAliveTimeout = 65000;
+server.headersTimeout = 66000;
+server.listen(PORT, () => console.log(`[fleet-standin] http://127.0.0.1:${PORT} (school code ${SCHOOL_CODE})`));
+
+process.on('SIGINT', () => {
+  console.log(`\n[fleet-standin] ${devices.size} devices`, stats);
+  process.exit(0);
+});
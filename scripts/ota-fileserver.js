@@ -0,0 +1,180 @@
+// Local firmware server for bench-testing the resumable OTA download.
+//
+// Serves one image with HTTP Range support (206 responses), keep-alive, and
+// fault injection, so the firmware's OtaEngine can be tested against
+// dropped connections without a real network. No dependencies.
+//
+// Usage:
+//   node scripts/ota-fileserver.js [--port 8080] [--image firmware.bin]
+//                                  [--size 1048576] [--rate 0]
+//                                  [--base old.bin --patch old-new.patch]
+//
+// --image FILE  image to serve (default: --size random bytes, fixed seed)
+// --rate KBPS   throttles each response to about KBPS KB/s (0 = unthrottled)
+// --base/--patch  a delta from `program --delta-make old.bin firmware.bin
+//               old-new.patch`, offered in the manifest next to the image
+//
+// Endpoints:
+//   GET /manifest.json   {"url","size","sha256"}: the UPDATE_FIRMWARE payload
+//                        for /firmware.bin on this server, plus "patch_url",
+//                        "patch_size" and "base_sha256" with --patch
+//   GET /base.bin        the --base image (what the device is running)
+//   GET /firmware.patch  the --patch file
+//   GET /firmware.bin    the image; query options (also on the two above):
+//                          drop=N     every Nth request sends half its body,
+//                                     then closes the connection
+//                          corrupt=1  one byte in the middle is flipped
+//                                     (sha256 no longer matches the manifest)
+//
+// The firmware side is bench/OtaTest.h:
+//   .pio/build/native/program --ota-test http://127.0.0.1:8080
+// Stats are printed on Ctrl+C.
+
+const http = require('http');
+const fs = require('fs');
+const crypto = require('crypto');
+
+const args = process.argv.slice(2);
+function arg(name, def) {
+  const i = args.indexOf(name);
+  return i >= 0 && args[i + 1] !== undefined ? args[i + 1] : def;
+}
+const PORT = Number(arg('--port', 8080));
+const RATE_KBPS = Number(arg('--rate', 0));
+const IMAGE_PATH = arg('--image', null);
+const BASE_PATH = arg('--base', null);
+const PATCH_PATH = arg('--patch', null);
+
+function randomImage(size) {
+  // xorshift32 with a fixed seed, so runs are comparable
+  const buf = Buffer.alloc(size);
+  let x = 0x2545f491;
+  for (let i = 0; i < size; i++) {
+    x ^= x << 13; x >>>= 0;
+    x ^= x >>> 17;
+    x ^= x << 5; x >>>= 0;
+    buf[i] = x & 0xff;
+  }
+  return buf;
+}
+
+const sha256Of = (buf) => crypto.createHash('sha256').update(buf).digest('hex');
+const image = IMAGE_PATH ? fs.readFileSync(IMAGE_PATH) : randomImage(Number(arg('--size', 1024 * 1024)));
+const sha256 = sha256Of(image);
+const files = { '/firmware.bin': image };
+if (BASE_PATH && PATCH_PATH) {
+  files['/base.bin'] = fs.readFileSync(BASE_PATH);
+  files['/firmware.patch'] = fs.readFileSync(PATCH_PATH);
+}
+const corrupted = {};
+for (const [path, data] of Object.entries(files)) {
+  corrupted[path] = Buffer.from(data);
+  corrupted[path][data.length >> 1] ^= 0xff;
+}
+
+const stats = { requests: 0, ranged: 0, dropped: 0, bytes: 0, connections: 0 };
+
+// Parses "bytes=a-b" against the image size; null if unsatisfiable
+function parseRange(header, size) {
+  const m = /^bytes=(\d*)-(\d*)$/.exec(header || '');
+  if (!m || (m[1] === '' && m[2] === '')) return null;
+  let start, end;
+  if (m[1] === '') { // Suffix range: last N bytes
+    start = Math.max(0, size - Number(m[2]));
+    end = size - 1;
+  } else {
+    start = Number(m[1]);
+    end = m[2] === '' ? size - 1 : Math.min(Number(m[2]), size - 1);
+  }
+  return start <= end && start < size ? { start, end } : null;
+}
+
+// Writes body, throttled to RATE_KBPS; with drop, only half and then closes
+function sendBody(req, res, body, drop) {
+  const limit = drop ? body.length >> 1 : body.length;
+  const slice = RATE_KBPS > 0 ? Math.max(1024, RATE_KBPS * 1024 / 20) : limit;
+  let pos = 0;
+  const next = () => {
+    const n = Math.min(slice, limit - pos);
+    const part = body.subarray(pos, pos + n);
+    pos += n;
+    stats.bytes += n;
+    if (pos < limit) {
+      res.write(part);
+      setTimeout(next, RATE_KBPS > 0 ? 50 : 0);
+    } else if (drop) {
+      stats.dropped++;
+      res.write(part, () => req.socket.destroy()); // Once the half body is on the wire
+    } else {
+      res.end(part);
+    }
+  };
+  next();
+}
+
+const server = http.createServer((req, res) => {
+  const url = new URL(req.url, 'http://localhost');
+  stats.requests++;
+
+  if (url.pathname === '/manifest.json') {
+    const host = req.headers.host || `127.0.0.1:${PORT}`;
+    const manifest = { url: `http://${host}/firmware.bin`, size: image.length, sha256 };
+    if (files['/firmware.patch']) {
+      manifest.patch_url = `http://${host}/firmware.patch`;
+      manifest.patch_size = files['/firmware.patch'].length;
+      manifest.base_sha256 = sha256Of(files['/base.bin']);
+    }
+    const body = JSON.stringify(manifest);
+    res.writeHead(200, { 'Content-Type': 'application/json', 'Content-Length': Buffer.byteLength(body) });
+    res.end(body);
+    return;
+  }
+  if (!files[url.pathname]) {
+    res.writeHead(404, { 'Content-Length': 0 });
+    res.end();
+    return;
+  }
+
+  const data = (url.searchParams.get('corrupt') === '1' ? corrupted : files)[url.pathname];
+  const dropEvery = Number(url.searchParams.get('drop') || 0);
+  const drop = dropEvery > 0 && stats.requests % dropEvery === 0;
+
+  if (req.headers.range === undefined) {
+    res.writeHead(200, { 'Content-Type': 'application/octet-stream', 'Content-Length': data.length,
+                         'Accept-Ranges': 'bytes' });
+    sendBody(req, res, data, drop);
+    return;
+  }
+  const range = parseRange(req.headers.range, data.length);
+  if (!range) {
+    res.writeHead(416, { 'Content-Range': `bytes */${data.length}`, 'Content-Length': 0 });
+    res.end();
+    return;
+  }
+  stats.ranged++;
+  const body = data.subarray(range.start, range.end + 1);
+  res.writeHead(206, {
+    'Content-Type': 'application/octet-stream',
+    'Content-Length': body.length,
+    'Content-Range': `bytes ${range.start}-${range.end}/${data.length}`,
+    'Accept-Ranges': 'bytes',
+  });
+  sendBody(req, res, body, drop);
+});
+
+server.on('connection', () => stats.connections++);
+server.keepAliveTimeout = 30000;
+
+server.listen(PORT, () => {
+  console.log(`OTA file server on :${PORT}, image ${image.length} bytes, sha256 ${sha256}`);
+  if (files['/firmware.patch']) {
+    console.log(`Patch ${files['/firmware.patch'].length} bytes against base ${sha256Of(files['/base.bin'])}`);
+  }
+  if (RATE_KBPS > 0) console.log(`Throttled to ${RATE_KBPS} KB/s per response`);
+});
+
+process.on('SIGINT', () => {
+  console.log(`\n${stats.requests} requests (${stats.ranged} ranged, ${stats.dropped} dropped), ` +
+              `${stats.connections} connections, ${(stats.bytes / 1024).toFixed(0)} KB sent`);
+  process.exit(0);
+});
@@ -0,0 +1,233 @@
+// Local stand-in for Supabase Realtime, for bench-testing the ESP32 push path.
+//
+// Speaks just enough of the Phoenix v1 JSON protocol for the firmware's
+// RealtimeClient: phx_join, heartbeat, and broadcast fan-out between the
+// sockets joined to a topic. No dependencies (WebSocket framing is done by
+// hand), so it runs with plain `node`.
+//
+// Usage:
+//   node scripts/realtime-standin.js [--port 4000] [--ring-every 10]
+//
+// Build the firmware against it with
+//   -D REALTIME_HOST=\"<this machine's IP>\" -D REALTIME_PORT=4000 -D REALTIME_TLS=0
+//
+// --ring-every N  sends a manual_ring with an ack_id to every joined device
+//                 channel each N seconds. The firmware broadcasts an "ack"
+//                 back after ringing, and the time from send to ack is the
+//                 push ring latency. Stats are printed on Ctrl+C.
+//
+// HTTP control endpoints:
+//   POST /api/broadcast  {"topic":"device:AA:BB:..","event":"stop","payload":{}}
+//   POST /api/down       drops every socket and refuses new ones (forces the
+//                        device back to polling get_next_command)
+//   POST /api/up         accepts sockets again
+
+const http = require('http');
+const crypto = require('crypto');
+
+const args = process.argv.slice(2);
+function arg(name, def) {
+  const i = args.indexOf(name);
+  return i >= 0 && args[i + 1] !== undefined ? Number(args[i + 1]) : def;
+}
+const PORT = arg('--port', 4000);
+const RING_EVERY = arg('--ring-every', 0);
+
+const sockets = new Set();   // { socket, topics:Set, buf:Buffer }
+const pendingAcks = new Map(); // ack_id -> hrtime sent
+const latencies = [];
+let accepting = true;
+let ringSeq = 0;
+
+// ---------- WebSocket framing (RFC 6455, single-frame messages) ----------
+
+function sendFrame(conn, opcode, data) {
+  const payload = Buffer.isBuffer(data) ? data : Buffer.from(data);
+  let header;
+  if (payload.length < 126) {
+    header = Buffer.from([0x80 | opcode, payload.length]);
+  } else if (payload.length < 65536) {
+    header = Buffer.alloc(4);
+    header[0] = 0x80 | opcode;
+    header[1] = 126;
+    header.writeUInt16BE(payload.length, 2);
+  } else {
+    header = Buffer.alloc(10);
+    header[0] = 0x80 | opcode;
+    header[1] = 127;
+    header.writeBigUInt64BE(BigInt(payload.length), 2);
+  }
+  conn.socket.write(Buffer.concat([header, payload]));
+}
+
+function sendJson(conn, msg) {
+  sendFrame(conn, 0x1, JSON.stringify(msg));
+}
+
+function onData(conn, chunk) {
+  conn.buf = Buffer.concat([conn.buf, chunk]);
+  for (;;) {
+    const b = conn.buf;
+    if (b.length < 2) return;
+    const opcode = b[0] & 0x0f;
+    const masked = (b[1] & 0x80) !== 0;
+    let len = b[1] & 0x7f;
+    let off = 2;
+    if (len === 126) {
+      if (b.length < 4) return;
+      len = b.readUInt16BE(2);
+      off = 4;
+    } else if (len === 127) {
+      if (b.length < 10) return;
+      len = Number(b.readBigUInt64BE(2));
+      off = 10;
+    }
+    const maskOff = off;
+    if (masked) off += 4;
+    if (b.length < off + len) return;
+
+    const payload = Buffer.from(b.subarray(off, off + len));
+    if (masked) {
+      for (let i = 0; i < len; i++) payload[i] ^= b[maskOff + (i % 4)];
+    }
+    conn.buf = b.subarray(off + len);
+
+    if (opcode === 0x1) onMessage(conn, payload.toString('utf8'));
+    else if (opcode === 0x8) { sendFrame(conn, 0x8, Buffer.alloc(0)); conn.socket.end(); return; }
+    else if (opcode === 0x9) sendFrame(conn, 0xA, payload);
+  }
+}
+
+// ---------- Phoenix channels ----------
+
+function reply(conn, msg, status) {
+  sendJson(conn, { topic: msg.topic, event: 'phx_reply', payload: { status, response: {} }, ref: msg.ref });
+}
+
+function broadcast(topic, event, payload, except) {
+  let delivered = 0;
+  for (const conn of sockets) {
+    if (conn === except || !conn.topics.has(topic)) continue;
+    sendJson(conn, { topic, event: 'broadcast', payload: { type: 'broadcast', event, payload }, ref: null });
+    delivered++;
+  }
+  return delivered;
+}
+
+function onMessage(conn, text) {
+  let msg;
+  try {
+    msg = JSON.parse(text);
+  } catch (e) {
+    console.log('[standin] bad JSON:', text);
+    return;
+  }
+
+  if (msg.topic === 'phoenix' && msg.event === 'heartbeat') {
+    reply(conn, msg, 'ok');
+  } else if (msg.event === 'phx_join') {
+    conn.topics.add(msg.topic);
+    console.log(`[standin] ${conn.name} joined ${msg.topic}`);
+    reply(conn, msg, 'ok');
+  } else if (msg.event === 'phx_leave') {
+    conn.topics.delete(msg.topic);
+    reply(conn, msg, 'ok');
+  } else if (msg.event === 'broadcast') {
+    const inner = msg.payload || {};
+    if (inner.event === 'ack' && inner.payload && pendingAcks.has(inner.payload.ack_id)) {
+      const sent = pendingAcks.get(inner.payload.ack_id);
+      pendingAcks.delete(inner.payload.ack_id);
+      const ms = Number(process.hrtime.bigint() - sent) / 1e6;
+      latencies.push(ms);
+      console.log(`[standin] ack ${inner.payload.ack_id} after ${ms.toFixed(1)} ms`);
+    }
+    broadcast(msg.topic, inner.event, inner.payload, conn);
+  }
+}
+
+// ---------- Server ----------
+
+const server = http.createServer((req, res) => {
+  let body = '';
+  req.on('data', (c) => (body += c));
+  req.on('end', () => {
+    if (req.method === 'POST' && req.url === '/api/broadcast') {
+      try {
+        const { topic, event, payload } = JSON.parse(body);
+        const n = broadcast(`realtime:${topic}`, event, payload || {});
+        res.end(JSON.stringify({ delivered: n }) + '\n');
+      } catch (e) {
+        res.statusCode = 400;
+        res.end(e.message + '\n');
+      }
+    } else if (req.method === 'POST' && req.url === '/api/down') {
+      accepting = false;
+      for (const conn of sockets) conn.socket.destroy();
+      res.end('down\n');
+    } else if (req.method === 'POST' && req.url === '/api/up') {
+      accepting = true;
+      res.end('up\n');
+    } else {
+      res.statusCode = 404;
+      res.end();
+    }
+  });
+});
+
+server.on('upgrade', (req, socket) => {
+  if (!accepting || !req.url.startsWith('/realtime/v1/websocket')) {
+    socket.end('HTTP/1.1 503 Service Unavailable\r\n\r\n');
+    return;
+  }
+  const accept = crypto
+    .createHash('sha1')
+    .update(req.headers['sec-websocket-key'] + '258EAFA5-E914-47DA-95CA-C5AB0DC85B11')
+    .digest('base64');
+  socket.write(
+    'HTTP/1.1 101 Switching Protocols\r\n' +
+      'Upgrade: websocket\r\n' +
+      'Connection: Upgrade\r\n' +
+      `Sec-WebSocket-Accept: ${accept}\r\n\r\n`
+  );
+  socket.setNoDelay(true);
+
+  const conn = { socket, topics: new Set(), buf: Buffer.alloc(0), name: `${socket.remoteAddress}:${socket.remotePort}` };
+  sockets.add(conn);
+  console.log(`[standin] ${conn.name} connected`);
+  socket.on('data', (chunk) => onData(conn, chunk));
+  socket.on('close', () => {
+    sockets.delete(conn);
+    console.log(`[standin] ${conn.name} disconnected`);
+  });
+  socket.on('error', () => {});
+});
+
+if (RING_EVERY > 0) {
+  setInterval(() => {
+    const topics = new Set();
+    for (const conn of sockets) for (const t of conn.topics) if (t.startsWith('realtime:device:')) topics.add(t);
+    for (const topic of topics) {
+      const ackId = `ring-${++ringSeq}`;
+      pendingAcks.set(ackId, process.hrtime.bigint());
+      broadcast(topic, 'manual_ring', { duration: 1, name: 'Latency probe', ack_id: ackId });
+    }
+  }, RING_EVERY * 1000);
+}
+
+function report() {
+  if (latencies.length === 0) {
+    console.log('\n[standin] no ring acks recorded');
+  } else {
+    const s = [...latencies].sort((a, b) => a - b);
+    const pct = (p) => s[Math.min(s.length - 1, Math.floor((p / 100) * s.length))].toFixed(1);
+    console.log(`\n[standin] push ring latency over ${s.length} rings: ` +
+      `p50 ${pct(50)} ms, p95 ${pct(95)} ms, max ${s[s.length - 1].toFixed(1)} ms, ` +
+      `${pendingAcks.size} unacked`);
+  }
+  process.exit(0);
+}
+process.on('SIGINT', report);
+
+server.listen(PORT, () => {
+  console.log(`[standin] Realtime stand-in on ws://0.0.0.0:${PORT}/realtime/v1/websocket`);
+});
@@ -0,0 +1,43 @@
+-- Push queued commands to devices over Realtime
+--
+-- Devices keep a WebSocket open on the broadcast channel "device:<MAC>"
+-- (API_CONTRACT.md section 4) and only poll get_next_command while that
+-- socket is down. Every row queued for a device is therefore also broadcast
+-- on its channel as a "command" event; the device executes it and acks it
+-- through ack_command() exactly as if it had been polled. If the broadcast
+-- is missed the row stays 'pending' and is picked up by the next poll.
+
+CREATE OR REPLACE FUNCTION public.broadcast_device_command()
+RETURNS trigger
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_mac text;
+BEGIN
+    SELECT mac_address INTO v_mac FROM public.bell_devices WHERE id = NEW.device_id;
+    IF v_mac IS NULL THEN
+        RETURN NEW;
+    END IF;
+
+    PERFORM realtime.send(
+        jsonb_build_object('id', NEW.id, 'command', NEW.command, 'payload', NEW.payload),
+        'command',
+        'device:' || v_mac,
+        false
+    );
+    RETURN NEW;
+EXCEPTION WHEN OTHERS THEN
+    -- Never block the insert: polling still delivers the command
+    RAISE WARNING 'broadcast_device_command: %', SQLERRM;
+    RETURN NEW;
+END;
+$$;
+
+DROP TRIGGER IF EXISTS on_command_queued ON public.command_queue;
+CREATE TRIGGER on_command_queued
+    AFTER INSERT ON public.command_queue
+    FOR EACH ROW
+    WHEN (NEW.status = 'pending')
+    EXECUTE FUNCTION public.broadcast_device_command();
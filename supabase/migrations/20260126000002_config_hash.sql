@@ -0,0 +1,86 @@
+-- Conditional config sync: get_device_config returns a content hash and
+-- accepts the device's current one.
+--
+-- Devices resync every 5 minutes but the timetable rarely changes. The
+-- response now carries "config_hash" (md5 of the config as returned); when
+-- the caller already has that hash it gets
+--     {"status": "unchanged", "config_hash": "<hash>"}
+-- instead of the full schedule list, and keeps its cached copy.
+--
+-- The heartbeat update that used to happen here is dropped: liveness is
+-- reported by update_heartbeat, and a read-only config call no longer
+-- writes bell_devices on every sync.
+--
+-- p_config_hash defaults to NULL so firmware that does not send it keeps
+-- getting the full config.
+
+DROP FUNCTION IF EXISTS public.get_device_config(text);
+DROP FUNCTION IF EXISTS public.get_device_config(text, text);
+
+CREATE OR REPLACE FUNCTION public.get_device_config(device_mac text, p_config_hash text DEFAULT NULL)
+RETURNS json
+LANGUAGE plpgsql
+STABLE
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_device_id uuid;
+    v_school_id uuid;
+    v_active_profile_id uuid;
+    v_schedule_data json;
+    v_timezone_offset integer := 300; -- Default to GMT+5 (300 minutes)
+    v_hash text;
+BEGIN
+    -- 1. Find Device and School
+    SELECT id, school_id INTO v_device_id, v_school_id
+    FROM public.bell_devices
+    WHERE mac_address = device_mac;
+
+    IF v_device_id IS NULL THEN
+        RETURN json_build_object('error', 'Device not found');
+    END IF;
+
+    -- 2. Active profile, or the oldest one as fallback
+    SELECT id INTO v_active_profile_id FROM public.bell_profiles
+    WHERE school_id = v_school_id AND is_active = true LIMIT 1;
+
+    IF v_active_profile_id IS NULL THEN
+        SELECT id INTO v_active_profile_id FROM public.bell_profiles
+        WHERE school_id = v_school_id ORDER BY created_at ASC LIMIT 1;
+    END IF;
+
+    -- 3. Schedule, in a fixed order so equal timetables hash equally
+    SELECT json_agg(t ORDER BY t.bell_time, t.day_of_week, t.audio_url) INTO v_schedule_data FROM (
+        SELECT
+            bt.bell_time::text, -- Convert time to text for JSON
+            bt.day_of_week,
+            -- Also provide 'days_of_week' alias if device expects plural
+            bt.day_of_week as days_of_week,
+            af.storage_path as audio_url,
+            af.duration
+        FROM public.bell_times bt
+        LEFT JOIN public.audio_files af ON bt.audio_file_id = af.id
+        WHERE bt.profile_id = v_active_profile_id
+    ) t;
+
+    v_schedule_data := coalesce(v_schedule_data, '[]'::json);
+    v_hash := md5(concat_ws('|', v_school_id::text, v_timezone_offset::text, v_schedule_data::text));
+
+    IF p_config_hash IS NOT NULL AND p_config_hash = v_hash THEN
+        RETURN json_build_object('status', 'unchanged', 'config_hash', v_hash);
+    END IF;
+
+    RETURN json_build_object(
+        'status', 'ok',
+        'config_hash', v_hash,
+        'school_id', v_school_id,
+        'timezone_offset', v_timezone_offset,
+        'schedules', v_schedule_data
+    );
+END;
+$$;
+
+GRANT EXECUTE ON FUNCTION public.get_device_config(text, text) TO anon;
+GRANT EXECUTE ON FUNCTION public.get_device_config(text, text) TO authenticated;
+GRANT EXECUTE ON FUNCTION public.get_device_config(text, text) TO service_role;
@@ -0,0 +1,70 @@
+-- Batched command dequeue and acknowledgement
+--
+-- get_next_command/ack_command move one command per poll and cost two
+-- round trips each, so a backlog of N commands took N poll intervals to
+-- drain. Devices now fetch up to p_limit pending commands in queue order
+-- and ack the whole batch in one call:
+--
+--   get_pending_commands(p_device_id, p_limit) -> [{id, command, payload}, ...]
+--   ack_commands(p_device_id, p_acks)          -> number of rows updated
+--       p_acks: [{"id": 42, "status": "executed", "executed_at": 1769400000}, ...]
+--
+-- executed_at is Unix seconds from the device clock; 0 or missing means
+-- "use now()". Only pending rows of the calling device are updated, so a
+-- repeated ack is a no-op. The single-command RPCs stay for old firmware.
+
+CREATE OR REPLACE FUNCTION public.get_pending_commands(p_device_id uuid, p_limit integer DEFAULT 10)
+RETURNS TABLE (
+    id bigint,
+    command text,
+    payload jsonb
+)
+LANGUAGE plpgsql
+STABLE
+SECURITY DEFINER
+SET search_path = public
+AS $$
+BEGIN
+    RETURN QUERY
+    SELECT c.id, c.command, c.payload
+    FROM command_queue c
+    WHERE c.device_id = p_device_id
+      AND c.status = 'pending'
+    ORDER BY c.created_at ASC, c.id ASC
+    LIMIT least(greatest(coalesce(p_limit, 10), 1), 50);
+END;
+$$;
+
+CREATE OR REPLACE FUNCTION public.ack_commands(p_device_id uuid, p_acks jsonb)
+RETURNS integer
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_updated integer;
+BEGIN
+    IF p_acks IS NULL OR jsonb_typeof(p_acks) <> 'array' THEN
+        RETURN 0;
+    END IF;
+
+    UPDATE command_queue c
+    SET status = CASE WHEN a.status IN ('executed', 'failed') THEN a.status ELSE 'executed' END,
+        executed_at = CASE WHEN coalesce(a.executed_at, 0) > 0 THEN to_timestamp(a.executed_at) ELSE now() END
+    FROM jsonb_to_recordset(p_acks) AS a(id bigint, status text, executed_at double precision)
+    WHERE c.id = a.id
+      AND c.device_id = p_device_id
+      AND c.status = 'pending';
+
+    GET DIAGNOSTICS v_updated = ROW_COUNT;
+    RETURN v_updated;
+END;
+$$;
+
+GRANT EXECUTE ON FUNCTION public.get_pending_commands(uuid, integer) TO anon;
+GRANT EXECUTE ON FUNCTION public.get_pending_commands(uuid, integer) TO authenticated;
+GRANT EXECUTE ON FUNCTION public.get_pending_commands(uuid, integer) TO service_role;
+
+GRANT EXECUTE ON FUNCTION public.ack_commands(uuid, jsonb) TO anon;
+GRANT EXECUTE ON FUNCTION public.ack_commands(uuid, jsonb) TO authenticated;
+GRANT EXECUTE ON FUNCTION public.ack_commands(uuid, jsonb) TO service_role;
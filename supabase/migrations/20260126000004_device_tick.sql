@@ -0,0 +1,157 @@
+-- device_tick: one round trip per device tick
+--
+-- Active devices used to run three RPC streams: update_heartbeat (60 s),
+-- get_next_command (5 s) and get_device_config (5 min). device_tick does
+-- all three at once:
+--
+--   device_tick(p_device_id, p_status, p_config_hash, p_telemetry, p_acks, p_limit)
+--     -> {"commands": [{id, command, payload}, ...], "config_stale": bool}
+--
+-- * Records the heartbeat (status, last_heartbeat) and the telemetry blob.
+-- * Applies p_acks first (same format as ack_commands), so the device can
+--   ack a batch on the tick after it ran it without being sent it again.
+-- * Returns up to p_limit pending commands in queue order.
+-- * config_stale is true when p_config_hash differs from the current
+--   config_hash; the device then calls get_device_config.
+--
+-- The config body moves into device_config_json() so get_device_config and
+-- device_tick hash exactly the same thing.
+
+ALTER TABLE public.bell_devices ADD COLUMN IF NOT EXISTS telemetry jsonb;
+
+CREATE OR REPLACE FUNCTION public.device_config_json(p_device_id uuid)
+RETURNS json
+LANGUAGE plpgsql
+STABLE
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_school_id uuid;
+    v_active_profile_id uuid;
+    v_schedule_data json;
+    v_timezone_offset integer := 300; -- Default to GMT+5 (300 minutes)
+BEGIN
+    SELECT school_id INTO v_school_id FROM public.bell_devices WHERE id = p_device_id;
+
+    -- Active profile, or the oldest one as fallback
+    SELECT id INTO v_active_profile_id FROM public.bell_profiles
+    WHERE school_id = v_school_id AND is_active = true LIMIT 1;
+
+    IF v_active_profile_id IS NULL THEN
+        SELECT id INTO v_active_profile_id FROM public.bell_profiles
+        WHERE school_id = v_school_id ORDER BY created_at ASC LIMIT 1;
+    END IF;
+
+    -- Schedule, in a fixed order so equal timetables hash equally
+    SELECT json_agg(t ORDER BY t.bell_time, t.day_of_week, t.audio_url) INTO v_schedule_data FROM (
+        SELECT
+            bt.bell_time::text, -- Convert time to text for JSON
+            bt.day_of_week,
+            -- Also provide 'days_of_week' alias if device expects plural
+            bt.day_of_week as days_of_week,
+            af.storage_path as audio_url,
+            af.duration
+        FROM public.bell_times bt
+        LEFT JOIN public.audio_files af ON bt.audio_file_id = af.id
+        WHERE bt.profile_id = v_active_profile_id
+    ) t;
+
+    v_schedule_data := coalesce(v_schedule_data, '[]'::json);
+
+    RETURN json_build_object(
+        'status', 'ok',
+        'config_hash', md5(concat_ws('|', v_school_id::text, v_timezone_offset::text, v_schedule_data::text)),
+        'school_id', v_school_id,
+        'timezone_offset', v_timezone_offset,
+        'schedules', v_schedule_data
+    );
+END;
+$$;
+
+CREATE OR REPLACE FUNCTION public.get_device_config(device_mac text, p_config_hash text DEFAULT NULL)
+RETURNS json
+LANGUAGE plpgsql
+STABLE
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_device_id uuid;
+    v_config json;
+BEGIN
+    SELECT id INTO v_device_id FROM public.bell_devices WHERE mac_address = device_mac;
+
+    IF v_device_id IS NULL THEN
+        RETURN json_build_object('error', 'Device not found');
+    END IF;
+
+    v_config := public.device_config_json(v_device_id);
+
+    IF p_config_hash IS NOT NULL AND p_config_hash = v_config->>'config_hash' THEN
+        RETURN json_build_object('status', 'unchanged', 'config_hash', v_config->>'config_hash');
+    END IF;
+
+    RETURN v_config;
+END;
+$$;
+
+CREATE OR REPLACE FUNCTION public.device_tick(
+    p_device_id uuid,
+    p_status text DEFAULT 'online',
+    p_config_hash text DEFAULT NULL,
+    p_telemetry jsonb DEFAULT NULL,
+    p_acks jsonb DEFAULT NULL,
+    p_limit integer DEFAULT 10
+)
+RETURNS json
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_commands json;
+    v_hash text;
+BEGIN
+    UPDATE public.bell_devices
+    SET last_heartbeat = now(),
+        status = coalesce(p_status, 'online'),
+        telemetry = coalesce(p_telemetry, telemetry)
+    WHERE id = p_device_id;
+
+    IF NOT FOUND THEN
+        RETURN json_build_object('error', 'Device not found');
+    END IF;
+
+    IF p_acks IS NOT NULL THEN
+        PERFORM public.ack_commands(p_device_id, p_acks);
+    END IF;
+
+    SELECT json_agg(json_build_object('id', c.id, 'command', c.command, 'payload', c.payload)
+                    ORDER BY c.created_at, c.id)
+    INTO v_commands
+    FROM (
+        SELECT id, command, payload, created_at
+        FROM command_queue
+        WHERE device_id = p_device_id
+          AND status = 'pending'
+        ORDER BY created_at ASC, id ASC
+        LIMIT least(greatest(coalesce(p_limit, 10), 1), 50)
+    ) c;
+
+    v_hash := public.device_config_json(p_device_id)->>'config_hash';
+
+    RETURN json_build_object(
+        'commands', coalesce(v_commands, '[]'::json),
+        'config_stale', p_config_hash IS DISTINCT FROM v_hash
+    );
+END;
+$$;
+
+GRANT EXECUTE ON FUNCTION public.get_device_config(text, text) TO anon;
+GRANT EXECUTE ON FUNCTION public.get_device_config(text, text) TO authenticated;
+GRANT EXECUTE ON FUNCTION public.get_device_config(text, text) TO service_role;
+
+GRANT EXECUTE ON FUNCTION public.device_tick(uuid, text, text, jsonb, jsonb, integer) TO anon;
+GRANT EXECUTE ON FUNCTION public.device_tick(uuid, text, text, jsonb, jsonb, integer) TO authenticated;
+GRANT EXECUTE ON FUNCTION public.device_tick(uuid, text, text, jsonb, jsonb, integer) TO service_role;
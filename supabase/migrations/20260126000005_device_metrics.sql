@@ -0,0 +1,87 @@
+-- Device metrics snapshots in device_logs
+--
+-- Once per heartbeat interval the firmware attaches a metrics snapshot to
+-- device_tick (MetricsReport in esp32-firmware/src/Metrics.h):
+--
+--   {"s": 60,                                   -- seconds covered
+--    "c": {"bells": 4, "tls": 1, ...},           -- counts in the interval
+--    "g": {"heap": 181240, "rssi": -61, ...},    -- values when taken
+--    "h": {"rpc_tick_us": {"n": 12, "p50": 262143, "p99": 524287,
+--                          "max": 301122, "b": {"18": 9, "19": 3}}, ...}}
+--
+-- Histograms are log2 buckets (bucket b = values below 2^b); "b" may be
+-- left out when the snapshot would not fit the device's buffer.
+--
+-- Each snapshot is one device_logs row (level 'metrics'), so a late bell can
+-- be lined up with what the device was doing. The snapshot is only dropped
+-- from the device once this call succeeds, so rows never overlap.
+
+ALTER TABLE public.device_logs ADD COLUMN IF NOT EXISTS metrics jsonb;
+
+CREATE INDEX IF NOT EXISTS idx_device_logs_device_created
+    ON public.device_logs(device_id, created_at DESC);
+
+-- New trailing parameter: replace the old signature rather than overload it
+DROP FUNCTION IF EXISTS public.device_tick(uuid, text, text, jsonb, jsonb, integer);
+
+CREATE OR REPLACE FUNCTION public.device_tick(
+    p_device_id uuid,
+    p_status text DEFAULT 'online',
+    p_config_hash text DEFAULT NULL,
+    p_telemetry jsonb DEFAULT NULL,
+    p_acks jsonb DEFAULT NULL,
+    p_limit integer DEFAULT 10,
+    p_metrics jsonb DEFAULT NULL
+)
+RETURNS json
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_commands json;
+    v_hash text;
+BEGIN
+    UPDATE public.bell_devices
+    SET last_heartbeat = now(),
+        status = coalesce(p_status, 'online'),
+        telemetry = coalesce(p_telemetry, telemetry)
+    WHERE id = p_device_id;
+
+    IF NOT FOUND THEN
+        RETURN json_build_object('error', 'Device not found');
+    END IF;
+
+    IF p_metrics IS NOT NULL THEN
+        INSERT INTO public.device_logs (device_id, message, level, metrics)
+        VALUES (p_device_id, 'metrics', 'metrics', p_metrics);
+    END IF;
+
+    IF p_acks IS NOT NULL THEN
+        PERFORM public.ack_commands(p_device_id, p_acks);
+    END IF;
+
+    SELECT json_agg(json_build_object('id', c.id, 'command', c.command, 'payload', c.payload)
+                    ORDER BY c.created_at, c.id)
+    INTO v_commands
+    FROM (
+        SELECT id, command, payload, created_at
+        FROM command_queue
+        WHERE device_id = p_device_id
+          AND status = 'pending'
+        ORDER BY created_at ASC, id ASC
+        LIMIT least(greatest(coalesce(p_limit, 10), 1), 50)
+    ) c;
+
+    v_hash := public.device_config_json(p_device_id)->>'config_hash';
+
+    RETURN json_build_object(
+        'commands', coalesce(v_commands, '[]'::json),
+        'config_stale', p_config_hash IS DISTINCT FROM v_hash
+    );
+END;
+$$;
+
+GRANT EXECUTE ON FUNCTION public.device_tick(uuid, text, text, jsonb, jsonb, integer, jsonb) TO anon;
+GRANT EXECUTE ON FUNCTION public.device_tick(uuid, text, text, jsonb, jsonb, integer, jsonb) TO authenticated;
+GRANT EXECUTE ON FUNCTION public.device_tick(uuid, text, text, jsonb, jsonb, integer, jsonb) TO service_role;
@@ -0,0 +1,80 @@
+-- Device event journal
+--
+-- The firmware journals every bell it rings and every command it runs to
+-- flash (EventJournal in esp32-firmware/src/EventJournal.h) and replays the
+-- journal here in batches once it is online (JournalUploader):
+--
+--   p_journal: 2864434397            -- random per journal on the device
+--   p_events: [{"seq": 41, "type": "bell", "at": 1769400000,
+--               "minute_of_week": 2340, "entry": 3, "track": 0},
+--              {"seq": 42, "type": "command", "at": 1769400012,
+--               "command_id": 1234, "command": "RING", "ok": true}, ...]
+--
+-- "at" is the device's UTC clock in seconds (0 = not set yet). A batch may be
+-- sent more than once (lost response, reboot before the position was
+-- saved); (device, journal, seq) is the key and duplicates are ignored, so
+-- every event is stored exactly once.
+
+CREATE TABLE IF NOT EXISTS public.device_events (
+    device_id uuid REFERENCES public.bell_devices(id) ON DELETE CASCADE NOT NULL,
+    journal_id bigint NOT NULL,
+    seq bigint NOT NULL,
+    event_type text NOT NULL,
+    occurred_at timestamp with time zone, -- NULL if the device clock was not set
+    details jsonb NOT NULL DEFAULT '{}'::jsonb,
+    received_at timestamp with time zone DEFAULT now(),
+    PRIMARY KEY (device_id, journal_id, seq)
+);
+
+CREATE INDEX IF NOT EXISTS idx_device_events_device_occurred
+    ON public.device_events(device_id, occurred_at DESC);
+
+ALTER TABLE public.device_events ENABLE ROW LEVEL SECURITY;
+
+CREATE POLICY "Users can view events in their school" ON public.device_events
+    FOR SELECT
+    USING (
+        device_id IN (
+            SELECT id FROM public.bell_devices WHERE school_id = get_my_school_id()
+        )
+    );
+
+CREATE POLICY "Super admin full access device_events" ON public.device_events FOR ALL USING (is_super_admin());
+
+-- Stores a batch; returns how many events were new
+CREATE OR REPLACE FUNCTION public.upload_device_events(
+    p_device_id uuid,
+    p_journal bigint,
+    p_events jsonb
+)
+RETURNS integer
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_count integer;
+BEGIN
+    IF NOT EXISTS (SELECT 1 FROM public.bell_devices WHERE id = p_device_id) THEN
+        RAISE EXCEPTION 'Device not found';
+    END IF;
+
+    INSERT INTO public.device_events (device_id, journal_id, seq, event_type, occurred_at, details)
+    SELECT p_device_id,
+           p_journal,
+           (e->>'seq')::bigint,
+           e->>'type',
+           CASE WHEN coalesce((e->>'at')::bigint, 0) > 0 THEN to_timestamp((e->>'at')::bigint) END,
+           e - 'seq' - 'type' - 'at'
+    FROM jsonb_array_elements(coalesce(p_events, '[]'::jsonb)) AS e
+    WHERE e ? 'seq' AND e ? 'type'
+    ON CONFLICT (device_id, journal_id, seq) DO NOTHING;
+
+    GET DIAGNOSTICS v_count = ROW_COUNT;
+    RETURN v_count;
+END;
+$$;
+
+GRANT EXECUTE ON FUNCTION public.upload_device_events(uuid, bigint, jsonb) TO anon;
+GRANT EXECUTE ON FUNCTION public.upload_device_events(uuid, bigint, jsonb) TO authenticated;
+GRANT EXECUTE ON FUNCTION public.upload_device_events(uuid, bigint, jsonb) TO service_role;
@@ -0,0 +1,236 @@
+-- Command queue dequeue path for fleet-wide polling
+--
+-- Every device without a Realtime socket calls device_tick every 5 s, which
+-- reads its pending commands from command_queue. Executed rows were never
+-- removed and the only index was the primary key, so each poll scanned more
+-- rows as the fleet's history grew. Now:
+--
+-- * idx_command_queue_pending covers pending rows only. It stays the size of
+--   the live backlog however many rows have been executed.
+-- * Commands are claimed with FOR UPDATE SKIP LOCKED (claim_commands()). A
+--   claimed row is not handed out again for p_lease (30 s) unless it is
+--   acked. Two overlapping polls for one device, such as a retried request
+--   racing the original or old firmware still on get_next_command, never
+--   get the same command. A response lost on the way is redelivered once
+--   the lease runs out, so at-least-once delivery is kept.
+-- * archive_commands() moves executed/failed rows older than p_keep
+--   (7 days) into command_queue_archive in bounded batches. It is scheduled
+--   every 15 minutes where pg_cron is installed; otherwise call it from any
+--   scheduler.
+--
+-- Load test: node scripts/command-queue-load.js against a local Postgres.
+
+ALTER TABLE public.command_queue ADD COLUMN IF NOT EXISTS delivered_at timestamp with time zone;
+ALTER TABLE public.command_queue ADD COLUMN IF NOT EXISTS delivery_count integer NOT NULL DEFAULT 0;
+
+CREATE INDEX IF NOT EXISTS idx_command_queue_pending
+    ON public.command_queue(device_id, created_at, id)
+    WHERE status = 'pending';
+
+-- Finds archivable rows without touching the pending ones
+CREATE INDEX IF NOT EXISTS idx_command_queue_done
+    ON public.command_queue(created_at)
+    WHERE status <> 'pending';
+
+-- Up to p_limit pending commands in queue order that are not leased to an
+-- earlier poll; marks them delivered
+CREATE OR REPLACE FUNCTION public.claim_commands(
+    p_device_id uuid,
+    p_limit integer DEFAULT 10,
+    p_lease interval DEFAULT interval '30 seconds'
+)
+RETURNS TABLE (
+    id bigint,
+    command text,
+    payload jsonb
+)
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+BEGIN
+    RETURN QUERY
+    WITH picked AS (
+        SELECT c.id
+        FROM command_queue c
+        WHERE c.device_id = p_device_id
+          AND c.status = 'pending'
+          AND (c.delivered_at IS NULL OR c.delivered_at < now() - p_lease)
+        ORDER BY c.created_at ASC, c.id ASC
+        LIMIT least(greatest(coalesce(p_limit, 10), 1), 50)
+        FOR UPDATE SKIP LOCKED
+    ), claimed AS (
+        UPDATE command_queue c
+        SET delivered_at = now(),
+            delivery_count = c.delivery_count + 1
+        FROM picked
+        WHERE c.id = picked.id
+        RETURNING c.id, c.command, c.payload, c.created_at
+    )
+    SELECT claimed.id, claimed.command, claimed.payload
+    FROM claimed
+    ORDER BY claimed.created_at ASC, claimed.id ASC;
+END;
+$$;
+
+-- Batch dequeue (batch_commands migration), now claiming
+CREATE OR REPLACE FUNCTION public.get_pending_commands(p_device_id uuid, p_limit integer DEFAULT 10)
+RETURNS TABLE (
+    id bigint,
+    command text,
+    payload jsonb
+)
+LANGUAGE plpgsql
+VOLATILE
+SECURITY DEFINER
+SET search_path = public
+AS $$
+BEGIN
+    RETURN QUERY SELECT * FROM public.claim_commands(p_device_id, p_limit);
+END;
+$$;
+
+-- Single-command dequeue for old firmware
+CREATE OR REPLACE FUNCTION public.get_next_command(p_device_id uuid)
+RETURNS TABLE (
+    id bigint,
+    command text,
+    payload jsonb
+)
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+BEGIN
+    RETURN QUERY SELECT * FROM public.claim_commands(p_device_id, 1);
+END;
+$$;
+
+CREATE OR REPLACE FUNCTION public.device_tick(
+    p_device_id uuid,
+    p_status text DEFAULT 'online',
+    p_config_hash text DEFAULT NULL,
+    p_telemetry jsonb DEFAULT NULL,
+    p_acks jsonb DEFAULT NULL,
+    p_limit integer DEFAULT 10,
+    p_metrics jsonb DEFAULT NULL
+)
+RETURNS json
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_commands json;
+    v_hash text;
+BEGIN
+    UPDATE public.bell_devices
+    SET last_heartbeat = now(),
+        status = coalesce(p_status, 'online'),
+        telemetry = coalesce(p_telemetry, telemetry)
+    WHERE id = p_device_id;
+
+    IF NOT FOUND THEN
+        RETURN json_build_object('error', 'Device not found');
+    END IF;
+
+    IF p_metrics IS NOT NULL THEN
+        INSERT INTO public.device_logs (device_id, message, level, metrics)
+        VALUES (p_device_id, 'metrics', 'metrics', p_metrics);
+    END IF;
+
+    IF p_acks IS NOT NULL THEN
+        PERFORM public.ack_commands(p_device_id, p_acks);
+    END IF;
+
+    SELECT json_agg(json_build_object('id', c.id, 'command', c.command, 'payload', c.payload) ORDER BY c.n)
+    INTO v_commands
+    FROM public.claim_commands(p_device_id, p_limit) WITH ORDINALITY AS c(id, command, payload, n);
+
+    v_hash := public.device_config_json(p_device_id)->>'config_hash';
+
+    RETURN json_build_object(
+        'commands', coalesce(v_commands, '[]'::json),
+        'config_stale', p_config_hash IS DISTINCT FROM v_hash
+    );
+END;
+$$;
+
+-- Executed and failed commands past p_keep, moved out of the hot table
+CREATE TABLE IF NOT EXISTS public.command_queue_archive (
+    LIKE public.command_queue INCLUDING DEFAULTS,
+    archived_at timestamp with time zone DEFAULT now(),
+    PRIMARY KEY (id)
+);
+
+CREATE INDEX IF NOT EXISTS idx_command_queue_archive_device
+    ON public.command_queue_archive(device_id, created_at DESC);
+
+ALTER TABLE public.command_queue_archive ENABLE ROW LEVEL SECURITY;
+
+CREATE POLICY "Users can view archived commands in their school" ON public.command_queue_archive
+    FOR SELECT
+    USING (
+        device_id IN (
+            SELECT id FROM public.bell_devices WHERE school_id = get_my_school_id()
+        )
+    );
+
+CREATE POLICY "Super admin full access command_queue_archive" ON public.command_queue_archive
+    FOR ALL USING (is_super_admin());
+
+-- Moves up to p_batch rows per call; returns how many were moved, so a
+-- caller catching up on a large backlog repeats until it returns 0
+CREATE OR REPLACE FUNCTION public.archive_commands(
+    p_keep interval DEFAULT interval '7 days',
+    p_batch integer DEFAULT 5000
+)
+RETURNS integer
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_moved integer;
+BEGIN
+    WITH old AS (
+        SELECT c.id
+        FROM command_queue c
+        WHERE c.status <> 'pending'
+          AND c.created_at < now() - p_keep
+        ORDER BY c.created_at
+        LIMIT greatest(coalesce(p_batch, 5000), 1)
+        FOR UPDATE SKIP LOCKED
+    ), moved AS (
+        DELETE FROM command_queue c
+        USING old
+        WHERE c.id = old.id
+        RETURNING c.id, c.device_id, c.command, c.payload, c.status, c.created_at, c.executed_at,
+                  c.delivered_at, c.delivery_count
+    )
+    INSERT INTO command_queue_archive (id, device_id, command, payload, status, created_at, executed_at,
+                                       delivered_at, delivery_count)
+    SELECT * FROM moved
+    ON CONFLICT (id) DO NOTHING;
+
+    GET DIAGNOSTICS v_moved = ROW_COUNT;
+    RETURN v_moved;
+END;
+$$;
+
+-- Internal: reached through the RPCs above or a scheduler only
+REVOKE EXECUTE ON FUNCTION public.claim_commands(uuid, integer, interval) FROM PUBLIC, anon, authenticated;
+REVOKE EXECUTE ON FUNCTION public.archive_commands(interval, integer) FROM PUBLIC, anon, authenticated;
+GRANT EXECUTE ON FUNCTION public.claim_commands(uuid, integer, interval) TO service_role;
+GRANT EXECUTE ON FUNCTION public.get_next_command(uuid) TO anon;
+GRANT EXECUTE ON FUNCTION public.get_next_command(uuid) TO authenticated;
+GRANT EXECUTE ON FUNCTION public.get_next_command(uuid) TO service_role;
+GRANT EXECUTE ON FUNCTION public.archive_commands(interval, integer) TO service_role;
+
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM pg_extension WHERE extname = 'pg_cron') THEN
+        PERFORM cron.schedule('archive-commands', '*/15 * * * *', 'SELECT public.archive_commands()');
+    END IF;
+END;
+$$;
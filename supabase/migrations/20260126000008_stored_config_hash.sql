@@ -0,0 +1,281 @@
+-- Stored config_hash for device_tick
+--
+-- device_tick compared p_config_hash with device_config_json(), which
+-- aggregates the school's whole timetable into JSON and md5s it, on every
+-- tick of every device (5 s). The hash only changes when the timetable
+-- does, so it is now kept in schools.config_hash, refreshed by triggers on
+-- bell_times, bell_profiles and audio_files:
+--
+-- * device_tick reads the stored hash (one indexed row) instead of
+--   building the config.
+-- * get_device_config answers "unchanged" from the stored hash too, and
+--   builds the full JSON only when the device needs it.
+--
+-- The config body moves into school_config_json(), so the stored hash and
+-- get_device_config hash exactly the same thing.
+
+ALTER TABLE public.schools ADD COLUMN IF NOT EXISTS config_hash text;
+
+CREATE OR REPLACE FUNCTION public.school_config_json(p_school_id uuid)
+RETURNS json
+LANGUAGE plpgsql
+STABLE
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_active_profile_id uuid;
+    v_schedule_data json;
+    v_timezone_offset integer := 300; -- Default to GMT+5 (300 minutes)
+BEGIN
+    -- Active profile, or the oldest one as fallback
+    SELECT id INTO v_active_profile_id FROM public.bell_profiles
+    WHERE school_id = p_school_id AND is_active = true LIMIT 1;
+
+    IF v_active_profile_id IS NULL THEN
+        SELECT id INTO v_active_profile_id FROM public.bell_profiles
+        WHERE school_id = p_school_id ORDER BY created_at ASC LIMIT 1;
+    END IF;
+
+    -- Schedule, in a fixed order so equal timetables hash equally
+    SELECT json_agg(t ORDER BY t.bell_time, t.day_of_week, t.audio_url) INTO v_schedule_data FROM (
+        SELECT
+            bt.bell_time::text, -- Convert time to text for JSON
+            bt.day_of_week,
+            -- Also provide 'days_of_week' alias if device expects plural
+            bt.day_of_week as days_of_week,
+            af.storage_path as audio_url,
+            af.duration
+        FROM public.bell_times bt
+        LEFT JOIN public.audio_files af ON bt.audio_file_id = af.id
+        WHERE bt.profile_id = v_active_profile_id
+    ) t;
+
+    v_schedule_data := coalesce(v_schedule_data, '[]'::json);
+
+    RETURN json_build_object(
+        'status', 'ok',
+        'config_hash', md5(concat_ws('|', p_school_id::text, v_timezone_offset::text, v_schedule_data::text)),
+        'school_id', p_school_id,
+        'timezone_offset', v_timezone_offset,
+        'schedules', v_schedule_data
+    );
+END;
+$$;
+
+CREATE OR REPLACE FUNCTION public.device_config_json(p_device_id uuid)
+RETURNS json
+LANGUAGE sql
+STABLE
+SECURITY DEFINER
+SET search_path = public
+AS $$
+    SELECT public.school_config_json((SELECT school_id FROM public.bell_devices WHERE id = p_device_id));
+$$;
+
+-- The stored hash for a school, built if it was never stored (and for
+-- devices without a school)
+CREATE OR REPLACE FUNCTION public.school_config_hash(p_school_id uuid)
+RETURNS text
+LANGUAGE sql
+STABLE
+SECURITY DEFINER
+SET search_path = public
+AS $$
+    SELECT coalesce((SELECT config_hash FROM public.schools WHERE id = p_school_id),
+                    public.school_config_json(p_school_id)->>'config_hash');
+$$;
+
+CREATE OR REPLACE FUNCTION public.refresh_config_hash(p_school_id uuid)
+RETURNS void
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_hash text;
+BEGIN
+    IF p_school_id IS NULL THEN
+        RETURN;
+    END IF;
+
+    v_hash := public.school_config_json(p_school_id)->>'config_hash';
+
+    UPDATE public.schools
+    SET config_hash = v_hash
+    WHERE id = p_school_id AND config_hash IS DISTINCT FROM v_hash;
+END;
+$$;
+
+-- bell_times: the school of the profile a row left and the one it joined
+CREATE OR REPLACE FUNCTION public.bell_times_refresh_config_hash()
+RETURNS TRIGGER AS $$
+DECLARE
+    v_old_school uuid;
+    v_new_school uuid;
+BEGIN
+    IF TG_OP <> 'INSERT' THEN
+        SELECT school_id INTO v_old_school FROM public.bell_profiles WHERE id = OLD.profile_id;
+        PERFORM public.refresh_config_hash(v_old_school);
+    END IF;
+    IF TG_OP <> 'DELETE' THEN
+        SELECT school_id INTO v_new_school FROM public.bell_profiles WHERE id = NEW.profile_id;
+        IF v_new_school IS DISTINCT FROM v_old_school THEN
+            PERFORM public.refresh_config_hash(v_new_school);
+        END IF;
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER SET search_path = public;
+
+-- bell_profiles: which profile is active (or oldest) decides the timetable
+CREATE OR REPLACE FUNCTION public.bell_profiles_refresh_config_hash()
+RETURNS TRIGGER AS $$
+BEGIN
+    IF TG_OP <> 'INSERT' THEN
+        PERFORM public.refresh_config_hash(OLD.school_id);
+    END IF;
+    IF TG_OP <> 'DELETE' AND (TG_OP = 'INSERT' OR NEW.school_id IS DISTINCT FROM OLD.school_id) THEN
+        PERFORM public.refresh_config_hash(NEW.school_id);
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER SET search_path = public;
+
+-- audio_files: path and duration are part of every bell that uses the file.
+-- A deleted file is covered by the bell_times update its ON DELETE SET NULL
+-- makes.
+CREATE OR REPLACE FUNCTION public.audio_files_refresh_config_hash()
+RETURNS TRIGGER AS $$
+BEGIN
+    PERFORM public.refresh_config_hash(s.school_id)
+    FROM (
+        SELECT DISTINCT bp.school_id
+        FROM public.bell_times bt
+        JOIN public.bell_profiles bp ON bp.id = bt.profile_id
+        WHERE bt.audio_file_id = NEW.id
+    ) s;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER SET search_path = public;
+
+-- New schools start with the hash of an empty timetable
+CREATE OR REPLACE FUNCTION public.schools_init_config_hash()
+RETURNS TRIGGER AS $$
+BEGIN
+    NEW.config_hash := public.school_config_json(NEW.id)->>'config_hash';
+    RETURN NEW;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER SET search_path = public;
+
+DROP TRIGGER IF EXISTS trigger_bell_times_config_hash ON public.bell_times;
+CREATE TRIGGER trigger_bell_times_config_hash
+AFTER INSERT OR UPDATE OR DELETE ON public.bell_times
+FOR EACH ROW
+EXECUTE FUNCTION public.bell_times_refresh_config_hash();
+
+DROP TRIGGER IF EXISTS trigger_bell_profiles_config_hash ON public.bell_profiles;
+CREATE TRIGGER trigger_bell_profiles_config_hash
+AFTER INSERT OR UPDATE OF is_active, school_id, created_at OR DELETE ON public.bell_profiles
+FOR EACH ROW
+EXECUTE FUNCTION public.bell_profiles_refresh_config_hash();
+
+DROP TRIGGER IF EXISTS trigger_audio_files_config_hash ON public.audio_files;
+CREATE TRIGGER trigger_audio_files_config_hash
+AFTER UPDATE OF storage_path, duration ON public.audio_files
+FOR EACH ROW
+EXECUTE FUNCTION public.audio_files_refresh_config_hash();
+
+DROP TRIGGER IF EXISTS trigger_schools_config_hash ON public.schools;
+CREATE TRIGGER trigger_schools_config_hash
+BEFORE INSERT ON public.schools
+FOR EACH ROW
+EXECUTE FUNCTION public.schools_init_config_hash();
+
+UPDATE public.schools SET config_hash = public.school_config_json(id)->>'config_hash';
+
+CREATE OR REPLACE FUNCTION public.get_device_config(device_mac text, p_config_hash text DEFAULT NULL)
+RETURNS json
+LANGUAGE plpgsql
+STABLE
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_device_id uuid;
+    v_school_id uuid;
+    v_hash text;
+BEGIN
+    SELECT id, school_id INTO v_device_id, v_school_id FROM public.bell_devices WHERE mac_address = device_mac;
+
+    IF v_device_id IS NULL THEN
+        RETURN json_build_object('error', 'Device not found');
+    END IF;
+
+    IF p_config_hash IS NOT NULL THEN
+        v_hash := public.school_config_hash(v_school_id);
+        IF p_config_hash = v_hash THEN
+            RETURN json_build_object('status', 'unchanged', 'config_hash', v_hash);
+        END IF;
+    END IF;
+
+    RETURN public.school_config_json(v_school_id);
+END;
+$$;
+
+CREATE OR REPLACE FUNCTION public.device_tick(
+    p_device_id uuid,
+    p_status text DEFAULT 'online',
+    p_config_hash text DEFAULT NULL,
+    p_telemetry jsonb DEFAULT NULL,
+    p_acks jsonb DEFAULT NULL,
+    p_limit integer DEFAULT 10,
+    p_metrics jsonb DEFAULT NULL
+)
+RETURNS json
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_commands json;
+    v_school_id uuid;
+BEGIN
+    UPDATE public.bell_devices
+    SET last_heartbeat = now(),
+        status = coalesce(p_status, 'online'),
+        telemetry = coalesce(p_telemetry, telemetry)
+    WHERE id = p_device_id
+    RETURNING school_id INTO v_school_id;
+
+    IF NOT FOUND THEN
+        RETURN json_build_object('error', 'Device not found');
+    END IF;
+
+    IF p_metrics IS NOT NULL THEN
+        INSERT INTO public.device_logs (device_id, message, level, metrics)
+        VALUES (p_device_id, 'metrics', 'metrics', p_metrics);
+    END IF;
+
+    IF p_acks IS NOT NULL THEN
+        PERFORM public.ack_commands(p_device_id, p_acks);
+    END IF;
+
+    SELECT json_agg(json_build_object('id', c.id, 'command', c.command, 'payload', c.payload) ORDER BY c.n)
+    INTO v_commands
+    FROM public.claim_commands(p_device_id, p_limit) WITH ORDINALITY AS c(id, command, payload, n);
+
+    RETURN json_build_object(
+        'commands', coalesce(v_commands, '[]'::json),
+        'config_stale', p_config_hash IS DISTINCT FROM public.school_config_hash(v_school_id)
+    );
+END;
+$$;
+
+-- Internal: reached through the RPCs and triggers above only
+REVOKE EXECUTE ON FUNCTION public.school_config_json(uuid) FROM PUBLIC, anon, authenticated;
+REVOKE EXECUTE ON FUNCTION public.school_config_hash(uuid) FROM PUBLIC, anon, authenticated;
+REVOKE EXECUTE ON FUNCTION public.refresh_config_hash(uuid) FROM PUBLIC, anon, authenticated;
+GRANT EXECUTE ON FUNCTION public.school_config_json(uuid) TO service_role;
+GRANT EXECUTE ON FUNCTION public.school_config_hash(uuid) TO service_role;
+GRANT EXECUTE ON FUNCTION public.refresh_config_hash(uuid) TO service_role;
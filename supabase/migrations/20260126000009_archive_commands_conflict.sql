@@ -0,0 +1,57 @@
+-- archive_commands: archive before deleting
+--
+-- The first version deleted the batch from command_queue and then inserted
+-- it into command_queue_archive ON CONFLICT (id) DO NOTHING. A row whose id
+-- was already archived (restored by hand, or a rerun after a partial copy)
+-- was deleted without being archived, and the returned count was rows
+-- inserted rather than rows moved.
+--
+-- Now the batch is upserted into the archive first (the queue's copy wins)
+-- and only the ids the archive returned are deleted, so the count is the
+-- number of rows moved.
+
+CREATE OR REPLACE FUNCTION public.archive_commands(
+    p_keep interval DEFAULT interval '7 days',
+    p_batch integer DEFAULT 5000
+)
+RETURNS integer
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_moved integer;
+BEGIN
+    WITH old AS (
+        SELECT c.id, c.device_id, c.command, c.payload, c.status, c.created_at, c.executed_at,
+               c.delivered_at, c.delivery_count
+        FROM command_queue c
+        WHERE c.status <> 'pending'
+          AND c.created_at < now() - p_keep
+        ORDER BY c.created_at
+        LIMIT greatest(coalesce(p_batch, 5000), 1)
+        FOR UPDATE SKIP LOCKED
+    ), archived AS (
+        INSERT INTO command_queue_archive (id, device_id, command, payload, status, created_at, executed_at,
+                                           delivered_at, delivery_count)
+        SELECT * FROM old
+        ON CONFLICT (id) DO UPDATE
+        SET device_id = EXCLUDED.device_id,
+            command = EXCLUDED.command,
+            payload = EXCLUDED.payload,
+            status = EXCLUDED.status,
+            created_at = EXCLUDED.created_at,
+            executed_at = EXCLUDED.executed_at,
+            delivered_at = EXCLUDED.delivered_at,
+            delivery_count = EXCLUDED.delivery_count,
+            archived_at = now()
+        RETURNING id
+    )
+    DELETE FROM command_queue c
+    USING archived
+    WHERE c.id = archived.id;
+
+    GET DIAGNOSTICS v_moved = ROW_COUNT;
+    RETURN v_moved;
+END;
+$$;
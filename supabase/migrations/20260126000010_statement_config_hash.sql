@@ -0,0 +1,137 @@
+-- Statement-level config_hash triggers
+--
+-- The triggers from 20260126000008_stored_config_hash.sql ran FOR EACH ROW,
+-- and every row rebuilt the school's whole school_config_json(). The
+-- dashboard saves a profile by deleting all its bell_times and inserting
+-- them again, so a 300-bell timetable cost about 600 full aggregations per
+-- save, inside the user's transaction.
+--
+-- They now run FOR EACH STATEMENT with transition tables: each statement
+-- collects the distinct schools its rows touched and refreshes each once.
+-- Postgres allows transition tables only on single-event triggers without a
+-- column list, so every table gets one trigger per event, and the UPDATE
+-- triggers check the columns themselves.
+
+-- bell_times: the schools of the profiles the statement's rows left and joined
+CREATE OR REPLACE FUNCTION public.bell_times_refresh_config_hash()
+RETURNS TRIGGER AS $$
+BEGIN
+    IF TG_OP = 'INSERT' THEN
+        PERFORM public.refresh_config_hash(s.school_id)
+        FROM (
+            SELECT DISTINCT bp.school_id
+            FROM public.bell_profiles bp
+            WHERE bp.id IN (SELECT profile_id FROM new_rows)
+        ) s;
+    ELSIF TG_OP = 'DELETE' THEN
+        PERFORM public.refresh_config_hash(s.school_id)
+        FROM (
+            SELECT DISTINCT bp.school_id
+            FROM public.bell_profiles bp
+            WHERE bp.id IN (SELECT profile_id FROM old_rows)
+        ) s;
+    ELSE
+        PERFORM public.refresh_config_hash(s.school_id)
+        FROM (
+            SELECT DISTINCT bp.school_id
+            FROM public.bell_profiles bp
+            WHERE bp.id IN (SELECT profile_id FROM old_rows UNION SELECT profile_id FROM new_rows)
+        ) s;
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER SET search_path = public;
+
+-- bell_profiles: only changes to the active flag, school or age matter
+CREATE OR REPLACE FUNCTION public.bell_profiles_refresh_config_hash()
+RETURNS TRIGGER AS $$
+BEGIN
+    IF TG_OP = 'INSERT' THEN
+        PERFORM public.refresh_config_hash(s.school_id)
+        FROM (SELECT DISTINCT school_id FROM new_rows) s;
+    ELSIF TG_OP = 'DELETE' THEN
+        PERFORM public.refresh_config_hash(s.school_id)
+        FROM (SELECT DISTINCT school_id FROM old_rows) s;
+    ELSE
+        PERFORM public.refresh_config_hash(s.school_id)
+        FROM (
+            SELECT DISTINCT unnest(ARRAY[o.school_id, n.school_id]) AS school_id
+            FROM old_rows o JOIN new_rows n ON n.id = o.id
+            WHERE (o.is_active, o.school_id, o.created_at) IS DISTINCT FROM (n.is_active, n.school_id, n.created_at)
+        ) s;
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER SET search_path = public;
+
+-- audio_files: path and duration are part of every bell that uses the file
+CREATE OR REPLACE FUNCTION public.audio_files_refresh_config_hash()
+RETURNS TRIGGER AS $$
+BEGIN
+    PERFORM public.refresh_config_hash(s.school_id)
+    FROM (
+        SELECT DISTINCT bp.school_id
+        FROM public.bell_times bt
+        JOIN public.bell_profiles bp ON bp.id = bt.profile_id
+        WHERE bt.audio_file_id IN (
+            SELECT n.id
+            FROM old_rows o JOIN new_rows n ON n.id = o.id
+            WHERE (o.storage_path, o.duration) IS DISTINCT FROM (n.storage_path, n.duration)
+        )
+    ) s;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER SET search_path = public;
+
+DROP TRIGGER IF EXISTS trigger_bell_times_config_hash ON public.bell_times;
+DROP TRIGGER IF EXISTS trigger_bell_profiles_config_hash ON public.bell_profiles;
+DROP TRIGGER IF EXISTS trigger_audio_files_config_hash ON public.audio_files;
+
+DROP TRIGGER IF EXISTS trigger_bell_times_config_hash_insert ON public.bell_times;
+CREATE TRIGGER trigger_bell_times_config_hash_insert
+AFTER INSERT ON public.bell_times
+REFERENCING NEW TABLE AS new_rows
+FOR EACH STATEMENT
+EXECUTE FUNCTION public.bell_times_refresh_config_hash();
+
+DROP TRIGGER IF EXISTS trigger_bell_times_config_hash_update ON public.bell_times;
+CREATE TRIGGER trigger_bell_times_config_hash_update
+AFTER UPDATE ON public.bell_times
+REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+FOR EACH STATEMENT
+EXECUTE FUNCTION public.bell_times_refresh_config_hash();
+
+DROP TRIGGER IF EXISTS trigger_bell_times_config_hash_delete ON public.bell_times;
+CREATE TRIGGER trigger_bell_times_config_hash_delete
+AFTER DELETE ON public.bell_times
+REFERENCING OLD TABLE AS old_rows
+FOR EACH STATEMENT
+EXECUTE FUNCTION public.bell_times_refresh_config_hash();
+
+DROP TRIGGER IF EXISTS trigger_bell_profiles_config_hash_insert ON public.bell_profiles;
+CREATE TRIGGER trigger_bell_profiles_config_hash_insert
+AFTER INSERT ON public.bell_profiles
+REFERENCING NEW TABLE AS new_rows
+FOR EACH STATEMENT
+EXECUTE FUNCTION public.bell_profiles_refresh_config_hash();
+
+DROP TRIGGER IF EXISTS trigger_bell_profiles_config_hash_update ON public.bell_profiles;
+CREATE TRIGGER trigger_bell_profiles_config_hash_update
+AFTER UPDATE ON public.bell_profiles
+REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+FOR EACH STATEMENT
+EXECUTE FUNCTION public.bell_profiles_refresh_config_hash();
+
+DROP TRIGGER IF EXISTS trigger_bell_profiles_config_hash_delete ON public.bell_profiles;
+CREATE TRIGGER trigger_bell_profiles_config_hash_delete
+AFTER DELETE ON public.bell_profiles
+REFERENCING OLD TABLE AS old_rows
+FOR EACH STATEMENT
+EXECUTE FUNCTION public.bell_profiles_refresh_config_hash();
+
+DROP TRIGGER IF EXISTS trigger_audio_files_config_hash_update ON public.audio_files;
+CREATE TRIGGER trigger_audio_files_config_hash_update
+AFTER UPDATE ON public.audio_files
+REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+FOR EACH STATEMENT
+EXECUTE FUNCTION public.audio_files_refresh_config_hash();
@@ -0,0 +1,40 @@
+-- "command" broadcasts only wake the device
+--
+-- The device channel "device:<MAC>" is public: any client with the anon key
+-- can broadcast on it, and the MAC can be read over the air. The device
+-- used to run the command carried by a "command" event, so anyone could
+-- send it REBOOT, CONFIG or an UPDATE_FIRMWARE with their own image.
+--
+-- The device now treats the event as a wake-up and runs a device_tick,
+-- which claims the rows queued for its own device id. The broadcast only
+-- carries the row id, so the queue's payloads (firmware URLs included) are
+-- no longer published on the channel either. manual_ring, emergency and
+-- stop are unchanged.
+
+CREATE OR REPLACE FUNCTION public.broadcast_device_command()
+RETURNS trigger
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_mac text;
+BEGIN
+    SELECT mac_address INTO v_mac FROM public.bell_devices WHERE id = NEW.device_id;
+    IF v_mac IS NULL THEN
+        RETURN NEW;
+    END IF;
+
+    PERFORM realtime.send(
+        jsonb_build_object('id', NEW.id),
+        'command',
+        'device:' || v_mac,
+        false
+    );
+    RETURN NEW;
+EXCEPTION WHEN OTHERS THEN
+    -- Never block the insert: device_tick still delivers the command
+    RAISE WARNING 'broadcast_device_command: %', SQLERRM;
+    RETURN NEW;
+END;
+$$;
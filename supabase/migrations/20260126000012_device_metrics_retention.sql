@@ -0,0 +1,152 @@
+-- Retention for device metrics snapshots
+--
+-- device_tick stores one device_logs row (level 'metrics') per device per
+-- heartbeat interval: about 1,440 rows per device per day, 7 M per day for
+-- a 5,000-device fleet, and nothing removed them. The policy is now:
+--
+-- * Snapshots are kept as they are for 3 days, long enough to line a late
+--   bell up with what the device was doing.
+-- * Older ones are rolled up into device_metrics_daily, one row per device,
+--   UTC day, metric and histogram bucket, and deleted:
+--     snapshots, seconds      number of snapshots, seconds they covered
+--     c:<counter>             sum
+--     g:<gauge>               sum (divide by snapshots for the mean), min, max
+--     h:<histogram>           bucket -1: sum of n and the largest max;
+--                             bucket b: sum of the snapshots' "b" counts
+--   Percentiles for a day are read off the merged buckets.
+-- * prune_device_metrics() does this in bounded batches, like
+--   archive_commands(). It is scheduled every 5 minutes where pg_cron is
+--   installed; otherwise call it from any scheduler.
+--
+-- Other device_logs levels are not touched.
+
+CREATE TABLE IF NOT EXISTS public.device_metrics_daily (
+    device_id uuid REFERENCES public.bell_devices(id) ON DELETE CASCADE NOT NULL,
+    day date NOT NULL,
+    metric text NOT NULL,
+    bucket smallint NOT NULL DEFAULT -1,
+    total bigint NOT NULL,
+    low bigint,
+    peak bigint,
+    PRIMARY KEY (device_id, day, metric, bucket)
+);
+
+-- Finds expired snapshots without scanning the other logs
+CREATE INDEX IF NOT EXISTS idx_device_logs_metrics_created
+    ON public.device_logs(created_at)
+    WHERE level = 'metrics';
+
+ALTER TABLE public.device_metrics_daily ENABLE ROW LEVEL SECURITY;
+
+CREATE POLICY "Users can view device metrics in their school" ON public.device_metrics_daily
+    FOR SELECT
+    USING (
+        device_id IN (
+            SELECT id FROM public.bell_devices WHERE school_id = get_my_school_id()
+        )
+    );
+
+CREATE POLICY "Super admin full access device_metrics_daily" ON public.device_metrics_daily
+    FOR ALL USING (is_super_admin());
+
+-- The snapshot is written by the device: anything that is not an object
+-- of the expected shape is rolled up as empty
+CREATE OR REPLACE FUNCTION public.metrics_object(p_value jsonb)
+RETURNS jsonb
+LANGUAGE sql
+IMMUTABLE
+AS $$
+    SELECT CASE WHEN jsonb_typeof(p_value) = 'object' THEN p_value ELSE '{}'::jsonb END;
+$$;
+
+-- Keeps an out-of-range value from failing the whole batch, every time
+CREATE OR REPLACE FUNCTION public.metrics_clamp(p_value numeric)
+RETURNS bigint
+LANGUAGE sql
+IMMUTABLE
+AS $$
+    SELECT least(greatest(p_value, -1e15), 1e15)::bigint;
+$$;
+
+-- Rolls up and deletes up to p_batch snapshots older than p_keep; returns
+-- how many, so a caller catching up on a backlog repeats until it returns 0
+CREATE OR REPLACE FUNCTION public.prune_device_metrics(
+    p_keep interval DEFAULT interval '3 days',
+    p_batch integer DEFAULT 50000
+)
+RETURNS integer
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+    v_pruned integer;
+BEGIN
+    WITH old AS (
+        SELECT l.id
+        FROM device_logs l
+        WHERE l.level = 'metrics'
+          AND l.created_at < now() - p_keep
+        ORDER BY l.created_at
+        LIMIT greatest(coalesce(p_batch, 50000), 1)
+        FOR UPDATE SKIP LOCKED
+    ), gone AS (
+        DELETE FROM device_logs l
+        USING old
+        WHERE l.id = old.id
+        RETURNING l.device_id, (l.created_at AT TIME ZONE 'UTC')::date AS day, metrics_object(l.metrics) AS m
+    ), items AS (
+        SELECT device_id, day, 'snapshots' AS metric, -1 AS bucket, 1::numeric AS total,
+               NULL::numeric AS low, NULL::numeric AS peak
+        FROM gone
+        UNION ALL
+        SELECT device_id, day, 'seconds', -1, (m->>'s')::numeric, NULL, NULL
+        FROM gone
+        WHERE jsonb_typeof(m->'s') = 'number'
+        UNION ALL
+        SELECT g.device_id, g.day, 'c:' || c.key, -1, (c.value #>> '{}')::numeric, NULL, NULL
+        FROM gone g, jsonb_each(metrics_object(g.m->'c')) c
+        WHERE jsonb_typeof(c.value) = 'number'
+        UNION ALL
+        SELECT g.device_id, g.day, 'g:' || v.key, -1, (v.value #>> '{}')::numeric,
+               (v.value #>> '{}')::numeric, (v.value #>> '{}')::numeric
+        FROM gone g, jsonb_each(metrics_object(g.m->'g')) v
+        WHERE jsonb_typeof(v.value) = 'number'
+        UNION ALL
+        SELECT g.device_id, g.day, 'h:' || h.key, -1,
+               CASE WHEN jsonb_typeof(h.value->'n') = 'number' THEN (h.value->>'n')::numeric ELSE 0 END,
+               NULL,
+               CASE WHEN jsonb_typeof(h.value->'max') = 'number' THEN (h.value->>'max')::numeric END
+        FROM gone g, jsonb_each(metrics_object(g.m->'h')) h
+        UNION ALL
+        SELECT g.device_id, g.day, 'h:' || h.key, b.key::integer, (b.value #>> '{}')::numeric, NULL, NULL
+        FROM gone g, jsonb_each(metrics_object(g.m->'h')) h, jsonb_each(metrics_object(h.value->'b')) b
+        WHERE b.key ~ '^[0-9]{1,2}$' AND jsonb_typeof(b.value) = 'number'
+    ), rolled AS (
+        INSERT INTO device_metrics_daily AS d (device_id, day, metric, bucket, total, low, peak)
+        SELECT device_id, day, metric, bucket::smallint, metrics_clamp(sum(total)), metrics_clamp(min(low)),
+               metrics_clamp(max(peak))
+        FROM items
+        GROUP BY device_id, day, metric, bucket
+        ON CONFLICT (device_id, day, metric, bucket) DO UPDATE
+        SET total = d.total + EXCLUDED.total,
+            low = least(d.low, EXCLUDED.low),
+            peak = greatest(d.peak, EXCLUDED.peak)
+    )
+    SELECT count(*) INTO v_pruned FROM gone;
+
+    RETURN v_pruned;
+END;
+$$;
+
+-- Internal: reached through a scheduler only
+REVOKE EXECUTE ON FUNCTION public.prune_device_metrics(interval, integer) FROM PUBLIC, anon, authenticated;
+GRANT EXECUTE ON FUNCTION public.prune_device_metrics(interval, integer) TO service_role;
+
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM pg_extension WHERE extname = 'pg_cron') THEN
+        PERFORM cron.schedule('prune-device-metrics', '*/5 * * * *', 'SELECT public.prune_device_metrics()');
+    END IF;
+END;
+$$;